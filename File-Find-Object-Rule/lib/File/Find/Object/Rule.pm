@@ -14,6 +14,7 @@ use Number::Compare;
 use Carp qw/croak/;
 use File::Find::Object;    # we're only wrapping for now
 use File::Basename;
+use Fcntl ();
 use Cwd;                   # 5.00503s File::Find goes screwy with max_depth == 0
 
 use Class::XSAccessor accessors => {
@@ -185,6 +186,11 @@ expressions.
  $set->name( qr/\.(mp3|ogg)$/ ); # the same as a regex
  $set->name( 'foo.bar' );        # just things named foo.bar
 
+The patterns are compiled together, so that many of them cost little
+more than one: globs without wildcards and globs of the form
+C<*suffix> are looked up in hashes, and the other globs and the regular
+expressions are combined into a single regular expression.
+
 =cut
 
 sub _flatten
@@ -208,15 +214,110 @@ sub _add_rule
     return;
 }
 
+# Returns a sub that returns whether the name that it is given matches any
+# of @patterns. Globs without wildcards are looked up in a hash of the names,
+# and globs of a "*" and a string without wildcards in a hash of the
+# suffixes, once for each distinct length of suffix. The other globs and the
+# regexes are combined into one regex. Names with a newline, which the
+# regexes of Text::Glob treat specially, are matched against all of them.
+sub _compile_name_matcher
+{
+    my @patterns = @_;
+
+    my ( %names, %suffixes, @regexes );
+
+    # The suffixes are matched the way Text::Glob does by default, where
+    # "*" does not match a leading "." or a "/". Otherwise its regexes are
+    # used, as they are read when the rule is built.
+    my $can_match_suffixes =
+        ( $Text::Glob::strict_leading_dot && $Text::Glob::strict_wildcard_slash );
+
+    foreach my $pattern (@patterns)
+    {
+        if ( ref $pattern eq "Regexp" )
+        {
+            push @regexes, $pattern;
+        }
+        elsif ( $pattern !~ /[*?\[{\\]/ )
+        {
+            $names{$pattern} = 1;
+        }
+        elsif ($can_match_suffixes
+            && $pattern =~ /\A\*([^*?\[{\\\/]*)\z/ )
+        {
+            $suffixes{$1} = 1;
+        }
+        else
+        {
+            push @regexes, glob_to_regex $pattern;
+        }
+    }
+
+    my %suffix_lengths = map { length($_) => 1 } keys %suffixes;
+    my @suffix_lengths = sort { $a <=> $b } keys %suffix_lengths;
+
+    my $regex = do
+    {
+        my $alternatives = join( '|', @regexes );
+        @regexes ? qr/$alternatives/ : undef;
+    };
+
+    my $all_regex = do
+    {
+        my $alternatives = join( '|',
+            map { ref $_ eq "Regexp" ? $_ : glob_to_regex $_ } @patterns );
+        qr/$alternatives/;
+    };
+
+    return sub {
+        my $name = shift;
+
+        if ( index( $name, "\n" ) >= 0 )
+        {
+            return scalar( $name =~ $all_regex );
+        }
+
+        if ( exists $names{$name} )
+        {
+            return 1;
+        }
+
+        # Text::Glob's globs that do not start with a "." do not match
+        # names that do, and their "*" does not match a "/".
+        if (   @suffix_lengths
+            && length($name)
+            && ( $name !~ /\A\./ )
+            && ( index( $name, "/" ) < 0 ) )
+        {
+            my $len = length($name);
+
+            foreach my $suffix_len (@suffix_lengths)
+            {
+                if ( $suffix_len > $len )
+                {
+                    last;
+                }
+
+                if ( exists $suffixes{ substr( $name, $len - $suffix_len ) } )
+                {
+                    return 1;
+                }
+            }
+        }
+
+        return ( defined($regex) && scalar( $name =~ $regex ) );
+    };
+}
+
 sub name
 {
-    my $self  = _force_object shift;
-    my @names = map { ref $_ eq "Regexp" ? $_ : glob_to_regex $_ } _flatten(@_);
+    my $self    = _force_object shift;
+    my $matcher = _compile_name_matcher( _flatten(@_) );
 
     $self->_add_rule(
         {
             rule => 'name',
-            code => join( ' || ', map { "m($_)" } @names ),
+            code => sub { $matcher->($_) },
             args => \@_,
         }
     );
@@ -252,12 +353,93 @@ details.  None of these methods take arguments.
 Though some tests are fairly meaningless as binary flags (C<modified>,
 C<accessed>, C<changed>), they have been included for completeness.
 
+The tests are answered from a single C<stat> of the file, which is
+shared with the stat tests below and with C<exec> subroutines, and is
+only taken if one of them needs it. The finder's own C<lstat> is reused
+unless the file is a symbolic link. C<readable>, C<writable>,
+C<executable> and their C<r_> forms are perl's own C<-r _> and so on,
+on the C<_> buffer of that C<stat>. C<symlink> is told by the finder,
+and C<tty>, C<ascii> and C<binary> are still done with C<-t>, C<-T> and
+C<-B>.
+
  # find nonempty files
  $rule->file,
       ->nonempty;
 
 =cut
 
+# The stat() of the candidate, which the finder has already taken unless it is
+# a symbolic link, since the tests follow those. It is empty if the stat()
+# failed.
+sub _stat_record
+{
+    my ( $path_obj, $path ) = @_;
+
+    if ( $path_obj->is_link() )
+    {
+        return [ stat $path ];
+    }
+
+    return ( $path_obj->stat_ret() || [] );
+}
+
+# Makes perl's "_" stat buffer hold the candidate, whose stat() record is
+# $stat, so that -r, -w, -x, -R, -W and -X can be asked of it without another
+# stat(). The finder or _stat_record() usually stat()ed it last, so it is only
+# taken again if something else, such as an exec sub, was stat()ed since.
+# Returns false if the candidate could not be stat()ed.
+sub _stat_buffer
+{
+    my ( $stat, $path ) = @_;
+
+    if ( !@$stat )
+    {
+        return '';
+    }
+
+    my @buffer = stat _;
+
+    if ( !( @buffer && ( $buffer[0] == $stat->[0] )
+            && ( $buffer[1] == $stat->[1] ) ) )
+    {
+        stat $path;
+    }
+
+    return 1;
+}
+
+# An expression of the stat() record of the candidate in the compiled match
+# sub, where it is taken at most once.
+my $stat_record_code = '( $stat ||= _stat_record( $path_obj, $path ) )';
+
+use vars qw( %X_test_code );
+%X_test_code = (
+    -r => '( _stat_buffer( $st, $path ) && -r _ )',
+    -w => '( _stat_buffer( $st, $path ) && -w _ )',
+    -x => '( _stat_buffer( $st, $path ) && -x _ )',
+    -o => '( @$st && ( $st->[4] == $> ) )',
+    -R => '( _stat_buffer( $st, $path ) && -R _ )',
+    -W => '( _stat_buffer( $st, $path ) && -W _ )',
+    -X => '( _stat_buffer( $st, $path ) && -X _ )',
+    -O => '( @$st && ( $st->[4] == $< ) )',
+    -e => 'scalar(@$st)',
+    -z => '( @$st && ( $st->[7] == 0 ) )',
+    -s => '( @$st && $st->[7] )',
+    -f => '( @$st && Fcntl::S_ISREG( $st->[2] ) )',
+    -d => '( @$st && Fcntl::S_ISDIR( $st->[2] ) )',
+    -p => '( @$st && Fcntl::S_ISFIFO( $st->[2] ) )',
+    -S => '( @$st && Fcntl::S_ISSOCK( $st->[2] ) )',
+    -b => '( @$st && Fcntl::S_ISBLK( $st->[2] ) )',
+    -c => '( @$st && Fcntl::S_ISCHR( $st->[2] ) )',
+    -u => '( @$st && ( $st->[2] & Fcntl::S_ISUID() ) )',
+    -g => '( @$st && ( $st->[2] & Fcntl::S_ISGID() ) )',
+    -k => '( @$st && ( $st->[2] & Fcntl::S_ISVTX() ) )',
+    -M => '( @$st && ( ( $^T - $st->[9] ) / 86400 ) )',
+    -A => '( @$st && ( ( $^T - $st->[8] ) / 86400 ) )',
+    -C => '( @$st && ( ( $^T - $st->[10] ) / 86400 ) )',
+    -l => '$path_obj->is_link()',
+);
+
 use vars qw( %X_tests );
 %X_tests = (
     -r              => readable => -R => r_readable => -w => writeable  => -W =>
@@ -273,10 +455,15 @@ use vars qw( %X_tests );
 
 for my $test ( keys %X_tests )
 {
+    my $code =
+        !exists $X_test_code{$test} ? "$test \$path"
+        : ( $X_test_code{$test} =~ /\$st\b/ )
+        ? "do { my \$st = $stat_record_code; $X_test_code{$test} }"
+        : $X_test_code{$test};
     my $sub = eval 'sub () {
         my $self = _force_object shift;
         $self->_add_rule({
-            code => "' . $test . ' \$path",
+            code => $code,
             rule => "' . $X_tests{$test} . '",
         });
         $self;
@@ -320,7 +507,8 @@ use vars qw( @stat_tests );
                 {
                     rule => $test,
                     args => \@_,
-                    code => 'do { my $val = (stat $path)['
+                    code => 'do { my $val = '
+                        . $stat_record_code . '->['
                         . $index
                         . '] || 0;'
                         . join( '||', map { "(\$val $_)" } @tests ) . ' }',
@@ -442,7 +630,7 @@ sub discard ()
     return $self;
 }
 
-=item C<exec( \&subroutine( $shortname, $path, $fullname ) )>
+=item C<exec( \&subroutine( $shortname, $path, $fullname, $get_stat ) )>
 
 Allows user-defined rules.  Your subroutine will be invoked with parameters of
 the name, the path you're in, and the full relative filename.
@@ -450,6 +638,14 @@ In addition, C<$_> is set to the current short name, but its use is
 discouraged since as opposed to File::Find::Rule, File::Find::Object::Rule
 does not cd to the containing directory.
 
+The last parameter is a subroutine that returns a reference to the list
+that C<stat> returns for the file, which is empty if it could not be
+C<stat>ed. It is the same C<stat> that the -X and stat tests use, so
+calling it does not C<stat> the file again.
+
+ # files that are larger than their blocks
+ $rules->exec( sub { my $st = $_[3]->(); $st->[7] > 512 * $st->[12] } );
+
 Return a true value if your rule matched.
 
  # get things with long names
@@ -698,7 +894,13 @@ sub start
     warn "relative mode handed multiple paths - that's a bit silly\n"
         if $self->_relative() && @paths > 1;
 
-    my $code = 'sub {
+    # The stat() record of the current candidate, see _stat_record().
+    my $code = 'my ( $stat, $stat_path_obj, $stat_path );
+    my $get_stat = sub {
+        return ( $stat ||= _stat_record( $stat_path_obj, $stat_path ) );
+    };
+
+    sub {
         my $path_obj = shift;
         my $path = shift;
 
@@ -708,9 +910,10 @@ sub start
         }
 
         $path =~ s#^(?:\./+)+##;
+        ( $stat, $stat_path_obj, $stat_path ) = ( undef, $path_obj, $path );
         my $path_dir = dirname($path);
         my $path_base = fileparse($path);
-        my @args = ($path_base, $path_dir, $path);
+        my @args = ($path_base, $path_dir, $path, $get_stat);
         local $_ = $path_base;
         my $maxdepth = $self->_maxdepth;
         my $mindepth = $self->_mindepth;
@@ -1101,24 +1304,24 @@ tests).
 Need to check this currently working version in before I play with
 that though.
 
-[*] There's probably a win to be made with the current model in making
-stat calls use C<_>.  For
+[*] The -X and stat tests and the exec subs share one stat record for
+each candidate (see C<_stat_record>), which is taken when the first of
+them needs it, or reused from the finder's C<lstat> if the candidate is
+not a symbolic link. So
 
   find( file => size => "> 20M" => size => "< 400M" );
 
-up to 3 stats will happen for each candidate.  Adding a priming _
-would be a bit blind if the first operation was C< name => 'foo' >,
-since that can be tested by a single regex.  Simply checking what the
-next type of operation doesn't work since any arbritary exec sub may
-or may not stat.  Potentially worse, they could stat something else
-like so:
+does not stat at all, instead of up to 3 times for each candidate. The
+record is a list rather than C<_>, which any exec sub may clobber by
+stat()ing something else, like so:
 
   # extract from the worlds stupidest make(1)
   find( exec => sub { my $f = $_; $f =~ s/\.c$/.o/ && !-e $f } );
 
-Maybe the best way is to treat C<_> as invalid after calling an exec,
-and doc that C<_> will only be meaningful after stat and -X tests if
-they're wanted in exec blocks.
+The -r, -w, -x, -R, -W and -X tests are left to perl, whose rules for
+root and for the real and effective IDs they follow, so they are asked of C<_>
+after C<_stat_buffer> checks, by the device and inode of the record,
+that it still holds the candidate. It only stat()s again if it does not.
 
 =end Developers
 
@@ -4,13 +4,37 @@
 use strict;
 use warnings;
 
-use Test::More tests => 42;
+use Test::More tests => 51;
 
 use File::TreeCreate ();
 use File::Path qw( rmtree );
+use File::Temp qw( tempdir );
 
 use lib './t/lib';
 
+# The stat()s and lstat()s of each path by the finder and the rules, which
+# are counted while $count_stats is true.
+my ( %num_stats, $count_stats );
+
+BEGIN
+{
+    no warnings 'once';
+
+    # "stat _" does not stat() anything.
+    *CORE::GLOBAL::stat = sub (;*) {
+        my $arg = @_ ? $_[0] : $_;
+        return CORE::stat(_) if ( !ref($arg) && ( $arg eq '_' ) );
+        $num_stats{$arg}++ if $count_stats;
+        return CORE::stat($arg);
+    };
+    *CORE::GLOBAL::lstat = sub (;*) {
+        my $arg = @_ ? $_[0] : $_;
+        return CORE::lstat(_) if ( !ref($arg) && ( $arg eq '_' ) );
+        $num_stats{$arg}++ if $count_stats;
+        return CORE::lstat($arg);
+    };
+}
+
 my $tree_creator = File::TreeCreate->new();
 
 {
@@ -173,6 +197,52 @@ is_deeply(
     "name( [ 'foobar', '*.t' ] )"
 );
 
+{
+    # The globs of name() follow the Text::Glob settings of when the rule
+    # is built.
+    my @names = ( "", ".hidden.t", "a.t", "a/b.t", "foobar" );
+
+    my $matches = sub {
+        my $matcher = File::Find::Object::Rule::_compile_name_matcher(@_);
+        return [ grep { $matcher->($_) } @names ];
+    };
+
+    # TEST
+    is_deeply(
+        $matches->( '*.t', 'foobar' ),
+        [ "a.t", "foobar" ],
+        "name() skips dot files and slashes by default"
+    );
+
+    {
+        local $Text::Glob::strict_leading_dot = 0;
+
+        # TEST
+        is_deeply(
+            $matches->( '*.t', 'foobar' ),
+            [ ".hidden.t", "a.t", "foobar" ],
+            "name() with strict_leading_dot off"
+        );
+    }
+
+    {
+        local $Text::Glob::strict_wildcard_slash = 0;
+
+        # TEST
+        is_deeply(
+            $matches->( '*.t', 'foobar' ),
+            [ "a.t", "a/b.t", "foobar" ],
+            "name() with strict_wildcard_slash off"
+        );
+
+        local $Text::Glob::strict_leading_dot = 0;
+
+        # TEST
+        is_deeply( $matches->('*'), [ "", @names[ 1 .. $#names ] ],
+            "name( '*' ) with both off" );
+    }
+}
+
 # exec
 $f = $class->exec( sub { length( $_[0] ) == 6 } )->maxdepth(1);
 
@@ -197,6 +267,154 @@ is_deeply(
     "exec (check arg 2)"
 );
 
+# TEST
+is_deeply(
+    [
+        find(
+            file     => maxdepth => 1,
+            size     => $foobar_size,
+            exec     => sub { $_[3]->()->[7] == $foobar_size },
+            in       => $copy_fn
+        )
+    ],
+    [$foobar_fn],
+    "exec gets the stat record of the size test"
+);
+
+{
+    # The tests of a rule take at most one stat() of each candidate more than
+    # the finder does, for the "_" of -r and -w if something else clobbered it.
+    my $count = sub {
+        my $rule = shift;
+
+        %num_stats   = ();
+        $count_stats = 1;
+        my @found = $rule->in($copy_fn);
+        $count_stats = 0;
+
+        return ( \@found, {%num_stats} );
+    };
+
+    my ( undef, $finder_stats ) = $count->( $class->new );
+    my ( $found, $rule_stats ) =
+        $count->( $class->file->nonempty->size('>0')->mtime('>0')->readable
+            ->writable->exec( sub { $_[3]->()->[7] > 0 } )->r_readable );
+
+    # TEST
+    ok(
+        (
+            @$found && !grep {
+                $rule_stats->{$_} > ( $finder_stats->{$_} || 0 ) + 1
+            } keys(%$rule_stats)
+        ),
+        "Each candidate is stat()ed at most once by the rule"
+    );
+}
+
+{
+    # The -X tests of a candidate all ask the stat() that the first one took.
+    my $dir = tempdir( CLEANUP => 1 );
+    my $fn  = "$dir/script";
+
+    open my $fh, ">", $fn or die "Cannot create $fn";
+    close($fh);
+    chmod( 0755, $fn );
+
+    # TEST
+    is_deeply(
+        [
+            $class->file->executable->exec( sub { chmod( 0644, $_[2] ) } )
+                ->r_executable->in($dir)
+        ],
+        [$fn],
+        "The -X tests do not stat() the candidate again",
+    );
+}
+
+{
+    # The -X rules agree with perl's own -r, -w, -x, -R, -W and -X.
+    my %X_rules = (
+        readable     => 'r',
+        writable     => 'w',
+        executable   => 'x',
+        r_readable   => 'R',
+        r_writable   => 'W',
+        r_executable => 'X',
+    );
+
+    my $dir = tempdir( CLEANUP => 1 );
+    my @paths;
+
+    foreach my $mode ( 0000, 0400, 0200, 0100, 0444, 0222, 0111, 0644, 0755 )
+    {
+        my $fn = sprintf( "%s/f%04o", $dir, $mode );
+        open my $fh, ">", $fn or die "Cannot create $fn";
+        close($fh);
+        chmod( $mode, $fn );
+
+        push @paths, $fn;
+    }
+
+    # Directories that the finder can still list.
+    foreach my $mode ( 0500, 0555, 0755 )
+    {
+        my $dn = sprintf( "%s/d%04o", $dir, $mode );
+        mkdir($dn);
+        chmod( $mode, $dn );
+
+        push @paths, $dn;
+    }
+
+    foreach my $mode ( 0000, 0755 )
+    {
+        my $ln = sprintf( "%s/l%04o", $dir, $mode );
+        symlink( sprintf( "f%04o", $mode ), $ln )
+            or die "Cannot symlink $ln";
+
+        push @paths, $ln;
+    }
+
+    # Something else for an exec sub to stat().
+    my $other_dir = tempdir( CLEANUP => 1 );
+    my $other     = "$other_dir/other";
+    open my $other_fh, ">", $other or die "Cannot create $other";
+    close($other_fh);
+    chmod( 0777, $other );
+
+    my $mismatches = sub {
+        my $exec = shift;
+        my @ret;
+
+        foreach my $method ( sort keys %X_rules )
+        {
+            my $rule = $class->new;
+            if ($exec)
+            {
+                $rule->exec($exec);
+            }
+            $rule->$method;
+
+            my @got = sort $rule->in($dir);
+            my @expected =
+                sort grep { eval "-$X_rules{$method} \$_" } ( $dir, @paths );
+
+            if ( "@got" ne "@expected" )
+            {
+                push @ret, $method;
+            }
+        }
+
+        return \@ret;
+    };
+
+    # TEST
+    is_deeply( $mismatches->(), [], "The -X rules agree with perl's -X" );
+
+    # TEST
+    is_deeply( $mismatches->( sub { stat($other); 1 } ),
+        [], "The -X rules agree with perl's -X after an exec stat()s" );
+}
+
 # name and exec, chained
 $f = $class->exec( sub { length > $foobar_size } )->name(qr/\.t$/);
 
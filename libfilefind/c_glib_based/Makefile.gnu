@@ -2,10 +2,15 @@ CFLAGS = -O3 -march=native -fomit-frame-pointer -flto -fwhole-program
 
 all: minifind
 
-C_FILES = minifind.c filefind.c
+C_FILES = minifind.c dir_frontier.c dir_prefetcher.c dupfind.c filefind.c findasync.c findarchive.c findbackend.c findemit.c findestimate.c findmatch.c findreport.c inode_set.c listing_spill.c mount_table.c roots_scanner.c
 
 minifind: $(C_FILES)
-	gcc `pkg-config --cflags --libs glib-2.0` $(CFLAGS) -o $@ $(C_FILES)
+	gcc `pkg-config --cflags --libs glib-2.0 zlib` $(CFLAGS) -o $@ $(C_FILES) -lm
+
+API_BENCH_C_FILES = bench/api_bench.c $(filter-out minifind.c, $(C_FILES))
+
+api_bench: $(API_BENCH_C_FILES)
+	gcc `pkg-config --cflags --libs glib-2.0 zlib` $(CFLAGS) -o $@ $(API_BENCH_C_FILES) -lm
 
 clean:
-	rm -f minifind *.o
+	rm -f minifind api_bench *.o
@@ -0,0 +1,354 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  api_bench.c
+ *
+ *    Description:  times the library API directly in each of its
+ *                  traversal modes.
+ *
+ *        Created:  20/10/26 14:06:31
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+/*
+ * Usage: api_bench [--repeat N] [--mode MODE]... dir [dir...]
+ *
+ * Walks the dirs with a finder of its own in every mode (or in the given
+ * ones), reading the stat of every item, and prints the best of N
+ * wall-clock times of each mode as a JSON object, with the counters of
+ * file_find_get_stats() of its last run. Unlike bench.pl, which times
+ * minifind, the times do not include starting a process or writing the
+ * paths. All the modes must find the same number of items.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+
+#include "../filefind.h"
+#include "../findasync.h"
+#include "../findbackend.h"
+
+static double score_by_mtime(const file_find_item_t * item, void * context)
+{
+    return (double)file_find_item_get_stat(item)->st_mtime;
+}
+
+static int set_up_sorted(file_find_handle_t * tree)
+{
+    return FILE_FIND_OK;
+}
+
+static int set_up_unsorted(file_find_handle_t * tree)
+{
+    file_find_set_should_sort(tree, 0);
+
+    return FILE_FIND_OK;
+}
+
+static int set_up_depth_first(file_find_handle_t * tree)
+{
+    file_find_set_should_traverse_depth_first(tree, 1);
+
+    return FILE_FIND_OK;
+}
+
+static int set_up_breadth_first(file_find_handle_t * tree)
+{
+    return file_find_set_breadth_first(tree, 1, 0);
+}
+
+static int set_up_best_first(file_find_handle_t * tree)
+{
+    return file_find_set_best_first(tree, score_by_mtime, NULL);
+}
+
+static int set_up_inode_order(file_find_handle_t * tree)
+{
+    file_find_set_should_stat_in_inode_order(tree, 1);
+
+    return FILE_FIND_OK;
+}
+
+static int set_up_prefetch(file_find_handle_t * tree)
+{
+    file_find_set_prefetch(tree, 64, 4);
+
+    return FILE_FIND_OK;
+}
+
+static int set_up_parallel_roots(file_find_handle_t * tree)
+{
+    file_find_set_parallel_roots(tree, 0, FILE_FIND_ROOTS_AS_READY);
+
+    return FILE_FIND_OK;
+}
+
+typedef struct
+{
+    const char * name;
+    /* NULL for the default one. */
+    const file_find_backend_t * (*get_backend)(void);
+    int (*set_up)(file_find_handle_t * tree);
+    /* Whether to walk on a thread of its own with findasync.h. */
+    int is_async;
+} bench_mode_t;
+
+static const bench_mode_t modes[] =
+{
+    { "sorted", NULL, set_up_sorted, 0 },
+    { "unsorted", NULL, set_up_unsorted, 0 },
+    { "depth-first", NULL, set_up_depth_first, 0 },
+    { "breadth-first", NULL, set_up_breadth_first, 0 },
+    { "best-first", NULL, set_up_best_first, 0 },
+    { "inode-order", NULL, set_up_inode_order, 0 },
+    { "prefetch", NULL, set_up_prefetch, 0 },
+    { "parallel-roots", NULL, set_up_parallel_roots, 0 },
+    { "getdents", file_find_backend_getdents, set_up_sorted, 0 },
+    { "async", NULL, set_up_sorted, 1 },
+};
+
+#define NUM_MODES (sizeof(modes) / sizeof(modes[0]))
+
+/* Where the sizes of the items go, so that reading them is not elided. */
+static volatile unsigned long long total_size_sink;
+
+static double now_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/*
+ * Returns the sum of the sizes of the items, like the loop of time_walk().
+ * */
+static unsigned long long walk_async(
+    file_find_handle_t * tree,
+    unsigned long long * num_items
+)
+{
+    file_find_async_t * async;
+    file_find_item_t * item;
+    unsigned long long total_size = 0;
+    int ret;
+
+    if (file_find_async_new(&async, tree, 0) != FILE_FIND_OK)
+    {
+        return 0;
+    }
+
+    while ((ret = file_find_async_next(async, &item)) != FILE_FIND_END)
+    {
+        if (ret == FILE_FIND_AGAIN)
+        {
+            struct pollfd pfd = {
+                .fd = file_find_async_get_fd(async),
+                .events = POLLIN,
+            };
+
+            poll(&pfd, 1, -1);
+        }
+        else if (ret == FILE_FIND_OK)
+        {
+            (*num_items)++;
+            total_size += file_find_item_get_stat(item)->st_size;
+            file_find_item_free(item);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    file_find_async_free(async);
+
+    return total_size;
+}
+
+/*
+ * Returns the number of seconds of a walk of targets in mode, or a
+ * negative number on error.
+ * */
+static double time_walk(
+    const bench_mode_t * const mode,
+    int num_targets,
+    char * * targets,
+    unsigned long long * num_items,
+    file_find_stats_t * stats
+)
+{
+    file_find_handle_t * tree;
+    unsigned long long total_size = 0;
+    const double start = now_secs();
+
+    *num_items = 0;
+
+    if (file_find_new_with_backend(
+            &tree, targets[0],
+            (mode->get_backend ? mode->get_backend() : file_find_backend_posix())
+        ) != FILE_FIND_OK)
+    {
+        return -1;
+    }
+
+    for (int i = 1 ; i < num_targets ; i++)
+    {
+        if (file_find_add_target(tree, targets[i]) != FILE_FIND_OK)
+        {
+            file_find_free(tree);
+            return -1;
+        }
+    }
+
+    if (mode->set_up(tree) != FILE_FIND_OK)
+    {
+        file_find_free(tree);
+        return -1;
+    }
+
+    if (mode->is_async)
+    {
+        total_size = walk_async(tree, num_items);
+    }
+    else
+    {
+        while (file_find_next(tree) == FILE_FIND_OK)
+        {
+            (*num_items)++;
+            total_size +=
+                file_find_item_get_stat(file_find_get_item(tree))->st_size;
+        }
+    }
+
+    const double secs = now_secs() - start;
+
+    memset(stats, '\0', sizeof(*stats));
+    file_find_get_stats(tree, stats);
+    file_find_free(tree);
+
+    total_size_sink = total_size;
+
+    return secs;
+}
+
+int main(int argc, char * argv[])
+{
+    int repeat = 3;
+    int is_mode_selected[NUM_MODES] = { 0 };
+    int num_selected = 0;
+    int arg_idx = 1;
+
+    while ((arg_idx < argc) && (argv[arg_idx][0] == '-'))
+    {
+        const char * const arg = argv[arg_idx++];
+
+        if (arg_idx >= argc)
+        {
+            fprintf(stderr, "%s requires an argument.\n", arg);
+            return -1;
+        }
+
+        if (! strcmp(arg, "--repeat"))
+        {
+            repeat = atoi(argv[arg_idx++]);
+        }
+        else if (! strcmp(arg, "--mode"))
+        {
+            const char * const name = argv[arg_idx++];
+            size_t i;
+
+            for (i = 0 ; (i < NUM_MODES) && strcmp(modes[i].name, name) ; i++)
+            {
+            }
+
+            if (i == NUM_MODES)
+            {
+                fprintf(stderr, "Unknown mode \"%s\".\n", name);
+                return -1;
+            }
+
+            is_mode_selected[i] = 1;
+            num_selected++;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option \"%s\".\n", arg);
+            return -1;
+        }
+    }
+
+    if ((arg_idx >= argc) || (repeat <= 0))
+    {
+        fprintf(stderr, "%s\n",
+            "Usage: api_bench [--repeat N] [--mode MODE]... dir [dir...]");
+        return -1;
+    }
+
+    unsigned long long expected_num_items = 0;
+    int is_first = 1;
+
+    printf("{");
+
+    for (size_t i = 0 ; i < NUM_MODES ; i++)
+    {
+        double best_secs = 0;
+        unsigned long long num_items = 0;
+        file_find_stats_t stats;
+
+        if (num_selected && (! is_mode_selected[i]))
+        {
+            continue;
+        }
+
+        for (int run = 0 ; run < repeat ; run++)
+        {
+            const double secs = time_walk(
+                &(modes[i]), argc - arg_idx, argv + arg_idx, &num_items, &stats
+            );
+
+            if (secs < 0)
+            {
+                fprintf(stderr, "Could not walk in the %s mode.\n", modes[i].name);
+                return -1;
+            }
+
+            if ((run == 0) || (secs < best_secs))
+            {
+                best_secs = secs;
+            }
+        }
+
+        if (is_first)
+        {
+            expected_num_items = num_items;
+        }
+        else if (num_items != expected_num_items)
+        {
+            fprintf(stderr, "\nThe %s mode found %llu items instead of %llu.\n",
+                modes[i].name, num_items, expected_num_items);
+            return -1;
+        }
+
+        printf("%s\"%s\": {\"count\": %llu, \"secs\": %f, \"opendir\": %llu,"
+            " \"stat\": %llu, \"peak_bytes\": %llu}",
+            (is_first ? "" : ", "), modes[i].name, num_items, best_secs,
+            stats.num_opendir, stats.num_stat, stats.peak_listing_bytes
+        );
+
+        is_first = 0;
+    }
+
+    printf("}\n");
+
+    return 0;
+}
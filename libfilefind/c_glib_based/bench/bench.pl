@@ -0,0 +1,427 @@
+#!/usr/bin/perl
+
+# Benchmarks minifind against find(1) and fd(1) on a set of generated
+# directory trees and writes a JSON report. With --api-bench, the library
+# API is timed in each of its traversal modes as well, without the cost of
+# starting minifind and writing the paths, under the names "api-MODE".
+#
+# Usage:
+#
+#     perl bench/bench.pl --minifind ./minifind [--api-bench ./api_bench]
+#         [--workdir DIR] [--scale N] [--repeat N] [--output report.json]
+#         [--baseline old-report.json --max-regression 10]
+
+use strict;
+use warnings;
+
+use Cwd qw/ abs_path /;
+use File::Path qw/ mkpath rmtree /;
+use File::Spec;
+use File::Temp qw/ tempfile /;
+use Getopt::Long;
+use JSON::PP;
+use POSIX qw/ WEXITSTATUS /;
+use Time::HiRes qw/ time /;
+
+my $minifind       = './minifind';
+my $api_bench;
+my $workdir        = 'bench-data';
+my $scale          = 1;
+my $repeat         = 3;
+my $output;
+my $baseline;
+my $max_regression = 10;
+my $regenerate     = 0;
+my @only_shapes;
+
+GetOptions(
+    'minifind=s'       => \$minifind,
+    'api-bench=s'      => \$api_bench,
+    'workdir=s'        => \$workdir,
+    'scale=i'          => \$scale,
+    'repeat=i'         => \$repeat,
+    'output=s'         => \$output,
+    'baseline=s'       => \$baseline,
+    'max-regression=f' => \$max_regression,
+    'regenerate!'      => \$regenerate,
+    'shape=s'          => \@only_shapes,
+) or die "Wrong options - see the top of $0 for the usage.";
+
+if ( !-x $minifind )
+{
+    die "minifind executable '$minifind' was not found.";
+}
+$minifind = abs_path($minifind);
+
+if ( defined($api_bench) )
+{
+    if ( !-x $api_bench )
+    {
+        die "api_bench executable '$api_bench' was not found.";
+    }
+    $api_bench = abs_path($api_bench);
+}
+
+sub which
+{
+    my $name = shift;
+
+    foreach my $dir ( File::Spec->path() )
+    {
+        my $path = File::Spec->catfile( $dir, $name );
+        if ( -f $path && -x $path )
+        {
+            return $path;
+        }
+    }
+
+    return;
+}
+
+sub write_file
+{
+    my ( $path, $contents ) = @_;
+
+    open my $fh, '>', $path
+        or die "Cannot open '$path' for writing - $!";
+    print {$fh} $contents;
+    close($fh);
+
+    return;
+}
+
+# Each shape stresses a different part of the walker: a single huge
+# listing, a deep directory stack, many small directories, and the
+# symlink and hard link handling.
+my %shapes = (
+    'wide' => sub {
+        my $root = shift;
+
+        mkpath($root);
+        foreach my $i ( 1 .. 20_000 * $scale )
+        {
+            write_file( "$root/f$i.txt", '' );
+        }
+
+        return;
+    },
+    'deep' => sub {
+        my $root = shift;
+
+        # Keep well below PATH_MAX.
+        my $depth = 200 * $scale;
+        $depth = 1_000 if $depth > 1_000;
+
+        my $dir = $root;
+        foreach my $i ( 1 .. $depth )
+        {
+            $dir .= '/d';
+            mkpath($dir);
+            write_file( "$dir/f", "$i\n" );
+        }
+
+        return;
+    },
+    'many-small' => sub {
+        my $root = shift;
+
+        foreach my $i ( 1 .. 20 * $scale )
+        {
+            foreach my $j ( 1 .. 50 )
+            {
+                my $dir = "$root/a$i/b$j";
+                mkpath($dir);
+                foreach my $k ( 1 .. 5 )
+                {
+                    write_file( "$dir/s$k.c", "$i $j $k\n" );
+                }
+            }
+        }
+
+        return;
+    },
+    'symlinks' => sub {
+        my $root = shift;
+
+        foreach my $i ( 1 .. 100 * $scale )
+        {
+            my $dir = "$root/d$i";
+            mkpath($dir);
+            foreach my $j ( 1 .. 20 )
+            {
+                write_file( "$dir/f$j", '' );
+                symlink( "f$j", "$dir/l$j" )
+                    or die "Cannot symlink - $!";
+            }
+            symlink( '..', "$dir/up" )
+                or die "Cannot symlink - $!";
+        }
+
+        return;
+    },
+    'hardlinks' => sub {
+        my $root = shift;
+
+        mkpath("$root/orig");
+        foreach my $i ( 1 .. 100 * $scale )
+        {
+            write_file( "$root/orig/f$i", "$i\n" );
+        }
+        foreach my $j ( 1 .. 20 )
+        {
+            mkpath("$root/links$j");
+            foreach my $i ( 1 .. 100 * $scale )
+            {
+                link( "$root/orig/f$i", "$root/links$j/f$i" )
+                    or die "Cannot link - $!";
+            }
+        }
+
+        return;
+    },
+);
+
+my @shape_names = @only_shapes ? @only_shapes : ( sort keys %shapes );
+
+mkpath($workdir);
+$workdir = abs_path($workdir);
+
+foreach my $shape (@shape_names)
+{
+    my $generator = $shapes{$shape}
+        or die "Unknown shape '$shape'.";
+
+    my $root  = "$workdir/$shape";
+    my $stamp = "$workdir/.$shape-$scale.done";
+
+    if ( $regenerate or !-e $stamp )
+    {
+        rmtree($root);
+        unlink($stamp);
+        print STDERR "Generating $shape ...\n";
+        $generator->($root);
+        write_file( $stamp, '' );
+    }
+}
+
+# The libfilefind walker always lstat()s every entry, so there is no
+# stat-free mode to compare with find's -noleaf style listing.
+my @tools = (
+    [ 'minifind'                    => [ $minifind, ] ],
+    [ 'minifind-unsorted'           => [ $minifind, '--unsorted', ] ],
+    [ 'minifind-depth-first'        => [ $minifind, '--depth-first', ] ],
+    [ 'minifind-count'              => [ $minifind, '--count', ] ],
+    [ 'minifind-unsorted-count'     => [ $minifind, '--unsorted', '--count', ] ],
+    [ 'minifind-depth-first-count'  => [ $minifind, '--depth-first', '--count', ] ],
+    [ 'minifind-prefetch-count'     => [ $minifind, '--prefetch', 64, '--prefetch-threads', 4, '--count', ] ],
+    [ 'find'                        => [ which('find') ] ],
+);
+
+if ( my $fd = ( which('fd') || which('fdfind') ) )
+{
+    push @tools, [ 'fd' => [ $fd, '--unrestricted', '--no-ignore', '.', ] ];
+}
+
+my $strace    = which('strace');
+my $time_prog = ( -x '/usr/bin/time' ) ? '/usr/bin/time' : undef;
+
+@tools = grep { defined( $_->[1]->[0] ) } @tools;
+
+sub run_quietly
+{
+    my @cmd = @_;
+
+    my $pid = fork();
+    die "Cannot fork - $!" if !defined($pid);
+
+    if ( !$pid )
+    {
+        open STDOUT, '>', File::Spec->devnull();
+        open STDERR, '>', File::Spec->devnull();
+        exec(@cmd) or POSIX::_exit(127);
+    }
+
+    waitpid( $pid, 0 );
+
+    return WEXITSTATUS($?);
+}
+
+sub measure_time
+{
+    my @cmd = @_;
+
+    my $best;
+    foreach my $iter ( 1 .. $repeat )
+    {
+        my $start = time();
+        if ( run_quietly(@cmd) != 0 )
+        {
+            die "'@cmd' failed.";
+        }
+        my $elapsed = time() - $start;
+
+        if ( ( !defined($best) ) or ( $elapsed < $best ) )
+        {
+            $best = $elapsed;
+        }
+    }
+
+    return $best;
+}
+
+sub measure_peak_rss_kb
+{
+    my @cmd = @_;
+
+    return if !$time_prog;
+
+    my ( $fh, $fn ) = tempfile();
+    close($fh);
+
+    run_quietly( $time_prog, '-f', '%M', '-o', $fn, @cmd );
+
+    open my $in, '<', $fn or die "Cannot open '$fn' - $!";
+    my ($rss) = grep { /\A\d+\s*\z/ } <$in>;
+    close($in);
+    unlink($fn);
+
+    return defined($rss) ? ( $rss + 0 ) : undef;
+}
+
+sub measure_syscalls
+{
+    my @cmd = @_;
+
+    return if !$strace;
+
+    my ( $fh, $fn ) = tempfile();
+    close($fh);
+
+    run_quietly( $strace, '-f', '-c', '-o', $fn, @cmd );
+
+    my %counts;
+    open my $in, '<', $fn or die "Cannot open '$fn' - $!";
+    while ( my $l = <$in> )
+    {
+        # % time     seconds  usecs/call     calls    errors syscall
+        if ( $l =~ m{\A\s*([\d.]+)\s+([\d.]+)\s+(\d+)\s+(\d+)\s+(?:\d+\s+)?(\w+)\s*\z} )
+        {
+            $counts{$5} = $4 + 0;
+        }
+    }
+    close($in);
+    unlink($fn);
+
+    return \%counts;
+}
+
+my %results;
+
+foreach my $shape (@shape_names)
+{
+    my $root = "$workdir/$shape";
+
+    foreach my $tool (@tools)
+    {
+        my ( $name, $cmd ) = @$tool;
+        my @cmd = ( @$cmd, $root );
+
+        my %record = ( seconds => measure_time(@cmd), );
+
+        if ( defined( my $rss = measure_peak_rss_kb(@cmd) ) )
+        {
+            $record{peak_rss_kb} = $rss;
+        }
+        if ( defined( my $syscalls = measure_syscalls(@cmd) ) )
+        {
+            $record{syscalls} = $syscalls;
+        }
+
+        $results{$shape}{$name} = \%record;
+
+        printf "%-12s %-28s %10.4f s%s\n", $shape, $name, $record{seconds},
+            ( exists( $record{peak_rss_kb} )
+            ? sprintf( " %8d KiB", $record{peak_rss_kb} )
+            : '' );
+    }
+
+    if ( defined($api_bench) )
+    {
+        # It takes the best of the runs itself, and prints them as JSON.
+        my $out = `$api_bench --repeat $repeat $root`;
+        if ($?)
+        {
+            die "'$api_bench' failed on '$root'.";
+        }
+        my $modes = JSON::PP->new->decode($out);
+
+        foreach my $mode ( sort keys %$modes )
+        {
+            my $name = "api-$mode";
+
+            $results{$shape}{$name} = {
+                seconds   => $modes->{$mode}->{secs},
+                api_stats => {
+                    map { $_ => $modes->{$mode}->{$_} }
+                        qw(count opendir stat peak_bytes)
+                },
+            };
+
+            printf "%-12s %-28s %10.4f s\n", $shape, $name,
+                $results{$shape}{$name}{seconds};
+        }
+    }
+}
+
+my $report = {
+    scale   => $scale,
+    repeat  => $repeat,
+    results => \%results,
+};
+
+my $json = JSON::PP->new->canonical(1)->pretty(1);
+
+if ( defined($output) )
+{
+    write_file( $output, $json->encode($report) );
+}
+
+if ( defined($baseline) )
+{
+    open my $in, '<', $baseline
+        or die "Cannot open baseline '$baseline' - $!";
+    my $old = $json->decode( join( '', <$in> ) );
+    close($in);
+
+    my $num_regressions = 0;
+
+    foreach my $shape ( sort keys %results )
+    {
+        foreach my $name ( sort keys %{ $results{$shape} } )
+        {
+            # Only our own code is expected to be stable between runs.
+            next if $name !~ m{\A(?:minifind|api-)};
+
+            my $old_rec = $old->{results}->{$shape}->{$name}
+                or next;
+
+            my $was = $old_rec->{seconds};
+            my $now = $results{$shape}{$name}{seconds};
+
+            if ( $now > $was * ( 1 + $max_regression / 100 ) )
+            {
+                printf STDERR
+                    "REGRESSION: %s %s - %.4f s -> %.4f s (+%.1f%%)\n",
+                    $shape, $name, $was, $now, ( ( $now / $was - 1 ) * 100 );
+                $num_regressions++;
+            }
+        }
+    }
+
+    if ($num_regressions)
+    {
+        exit(1);
+    }
+}
+
+exit(0);
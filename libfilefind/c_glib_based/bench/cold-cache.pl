@@ -0,0 +1,152 @@
+#!/usr/bin/perl
+
+# Compares the cold-cache performance of minifind with and without
+# --inode-order and --prefetch on a freshly made ext4 file system in a
+# loopback-mounted image. Must be run as root, since it mounts the image
+# and drops the page cache.
+#
+# Usage:
+#
+#     sudo perl bench/cold-cache.pl --minifind ./minifind [--size-mb 2048]
+#         [--dirs 200] [--files-per-dir 500] [--repeat 3] [--output r.json]
+
+use strict;
+use warnings;
+
+use Cwd qw/ abs_path /;
+use File::Path qw/ mkpath /;
+use File::Temp qw/ tempdir /;
+use Getopt::Long;
+use JSON::PP;
+use List::Util qw/ shuffle /;
+use Time::HiRes qw/ time /;
+
+my $minifind      = './minifind';
+my $size_mb       = 2048;
+my $num_dirs      = 200;
+my $files_per_dir = 500;
+my $repeat        = 3;
+my $output;
+
+GetOptions(
+    'minifind=s'      => \$minifind,
+    'size-mb=i'       => \$size_mb,
+    'dirs=i'          => \$num_dirs,
+    'files-per-dir=i' => \$files_per_dir,
+    'repeat=i'        => \$repeat,
+    'output=s'        => \$output,
+) or die "Wrong options - see the top of $0 for the usage.";
+
+if ( $> != 0 )
+{
+    die "Must be run as root in order to mount the image and drop caches.";
+}
+
+$minifind = abs_path($minifind);
+
+my $workdir = tempdir( CLEANUP => 1 );
+my $image   = "$workdir/fs.img";
+my $mnt     = "$workdir/mnt";
+
+sub do_system
+{
+    my @cmd = @_;
+
+    if ( system(@cmd) != 0 )
+    {
+        die "'@cmd' failed.";
+    }
+
+    return;
+}
+
+my $is_mounted = 0;
+
+END
+{
+    if ($is_mounted)
+    {
+        system( 'umount', $mnt );
+    }
+}
+
+do_system( 'truncate', '-s', "${size_mb}M", $image );
+# Small files, so reserve an inode for every 4 KiB.
+do_system( 'mkfs.ext4', '-q', '-F', '-i', 4096, $image );
+mkpath($mnt);
+do_system( 'mount', '-o', 'loop', $image, $mnt );
+$is_mounted = 1;
+
+# Create the entries in a random order, so the order of the inodes differs
+# from the lexicographic order of the names, as it does on aged volumes.
+print STDERR "Generating the tree ...\n";
+foreach my $d ( shuffle( 1 .. $num_dirs ) )
+{
+    mkpath("$mnt/dir$d");
+}
+foreach my $f ( shuffle( 0 .. $num_dirs * $files_per_dir - 1 ) )
+{
+    my $path =
+        sprintf( "%s/dir%d/file%d", $mnt, 1 + $f % $num_dirs, $f );
+    open my $fh, '>', $path or die "Cannot create '$path' - $!";
+    print {$fh} "$f\n";
+    close($fh);
+}
+
+sub drop_caches
+{
+    do_system('sync');
+
+    open my $fh, '>', '/proc/sys/vm/drop_caches'
+        or die "Cannot drop the caches - $!";
+    print {$fh} "3\n";
+    close($fh);
+
+    return;
+}
+
+my %results;
+
+my @modes = (
+    [ 'name-order'  => [] ],
+    [ 'inode-order' => ['--inode-order'] ],
+    [ 'prefetch'    => [ '--prefetch', 64, '--prefetch-threads', 8 ] ],
+);
+
+foreach my $mode (@modes)
+{
+    my ( $name, $flags ) = @$mode;
+
+    my @times;
+    foreach my $iter ( 1 .. $repeat )
+    {
+        drop_caches();
+
+        my $start = time();
+        do_system( $minifind, '--count', @$flags, $mnt );
+        push @times, time() - $start;
+    }
+
+    @times = sort { $a <=> $b } @times;
+
+    $results{$name} = {
+        best_seconds   => $times[0],
+        median_seconds => $times[ $#times / 2 ],
+    };
+
+    printf "%-12s best %.3f s, median %.3f s\n",
+        $name, $results{$name}{best_seconds}, $results{$name}{median_seconds};
+}
+
+if ( defined($output) )
+{
+    open my $fh, '>', $output or die "Cannot open '$output' - $!";
+    print {$fh} JSON::PP->new->canonical(1)->pretty(1)->encode(
+        {
+            dirs          => $num_dirs,
+            files_per_dir => $files_per_dir,
+            results       => \%results,
+        }
+    );
+    close($fh);
+}
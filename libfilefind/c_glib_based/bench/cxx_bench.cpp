@@ -0,0 +1,298 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  cxx_bench.cpp
+ *
+ *    Description:  compares filefind.hpp with the equivalent code that
+ *                  uses std::filesystem::recursive_directory_iterator.
+ *
+ *        Created:  20/10/26 00:31:47
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+/*
+ * Usage: cxx_bench [--repeat N] [--glob GLOB] [--max-depth D] dir
+ *
+ * Every variant counts the regular files under dir (and at most D levels
+ * deep) whose name matches GLOB, and prints the best of N wall-clock times
+ * of each as a JSON object. The counts of all the variants must agree.
+ * */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../filefind.hpp"
+
+namespace
+{
+
+struct options
+{
+    std::string dir;
+    std::string glob = "*";
+    int max_depth = 1000000;
+};
+
+/* The globs of file_find::name(), for the variants that do without it. */
+std::shared_ptr<file_find_matcher_t> compile_glob(const std::string & glob)
+{
+    file_find_matcher_t * handle;
+
+    file_find::check(file_find_matcher_new(&handle));
+
+    std::shared_ptr<file_find_matcher_t> ret(handle, file_find_matcher_free);
+
+    file_find::check(file_find_matcher_add_glob(handle, glob.c_str()));
+    file_find::check(file_find_matcher_compile(handle));
+
+    return ret;
+}
+
+/* The way it was written by hand, with a std::string and std::functions. */
+unsigned long long count_with_handle(const options & opts)
+{
+    const auto matcher = compile_glob(opts.glob);
+    std::vector<std::function<bool(const file_find_item_t *)>> filters;
+
+    filters.emplace_back([](const file_find_item_t * item)
+    {
+        return file_find_item_is_file(item) != 0;
+    });
+    filters.emplace_back([&](const file_find_item_t * item)
+    {
+        const char * const basename = file_find_item_get_basename(item);
+
+        return (basename
+            && file_find_matcher_match(matcher.get(), basename));
+    });
+    filters.emplace_back([&](const file_find_item_t * item)
+    {
+        int num_components;
+
+        file_find_item_get_dir_components(item, &num_components);
+
+        return (num_components + 1 <= opts.max_depth);
+    });
+
+    file_find_handle_t * tree;
+    unsigned long long count = 0;
+
+    file_find::check(file_find_new(&tree, opts.dir.c_str()));
+
+    while (file_find_next(tree) == FILE_FIND_OK)
+    {
+        const file_find_item_t * const item = file_find_get_item(tree);
+        const std::string path = file_find_item_get_path(item);
+        bool is_match = true;
+
+        for (const auto & filter : filters)
+        {
+            if (! filter(item))
+            {
+                is_match = false;
+                break;
+            }
+        }
+
+        if (is_match && ! path.empty())
+        {
+            count++;
+        }
+    }
+
+    file_find_free(tree);
+
+    return count;
+}
+
+unsigned long long count_with_range(const options & opts)
+{
+    file_find::finder tree(opts.dir);
+    unsigned long long count = 0;
+
+    for (const file_find::entry & e : tree.filter(
+            file_find::is(file_find::type::file)
+            && file_find::name(opts.glob)
+            && file_find::max_depth(opts.max_depth)))
+    {
+        if (! e.path().empty())
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+unsigned long long count_with_generator(const options & opts)
+{
+    file_find::finder tree(opts.dir);
+    unsigned long long count = 0;
+
+    for (const file_find::entry & e : tree.walk(
+            file_find::is(file_find::type::file)
+            && file_find::name(opts.glob)
+            && file_find::max_depth(opts.max_depth)))
+    {
+        if (! e.path().empty())
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* Like the finder, it follows no links to directories. */
+unsigned long long count_with_std_filesystem(const options & opts)
+{
+    namespace fs = std::filesystem;
+
+    const auto matcher = compile_glob(opts.glob);
+    unsigned long long count = 0;
+
+    for (auto it = fs::recursive_directory_iterator(opts.dir) ;
+        it != fs::recursive_directory_iterator() ; ++it)
+    {
+        const int depth = it.depth() + 1;
+
+        if (depth >= opts.max_depth)
+        {
+            it.disable_recursion_pending();
+        }
+
+        if ((depth <= opts.max_depth) && it->is_regular_file()
+            && file_find_matcher_match(
+                matcher.get(), it->path().filename().c_str()
+            ))
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+} /* namespace */
+
+int main(int argc, char * argv[])
+{
+    options opts;
+    int repeat = 3;
+    int arg_idx = 1;
+
+    while ((arg_idx < argc) && (argv[arg_idx][0] == '-'))
+    {
+        const char * const arg = argv[arg_idx++];
+
+        if (arg_idx >= argc)
+        {
+            fprintf(stderr, "%s requires an argument.\n", arg);
+            return -1;
+        }
+
+        if (! strcmp(arg, "--repeat"))
+        {
+            repeat = atoi(argv[arg_idx++]);
+        }
+        else if (! strcmp(arg, "--glob"))
+        {
+            opts.glob = argv[arg_idx++];
+        }
+        else if (! strcmp(arg, "--max-depth"))
+        {
+            opts.max_depth = atoi(argv[arg_idx++]);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option \"%s\".\n", arg);
+            return -1;
+        }
+    }
+
+    if (arg_idx + 1 != argc)
+    {
+        fprintf(stderr, "%s\n",
+            "Usage: cxx_bench [--repeat N] [--glob GLOB] [--max-depth D] dir");
+        return -1;
+    }
+
+    opts.dir = argv[arg_idx];
+
+    try
+    {
+        compile_glob(opts.glob);
+    }
+    catch (const file_find::error &)
+    {
+        fprintf(stderr, "Invalid glob \"%s\".\n", opts.glob.c_str());
+        return -1;
+    }
+
+    const struct
+    {
+        const char * name;
+        unsigned long long (*count)(const options &);
+    } variants[] =
+    {
+        { "handle_std_function", count_with_handle },
+        { "range", count_with_range },
+        { "generator", count_with_generator },
+        { "std_filesystem", count_with_std_filesystem },
+    };
+
+    unsigned long long expected_count = 0;
+
+    printf("{");
+
+    for (size_t i = 0 ; i < sizeof(variants) / sizeof(variants[0]) ; i++)
+    {
+        double best_secs = 0;
+        unsigned long long count = 0;
+
+        for (int run = 0 ; run < repeat ; run++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            count = variants[i].count(opts);
+
+            const std::chrono::duration<double> secs =
+                std::chrono::steady_clock::now() - start;
+
+            if ((run == 0) || (secs.count() < best_secs))
+            {
+                best_secs = secs.count();
+            }
+        }
+
+        if (i == 0)
+        {
+            expected_count = count;
+        }
+        else if (count != expected_count)
+        {
+            fprintf(stderr, "%s found %llu files instead of %llu.\n",
+                variants[i].name, count, expected_count);
+            return 1;
+        }
+
+        printf("%s\"%s\": {\"count\": %llu, \"secs\": %.6f}",
+            (i ? ", " : ""), variants[i].name, count, best_secs);
+    }
+
+    printf("}\n");
+
+    return 0;
+}
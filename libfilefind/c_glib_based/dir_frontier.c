@@ -0,0 +1,843 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  dir_frontier.c
+ *
+ *    Description:  the directories that are still to be entered, by their
+ *                  priority or in the order they were found.
+ *
+ *        Created:  20/10/26 01:12:40
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "inline.h"
+
+#include "dir_frontier.h"
+
+/*
+ * The spilled directories are written in chunks of about this size, and
+ * read back in chunks of at least this size.
+ * */
+#define FRONTIER_SPILL_CHUNK_SIZE (64 * 1024)
+
+typedef struct
+{
+    gdouble score;
+    /* Orders the directories of equal scores by when they were pushed. */
+    guint64 seq;
+    dir_frontier_node_t * node;
+    /* The memory held by node and its traverse_to. */
+    guint64 bytes;
+} dir_frontier_entry_type;
+
+struct dir_frontier_struct
+{
+    /*
+     * A binary max-heap of the entries, or, for a queue, the entries in
+     * the order they were pushed, from head on.
+     * */
+    GArray * entries;
+    guint64 next_seq;
+    gboolean is_queue;
+    guint head;
+    guint64 max_memory_bytes;
+    guint64 memory_bytes;
+
+    /*
+     * The spilled directories of a queue, which were all pushed after
+     * those in entries. Each one is a guint32 of the length of the rest of
+     * the record, a guint32 of its depth, then the dev, inode and name of
+     * each directory from the entries of the target down to it, and the
+     * number of its traverse_to (G_MAXUINT32 for NULL) and their names.
+     * The names are prefixed by their guint32 lengths. They are appended
+     * to write_buf, which is written to the end of the file as it fills
+     * up, or kept in memory if the file cannot be written.
+     * */
+    guint64 num_spilled;
+    guint64 total_spilled;
+    GByteArray * write_buf;
+    int fd;
+    gboolean spill_failed;
+    off_t size;
+    off_t read_offset;
+    GByteArray * read_buf;
+    gsize read_start;
+    /*
+     * The parents of the last directory that was read back, which are
+     * shared with the following ones that are inside them.
+     * */
+    GPtrArray * last_chain;
+};
+
+dir_frontier_t * dir_frontier_new(void)
+{
+    dir_frontier_t * const self = g_new0(dir_frontier_t, 1);
+
+    if (! self)
+    {
+        return NULL;
+    }
+
+    self->fd = -1;
+
+    if (! (self->entries = g_array_new(FALSE, FALSE, sizeof(dir_frontier_entry_type))))
+    {
+        g_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+dir_frontier_t * dir_frontier_new_queue(const guint64 max_memory_bytes)
+{
+    dir_frontier_t * const self = dir_frontier_new();
+
+    if (! self)
+    {
+        return NULL;
+    }
+
+    self->is_queue = TRUE;
+    self->max_memory_bytes = max_memory_bytes;
+
+    if (max_memory_bytes
+        && (! ((self->write_buf = g_byte_array_new())
+            && (self->read_buf = g_byte_array_new())
+            && (self->last_chain = g_ptr_array_new())
+        )))
+    {
+        dir_frontier_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+static GCC_INLINE gboolean dir_frontier_entry_is_before(
+    const dir_frontier_entry_type * const a,
+    const dir_frontier_entry_type * const b
+)
+{
+    return ((a->score > b->score)
+        || ((a->score == b->score) && (a->seq < b->seq))
+    );
+}
+
+static void dir_frontier_string_array_free(GPtrArray * const arr)
+{
+    for (guint i = 0 ; i < arr->len ; i++)
+    {
+        g_free(g_ptr_array_index(arr, i));
+    }
+
+    g_ptr_array_free(arr, TRUE);
+
+    return;
+}
+
+/*
+ * Takes over traverse_to, but not the reference to parent.
+ * */
+static dir_frontier_node_t * dir_frontier_node_new(
+    dir_frontier_node_t * const parent,
+    const gchar * const name,
+    const gsize name_len,
+    const guint64 dir_dev,
+    const guint64 dir_ino,
+    GPtrArray * const traverse_to
+)
+{
+    dir_frontier_node_t * const node =
+        g_malloc(sizeof(*node) + name_len + 1);
+
+    if (! node)
+    {
+        return NULL;
+    }
+
+    node->parent = (parent ? dir_frontier_node_ref(parent) : NULL);
+    node->ref_count = 1;
+    node->depth = (parent ? (parent->depth + 1) : 1);
+    node->dir_dev = dir_dev;
+    node->dir_ino = dir_ino;
+    node->traverse_to = traverse_to;
+    memcpy(node->name, name, name_len);
+    node->name[name_len] = '\0';
+
+    return node;
+}
+
+static guint64 dir_frontier_node_get_bytes(const dir_frontier_node_t * const node)
+{
+    guint64 ret = sizeof(dir_frontier_entry_type) + sizeof(*node)
+        + strlen(node->name) + 1;
+
+    if (node->traverse_to)
+    {
+        ret += sizeof(GPtrArray);
+
+        for (guint i = 0 ; i < node->traverse_to->len ; i++)
+        {
+            ret += sizeof(gpointer)
+                + strlen(g_ptr_array_index(node->traverse_to, i)) + 1;
+        }
+    }
+
+    return ret;
+}
+
+static void dir_frontier_heap_push(
+    dir_frontier_t * const self,
+    const dir_frontier_entry_type entry
+)
+{
+    GArray * const heap = self->entries;
+
+    g_array_append_val(heap, entry);
+
+    /* Sift up. */
+    guint i = heap->len - 1;
+
+    while (i > 0)
+    {
+        const guint parent_idx = ((i - 1) >> 1);
+        dir_frontier_entry_type * const up =
+            &g_array_index(heap, dir_frontier_entry_type, parent_idx);
+
+        if (! dir_frontier_entry_is_before(&entry, up))
+        {
+            break;
+        }
+
+        g_array_index(heap, dir_frontier_entry_type, i) = *up;
+        i = parent_idx;
+    }
+
+    g_array_index(heap, dir_frontier_entry_type, i) = entry;
+
+    return;
+}
+
+static GCC_INLINE void dir_frontier_put_uint32(
+    GByteArray * const buf,
+    const guint32 value
+)
+{
+    g_byte_array_append(buf, (const guint8 *)&value, sizeof(value));
+
+    return;
+}
+
+static void dir_frontier_put_string(
+    GByteArray * const buf,
+    const gchar * const string
+)
+{
+    const gsize len = strlen(string);
+
+    dir_frontier_put_uint32(buf, len);
+    g_byte_array_append(buf, (const guint8 *)string, len);
+
+    return;
+}
+
+static void dir_frontier_put_dir(
+    GByteArray * const buf,
+    const gchar * const name,
+    const guint64 dir_dev,
+    const guint64 dir_ino
+)
+{
+    g_byte_array_append(buf, (const guint8 *)&dir_dev, sizeof(dir_dev));
+    g_byte_array_append(buf, (const guint8 *)&dir_ino, sizeof(dir_ino));
+    dir_frontier_put_string(buf, name);
+
+    return;
+}
+
+/*
+ * Puts the parents of a spilled directory, from the top down.
+ * */
+static void dir_frontier_put_parents(
+    GByteArray * const buf,
+    const dir_frontier_node_t * const node
+)
+{
+    if (node)
+    {
+        dir_frontier_put_parents(buf, node->parent);
+        dir_frontier_put_dir(buf, node->name, node->dir_dev, node->dir_ino);
+    }
+
+    return;
+}
+
+static gboolean dir_frontier_write_all(
+    const int fd,
+    const guint8 * buffer,
+    gsize len,
+    off_t offset
+)
+{
+    while (len > 0)
+    {
+        const ssize_t written = pwrite(fd, buffer, len, offset);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return FALSE;
+        }
+
+        buffer += written;
+        len -= written;
+        offset += written;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Writes write_buf to the end of the file. If that fails, it is kept in
+ * memory instead, and so are the directories that are spilled later.
+ * */
+static void dir_frontier_flush(dir_frontier_t * const self)
+{
+    if (self->fd < 0)
+    {
+        gchar * filename = NULL;
+
+        if ((self->fd = g_file_open_tmp("filefind-frontier-XXXXXX", &filename, NULL)) < 0)
+        {
+            self->spill_failed = TRUE;
+            return;
+        }
+
+        /* Nobody else needs it, and it is gone even if we crash. */
+        g_unlink(filename);
+        g_free(filename);
+    }
+
+    if (! dir_frontier_write_all(
+            self->fd, self->write_buf->data, self->write_buf->len, self->size
+        ))
+    {
+        self->spill_failed = TRUE;
+        return;
+    }
+
+    self->size += self->write_buf->len;
+    g_byte_array_set_size(self->write_buf, 0);
+
+    return;
+}
+
+static void dir_frontier_spill(
+    dir_frontier_t * const self,
+    dir_frontier_node_t * const parent,
+    const gchar * const name,
+    const guint64 dir_dev,
+    const guint64 dir_ino,
+    GPtrArray * const traverse_to
+)
+{
+    GByteArray * const buf = self->write_buf;
+    const guint record_start = buf->len;
+
+    /* The length, which is filled in below. */
+    dir_frontier_put_uint32(buf, 0);
+    dir_frontier_put_uint32(buf, (parent ? (parent->depth + 1) : 1));
+    dir_frontier_put_parents(buf, parent);
+    dir_frontier_put_dir(buf, name, dir_dev, dir_ino);
+
+    if (traverse_to)
+    {
+        dir_frontier_put_uint32(buf, traverse_to->len);
+
+        for (guint i = 0 ; i < traverse_to->len ; i++)
+        {
+            dir_frontier_put_string(buf, g_ptr_array_index(traverse_to, i));
+        }
+
+        dir_frontier_string_array_free(traverse_to);
+    }
+    else
+    {
+        dir_frontier_put_uint32(buf, G_MAXUINT32);
+    }
+
+    const guint32 record_len = buf->len - record_start - sizeof(guint32);
+
+    memcpy(buf->data + record_start, &record_len, sizeof(record_len));
+
+    self->num_spilled++;
+    self->total_spilled++;
+
+    if ((buf->len >= FRONTIER_SPILL_CHUNK_SIZE) && (! self->spill_failed))
+    {
+        dir_frontier_flush(self);
+    }
+
+    return;
+}
+
+gboolean dir_frontier_push(
+    dir_frontier_t * const self,
+    dir_frontier_node_t * const parent,
+    const gchar * const name,
+    const guint64 dir_dev,
+    const guint64 dir_ino,
+    GPtrArray * const traverse_to,
+    const gdouble score
+)
+{
+    dir_frontier_node_t * const node = dir_frontier_node_new(
+        parent, name, strlen(name), dir_dev, dir_ino, traverse_to
+    );
+
+    if (! node)
+    {
+        return FALSE;
+    }
+
+    dir_frontier_entry_type entry =
+        { score, self->next_seq++, node, dir_frontier_node_get_bytes(node) };
+
+    if (! self->is_queue)
+    {
+        dir_frontier_heap_push(self, entry);
+
+        return TRUE;
+    }
+
+    if (self->max_memory_bytes
+        && (self->num_spilled
+            || (self->memory_bytes + entry.bytes > self->max_memory_bytes)
+        ))
+    {
+        node->traverse_to = NULL;
+        dir_frontier_node_unref(node);
+
+        dir_frontier_spill(self, parent, name, dir_dev, dir_ino, traverse_to);
+
+        return TRUE;
+    }
+
+    g_array_append_val(self->entries, entry);
+    self->memory_bytes += entry.bytes;
+
+    return TRUE;
+}
+
+/*
+ * Makes len bytes of the spilled directories available from read_start
+ * on. Once the file was read to its end, the rest of them are in
+ * write_buf.
+ * */
+static gboolean dir_frontier_fill(dir_frontier_t * const self, const gsize len)
+{
+    GByteArray * const buf = self->read_buf;
+
+    while (buf->len - self->read_start < len)
+    {
+        if (self->read_start)
+        {
+            g_byte_array_remove_range(buf, 0, self->read_start);
+            self->read_start = 0;
+        }
+
+        if (self->read_offset == self->size)
+        {
+            if (! self->write_buf->len)
+            {
+                return FALSE;
+            }
+
+            g_byte_array_append(buf, self->write_buf->data, self->write_buf->len);
+            g_byte_array_set_size(self->write_buf, 0);
+
+            continue;
+        }
+
+        const gsize old_len = buf->len;
+        const gsize to_read = MIN(
+            (gsize)(self->size - self->read_offset),
+            MAX(len - old_len, FRONTIER_SPILL_CHUNK_SIZE)
+        );
+
+        g_byte_array_set_size(buf, old_len + to_read);
+
+        const ssize_t num_read =
+            pread(self->fd, buf->data + old_len, to_read, self->read_offset);
+
+        g_byte_array_set_size(buf, old_len + MAX(num_read, 0));
+
+        if ((num_read < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+
+        if (num_read <= 0)
+        {
+            return FALSE;
+        }
+
+        self->read_offset += num_read;
+    }
+
+    return TRUE;
+}
+
+static GCC_INLINE guint32 dir_frontier_get_uint32(const guint8 * * const ptr)
+{
+    guint32 ret;
+
+    memcpy(&ret, *ptr, sizeof(ret));
+    *ptr += sizeof(ret);
+
+    return ret;
+}
+
+static GCC_INLINE guint64 dir_frontier_get_uint64(const guint8 * * const ptr)
+{
+    guint64 ret;
+
+    memcpy(&ret, *ptr, sizeof(ret));
+    *ptr += sizeof(ret);
+
+    return ret;
+}
+
+/*
+ * Reads back the next spilled directory. Returns NULL if it could not be
+ * read or if out of memory.
+ * */
+static dir_frontier_node_t * dir_frontier_unspill(dir_frontier_t * const self)
+{
+    if (! dir_frontier_fill(self, sizeof(guint32)))
+    {
+        return NULL;
+    }
+
+    const guint8 * ptr = self->read_buf->data + self->read_start;
+    const guint32 record_len = dir_frontier_get_uint32(&ptr);
+
+    if (! dir_frontier_fill(self, sizeof(guint32) + record_len))
+    {
+        return NULL;
+    }
+
+    ptr = self->read_buf->data + self->read_start + sizeof(guint32);
+    self->read_start += sizeof(guint32) + record_len;
+
+    GPtrArray * const last_chain = self->last_chain;
+    const guint32 depth = dir_frontier_get_uint32(&ptr);
+    dir_frontier_node_t * parent = NULL;
+
+    for (guint32 i = 0 ; i + 1 < depth ; i++)
+    {
+        const guint64 dir_dev = dir_frontier_get_uint64(&ptr);
+        const guint64 dir_ino = dir_frontier_get_uint64(&ptr);
+        const guint32 name_len = dir_frontier_get_uint32(&ptr);
+        const gchar * const name = (const gchar *)ptr;
+
+        ptr += name_len;
+
+        if (i < last_chain->len)
+        {
+            dir_frontier_node_t * const prev = g_ptr_array_index(last_chain, i);
+
+            if ((prev->dir_dev == dir_dev) && (prev->dir_ino == dir_ino)
+                && (! strncmp(prev->name, name, name_len))
+                && (! prev->name[name_len]))
+            {
+                parent = prev;
+                continue;
+            }
+
+            while (last_chain->len > i)
+            {
+                dir_frontier_node_unref(g_ptr_array_index(last_chain, last_chain->len - 1));
+                g_ptr_array_set_size(last_chain, last_chain->len - 1);
+            }
+        }
+
+        if (! (parent = dir_frontier_node_new(
+                        parent, name, name_len, dir_dev, dir_ino, NULL)))
+        {
+            return NULL;
+        }
+
+        g_ptr_array_add(last_chain, parent);
+    }
+
+    const guint64 dir_dev = dir_frontier_get_uint64(&ptr);
+    const guint64 dir_ino = dir_frontier_get_uint64(&ptr);
+    const guint32 name_len = dir_frontier_get_uint32(&ptr);
+    const gchar * const name = (const gchar *)ptr;
+
+    ptr += name_len;
+
+    const guint32 num_traverse_to = dir_frontier_get_uint32(&ptr);
+    GPtrArray * traverse_to = NULL;
+
+    if (num_traverse_to != G_MAXUINT32)
+    {
+        if (! (traverse_to = g_ptr_array_sized_new(num_traverse_to)))
+        {
+            return NULL;
+        }
+
+        for (guint32 i = 0 ; i < num_traverse_to ; i++)
+        {
+            const guint32 len = dir_frontier_get_uint32(&ptr);
+
+            g_ptr_array_add(traverse_to, g_strndup((const gchar *)ptr, len));
+            ptr += len;
+        }
+    }
+
+    dir_frontier_node_t * const node = dir_frontier_node_new(
+        parent, name, name_len, dir_dev, dir_ino, traverse_to
+    );
+
+    if ((! node) && traverse_to)
+    {
+        dir_frontier_string_array_free(traverse_to);
+    }
+
+    return node;
+}
+
+/*
+ * Reads back spilled directories into the empty queue, until they take
+ * half of max_memory_bytes.
+ * */
+static void dir_frontier_refill(dir_frontier_t * const self)
+{
+    g_array_set_size(self->entries, 0);
+    self->head = 0;
+
+    while (self->num_spilled
+        && ((! self->entries->len)
+            || (self->memory_bytes < (self->max_memory_bytes >> 1))
+        ))
+    {
+        dir_frontier_node_t * const node = dir_frontier_unspill(self);
+
+        if (! node)
+        {
+            /* The rest of them are lost. */
+            self->num_spilled = 0;
+            break;
+        }
+
+        const dir_frontier_entry_type entry =
+            { 0, self->next_seq++, node, dir_frontier_node_get_bytes(node) };
+
+        g_array_append_val(self->entries, entry);
+        self->memory_bytes += entry.bytes;
+        self->num_spilled--;
+    }
+
+    if (! self->num_spilled)
+    {
+        /* Start the file over. */
+        g_byte_array_set_size(self->write_buf, 0);
+        g_byte_array_set_size(self->read_buf, 0);
+        self->read_start = 0;
+        self->size = self->read_offset = 0;
+    }
+
+    return;
+}
+
+static dir_frontier_node_t * dir_frontier_queue_pop(dir_frontier_t * const self)
+{
+    GArray * const queue = self->entries;
+
+    if ((self->head == queue->len) && self->num_spilled)
+    {
+        dir_frontier_refill(self);
+    }
+
+    if (self->head == queue->len)
+    {
+        return NULL;
+    }
+
+    const dir_frontier_entry_type entry =
+        g_array_index(queue, dir_frontier_entry_type, self->head++);
+
+    self->memory_bytes -= entry.bytes;
+
+    /* Reclaim the popped entries once they are most of the array. */
+    if (self->head == queue->len)
+    {
+        g_array_set_size(queue, 0);
+        self->head = 0;
+    }
+    else if ((self->head >= 1024) && (self->head >= (queue->len >> 1)))
+    {
+        g_array_remove_range(queue, 0, self->head);
+        self->head = 0;
+    }
+
+    return entry.node;
+}
+
+dir_frontier_node_t * dir_frontier_pop(dir_frontier_t * const self)
+{
+    if (self->is_queue)
+    {
+        return dir_frontier_queue_pop(self);
+    }
+
+    GArray * const heap = self->entries;
+
+    if (! heap->len)
+    {
+        return NULL;
+    }
+
+    dir_frontier_node_t * const ret =
+        g_array_index(heap, dir_frontier_entry_type, 0).node;
+    const dir_frontier_entry_type last =
+        g_array_index(heap, dir_frontier_entry_type, heap->len - 1);
+
+    g_array_set_size(heap, heap->len - 1);
+
+    /* Sift the last entry down from the root. */
+    const guint len = heap->len;
+    guint i = 0;
+
+    while (len)
+    {
+        guint child = (i << 1) + 1;
+
+        if (child >= len)
+        {
+            break;
+        }
+
+        if ((child + 1 < len)
+            && dir_frontier_entry_is_before(
+                &g_array_index(heap, dir_frontier_entry_type, child + 1),
+                &g_array_index(heap, dir_frontier_entry_type, child)
+            ))
+        {
+            child++;
+        }
+
+        if (! dir_frontier_entry_is_before(
+                &g_array_index(heap, dir_frontier_entry_type, child), &last
+            ))
+        {
+            break;
+        }
+
+        g_array_index(heap, dir_frontier_entry_type, i) =
+            g_array_index(heap, dir_frontier_entry_type, child);
+        i = child;
+    }
+
+    if (len)
+    {
+        g_array_index(heap, dir_frontier_entry_type, i) = last;
+    }
+
+    return ret;
+}
+
+guint64 dir_frontier_get_len(dir_frontier_t * const self)
+{
+    return (self->entries->len - self->head + self->num_spilled);
+}
+
+guint64 dir_frontier_get_num_spilled(dir_frontier_t * const self)
+{
+    return self->total_spilled;
+}
+
+dir_frontier_node_t * dir_frontier_node_ref(dir_frontier_node_t * const node)
+{
+    node->ref_count++;
+
+    return node;
+}
+
+void dir_frontier_node_unref(dir_frontier_node_t * node)
+{
+    while (node && (! (--node->ref_count)))
+    {
+        dir_frontier_node_t * const parent = node->parent;
+
+        if (node->traverse_to)
+        {
+            dir_frontier_string_array_free(node->traverse_to);
+        }
+
+        g_free(node);
+
+        node = parent;
+    }
+
+    return;
+}
+
+void dir_frontier_free(dir_frontier_t * const self)
+{
+    for (guint i = self->head ; i < self->entries->len ; i++)
+    {
+        dir_frontier_node_unref(
+            g_array_index(self->entries, dir_frontier_entry_type, i).node
+        );
+    }
+
+    g_array_free(self->entries, TRUE);
+
+    if (self->last_chain)
+    {
+        for (guint i = 0 ; i < self->last_chain->len ; i++)
+        {
+            dir_frontier_node_unref(g_ptr_array_index(self->last_chain, i));
+        }
+
+        g_ptr_array_free(self->last_chain, TRUE);
+    }
+
+    if (self->write_buf)
+    {
+        g_byte_array_free(self->write_buf, TRUE);
+    }
+
+    if (self->read_buf)
+    {
+        g_byte_array_free(self->read_buf, TRUE);
+    }
+
+    if (self->fd >= 0)
+    {
+        close(self->fd);
+    }
+
+    g_free(self);
+
+    return;
+}
@@ -0,0 +1,106 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  dir_frontier.h
+ *
+ *    Description:  the directories that are still to be entered, by their
+ *                  priority or in the order they were found. Internal to
+ *                  libfilefind.
+ *
+ *        Created:  20/10/26 01:12:40
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_DIR_FRONTIER_H
+#define FILEFIND_DIR_FRONTIER_H
+
+#include <glib.h>
+
+/*
+ * A pending directory. Only its own name is kept: the rest of its path is
+ * that of its parent, which is kept for as long as any of its
+ * subdirectories are.
+ * */
+typedef struct dir_frontier_node_struct dir_frontier_node_t;
+
+struct dir_frontier_node_struct
+{
+    /* NULL for the entries of the target. */
+    dir_frontier_node_t * parent;
+    guint ref_count;
+    /* The number of components below the target: 1 for its entries. */
+    gint depth;
+    guint64 dir_dev;
+    guint64 dir_ino;
+    /*
+     * What file_find_set_traverse_to() left to be traversed inside the
+     * directory, or NULL if it is to be listed.
+     * */
+    GPtrArray * traverse_to;
+    gchar name[];
+};
+
+typedef struct dir_frontier_struct dir_frontier_t;
+
+/*
+ * Returns NULL if out of memory.
+ * */
+extern dir_frontier_t * dir_frontier_new(void);
+
+/*
+ * Returns a frontier that pops the directories in the order they were
+ * pushed, regardless of their scores. Once the directories that it holds
+ * take more than about max_memory_bytes (if it is not 0), the next ones
+ * are written to a temporary file until they are popped, along with the
+ * names and identities of their parents. Returns NULL if out of memory.
+ * */
+extern dir_frontier_t * dir_frontier_new_queue(guint64 max_memory_bytes);
+
+/*
+ * Queues the directory name inside parent with score, and takes over
+ * traverse_to. The directories with higher scores are popped first, and
+ * those with equal scores in the order they were pushed. Returns FALSE if
+ * out of memory.
+ * */
+extern gboolean dir_frontier_push(
+    dir_frontier_t * self,
+    dir_frontier_node_t * parent,
+    const gchar * name,
+    guint64 dir_dev,
+    guint64 dir_ino,
+    GPtrArray * traverse_to,
+    gdouble score
+);
+
+/*
+ * Returns the next directory, whose reference now belongs to the caller,
+ * or NULL if there are none.
+ * */
+extern dir_frontier_node_t * dir_frontier_pop(dir_frontier_t * self);
+
+extern guint64 dir_frontier_get_len(dir_frontier_t * self);
+
+/*
+ * The number of directories that were written to the temporary file.
+ * */
+extern guint64 dir_frontier_get_num_spilled(dir_frontier_t * self);
+
+extern dir_frontier_node_t * dir_frontier_node_ref(dir_frontier_node_t * node);
+
+/*
+ * Frees node, and its parents that are no longer needed, once it is no
+ * longer needed. node may be NULL.
+ * */
+extern void dir_frontier_node_unref(dir_frontier_node_t * node);
+
+/*
+ * Drops the directories that were not popped.
+ * */
+extern void dir_frontier_free(dir_frontier_t * self);
+
+#endif /* #ifndef FILEFIND_DIR_FRONTIER_H */
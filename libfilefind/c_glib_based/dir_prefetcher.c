@@ -0,0 +1,769 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  dir_prefetcher.c
+ *
+ *    Description:  lists and stats the directories that a serial walk is
+ *                  about to enter on helper threads.
+ *
+ *        Created:  19/10/26 18:21:44
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+
+#ifdef G_OS_UNIX
+
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <fcntl.h>
+
+#include "inline.h"
+
+#include "dir_prefetcher.h"
+
+enum
+{
+    JOB_PENDING = 0,
+    JOB_RUNNING,
+    JOB_DONE,
+};
+
+typedef struct
+{
+    gchar * path;
+    gint state;
+    /* Whether it counts against max_ahead. */
+    gboolean is_ahead;
+    /* Set when it was discarded while running. The worker frees it. */
+    gboolean is_dropped;
+    /* NULL if out of memory. */
+    dir_prefetcher_listing_t * listing;
+} prefetch_job_t;
+
+struct dir_prefetcher_struct
+{
+    GMutex lock;
+    GCond cond;
+    /* All the jobs that were not discarded, by their path. */
+    GHashTable * jobs;
+    /* The pending jobs, by walk_order_cmp() of their paths. */
+    GTree * pending;
+    /* The running and done jobs. */
+    GPtrArray * started;
+    /* The job that the walker is waiting for, or NULL. */
+    prefetch_job_t * wanted;
+    guint num_ahead;
+    guint max_ahead;
+    /* The last path the walker took, or NULL. */
+    gchar * last_taken;
+    gboolean is_cancelled;
+    GPtrArray * threads;
+    dir_prefetcher_should_enter_t should_enter;
+    gpointer should_enter_context;
+};
+
+/*
+ * Compares two paths by their order in a sorted pre-order walk: component
+ * by component, with a directory before its contents.
+ * */
+static gint walk_order_cmp(const gchar * a, const gchar * b)
+{
+    while ((*a) && (*a == *b))
+    {
+        a++;
+        b++;
+    }
+
+    if (*a == *b)
+    {
+        return 0;
+    }
+    /* A directory comes before everything below it. */
+    else if (! *a)
+    {
+        return -1;
+    }
+    else if (! *b)
+    {
+        return 1;
+    }
+    /* The end of a component sorts before any character. */
+    else if (*a == G_DIR_SEPARATOR)
+    {
+        return -1;
+    }
+    else if (*b == G_DIR_SEPARATOR)
+    {
+        return 1;
+    }
+    else
+    {
+        return (((guchar)*a) - ((guchar)*b));
+    }
+}
+
+static void prefetch_job_free(gpointer data)
+{
+    prefetch_job_t * const job = (prefetch_job_t *)data;
+
+    if (job->listing)
+    {
+        dir_prefetcher_listing_free(job->listing);
+    }
+
+    g_free(job->path);
+    g_free(job);
+
+    return;
+}
+
+static prefetch_job_t * dir_prefetcher_add_job(
+    dir_prefetcher_t * const self,
+    gchar * const path
+)
+{
+    prefetch_job_t * const job = g_new0(prefetch_job_t, 1);
+
+    if (! job)
+    {
+        g_free(path);
+        return NULL;
+    }
+
+    job->path = path;
+    job->state = JOB_PENDING;
+
+    g_hash_table_insert(self->jobs, job->path, job);
+    g_tree_insert(self->pending, job->path, job);
+
+    return job;
+}
+
+static void dir_prefetcher_discard_job(
+    dir_prefetcher_t * const self,
+    prefetch_job_t * const job
+)
+{
+    g_hash_table_steal(self->jobs, job->path);
+
+    if (job->state == JOB_PENDING)
+    {
+        g_tree_remove(self->pending, job->path);
+        prefetch_job_free(job);
+
+        return;
+    }
+
+    g_ptr_array_remove(self->started, job);
+
+    if (job->state == JOB_RUNNING)
+    {
+        job->is_dropped = TRUE;
+
+        return;
+    }
+
+    if (job->is_ahead)
+    {
+        self->num_ahead--;
+    }
+
+    prefetch_job_free(job);
+
+    return;
+}
+
+static GCC_INLINE gboolean is_stale(
+    dir_prefetcher_t * const self,
+    const prefetch_job_t * const job
+)
+{
+    return (self->last_taken
+        && (walk_order_cmp(job->path, self->last_taken) < 0));
+}
+
+static gboolean get_first_job(gpointer key, gpointer value, gpointer data)
+{
+    *(prefetch_job_t * *)data = (prefetch_job_t *)value;
+
+    return TRUE;
+}
+
+static GCC_INLINE prefetch_job_t * dir_prefetcher_first_pending(
+    dir_prefetcher_t * const self
+)
+{
+    prefetch_job_t * ret = NULL;
+
+    g_tree_foreach(self->pending, get_first_job, &ret);
+
+    return ret;
+}
+
+/*
+ * Discards the jobs of the directories that the walk has passed.
+ * */
+static void dir_prefetcher_drop_stale(dir_prefetcher_t * const self)
+{
+    prefetch_job_t * job;
+
+    for (guint i = self->started->len ; i > 0 ; i--)
+    {
+        job = g_ptr_array_index(self->started, i-1);
+
+        if (is_stale(self, job))
+        {
+            dir_prefetcher_discard_job(self, job);
+        }
+    }
+
+    while ((job = dir_prefetcher_first_pending(self)) && is_stale(self, job))
+    {
+        dir_prefetcher_discard_job(self, job);
+    }
+
+    return;
+}
+
+/*
+ * Returns the job that the walker waits for, or else the next one in walk
+ * order if there is room for it.
+ * */
+static prefetch_job_t * dir_prefetcher_pop_job(dir_prefetcher_t * const self)
+{
+    prefetch_job_t * job = self->wanted;
+
+    if ((! job) || (job->state != JOB_PENDING))
+    {
+        if (self->num_ahead >= self->max_ahead)
+        {
+            return NULL;
+        }
+
+        if (! (job = dir_prefetcher_first_pending(self)))
+        {
+            return NULL;
+        }
+
+        job->is_ahead = TRUE;
+        self->num_ahead++;
+    }
+
+    g_tree_remove(self->pending, job->path);
+    g_ptr_array_add(self->started, job);
+
+    job->state = JOB_RUNNING;
+
+    return job;
+}
+
+typedef struct
+{
+    ino_t ino;
+    guint idx;
+} ino_order_type;
+
+static int ino_order_cmp(const void * a, const void * b)
+{
+    const ino_t a_ino = ((const ino_order_type *)a)->ino;
+    const ino_t b_ino = ((const ino_order_type *)b)->ino;
+
+    return ((a_ino < b_ino) ? -1 : (a_ino > b_ino) ? 1 : 0);
+}
+
+/*
+ * Reads path and stats its entries in ascending inode order. Runs without
+ * the lock.
+ * */
+static dir_prefetcher_listing_t * dir_prefetcher_read(
+    const gchar * const path,
+    const gboolean should_stat_dir
+)
+{
+    struct dirent * entry;
+    dir_prefetcher_listing_t * const listing =
+        g_new0(dir_prefetcher_listing_t, 1);
+
+    if (! listing)
+    {
+        return NULL;
+    }
+
+    if (! (listing->entries =
+                g_array_new(FALSE, FALSE, sizeof(dir_prefetcher_entry_t))))
+    {
+        g_free(listing);
+        return NULL;
+    }
+
+    DIR * const handle = opendir(path);
+
+    if (! handle)
+    {
+        return listing;
+    }
+
+    listing->opened = TRUE;
+
+    GArray * const order = g_array_new(FALSE, FALSE, sizeof(ino_order_type));
+
+    if (! order)
+    {
+        closedir(handle);
+        dir_prefetcher_listing_free(listing);
+        return NULL;
+    }
+
+    while ((entry = readdir(handle)))
+    {
+        if ((! strcmp(entry->d_name, ".")) || (! strcmp(entry->d_name, "..")))
+        {
+            continue;
+        }
+
+        dir_prefetcher_entry_t new_entry;
+        ino_order_type ino_order;
+
+        memset(&new_entry, '\0', sizeof(new_entry));
+
+        if (! (new_entry.name = g_strdup(entry->d_name)))
+        {
+            g_array_free(order, TRUE);
+            closedir(handle);
+            dir_prefetcher_listing_free(listing);
+            return NULL;
+        }
+
+        ino_order.ino = entry->d_ino;
+        ino_order.idx = listing->entries->len;
+
+        g_array_append_val(listing->entries, new_entry);
+        g_array_append_val(order, ino_order);
+    }
+
+    qsort(order->data, order->len, sizeof(ino_order_type), ino_order_cmp);
+
+    const int dir_fd = dirfd(handle);
+
+    if (should_stat_dir)
+    {
+        fstat(dir_fd, &(listing->dir_stat));
+    }
+
+    for (guint i = 0 ; i < order->len ; i++)
+    {
+        dir_prefetcher_entry_t * const e = &g_array_index(
+            listing->entries,
+            dir_prefetcher_entry_t,
+            g_array_index(order, ino_order_type, i).idx
+        );
+
+        e->stat_ok =
+            (fstatat(dir_fd, e->name, &(e->stat_ret), AT_SYMLINK_NOFOLLOW) == 0);
+    }
+
+    g_array_free(order, TRUE);
+    closedir(handle);
+
+    return listing;
+}
+
+static gint indirect_strcmp(gconstpointer a, gconstpointer b)
+{
+    return strcmp((*(const gchar * *)a), (*(const gchar * *)b));
+}
+
+/*
+ * Predicts that the subdirectories of job are entered next, in order.
+ * */
+static void dir_prefetcher_push_subdirs(
+    dir_prefetcher_t * const self,
+    prefetch_job_t * const job
+)
+{
+    GArray * const entries = job->listing->entries;
+    GPtrArray * const subdirs = g_ptr_array_new();
+
+    if (! subdirs)
+    {
+        return;
+    }
+
+    for (guint i = 0 ; i < entries->len ; i++)
+    {
+        const dir_prefetcher_entry_t * const e =
+            &g_array_index(entries, dir_prefetcher_entry_t, i);
+
+        if (e->stat_ok && S_ISDIR(e->stat_ret.st_mode)
+            && ((! self->should_enter)
+                || self->should_enter(
+                    &(job->listing->dir_stat),
+                    &(e->stat_ret),
+                    self->should_enter_context
+                )
+            )
+        )
+        {
+            g_ptr_array_add(subdirs, e->name);
+        }
+    }
+
+    g_ptr_array_sort(subdirs, indirect_strcmp);
+
+    for (guint i = subdirs->len ; i > 0 ; i--)
+    {
+        gchar * const path =
+            g_build_filename(job->path, g_ptr_array_index(subdirs, i-1), NULL);
+
+        if ((! path) || g_hash_table_contains(self->jobs, path))
+        {
+            g_free(path);
+            continue;
+        }
+
+        dir_prefetcher_add_job(self, path);
+    }
+
+    g_ptr_array_free(subdirs, TRUE);
+
+    return;
+}
+
+static gpointer dir_prefetcher_worker(gpointer data)
+{
+    dir_prefetcher_t * const self = (dir_prefetcher_t *)data;
+
+    g_mutex_lock(&(self->lock));
+
+    while (TRUE)
+    {
+        prefetch_job_t * job = NULL;
+
+        while ((! self->is_cancelled) && (! (job = dir_prefetcher_pop_job(self))))
+        {
+            g_cond_wait(&(self->cond), &(self->lock));
+        }
+
+        if (self->is_cancelled)
+        {
+            break;
+        }
+
+        g_mutex_unlock(&(self->lock));
+
+        dir_prefetcher_listing_t * const listing =
+            dir_prefetcher_read(job->path, (self->should_enter != NULL));
+
+        g_mutex_lock(&(self->lock));
+
+        job->listing = listing;
+        job->state = JOB_DONE;
+
+        if (job->is_dropped)
+        {
+            if (job->is_ahead)
+            {
+                self->num_ahead--;
+            }
+            prefetch_job_free(job);
+        }
+        else if (listing)
+        {
+            dir_prefetcher_push_subdirs(self, job);
+        }
+
+        g_cond_broadcast(&(self->cond));
+    }
+
+    g_mutex_unlock(&(self->lock));
+
+    return NULL;
+}
+
+dir_prefetcher_t * dir_prefetcher_new(
+    int num_dirs_ahead,
+    int num_threads,
+    dir_prefetcher_should_enter_t should_enter,
+    gpointer should_enter_context
+)
+{
+    dir_prefetcher_t * self;
+
+    if (! (self = g_new0(dir_prefetcher_t, 1)))
+    {
+        return NULL;
+    }
+
+    g_mutex_init(&(self->lock));
+    g_cond_init(&(self->cond));
+
+    self->max_ahead = num_dirs_ahead;
+    self->should_enter = should_enter;
+    self->should_enter_context = should_enter_context;
+
+    if (! (self->jobs = g_hash_table_new_full(
+                    g_str_hash, g_str_equal, NULL, prefetch_job_free)))
+    {
+        goto cleanup;
+    }
+
+    if (! (self->pending = g_tree_new((GCompareFunc)walk_order_cmp)))
+    {
+        goto cleanup;
+    }
+
+    if (! (self->started = g_ptr_array_new()))
+    {
+        goto cleanup;
+    }
+
+    if (! (self->threads = g_ptr_array_new()))
+    {
+        goto cleanup;
+    }
+
+    for (int i = 0 ; i < MAX(num_threads, 1) ; i++)
+    {
+        GThread * const thread = g_thread_try_new(
+            "filefind-prefetch", dir_prefetcher_worker, self, NULL
+        );
+
+        if (! thread)
+        {
+            goto cleanup;
+        }
+
+        g_ptr_array_add(self->threads, thread);
+    }
+
+    return self;
+
+cleanup:
+
+    dir_prefetcher_free(self);
+
+    return NULL;
+}
+
+dir_prefetcher_listing_t * dir_prefetcher_take(
+    dir_prefetcher_t * const self,
+    const gchar * const path,
+    gboolean * const was_ready
+)
+{
+    dir_prefetcher_listing_t * listing;
+
+    g_mutex_lock(&(self->lock));
+
+    g_free(self->last_taken);
+    self->last_taken = g_strdup(path);
+
+    dir_prefetcher_drop_stale(self);
+
+    prefetch_job_t * job = g_hash_table_lookup(self->jobs, path);
+
+    if (! job)
+    {
+        gchar * const path_copy = g_strdup(path);
+
+        if ((! path_copy) || (! (job = dir_prefetcher_add_job(self, path_copy))))
+        {
+            g_mutex_unlock(&(self->lock));
+            return NULL;
+        }
+    }
+
+    self->wanted = job;
+    *was_ready = (job->state == JOB_DONE);
+
+    g_cond_broadcast(&(self->cond));
+
+    while (job->state != JOB_DONE)
+    {
+        g_cond_wait(&(self->cond), &(self->lock));
+    }
+
+    listing = job->listing;
+    job->listing = NULL;
+
+    self->wanted = NULL;
+    dir_prefetcher_discard_job(self, job);
+
+    /* There is room for another directory ahead. */
+    g_cond_broadcast(&(self->cond));
+
+    g_mutex_unlock(&(self->lock));
+
+    return listing;
+}
+
+static GCC_INLINE gboolean is_below(
+    const gchar * const path,
+    const gchar * const dir,
+    const gsize dir_len
+)
+{
+    return ((! strncmp(path, dir, dir_len))
+        && path[dir_len]
+        && ((path[dir_len] == G_DIR_SEPARATOR)
+            || (dir_len && (dir[dir_len-1] == G_DIR_SEPARATOR))
+        )
+    );
+}
+
+typedef struct
+{
+    const gchar * dir;
+    gsize dir_len;
+    GPtrArray * below;
+} below_search_t;
+
+static gboolean collect_below(gpointer key, gpointer value, gpointer data)
+{
+    below_search_t * const search = (below_search_t *)data;
+
+    if (is_below((const gchar *)key, search->dir, search->dir_len))
+    {
+        g_ptr_array_add(search->below, value);
+    }
+
+    return FALSE;
+}
+
+void dir_prefetcher_drop_below(
+    dir_prefetcher_t * const self,
+    const gchar * const path
+)
+{
+    const gsize path_len = strlen(path);
+
+    g_mutex_lock(&(self->lock));
+
+    for (guint i = self->started->len ; i > 0 ; i--)
+    {
+        prefetch_job_t * const job = g_ptr_array_index(self->started, i-1);
+
+        if (is_below(job->path, path, path_len))
+        {
+            dir_prefetcher_discard_job(self, job);
+        }
+    }
+
+    GPtrArray * const below = g_ptr_array_new();
+
+    if (below)
+    {
+        below_search_t search;
+
+        search.dir = path;
+        search.dir_len = path_len;
+        search.below = below;
+
+        g_tree_foreach(self->pending, collect_below, &search);
+
+        for (guint i = 0 ; i < below->len ; i++)
+        {
+            dir_prefetcher_discard_job(self, g_ptr_array_index(below, i));
+        }
+
+        g_ptr_array_free(below, TRUE);
+    }
+
+    g_cond_broadcast(&(self->cond));
+
+    g_mutex_unlock(&(self->lock));
+
+    return;
+}
+
+void dir_prefetcher_reset(dir_prefetcher_t * const self)
+{
+    g_mutex_lock(&(self->lock));
+
+    while (self->started->len)
+    {
+        dir_prefetcher_discard_job(
+            self, g_ptr_array_index(self->started, self->started->len-1)
+        );
+    }
+
+    prefetch_job_t * job;
+
+    while ((job = dir_prefetcher_first_pending(self)))
+    {
+        dir_prefetcher_discard_job(self, job);
+    }
+
+    g_free(self->last_taken);
+    self->last_taken = NULL;
+
+    g_cond_broadcast(&(self->cond));
+
+    g_mutex_unlock(&(self->lock));
+
+    return;
+}
+
+void dir_prefetcher_listing_free(dir_prefetcher_listing_t * const listing)
+{
+    for (guint i = 0 ; i < listing->entries->len ; i++)
+    {
+        g_free(g_array_index(listing->entries, dir_prefetcher_entry_t, i).name);
+    }
+
+    g_array_free(listing->entries, TRUE);
+    g_free(listing);
+
+    return;
+}
+
+void dir_prefetcher_free(dir_prefetcher_t * const self)
+{
+    g_mutex_lock(&(self->lock));
+    self->is_cancelled = TRUE;
+    g_cond_broadcast(&(self->cond));
+    g_mutex_unlock(&(self->lock));
+
+    if (self->threads)
+    {
+        /* The workers finish the directory that they are reading. */
+        for (guint i = 0 ; i < self->threads->len ; i++)
+        {
+            g_thread_join(g_ptr_array_index(self->threads, i));
+        }
+        g_ptr_array_free(self->threads, TRUE);
+    }
+
+    if (self->started)
+    {
+        g_ptr_array_free(self->started, TRUE);
+    }
+
+    if (self->pending)
+    {
+        g_tree_destroy(self->pending);
+    }
+
+    if (self->jobs)
+    {
+        g_hash_table_destroy(self->jobs);
+    }
+
+    g_free(self->last_taken);
+
+    g_mutex_clear(&(self->lock));
+    g_cond_clear(&(self->cond));
+
+    g_free(self);
+
+    return;
+}
+
+#endif /* #ifdef G_OS_UNIX */
@@ -0,0 +1,106 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  dir_prefetcher.h
+ *
+ *    Description:  lists and stats the directories that a serial walk is
+ *                  about to enter on helper threads. Internal to
+ *                  libfilefind.
+ *
+ *        Created:  19/10/26 18:21:44
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_DIR_PREFETCHER_H
+#define FILEFIND_DIR_PREFETCHER_H
+
+#include <glib.h>
+
+#ifdef G_OS_UNIX
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+typedef struct
+{
+    gchar * name;
+    gboolean stat_ok;
+    struct stat stat_ret;
+} dir_prefetcher_entry_t;
+
+typedef struct
+{
+    /* FALSE if the directory could not be opened. */
+    gboolean opened;
+    /* Of dir_prefetcher_entry_t, in the order readdir() returned them. */
+    GArray * entries;
+    /* The fstat() of the directory itself. Only filled for should_enter. */
+    struct stat dir_stat;
+} dir_prefetcher_listing_t;
+
+/*
+ * Decides whether the subdirectory whose lstat() is subdir_stat, of the
+ * directory whose fstat() is dir_stat, is predicted to be entered. It is
+ * called on the helper threads.
+ * */
+typedef gboolean (*dir_prefetcher_should_enter_t)(
+    const struct stat * dir_stat,
+    const struct stat * subdir_stat,
+    gpointer context
+);
+
+/*
+ * The walk is predicted to be a pre-order traversal in which the
+ * subdirectories of every directory are entered in strcmp() order, which is
+ * what a sorted walk does. Every directory that the walker takes seeds the
+ * prediction with its subdirectories, and at most num_dirs_ahead
+ * directories that were not asked for yet are listed in advance.
+ * should_enter may be NULL, in which case every subdirectory is.
+ * */
+typedef struct dir_prefetcher_struct dir_prefetcher_t;
+
+extern dir_prefetcher_t * dir_prefetcher_new(
+    int num_dirs_ahead,
+    int num_threads,
+    dir_prefetcher_should_enter_t should_enter,
+    gpointer should_enter_context
+);
+
+/*
+ * Returns the listing of path, waiting for it to be read if it was not
+ * prefetched yet. Listings of directories that the walk has passed without
+ * entering are discarded. Sets *was_ready if the listing was complete
+ * before the call. Returns NULL if out of memory.
+ * */
+extern dir_prefetcher_listing_t * dir_prefetcher_take(
+    dir_prefetcher_t * self,
+    const gchar * path,
+    gboolean * was_ready
+);
+
+/*
+ * Discards the prefetched directories below path, for when the walker
+ * changed its plans for them.
+ * */
+extern void dir_prefetcher_drop_below(
+    dir_prefetcher_t * self,
+    const gchar * path
+);
+
+/*
+ * Discards everything, for when the walker moves to another target.
+ * */
+extern void dir_prefetcher_reset(dir_prefetcher_t * self);
+
+extern void dir_prefetcher_listing_free(dir_prefetcher_listing_t * listing);
+
+extern void dir_prefetcher_free(dir_prefetcher_t * self);
+
+#endif /* #ifdef G_OS_UNIX */
+
+#endif /* #ifndef FILEFIND_DIR_PREFETCHER_H */
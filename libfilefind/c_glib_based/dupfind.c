@@ -0,0 +1,515 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  dupfind.c
+ *
+ *    Description:  duplicate-files detection stage of libfilefind.
+ *
+ *        Created:  19/10/26 10:12:41
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dupfind.h"
+
+/*
+ * GLib does not ship BLAKE3 or xxHash, so we use its fastest checksum which
+ * is still collision-safe. The size and prefix steps make sure that only
+ * likely duplicates are hashed in full.
+ * */
+#define DUPS_CHECKSUM_TYPE G_CHECKSUM_SHA256
+
+#define DUPS_READ_BUFFER_SIZE (1024 * 1024)
+
+typedef struct
+{
+    gchar * path;
+    guint64 size;
+} dups_candidate_t;
+
+struct dups_finder_struct
+{
+    GMutex lock;
+    /* size -> GPtrArray of owned candidates. */
+    GHashTable * by_size;
+    /* "size:prefix_digest" -> GPtrArray of borrowed candidates. */
+    GHashTable * by_prefix;
+    /* "size:digest" -> GPtrArray of borrowed candidates. */
+    GHashTable * by_digest;
+    GThreadPool * prefix_pool;
+    GThreadPool * digest_pool;
+    gboolean finished;
+};
+
+typedef struct dups_finder_struct dups_finder_t;
+
+static GPrivate read_buffer_key = G_PRIVATE_INIT(g_free);
+
+static void dups_candidate_free(gpointer data)
+{
+    dups_candidate_t * const candidate = (dups_candidate_t *)data;
+
+    g_free(candidate->path);
+    g_free(candidate);
+
+    return;
+}
+
+static void dups_bucket_free(gpointer data)
+{
+    g_ptr_array_free((GPtrArray *)data, TRUE);
+
+    return;
+}
+
+/*
+ * Pushes the candidates of bucket that were not dispatched yet. Buckets with
+ * a single candidate are not dispatched at all.
+ * */
+static void dups_bucket_dispatch(GPtrArray * const bucket, GThreadPool * const pool)
+{
+    if (bucket->len == 2)
+    {
+        g_thread_pool_push(pool, g_ptr_array_index(bucket, 0), NULL);
+        g_thread_pool_push(pool, g_ptr_array_index(bucket, 1), NULL);
+    }
+    else if (bucket->len > 2)
+    {
+        g_thread_pool_push(pool, g_ptr_array_index(bucket, bucket->len-1), NULL);
+    }
+
+    return;
+}
+
+/*
+ * Must be called with self->lock held. Takes ownership of key.
+ * */
+static void dups_bucket_add(
+    GHashTable * const table,
+    gchar * const key,
+    dups_candidate_t * const candidate,
+    GThreadPool * const pool
+)
+{
+    GPtrArray * bucket = g_hash_table_lookup(table, key);
+
+    if (bucket)
+    {
+        g_free(key);
+    }
+    else
+    {
+        bucket = g_ptr_array_new();
+        g_hash_table_insert(table, key, bucket);
+    }
+
+    g_ptr_array_add(bucket, candidate);
+
+    if (pool)
+    {
+        dups_bucket_dispatch(bucket, pool);
+    }
+
+    return;
+}
+
+static guint8 * dups_get_read_buffer(void)
+{
+    guint8 * buffer = g_private_get(&read_buffer_key);
+
+    if (! buffer)
+    {
+        buffer = g_malloc(DUPS_READ_BUFFER_SIZE);
+        g_private_set(&read_buffer_key, buffer);
+    }
+
+    return buffer;
+}
+
+/*
+ * Returns the hex digest of the first len bytes of path, or NULL if the file
+ * could not be read or became shorter than len.
+ * */
+static gchar * dups_hash_file(const gchar * const path, const guint64 len)
+{
+    guint8 * const buffer = dups_get_read_buffer();
+    guint64 remaining = len;
+    gchar * ret = NULL;
+
+    const int fd = g_open(path, O_RDONLY, 0);
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (len > FILE_FIND_DUPS_PREFIX_SIZE)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
+    GChecksum * const checksum = g_checksum_new(DUPS_CHECKSUM_TYPE);
+
+    while (remaining > 0)
+    {
+        const ssize_t num_read =
+            read(fd, buffer, MIN(remaining, DUPS_READ_BUFFER_SIZE));
+
+        if (num_read < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        else if (num_read == 0)
+        {
+            break;
+        }
+
+        g_checksum_update(checksum, buffer, num_read);
+        remaining -= num_read;
+    }
+
+    close(fd);
+
+    if (remaining == 0)
+    {
+        ret = g_strdup(g_checksum_get_string(checksum));
+    }
+
+    g_checksum_free(checksum);
+
+    return ret;
+}
+
+static gchar * dups_calc_key(const guint64 size, gchar * const digest)
+{
+    gchar * const key = g_strdup_printf("%" G_GUINT64_FORMAT ":%s", size, digest);
+
+    g_free(digest);
+
+    return key;
+}
+
+static void dups_prefix_worker(gpointer data, gpointer user_data)
+{
+    dups_candidate_t * const candidate = (dups_candidate_t *)data;
+    dups_finder_t * const self = (dups_finder_t *)user_data;
+
+    /* For small files the prefix is the entire file. */
+    const gboolean is_whole = (candidate->size <= FILE_FIND_DUPS_PREFIX_SIZE);
+
+    gchar * const digest = dups_hash_file(
+        candidate->path,
+        is_whole ? candidate->size : FILE_FIND_DUPS_PREFIX_SIZE
+    );
+
+    if (! digest)
+    {
+        return;
+    }
+
+    gchar * const key = dups_calc_key(candidate->size, digest);
+
+    g_mutex_lock(&(self->lock));
+
+    if (is_whole)
+    {
+        dups_bucket_add(self->by_digest, key, candidate, NULL);
+    }
+    else
+    {
+        dups_bucket_add(self->by_prefix, key, candidate, self->digest_pool);
+    }
+
+    g_mutex_unlock(&(self->lock));
+
+    return;
+}
+
+static void dups_digest_worker(gpointer data, gpointer user_data)
+{
+    dups_candidate_t * const candidate = (dups_candidate_t *)data;
+    dups_finder_t * const self = (dups_finder_t *)user_data;
+
+    gchar * const digest = dups_hash_file(candidate->path, candidate->size);
+
+    if (! digest)
+    {
+        return;
+    }
+
+    gchar * const key = dups_calc_key(candidate->size, digest);
+
+    g_mutex_lock(&(self->lock));
+    dups_bucket_add(self->by_digest, key, candidate, NULL);
+    g_mutex_unlock(&(self->lock));
+
+    return;
+}
+
+int file_find_dups_new(
+    file_find_dups_handle_t * * output_handle,
+    int num_threads
+)
+{
+    dups_finder_t * self;
+
+    *output_handle = NULL;
+
+    if (! (self = g_new0(dups_finder_t, 1)))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    if (num_threads <= 0)
+    {
+        num_threads = g_get_num_processors();
+    }
+
+    g_mutex_init(&(self->lock));
+
+    self->by_size = g_hash_table_new_full(
+        g_int64_hash, g_int64_equal, g_free, dups_bucket_free
+    );
+    self->by_prefix = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, dups_bucket_free
+    );
+    self->by_digest = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, dups_bucket_free
+    );
+
+    self->prefix_pool = g_thread_pool_new(
+        dups_prefix_worker, self, num_threads, FALSE, NULL
+    );
+    self->digest_pool = g_thread_pool_new(
+        dups_digest_worker, self, num_threads, FALSE, NULL
+    );
+
+    if (! (self->prefix_pool && self->digest_pool))
+    {
+        file_find_dups_free((file_find_dups_handle_t *)self);
+
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    self->finished = FALSE;
+
+    *output_handle = (file_find_dups_handle_t *)self;
+
+    return FILE_FIND_OK;
+}
+
+int file_find_dups_add(
+    file_find_dups_handle_t * handle,
+    const char * path,
+    unsigned long long size
+)
+{
+    dups_finder_t * const self = (dups_finder_t *)handle;
+    dups_candidate_t * candidate;
+
+    g_assert(! self->finished);
+
+    /* Empty files are trivially identical and are not reported. */
+    if (size == 0)
+    {
+        return FILE_FIND_OK;
+    }
+
+    if (! (candidate = g_new0(dups_candidate_t, 1)))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    if (! (candidate->path = g_strdup(path)))
+    {
+        g_free(candidate);
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+    candidate->size = size;
+
+    g_mutex_lock(&(self->lock));
+
+    GPtrArray * bucket = g_hash_table_lookup(self->by_size, &(candidate->size));
+
+    if (! bucket)
+    {
+        bucket = g_ptr_array_new_with_free_func(dups_candidate_free);
+        g_hash_table_insert(
+            self->by_size,
+            g_memdup2(&(candidate->size), sizeof(candidate->size)),
+            bucket
+        );
+    }
+
+    g_ptr_array_add(bucket, candidate);
+    dups_bucket_dispatch(bucket, self->prefix_pool);
+
+    g_mutex_unlock(&(self->lock));
+
+    return FILE_FIND_OK;
+}
+
+int file_find_dups_add_current(
+    file_find_dups_handle_t * handle,
+    file_find_handle_t * finder
+)
+{
+    const struct stat * const st = file_find_get_stat(finder);
+
+    if ((! st) || (! S_ISREG(st->st_mode)))
+    {
+        return FILE_FIND_OK;
+    }
+
+    return file_find_dups_add(handle, file_find_get_path(finder), st->st_size);
+}
+
+static gint indirect_path_compare(gconstpointer a, gconstpointer b)
+{
+    return g_strcmp0(
+        (*(dups_candidate_t * const *)a)->path,
+        (*(dups_candidate_t * const *)b)->path
+    );
+}
+
+static gint indirect_group_compare(gconstpointer a, gconstpointer b)
+{
+    GPtrArray * const a_group = *(GPtrArray * const *)a;
+    GPtrArray * const b_group = *(GPtrArray * const *)b;
+
+    return g_strcmp0(
+        ((dups_candidate_t *)g_ptr_array_index(a_group, 0))->path,
+        ((dups_candidate_t *)g_ptr_array_index(b_group, 0))->path
+    );
+}
+
+int file_find_dups_finish(
+    file_find_dups_handle_t * handle,
+    file_find_dups_group_callback_t callback,
+    void * context
+)
+{
+    dups_finder_t * const self = (dups_finder_t *)handle;
+    GHashTableIter iter;
+    gpointer bucket;
+
+    g_assert(! self->finished);
+    self->finished = TRUE;
+
+    /*
+     * The prefix workers feed the digest pool, so the prefix pool must be
+     * drained first.
+     * */
+    g_thread_pool_free(self->prefix_pool, FALSE, TRUE);
+    self->prefix_pool = NULL;
+    g_thread_pool_free(self->digest_pool, FALSE, TRUE);
+    self->digest_pool = NULL;
+
+    GPtrArray * const groups = g_ptr_array_new();
+    GPtrArray * const paths = g_ptr_array_new();
+
+    if (! (groups && paths))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    g_hash_table_iter_init(&iter, self->by_digest);
+    while (g_hash_table_iter_next(&iter, NULL, &bucket))
+    {
+        if (((GPtrArray *)bucket)->len >= 2)
+        {
+            g_ptr_array_sort((GPtrArray *)bucket, indirect_path_compare);
+            g_ptr_array_add(groups, bucket);
+        }
+    }
+
+    g_ptr_array_sort(groups, indirect_group_compare);
+
+    for (guint group_idx = 0 ; group_idx < groups->len ; group_idx++)
+    {
+        GPtrArray * const group = g_ptr_array_index(groups, group_idx);
+
+        g_ptr_array_set_size(paths, 0);
+        for (guint i = 0 ; i < group->len ; i++)
+        {
+            g_ptr_array_add(
+                paths,
+                ((dups_candidate_t *)g_ptr_array_index(group, i))->path
+            );
+        }
+
+        callback(
+            paths->len,
+            (const char * const *)paths->pdata,
+            ((dups_candidate_t *)g_ptr_array_index(group, 0))->size,
+            context
+        );
+    }
+
+    g_ptr_array_free(paths, TRUE);
+    g_ptr_array_free(groups, TRUE);
+
+    return FILE_FIND_OK;
+}
+
+int file_find_dups_free(
+    file_find_dups_handle_t * handle
+)
+{
+    dups_finder_t * const self = (dups_finder_t *)handle;
+
+    /* Abandon the queued work if file_find_dups_finish() was not called. */
+    if (self->prefix_pool)
+    {
+        g_thread_pool_free(self->prefix_pool, TRUE, TRUE);
+        self->prefix_pool = NULL;
+    }
+
+    if (self->digest_pool)
+    {
+        g_thread_pool_free(self->digest_pool, TRUE, TRUE);
+        self->digest_pool = NULL;
+    }
+
+    /* The other tables only borrow the candidates owned by by_size. */
+    if (self->by_digest)
+    {
+        g_hash_table_destroy(self->by_digest);
+        self->by_digest = NULL;
+    }
+
+    if (self->by_prefix)
+    {
+        g_hash_table_destroy(self->by_prefix);
+        self->by_prefix = NULL;
+    }
+
+    if (self->by_size)
+    {
+        g_hash_table_destroy(self->by_size);
+        self->by_size = NULL;
+    }
+
+    g_mutex_clear(&(self->lock));
+
+    g_free(self);
+
+    return FILE_FIND_OK;
+}
@@ -0,0 +1,88 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  dupfind.h
+ *
+ *    Description:  duplicate-files detection stage of libfilefind.
+ *
+ *        Created:  19/10/26 10:12:41
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_DUPFIND_H
+#define FILEFIND_DUPFIND_H
+
+#include "filefind.h"
+
+/*
+ * The duplicates finder works in three steps:
+ *
+ * 1. Candidates are grouped by their size.
+ * 2. As soon as a size has at least two candidates, the first
+ * FILE_FIND_DUPS_PREFIX_SIZE bytes of them are hashed.
+ * 3. Candidates sharing both size and prefix hash are fully hashed.
+ *
+ * The hashing is done by a thread pool while the candidates are still being
+ * added, so it overlaps with the traversal.
+ * */
+
+#define FILE_FIND_DUPS_PREFIX_SIZE 4096
+
+typedef struct
+{
+    int stub;
+} file_find_dups_handle_t;
+
+/*
+ * Called once for every group of identical files. The paths are sorted
+ * and are only valid during the call.
+ * */
+typedef void (*file_find_dups_group_callback_t)(
+    int num_paths,
+    const char * const * paths,
+    unsigned long long size,
+    void * context
+);
+
+/*
+ * num_threads <= 0 means one thread per processor.
+ * */
+extern int file_find_dups_new(
+    file_find_dups_handle_t * * output_handle,
+    int num_threads
+);
+
+extern int file_find_dups_add(
+    file_find_dups_handle_t * handle,
+    const char * path,
+    unsigned long long size
+);
+
+/*
+ * Adds the current item of finder if it is a regular file.
+ * */
+extern int file_find_dups_add_current(
+    file_find_dups_handle_t * handle,
+    file_find_handle_t * finder
+);
+
+/*
+ * Waits for the hashing to complete and reports the duplicate groups in
+ * sorted order. No files may be added afterwards.
+ * */
+extern int file_find_dups_finish(
+    file_find_dups_handle_t * handle,
+    file_find_dups_group_callback_t callback,
+    void * context
+);
+
+extern int file_find_dups_free(
+    file_find_dups_handle_t * handle
+);
+
+#endif /* #ifndef FILEFIND_DUPFIND_H */
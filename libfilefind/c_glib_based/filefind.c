@@ -35,16 +35,32 @@ http://www.perlfoundation.org/legal/licenses/artistic-2_0.html
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <time.h>
+
+#ifdef G_OS_UNIX
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#endif
 
 #include "inline.h"
 
 #include "filefind.h"
+#include "dir_frontier.h"
+#include "dir_prefetcher.h"
+#include "findarchive.h"
+#include "findbackend.h"
+#include "inode_set.h"
+#include "listing_spill.h"
+#include "mount_table.h"
+#include "roots_scanner.h"
 
 enum
 {
     ACTION_RUN_CB = 0,
     ACTION_SET_OBJ,
     ACTION_RECURSE,
+    ACTION_NONE,
 };
 
 #ifdef G_OS_WIN32
@@ -67,19 +83,63 @@ enum FILEFIND_STATUS
 
 struct file_finder_struct;
 
+/*
+ * The stat of a directory entry that was taken while listing the directory.
+ * See file_find_set_should_stat_in_inode_order().
+ * */
+typedef struct
+{
+    ino_t ino;
+    /* Borrowed from the files of the component. */
+    const gchar * name;
+    gboolean stat_ok;
+    my_stat_type stat_ret;
+} entry_stat_type;
+
 #define NUM_ACTIONS 2
 struct path_component_struct
 {
     gint actions[NUM_ACTIONS];
     gint next_action_idx;
+    /* A view of curr_file_buf. */
     gchar * curr_file;
+    GString * curr_file_buf;
     GPtrArray * files;
     gchar * last_dir_scanned;
     gboolean open_dir_ret;
     my_stat_type stat_ret;
+    /*
+     * The identity of the directory, which for a followed symbolic link is
+     * that of its target rather than of stat_ret.
+     * */
+    dev_t dir_dev;
+    ino_t dir_ino;
     GPtrArray * traverse_to;
     gint next_traverse_to_idx;
+    /*
+     * Whether traverse_to was replaced by file_find_set_traverse_to(), so
+     * it is no longer the listing of the directory.
+     * */
+    gboolean is_traverse_to_set;
     GTree * inodes;
+    /* When stat()ing in inode order: the stats of the files by their name. */
+    entry_stat_type * entry_stats;
+    GHashTable * entry_stats_by_name;
+    /*
+     * Set instead of files when the listing is streamed (in unsorted mode)
+     * or spilled (when over max_listing_bytes). stream is a directory of
+     * the backend of the finder.
+     * */
+    void * stream;
+    listing_spill_t * spill;
+    gboolean spill_failed;
+    /* The bytes held by files, traverse_to and the entry stats. */
+    guint64 files_bytes;
+    guint64 traverse_to_bytes;
+    /* The du totals of the entries inside this directory. */
+    guint64 du_blocks;
+    guint64 du_size;
+    guint64 du_num_entries;
     status_type (*move_next)(
         struct path_component_struct * self,
         struct file_finder_struct * top
@@ -88,30 +148,62 @@ struct path_component_struct
 
 typedef struct path_component_struct path_component_type;
 
+/*
+ * An item returned by the finder. For the current item, the fields are views
+ * into the state of the finder that are valid until the next call to
+ * file_find_next(), so returning it costs no allocations. Detached items own
+ * copies of everything.
+ * */
 typedef struct
 {
-    gchar * path;
-    gchar * basename;
-    GPtrArray * dir_components;
-    gchar * base;
-    my_stat_type stat_ret;
-    gboolean is_file;
+    /* NULL for detached items. */
+    struct file_finder_struct * finder;
+    const gchar * path;
+    const my_stat_type * stat_ret;
+    /* base, basename and dir_components are NULL for parallel scans. */
+    const gchar * base;
+    const gchar * basename;
+    const gchar * const * dir_components;
+    gint num_dir_components;
     gboolean is_dir;
     gboolean is_link;
+    /* -1 until it is asked for. */
+    gint is_file;
+    /* See FILE_FIND_HARD_LINKS_FLAG. */
+    gboolean is_dup_link;
+    /* See file_find_set_archives(). */
+    gboolean is_archive_member;
+    /* The storage of detached items. */
+    my_stat_type detached_stat;
 } item_result_type;
 
 struct file_finder_struct
 {
+    /* See file_find_new_with_backend(). */
+    const file_find_backend_t * backend;
     my_stat_type top_stat;
+    /*
+     * The identity of the directory that curr_path resolves to: that of
+     * top_stat, or of the target of a symbolic link. 0 if there is none.
+     * */
+    dev_t top_dir_dev;
+    ino_t top_dir_ino;
     GPtrArray * dir_stack;
-    /* TODO : make curr_comps with GDestroyNotify of g_free. */
+    /*
+     * Views of the curr_file of the components on dir_stack (and "" for a
+     * component that did not move yet), so they are not freed.
+     * */
     GPtrArray * curr_comps;
     dev_t dev;
     path_component_type * current;
+    /* A view of curr_path_buf, which is reused for every item. */
     gchar * curr_path;
+    GString * curr_path_buf;
     /* The default actions. */
     gint def_actions[2];
+    /* NULL, or &item when there is a current item. */
     item_result_type * item_obj;
+    item_result_type item;
     int target_index;
     GPtrArray * targets;
     gboolean top_is_dir;
@@ -124,21 +216,151 @@ struct file_finder_struct
     void * filter_context;
     /* This is 'followlink' from File-Find-Object. */
     gboolean should_follow_link;
+    /* The targets of the symbolic links, by the identity of the link. */
+    GHashTable * link_cache;
+
+    /* See file_find_set_should_enter_dirs_once(). */
+    gboolean should_enter_dirs_once;
+    inode_set_t * entered_dirs;
 
     /* This is ->nocrossfs() from File-Find-Object. */
     gboolean should_not_cross_fs;
+
+    /* See file_find_set_skip_fs_types(). NULL-terminated, or NULL. */
+    gchar * * skip_fs_types;
+
+    /*
+     * Read once when there is a mount policy, and borrowed by the finders
+     * of the roots of a parallel scan.
+     * */
+    mount_table_t * mount_table;
+    gboolean owns_mount_table;
+    /*
+     * The realpath() of the current target, if its file system is mounted
+     * more than once, or NULL.
+     * */
+    gchar * target_real_path;
+    GString * mount_path_buf;
+
+    /* Whether to sort the directory listings lexicographically. */
+    gboolean should_sort;
+
+    /* See file_find_set_should_stat_in_inode_order(). */
+    gboolean should_stat_in_inode_order;
+
+    /* See file_find_set_max_listing_bytes(). 0 means unlimited. */
+    guint64 max_listing_bytes;
+
+    /* See file_find_set_prefetch(). */
+    int prefetch_num_dirs;
+    int prefetch_num_threads;
+#ifdef G_OS_UNIX
+    dir_prefetcher_t * prefetcher;
+#endif
+
+    void (*du_callback)(const file_find_du_record_t * record, void * context);
+    void * du_context;
+    /* The inodes of the multiply-linked files that were already counted. */
+    inode_set_t * du_seen_links;
+
+    /* See file_find_set_hard_links(). */
+    int hard_links_mode;
+    /* The inodes of the multiply-linked files that were already returned. */
+    inode_set_t * seen_hard_links;
+    /* Whether the current item is a later link of one of them. */
+    gboolean top_is_dup_link;
+
+    /* See file_find_set_shard(). num_shards is 0 when not sharding. */
+    int shard_index;
+    int num_shards;
+    int shard_depth;
+    /*
+     * The shards of the subtrees that were given costs, by their path
+     * relative to the target. Borrowed by the finders of the roots of a
+     * parallel scan.
+     * */
+    GHashTable * shard_owners;
+    gboolean owns_shard_owners;
+    GString * shard_path_buf;
+    /*
+     * Whether the current item is a directory above the shard depth, which
+     * is entered by every shard but only returned by shard 0.
+     * */
+    gboolean top_is_shared_dir;
+
+    /*
+     * See file_find_set_best_first() and file_find_set_breadth_first().
+     * frontier holds the directories that are still to be entered, and
+     * frontier_current is the one whose listing is walked, or NULL for
+     * that of the target.
+     * */
+    double (*dir_score)(const file_find_item_t * item, void * context);
+    void * dir_score_context;
+    gboolean is_breadth_first;
+    guint64 max_frontier_bytes;
+    dir_frontier_t * frontier;
+    dir_frontier_node_t * frontier_current;
+
+    /*
+     * See file_find_set_archives(). is_archive_pending is set while the
+     * current item is an archive that is entered by the next
+     * file_find_next(), and archive is the one whose members are returned.
+     * */
+    gboolean should_enter_archives;
+    gboolean is_archive_pending;
+    file_find_archive_t * archive;
+    /* The path of the archive, followed by that of the current member. */
+    GString * archive_path_buf;
+    gsize archive_path_len;
+    /*
+     * The dir_components of the members: those of the archive, which are
+     * views into curr_comps, and then views into archive_comps_buf.
+     * */
+    GPtrArray * archive_comps;
+    guint archive_num_outer_comps;
+    GString * archive_comps_buf;
+    /* The directories of the archive that file_find_prune() skips. */
+    GHashTable * pruned_archive_dirs;
+
+    /* See file_find_set_parallel_roots(). */
+    gboolean should_scan_roots_in_parallel;
+    int num_root_threads;
+    gboolean roots_in_target_order;
+    roots_scanner_t * roots_scanner;
+
+    file_find_stats_t stats;
+    /* When file_find_next() last returned an item to the consumer. */
+    guint64 consumer_start_time;
 };
 
 typedef struct file_finder_struct file_finder_t;
 
-static void item_result_free(item_result_type * item);
-
 static GCC_INLINE void free_item_obj(file_finder_t * self)
 {
-    if (self->item_obj)
+    self->item_obj = NULL;
+
+    return;
+}
+
+static GCC_INLINE guint64 path_component_listing_bytes(
+    path_component_type * const self
+)
+{
+    return (self->files_bytes + self->traverse_to_bytes);
+}
+
+static GCC_INLINE void file_finder_add_listing_bytes(
+    file_finder_t * const self,
+    const guint64 old_bytes,
+    const guint64 new_bytes
+)
+{
+    self->stats.listing_bytes -= old_bytes;
+    self->stats.listing_bytes += new_bytes;
+
+    if (self->stats.listing_bytes > self->stats.peak_listing_bytes)
     {
-        item_result_free(self->item_obj);
-        self->item_obj = NULL;
+        self->stats.peak_listing_bytes = self->stats.listing_bytes;
     }
 
     return;
@@ -202,12 +424,12 @@ static GPtrArray * path_component_traverse_to_copy(path_component_type * self)
 
 static GCC_INLINE dev_t path_component_get_dev(path_component_type * self)
 {
-    return self->stat_ret.st_dev;
+    return self->dir_dev;
 }
 
 static GCC_INLINE ino_t path_component_get_inode(path_component_type * self)
 {
-    return self->stat_ret.st_ino;
+    return self->dir_ino;
 }
 
 #if 0
@@ -222,6 +444,28 @@ static gboolean path_component_is_same_inode(path_component_type * self, my_stat
 }
 #endif
 
+/*
+ * Returns a monotonic timestamp in nanoseconds. On Linux this is a vDSO call
+ * that does not enter the kernel, so it is cheap enough to be always on.
+ * */
+static GCC_INLINE guint64 stats_now(void)
+{
+#ifdef G_OS_UNIX
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (((guint64)ts.tv_sec) * 1000000000 + ts.tv_nsec);
+#else
+    return (((guint64)g_get_monotonic_time()) * 1000);
+#endif
+}
+
+static GCC_INLINE guint64 string_array_entry_bytes(const gchar * const string)
+{
+    return (sizeof(gpointer) + strlen(string) + 1);
+}
+
 static gboolean path_component_should_scan_dir(
     path_component_type * self,
     gchar * dir_str)
@@ -248,483 +492,689 @@ gint indirect_lexic_compare(
     return g_strcmp0((*(const gchar * *)a), (*(const gchar * *)b));
 }
 
-static status_type path_component_calc_dir_files(
-    path_component_type * self,
-    gchar * dir_str)
+static void path_component_free_entry_stats(path_component_type * const self)
 {
-    GError * error;
-
-    GPtrArray *const files = g_ptr_array_new();
+    if (self->entry_stats_by_name)
+    {
+        g_hash_table_destroy(self->entry_stats_by_name);
+        self->entry_stats_by_name = NULL;
+    }
 
-    if (! files)
+    if (self->entry_stats)
     {
-        return FILEFIND_STATUS_OUT_OF_MEM;
+        g_free(self->entry_stats);
+        self->entry_stats = NULL;
     }
 
-    GDir * const handle = g_dir_open(dir_str, 0, &error);
+    return;
+}
+
+static void string_array_free(GPtrArray * arr);
+
+/*
+ * Opening a directory stream per level could run out of file descriptors
+ * in deep trees, so above this many open streams the listings are read
+ * into memory.
+ * */
+#define MAX_OPEN_STREAMS 64
 
-    if (! handle)
+static void path_component_close_listing(
+    path_component_type * const self,
+    file_finder_t * const top)
+{
+    if (self->stream)
     {
-        /* Handle this error gracefully. */
-        self->files = files;
-        return FILEFIND_STATUS_OK;
+        top->backend->closedir(top->backend->context, self->stream);
+        self->stream = NULL;
     }
-    else
+
+    if (self->spill)
     {
-        const gchar * filename;
-        while ((filename = g_dir_read_name(handle)))
-        {
-            gchar * const fn_copy = g_strdup(filename);
-            if (!fn_copy)
-            {
-                for (int prev_i = 0 ; prev_i < files->len ; ++prev_i)
-                {
-                    g_free(g_ptr_array_index(files, prev_i));
-                }
-                g_ptr_array_free(files, TRUE);
-                return FILEFIND_STATUS_OUT_OF_MEM;
-            }
-            g_ptr_array_add(files, fn_copy);
-        }
+        listing_spill_free(self->spill);
+        self->spill = NULL;
+    }
 
-        g_dir_close(handle);
+    self->spill_failed = FALSE;
 
-#if 1
-        g_ptr_array_sort(files, indirect_lexic_compare);
-#endif
+    return;
+}
 
-        self->files = files;
+static guint file_finder_count_open_streams(file_finder_t * const top)
+{
+    guint ret = 0;
 
-        return FILEFIND_STATUS_OK;
+    for (guint i = 0 ; i < top->dir_stack->len ; i++)
+    {
+        if (((path_component_type *)g_ptr_array_index(top->dir_stack, i))->stream)
+        {
+            ret++;
+        }
     }
+
+    return ret;
 }
 
-static status_type path_component_set_up_dir(
-    path_component_type *const self,
-    gchar *const dir_str)
+/*
+ * Writes the names read so far as a sorted run to the spill file, and
+ * frees them. If the spill fails, the names are kept in memory instead.
+ * */
+static void path_component_spill_files(
+    path_component_type * const self,
+    GPtrArray * const files,
+    file_finder_t * const top)
 {
-    if (self->files)
-    {
-        string_array_free(self->files);
-        self->files = NULL;
-    }
+    file_find_stats_t * const stats = &(top->stats);
 
-    const status_type ret = path_component_calc_dir_files(self, dir_str);
-    if (ret)
+    if ((! self->spill) && (! (self->spill = listing_spill_new())))
     {
-        return ret;
+        self->spill_failed = TRUE;
+        return;
     }
 
-    if (self->traverse_to)
+    const guint64 start_time = stats_now();
+
+    g_ptr_array_sort(files, indirect_lexic_compare);
+
+    stats->num_sort++;
+    stats->sort_ns += stats_now() - start_time;
+
+    if (! listing_spill_add_run(self->spill, files))
     {
-        string_array_free (self->traverse_to);
-        self->traverse_to = NULL;
+        self->spill_failed = TRUE;
+        return;
     }
 
-    if (! (self->traverse_to = path_component_files_copy(self)))
+    stats->num_spilled_runs++;
+
+    for (guint i = 0 ; i < files->len ; i++)
     {
-        return FILEFIND_STATUS_OUT_OF_MEM;
+        g_free(g_ptr_array_index(files, i));
     }
-    self->next_traverse_to_idx = 0;
+    g_ptr_array_set_size(files, 0);
 
-    self->open_dir_ret = TRUE;
+    self->files_bytes = 0;
 
-    return FILEFIND_STATUS_OK;
+    return;
 }
 
-static status_type path_component_component_open_dir(
-        path_component_type * self,
-        gchar * dir_str)
+static status_type path_component_add_file(
+    path_component_type * const self,
+    GPtrArray * const files,
+    const gchar * const filename,
+    const guint64 entry_bytes,
+    file_finder_t * const top)
 {
-    if (! path_component_should_scan_dir(self, dir_str))
+    gchar * const fn_copy = g_strdup(filename);
+
+    if (! fn_copy)
     {
-        return self->open_dir_ret
-            ? FILEFIND_STATUS_OK
-            : FILEFIND_STATUS_DONT_SCAN
-            ;
+        return FILEFIND_STATUS_OUT_OF_MEM;
     }
-    else
+
+    g_ptr_array_add(files, fn_copy);
+
+    self->files_bytes += entry_bytes;
+
+    if (top->max_listing_bytes
+        && (self->files_bytes > top->max_listing_bytes)
+        && (! self->spill_failed)
+    )
     {
-        return path_component_set_up_dir(self, dir_str);
+        path_component_spill_files(self, files, top);
     }
+
+    return FILEFIND_STATUS_OK;
 }
 
-static const gchar * path_component_next_traverse_to(path_component_type * self)
+/*
+ * Takes ownership of the num entry_stats, whose names are borrowed from the
+ * files of self, and looks them up by their name.
+ * */
+static status_type path_component_index_entry_stats(
+    path_component_type * const self,
+    entry_stat_type * const entry_stats,
+    const guint num)
 {
-    const gchar * next_fn;
-
-    g_assert( self->traverse_to );
-
-    if (self->next_traverse_to_idx == self->traverse_to->len)
+    if (! (self->entry_stats_by_name = g_hash_table_new(g_str_hash, g_str_equal)))
     {
-        return NULL;
+        g_free(entry_stats);
+        return FILEFIND_STATUS_OUT_OF_MEM;
     }
 
-    next_fn = (const gchar *)g_ptr_array_index(
-        self->traverse_to,
-        self->next_traverse_to_idx
+    self->entry_stats = entry_stats;
+
+    for (guint i = 0 ; i < num ; i++)
+    {
+        g_hash_table_insert(
+            self->entry_stats_by_name,
+            (gpointer)entry_stats[i].name,
+            &(entry_stats[i])
         );
-    self->next_traverse_to_idx++;
+    }
 
-    return next_fn;
+    return FILEFIND_STATUS_OK;
 }
 
-typedef struct
-{
-    dev_t st_dev;
-    ino_t st_ino;
-} inode_data_type;
+#ifdef G_OS_UNIX
 
-static gboolean dup_inode_tree(
-        gpointer key,
-        gpointer value,
-        gpointer data
-        )
+static gint entry_stat_ino_compare(gconstpointer a, gconstpointer b)
 {
-    GTree * new_tree = (GTree *)data;
-
-    /* TODO : add error control in case the allocations failed. */
-    g_tree_insert(new_tree, g_memdup2(key, sizeof(inode_data_type)), value);
+    const ino_t a_ino = ((const entry_stat_type *)a)->ino;
+    const ino_t b_ino = ((const entry_stat_type *)b)->ino;
 
-    return FALSE;
+    return ((a_ino < b_ino) ? -1 : (a_ino > b_ino) ? 1 : 0);
 }
 
-
-static gint inode_tree_cmp(gconstpointer a_void, gconstpointer b_void)
+/*
+ * Lists the directory with readdir() to get the d_ino of the entries, and
+ * stats them in ascending inode order, which makes the access to the inode
+ * table (nearly) sequential on cold caches. The results are kept in a side
+ * table that file_finder_mystat() consults instead of calling lstat().
+ *
+ * A listing that gets spilled has no side table.
+ * */
+static status_type path_component_read_dir_in_inode_order(
+    path_component_type * const self,
+    DIR * const handle,
+    GPtrArray * const files,
+    file_finder_t * const top)
 {
-    inode_data_type * a, * b;
+    file_find_stats_t * const stats = &(top->stats);
+    struct dirent * entry;
+    guint64 start_time;
 
-    a = (inode_data_type *)a_void;
-    b = (inode_data_type *)b_void;
+    GArray * entries = g_array_new(FALSE, FALSE, sizeof(entry_stat_type));
 
-    if (a->st_dev < b->st_dev)
-    {
-        return -1;
-    }
-    else if (a->st_dev > b->st_dev)
+    if (! entries)
     {
-        return 1;
+        return FILEFIND_STATUS_OUT_OF_MEM;
     }
-    else
+
+    start_time = stats_now();
+
+    while ((entry = readdir(handle)))
     {
-        if (a->st_ino < b->st_ino)
+        if ((! strcmp(entry->d_name, ".")) || (! strcmp(entry->d_name, "..")))
         {
-            return -1;
+            continue;
         }
-        else if (a->st_ino > b->st_ino)
+
+        stats->num_readdir++;
+
+        const status_type status = path_component_add_file(
+            self, files, entry->d_name,
+            (string_array_entry_bytes(entry->d_name)
+             + (entries ? sizeof(entry_stat_type) : 0)
+            ),
+            top
+        );
+
+        if (status != FILEFIND_STATUS_OK)
         {
-            return 1;
+            if (entries)
+            {
+                g_array_free(entries, TRUE);
+            }
+            return status;
         }
-        else
+
+        if (self->spill)
         {
-            return 0;
+            if (entries)
+            {
+                g_array_free(entries, TRUE);
+                entries = NULL;
+            }
+            continue;
         }
-    }
-}
 
-static gint inode_tree_cmp_with_context(gconstpointer a_void, gconstpointer b_void, gpointer user_data)
-{
-    return inode_tree_cmp(a_void, b_void);
-}
+        entry_stat_type entry_stat;
 
-static void inode_tree_destroy_key(gpointer data)
-{
-    g_free(data);
-}
+        memset(&entry_stat, '\0', sizeof(entry_stat));
+        entry_stat.ino = entry->d_ino;
+        entry_stat.name = g_ptr_array_index(files, files->len - 1);
 
-#if 0
-static void inode_tree_destroy_val(gpointer data)
-{
-#if 0
-    g_free(data);
-#endif
-}
-#endif
+        g_array_append_val(entries, entry_stat);
+    }
 
+    stats->readdir_ns += stats_now() - start_time;
 
-static void file_finder_fill_actions(
-    file_finder_t * top,
-    path_component_type * from
-);
+    if (! entries)
+    {
+        return FILEFIND_STATUS_OK;
+    }
 
-static status_type file_finder_open_dir(file_finder_t * top);
-static gboolean file_finder_increment_target_index(file_finder_t * top);
-static status_type file_finder_calc_curr_path(file_finder_t * top);
-static gchar * file_finder_calc_next_target(file_finder_t * top);
-static status_type file_finder_mystat(file_finder_t * top);
+    g_array_sort(entries, entry_stat_ino_compare);
 
-static GCC_INLINE path_component_type * file_finder_current_father(
-    file_finder_t * top
-    )
-{
-    GPtrArray * dir_stack;
+    start_time = stats_now();
 
-    dir_stack = top->dir_stack;
+    const int dir_fd = dirfd(handle);
 
-    return g_ptr_array_index(dir_stack, dir_stack->len-2);
-}
+    for (guint i = 0 ; i < entries->len ; i++)
+    {
+        entry_stat_type * const entry_stat =
+            &g_array_index(entries, entry_stat_type, i);
+
+        entry_stat->stat_ok =
+            (fstatat(
+                dir_fd, entry_stat->name,
+                &(entry_stat->stat_ret), AT_SYMLINK_NOFOLLOW
+            ) == 0);
+    }
 
-static status_type deep_path_move_next(
-    path_component_type * self,
-    file_finder_t * top)
-{
-    path_component_type * current_father;
-    const gchar * next_fn;
+    stats->num_stat += entries->len;
+    stats->stat_ns += stats_now() - start_time;
 
-    current_father = file_finder_current_father(top);
+    const guint num_entries = entries->len;
 
-    next_fn = path_component_next_traverse_to(current_father);
+    return path_component_index_entry_stats(
+        self, (entry_stat_type *)g_array_free(entries, FALSE), num_entries
+    );
+}
 
-    if (! next_fn)
-    {
-        return FILEFIND_STATUS_END;
-    }
+#endif
 
-    if (self->curr_file)
-    {
-        g_free(self->curr_file);
-        self->curr_file = NULL;
-    }
+/*
+ * Whether the mount table is needed. It only describes the file system of
+ * the process, so the other backends only have the st_dev checks of
+ * nocrossfs.
+ * */
+static GCC_INLINE gboolean file_finder_has_mount_policy(
+    file_finder_t * const self
+)
+{
+    return ((self->should_not_cross_fs || self->skip_fs_types)
+        && self->backend->is_host_fs
+    );
+}
 
-    if (!(self->curr_file = g_strdup(next_fn)))
+static status_type file_finder_init_mount_table(file_finder_t * const self)
+{
+    if (! (self->mount_table = mount_table_new("/proc/self/mountinfo")))
     {
         return FILEFIND_STATUS_OUT_OF_MEM;
     }
 
-    {
-        gchar * prev, * new_elem;
+    self->owns_mount_table = TRUE;
 
-        prev = g_ptr_array_index(top->curr_comps, top->curr_comps->len-1);
+    return FILEFIND_STATUS_OK;
+}
 
-        if (prev)
-        {
-            g_free(prev);
-            g_ptr_array_index(top->curr_comps, top->curr_comps->len-1) = NULL;
-        }
+/*
+ * "fuse" matches "fuse.sshfs", "nfs" matches "nfs4" and "cgroup" matches
+ * "cgroup2".
+ * */
+static gboolean fs_type_matches(
+    const gchar * const fs_type,
+    const gchar * const type
+)
+{
+    const size_t len = strlen(type);
 
-        new_elem = g_strdup(self->curr_file);
+    return ((! strncmp(fs_type, type, len))
+        && ((fs_type[len] == '\0')
+            || (fs_type[len] == '.')
+            || g_ascii_isdigit(fs_type[len])
+        )
+    );
+}
 
-        if (! new_elem)
-        {
-            return FILEFIND_STATUS_OUT_OF_MEM;
-        }
-        g_ptr_array_index(top->curr_comps, top->curr_comps->len-1) = new_elem;
+/*
+ * Only reads options that are fixed during the walk, so the prefetcher
+ * threads can call it.
+ * */
+static gboolean file_finder_is_fs_type_skipped(
+    file_finder_t * const self,
+    const dev_t dev
+)
+{
+    if ((! self->skip_fs_types) || (! self->mount_table))
+    {
+        return FALSE;
     }
 
-    file_finder_calc_curr_path(top);
+    const gchar * const fs_type = mount_table_get_fs_type(self->mount_table, dev);
 
-    file_finder_fill_actions(top, self);
+    if (! fs_type)
+    {
+        return FALSE;
+    }
 
-    file_finder_mystat(top);
+    for (gchar * * type = self->skip_fs_types ; *type ; type++)
+    {
+        if (fs_type_matches(fs_type, *type))
+        {
+            return TRUE;
+        }
+    }
 
-    return FILEFIND_STATUS_OK;
+    return FALSE;
 }
 
-static status_type path_component_move_to_next_target(
-    path_component_type * self,
-    file_finder_t * top,
-    const gchar * * next_target
-    )
+/*
+ * Called when the walk moves to a new target, which is in curr_path and
+ * was stat()ed into top_stat.
+ * */
+static status_type file_finder_start_target_mounts(file_finder_t * const self)
 {
-    gchar * target, * target_copy;
-
-    *next_target = NULL;
+    if (self->target_real_path)
+    {
+        free(self->target_real_path);
+        self->target_real_path = NULL;
+    }
 
-    target = file_finder_calc_next_target(top);
+    if (! file_finder_has_mount_policy(self))
+    {
+        return FILEFIND_STATUS_OK;
+    }
 
-    if (target == NULL)
+    if ((! self->mount_table)
+        && (file_finder_init_mount_table(self) == FILEFIND_STATUS_OUT_OF_MEM))
     {
         return FILEFIND_STATUS_OUT_OF_MEM;
     }
 
-    if (self->curr_file)
+#ifdef G_OS_UNIX
+    /*
+     * The bind mounts of the target's file system have its st_dev, so they
+     * can only be found by their paths. A target that cannot be resolved
+     * is walked as if there were none.
+     * */
+    if (self->should_not_cross_fs
+        && mount_table_is_dev_mounted_more_than_once(
+            self->mount_table, self->dev
+        )
+    )
     {
-        g_free(self->curr_file);
-        self->curr_file = NULL;
+        self->target_real_path = realpath(self->curr_path, NULL);
+
+        if (self->target_real_path
+            && (! self->mount_path_buf)
+            && (! (self->mount_path_buf = g_string_new(NULL))))
+        {
+            return FILEFIND_STATUS_OUT_OF_MEM;
+        }
     }
+#endif
 
-    self->curr_file = target;
+    return FILEFIND_STATUS_OK;
+}
 
-    g_ptr_array_set_size(top->curr_comps, 0);
+#ifdef G_OS_UNIX
 
-    target_copy = g_strdup(target);
+/*
+ * The nocrossfs and skip_fs_types part of file_finder_check_subdir(), for
+ * the subdirectories that the prefetcher predicts. It does not see bind
+ * mounts, whose listings are discarded when the walker passes them.
+ * */
+static gboolean file_finder_prefetch_should_enter(
+    const struct stat * const dir_stat,
+    const struct stat * const subdir_stat,
+    gpointer context
+)
+{
+    file_finder_t * const self = (file_finder_t *)context;
 
-    if (! target_copy)
+    if (self->should_not_cross_fs && (subdir_stat->st_dev != dir_stat->st_dev))
     {
-        return FILEFIND_STATUS_OUT_OF_MEM;
+        return FALSE;
     }
 
-    g_ptr_array_add (top->curr_comps, target_copy);
-
-    const status_type status = file_finder_calc_curr_path(top);
+    return (! file_finder_is_fs_type_skipped(self, subdir_stat->st_dev));
+}
 
-    if (status == FILEFIND_STATUS_OUT_OF_MEM)
+/*
+ * Lists the directory from the prefetcher, which also stat()ed its
+ * entries. The time spent waiting for it is counted as opendir() time.
+ * */
+static status_type path_component_read_prefetched_dir(
+    path_component_type * const self,
+    const gchar * const dir_str,
+    GPtrArray * const files,
+    file_finder_t * const top)
+{
+    file_find_stats_t * const stats = &(top->stats);
+    gboolean was_ready;
+
+    if ((! top->prefetcher)
+        && (! (top->prefetcher = dir_prefetcher_new(
+                    top->prefetch_num_dirs,
+                    top->prefetch_num_threads,
+                    (file_finder_has_mount_policy(top)
+                        ? file_finder_prefetch_should_enter : NULL),
+                    top
+                ))))
     {
         return FILEFIND_STATUS_OUT_OF_MEM;
     }
 
-    *next_target = target;
+    const guint64 start_time = stats_now();
 
-    return FILEFIND_STATUS_OK;
-}
+    dir_prefetcher_listing_t * const listing =
+        dir_prefetcher_take(top->prefetcher, dir_str, &was_ready);
 
-static status_type path_component_insert_inode_into_tree(
-    path_component_type * self,
-    GTree * find, const intptr_t depth)
-{
-    ino_t inode;
+    stats->num_opendir++;
+    stats->opendir_ns += stats_now() - start_time;
 
-    if ((inode = path_component_get_inode(self)))
+    if (! listing)
     {
-        inode_data_type data;
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
 
-        data.st_ino = inode;
-        data.st_dev = path_component_get_dev(self);
+    if (was_ready)
+    {
+        stats->num_prefetch_hits++;
+    }
+    else
+    {
+        stats->num_prefetch_misses++;
+    }
 
-        g_tree_insert(
-            find,
-            g_memdup2(&data, sizeof(data)),
-            ((gpointer)depth)
-        );
+    GArray * const entries = listing->entries;
+    entry_stat_type * const entry_stats = g_new0(entry_stat_type, entries->len);
+
+    if (! entry_stats)
+    {
+        dir_prefetcher_listing_free(listing);
+        return FILEFIND_STATUS_OUT_OF_MEM;
     }
 
-    return FILEFIND_STATUS_OK;
-}
+    for (guint i = 0 ; i < entries->len ; i++)
+    {
+        dir_prefetcher_entry_t * const e =
+            &g_array_index(entries, dir_prefetcher_entry_t, i);
 
-static path_component_type * deep_path_new(
-    file_finder_t * top,
-    path_component_type * from
-)
-{
-    path_component_type * self;
-    GTree * find;
+        /* The names are moved into files. */
+        g_ptr_array_add(files, e->name);
 
-    self = g_new0(path_component_type, 1);
+        entry_stats[i].ino = e->stat_ret.st_ino;
+        entry_stats[i].name = e->name;
+        entry_stats[i].stat_ok = e->stat_ok;
+        entry_stats[i].stat_ret = e->stat_ret;
 
-    if (! self)
-    {
-        return NULL;
+        self->files_bytes +=
+            string_array_entry_bytes(e->name) + sizeof(entry_stat_type);
+
+        e->name = NULL;
     }
 
-    self->move_next = deep_path_move_next;
+    stats->num_readdir += entries->len;
+    stats->num_stat += entries->len;
 
-    self->stat_ret = top->top_stat;
+    dir_prefetcher_listing_free(listing);
 
-    find = g_tree_new_full(
-        inode_tree_cmp_with_context,
-        NULL,
-        inode_tree_destroy_key,
-        NULL
-    );
+    return path_component_index_entry_stats(self, entry_stats, files->len);
+}
 
-    g_tree_foreach(from->inodes, dup_inode_tree, (gpointer)find);
+#endif
 
-    path_component_insert_inode_into_tree(self, find, top->dir_stack->len);
+/*
+ * The prefetcher predicts the order of a sorted walk, and the listings that
+ * it holds are not bounded by max_listing_bytes.
+ * */
+static GCC_INLINE gboolean file_finder_should_prefetch(file_finder_t * const top)
+{
+    return ((top->prefetch_num_dirs > 0)
+        && (top->backend == file_find_backend_posix())
+        && top->should_sort
+        && (! top->max_listing_bytes)
+        && (! top->frontier)
+    );
+}
 
-    self->inodes = find;
+/*
+ * Lists dir_str into self->files, unless the listing is streamed or
+ * spilled, in which case self->files is left empty and
+ * path_component_next_traverse_to() reads from self->stream or
+ * self->spill.
+ * */
+static status_type path_component_calc_dir_files(
+    path_component_type * self,
+    gchar * dir_str,
+    file_finder_t * const top)
+{
+    file_find_stats_t * const stats = &(top->stats);
+    const file_find_backend_t * const backend = top->backend;
+    guint64 start_time;
 
-    self->last_dir_scanned = NULL;
+    path_component_close_listing(self, top);
 
-    file_finder_fill_actions(top, self);
+    GPtrArray * files = g_ptr_array_new();
 
-    g_ptr_array_add(top->curr_comps, g_strdup(""));
+    if (! files)
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
 
-    const status_type status = file_finder_open_dir(top);
+    self->files_bytes = 0;
 
-    if (! status)
+#ifdef G_OS_UNIX
+    if (file_finder_should_prefetch(top))
     {
-        return self;
+        const status_type status =
+            path_component_read_prefetched_dir(self, dir_str, files, top);
+
+        if (status != FILEFIND_STATUS_OK)
+        {
+            string_array_free(files);
+            return status;
+        }
     }
-    else
+    else if (top->should_stat_in_inode_order
+        && (backend == file_find_backend_posix()))
     {
-        g_tree_destroy(find);
-        g_free(self);
+        start_time = stats_now();
 
-        return NULL;
-    }
-}
+        DIR * const handle = opendir(dir_str);
 
-static status_type top_path_move_next(
-    path_component_type * self,
-    file_finder_t * top)
-{
-    while (file_finder_increment_target_index(top))
+        stats->num_opendir++;
+        stats->opendir_ns += stats_now() - start_time;
+
+        if (handle)
+        {
+            const status_type status =
+                path_component_read_dir_in_inode_order(self, handle, files, top);
+
+            closedir(handle);
+
+            if (status != FILEFIND_STATUS_OK)
+            {
+                string_array_free(files);
+                return status;
+            }
+        }
+    }
+    else
+#endif
     {
-        const gchar * next_target;
+        start_time = stats_now();
 
-        /* next_target is a copy and should not be freed */
-        const status_type status = path_component_move_to_next_target(self, top, &next_target);
+        void * const handle = backend->opendir(backend->context, dir_str);
 
-        if (status == FILEFIND_STATUS_OUT_OF_MEM)
+        stats->num_opendir++;
+        stats->opendir_ns += stats_now() - start_time;
+
+        if (! handle)
         {
-            return FILEFIND_STATUS_OUT_OF_MEM;
+            /* Handle this error gracefully. */
+            self->files = files;
+            return FILEFIND_STATUS_OK;
         }
 
-        if (g_file_test(next_target, G_FILE_TEST_EXISTS))
+        /* Unsorted listings are not materialised at all. */
+        if ((! top->should_sort)
+            && (file_finder_count_open_streams(top) < MAX_OPEN_STREAMS))
         {
-            GTree * find;
+            self->stream = handle;
+            self->files = files;
+            return FILEFIND_STATUS_OK;
+        }
 
-            file_finder_fill_actions(top, self);
+        const gchar * filename;
 
-            if (file_finder_mystat(top)
-                    == FILEFIND_STATUS_OUT_OF_MEM)
-            {
-                return FILEFIND_STATUS_OUT_OF_MEM;
-            }
+        start_time = stats_now();
 
-            self->stat_ret = top->top_stat;
-            top->dev = top->top_stat.st_dev;
+        while ((filename = backend->readdir(backend->context, handle)))
+        {
+            stats->num_readdir++;
 
-            find = g_tree_new_full(
-                inode_tree_cmp_with_context,
-                NULL,
-                inode_tree_destroy_key,
-                NULL
+            const status_type status = path_component_add_file(
+                self, files, filename, string_array_entry_bytes(filename), top
             );
 
-            if (! find)
+            if (status != FILEFIND_STATUS_OK)
             {
-                return FILEFIND_STATUS_OUT_OF_MEM;
+                backend->closedir(backend->context, handle);
+                string_array_free(files);
+                return status;
             }
+        }
 
-            path_component_insert_inode_into_tree(self, find, 0);
-
-            self->inodes = find;
+        backend->closedir(backend->context, handle);
 
-            return FILEFIND_STATUS_OK;
-        }
+        stats->readdir_ns += stats_now() - start_time;
     }
 
-    return FILEFIND_STATUS_END;
-}
+    if (top->should_sort || self->spill)
+    {
+        start_time = stats_now();
 
-static path_component_type * top_path_new(
-    file_finder_t * top
-)
-{
-    path_component_type * self;
+        g_ptr_array_sort(files, indirect_lexic_compare);
 
-    self = g_new0(path_component_type, 1);
+        stats->num_sort++;
+        stats->sort_ns += stats_now() - start_time;
+    }
 
-    if (! self)
+    if (self->spill)
     {
-        return NULL;
-    }
+        /* The names that were not spilled are merged from memory. */
+        const gboolean merge_ok = listing_spill_start_merge(self->spill, files);
 
-    self->move_next = top_path_move_next;
+        if (! (files = g_ptr_array_new()))
+        {
+            return FILEFIND_STATUS_OUT_OF_MEM;
+        }
 
-    file_finder_fill_actions(top, self);
+        if (! merge_ok)
+        {
+            g_ptr_array_free(files, TRUE);
+            return FILEFIND_STATUS_OUT_OF_MEM;
+        }
 
-    return self;
+        self->files_bytes = listing_spill_get_memory_bytes(self->spill);
+    }
+
+    self->files = files;
+
+    return FILEFIND_STATUS_OK;
 }
 
-static void path_component_free(path_component_type * const self)
+static status_type path_component_set_up_dir(
+    path_component_type *const self,
+    gchar *const dir_str,
+    file_finder_t * const top)
 {
-    if (self->curr_file)
-    {
-        g_free(self->curr_file);
-        self->curr_file = NULL;
-    }
+    path_component_free_entry_stats(self);
 
     if (self->files)
     {
@@ -732,10 +1182,10 @@ static void path_component_free(path_component_type * const self)
         self->files = NULL;
     }
 
-    if (self->last_dir_scanned)
+    const status_type ret = path_component_calc_dir_files(self, dir_str, top);
+    if (ret)
     {
-        g_free( self->last_dir_scanned );
-        self->last_dir_scanned = NULL;
+        return ret;
     }
 
     if (self->traverse_to)
@@ -744,883 +1194,4220 @@ static void path_component_free(path_component_type * const self)
         self->traverse_to = NULL;
     }
 
-    if (self->inodes)
+    if (! (self->traverse_to = path_component_files_copy(self)))
     {
-        g_tree_destroy(self->inodes);
-        self->inodes = NULL;
+        return FILEFIND_STATUS_OUT_OF_MEM;
     }
+    self->traverse_to_bytes =
+        ((self->stream || self->spill) ? 0 : self->files_bytes);
+    self->next_traverse_to_idx = 0;
+    self->is_traverse_to_set = FALSE;
+
+    self->open_dir_ret = TRUE;
+
+    return FILEFIND_STATUS_OK;
+}
+
+static status_type path_component_component_open_dir(
+        path_component_type * self,
+        gchar * dir_str,
+        file_finder_t * const top)
+{
+    if (! path_component_should_scan_dir(self, dir_str))
+    {
+        return self->open_dir_ret
+            ? FILEFIND_STATUS_OK
+            : FILEFIND_STATUS_DONT_SCAN
+            ;
+    }
+    else
+    {
+        return path_component_set_up_dir(self, dir_str, top);
+    }
+}
+
+/*
+ * The returned name is only valid until the next call.
+ * */
+static const gchar * path_component_next_traverse_to(
+    path_component_type * self,
+    file_finder_t * const top)
+{
+    const gchar * next_fn;
+
+    if (self->stream)
+    {
+        const guint64 start_time = stats_now();
+
+        next_fn = top->backend->readdir(top->backend->context, self->stream);
+
+        top->stats.readdir_ns += stats_now() - start_time;
+
+        if (next_fn)
+        {
+            top->stats.num_readdir++;
+        }
+        else
+        {
+            top->backend->closedir(top->backend->context, self->stream);
+            self->stream = NULL;
+        }
+
+        return next_fn;
+    }
+
+    if (self->spill)
+    {
+        return listing_spill_next(self->spill);
+    }
+
+    g_assert( self->traverse_to );
+
+    if (self->next_traverse_to_idx == self->traverse_to->len)
+    {
+        return NULL;
+    }
+
+    next_fn = (const gchar *)g_ptr_array_index(
+        self->traverse_to,
+        self->next_traverse_to_idx
+        );
+    self->next_traverse_to_idx++;
+
+    return next_fn;
+}
+
+/*
+ * Reads the rest of a streamed or spilled listing into traverse_to, so it
+ * can be inspected or replaced.
+ * */
+static status_type path_component_materialise_traverse_to(
+    path_component_type * const self,
+    file_finder_t * const top)
+{
+    const gchar * next_fn;
+
+    if (! (self->stream || self->spill))
+    {
+        return FILEFIND_STATUS_OK;
+    }
+
+    GPtrArray * const rest = g_ptr_array_new();
+
+    if (! rest)
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
+
+    self->traverse_to_bytes = 0;
+
+    while ((next_fn = path_component_next_traverse_to(self, top)))
+    {
+        gchar * const fn_copy = g_strdup(next_fn);
+
+        if (! fn_copy)
+        {
+            string_array_free(rest);
+            return FILEFIND_STATUS_OUT_OF_MEM;
+        }
+
+        g_ptr_array_add(rest, fn_copy);
+        self->traverse_to_bytes += string_array_entry_bytes(fn_copy);
+    }
+
+    path_component_close_listing(self, top);
+    self->files_bytes = 0;
+
+    string_array_free(self->traverse_to);
+    self->traverse_to = rest;
+    self->next_traverse_to_idx = 0;
+
+    return FILEFIND_STATUS_OK;
+}
+
+typedef struct
+{
+    dev_t st_dev;
+    ino_t st_ino;
+} inode_data_type;
+
+static gboolean dup_inode_tree(
+        gpointer key,
+        gpointer value,
+        gpointer data
+        )
+{
+    GTree * new_tree = (GTree *)data;
+
+    /* TODO : add error control in case the allocations failed. */
+    g_tree_insert(new_tree, g_memdup2(key, sizeof(inode_data_type)), value);
+
+    return FALSE;
+}
+
+
+static gint inode_tree_cmp(gconstpointer a_void, gconstpointer b_void)
+{
+    inode_data_type * a, * b;
+
+    a = (inode_data_type *)a_void;
+    b = (inode_data_type *)b_void;
+
+    if (a->st_dev < b->st_dev)
+    {
+        return -1;
+    }
+    else if (a->st_dev > b->st_dev)
+    {
+        return 1;
+    }
+    else
+    {
+        if (a->st_ino < b->st_ino)
+        {
+            return -1;
+        }
+        else if (a->st_ino > b->st_ino)
+        {
+            return 1;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+}
+
+static gint inode_tree_cmp_with_context(gconstpointer a_void, gconstpointer b_void, gpointer user_data)
+{
+    return inode_tree_cmp(a_void, b_void);
+}
+
+static void inode_tree_destroy_key(gpointer data)
+{
+    g_free(data);
+}
+
+static guint inode_data_hash(gconstpointer key)
+{
+    const inode_data_type * const data = (const inode_data_type *)key;
+
+    return (guint)(data->st_ino ^ (data->st_ino >> 32) ^ (data->st_dev * 31));
+}
+
+static gboolean inode_data_equal(gconstpointer a, gconstpointer b)
+{
+    return (inode_tree_cmp(a, b) == 0);
+}
+
+/*
+ * A symbolic link can only be replaced, not changed, so what it resolved
+ * to is kept by the identity of the link for the rest of the walk.
+ * */
+typedef struct
+{
+    /* The key of link_cache. */
+    inode_data_type link;
+    gboolean is_dir;
+    /* Zeroed if the link is dangling. */
+    inode_data_type target;
+} link_target_type;
+
+#if 0
+static void inode_tree_destroy_val(gpointer data)
+{
+#if 0
+    g_free(data);
+#endif
+}
+#endif
+
+
+static void file_finder_fill_actions(
+    file_finder_t * top,
+    path_component_type * from
+);
+
+static status_type file_finder_open_dir(file_finder_t * top);
+static gboolean file_finder_increment_target_index(file_finder_t * top);
+static status_type file_finder_calc_curr_path(file_finder_t * top);
+static gchar * file_finder_calc_next_target(file_finder_t * top);
+static status_type file_finder_mystat(
+    file_finder_t * top,
+    const entry_stat_type * entry_stat
+);
+static void file_finder_du_account(
+    file_finder_t * top,
+    path_component_type * component
+);
+static void path_component_free(
+    path_component_type * self,
+    file_finder_t * top
+);
+
+static GCC_INLINE path_component_type * file_finder_current_father(
+    file_finder_t * top
+    )
+{
+    GPtrArray * dir_stack;
+
+    dir_stack = top->dir_stack;
+
+    return g_ptr_array_index(dir_stack, dir_stack->len-2);
+}
+
+/*
+ * Sets self->curr_file, reusing its buffer.
+ * */
+static gboolean path_component_set_curr_file(
+    path_component_type * const self,
+    const gchar * const name
+)
+{
+    if (self->curr_file_buf)
+    {
+        g_string_assign(self->curr_file_buf, name);
+    }
+    else if (! (self->curr_file_buf = g_string_new(name)))
+    {
+        return FALSE;
+    }
+
+    self->curr_file = self->curr_file_buf->str;
+
+    return TRUE;
+}
+
+/*
+ * Moves self to the entry name of the directory of its father.
+ * */
+static status_type deep_path_move_to(
+    path_component_type * const self,
+    file_finder_t * const top,
+    const gchar * const name)
+{
+    path_component_type * const current_father =
+        file_finder_current_father(top);
+
+    if (! path_component_set_curr_file(self, name))
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
+
+    g_ptr_array_index(top->curr_comps, top->curr_comps->len-1) = self->curr_file;
+
+    file_finder_calc_curr_path(top);
+
+    file_finder_fill_actions(top, self);
+
+    if (file_finder_mystat(
+            top,
+            (current_father->entry_stats_by_name
+                ? g_hash_table_lookup(
+                    current_father->entry_stats_by_name, self->curr_file
+                )
+                : NULL
+            )
+        ) == FILEFIND_STATUS_OUT_OF_MEM)
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
+
+    file_finder_du_account(top, self);
+
+    return FILEFIND_STATUS_OK;
+}
+
+static status_type deep_path_move_next(
+    path_component_type * self,
+    file_finder_t * top)
+{
+    const gchar * const next_fn = path_component_next_traverse_to(
+        file_finder_current_father(top), top
+    );
+
+    if (! next_fn)
+    {
+        return FILEFIND_STATUS_END;
+    }
+
+    return deep_path_move_to(self, top, next_fn);
+}
+
+/*
+ * Moves self to the first entry of the sorted listing of its father that
+ * is not before name, and sets *is_found if it is name itself. self is
+ * left unmoved if there is none.
+ * */
+static status_type deep_path_seek(
+    path_component_type * const self,
+    file_finder_t * const top,
+    const gchar * const name,
+    gboolean * const is_found)
+{
+    path_component_type * const current_father =
+        file_finder_current_father(top);
+    const gchar * next_fn;
+
+    *is_found = FALSE;
+
+    if (! (current_father->stream || current_father->spill))
+    {
+        GPtrArray * const traverse_to = current_father->traverse_to;
+        guint low = current_father->next_traverse_to_idx;
+        guint high = traverse_to->len;
+
+        while (low < high)
+        {
+            const guint mid = low + ((high - low) >> 1);
+
+            if (strcmp(g_ptr_array_index(traverse_to, mid), name) < 0)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+
+        current_father->next_traverse_to_idx = low;
+    }
+
+    while ((next_fn = path_component_next_traverse_to(current_father, top)))
+    {
+        const int cmp = strcmp(next_fn, name);
+
+        if (cmp >= 0)
+        {
+            *is_found = (cmp == 0);
+
+            return deep_path_move_to(self, top, next_fn);
+        }
+    }
+
+    return FILEFIND_STATUS_OK;
+}
+
+static status_type path_component_move_to_next_target(
+    path_component_type * self,
+    file_finder_t * top,
+    const gchar * * next_target
+    )
+{
+    gchar * target;
+
+    *next_target = NULL;
+
+    target = file_finder_calc_next_target(top);
+
+    if (target == NULL)
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
+
+    const gboolean set_ok = path_component_set_curr_file(self, target);
+
+    g_free(target);
+
+    if (! set_ok)
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
+
+    g_ptr_array_set_size(top->curr_comps, 0);
+
+    g_ptr_array_add (top->curr_comps, self->curr_file);
+
+#ifdef G_OS_UNIX
+    if (top->prefetcher)
+    {
+        dir_prefetcher_reset(top->prefetcher);
+    }
+#endif
+
+    const status_type status = file_finder_calc_curr_path(top);
+
+    if (status == FILEFIND_STATUS_OUT_OF_MEM)
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
+
+    *next_target = self->curr_file;
+
+    return FILEFIND_STATUS_OK;
+}
+
+static status_type path_component_insert_inode_into_tree(
+    path_component_type * self,
+    GTree * find, const intptr_t depth)
+{
+    ino_t inode;
+
+    if ((inode = path_component_get_inode(self)))
+    {
+        inode_data_type data;
+
+        data.st_ino = inode;
+        data.st_dev = path_component_get_dev(self);
+
+        g_tree_insert(
+            find,
+            g_memdup2(&data, sizeof(data)),
+            ((gpointer)depth)
+        );
+    }
+
+    return FILEFIND_STATUS_OK;
+}
+
+static path_component_type * deep_path_new(
+    file_finder_t * top,
+    path_component_type * from
+)
+{
+    path_component_type * self;
+    GTree * find;
+
+    self = g_new0(path_component_type, 1);
+
+    if (! self)
+    {
+        return NULL;
+    }
+
+    self->move_next = deep_path_move_next;
+
+    self->stat_ret = top->top_stat;
+    self->dir_dev = top->top_dir_dev;
+    self->dir_ino = top->top_dir_ino;
+
+    find = g_tree_new_full(
+        inode_tree_cmp_with_context,
+        NULL,
+        inode_tree_destroy_key,
+        NULL
+    );
+
+    g_tree_foreach(from->inodes, dup_inode_tree, (gpointer)find);
+
+    path_component_insert_inode_into_tree(self, find, top->dir_stack->len);
+
+    self->inodes = find;
+
+    self->last_dir_scanned = NULL;
+
+    file_finder_fill_actions(top, self);
+
+    /* Replaced by curr_file once the component moves. */
+    g_ptr_array_add(top->curr_comps, (gpointer)"");
+
+    const status_type status = file_finder_open_dir(top);
+
+    if (! status)
+    {
+        return self;
+    }
+    else
+    {
+        g_tree_destroy(find);
+        g_free(self);
+
+        return NULL;
+    }
+}
+
+/*
+ * Frees the components above the first stack_len ones of the dir_stack, and
+ * the components of the path above its first comps_len ones, like
+ * file_finder_become_default() does for one directory.
+ * */
+static void file_finder_unwind_dir_stack(
+    file_finder_t * const top,
+    const guint stack_len,
+    const guint comps_len
+)
+{
+    while (top->dir_stack->len > stack_len)
+    {
+        path_component_type * const leaving =
+            g_ptr_array_index(top->dir_stack, top->dir_stack->len - 1);
+
+        file_finder_add_listing_bytes(
+            top, path_component_listing_bytes(leaving), 0
+        );
+
+        path_component_free(leaving, top);
+        g_ptr_array_remove_index (top->dir_stack, top->dir_stack->len - 1);
+    }
+
+    g_ptr_array_set_size(top->curr_comps, comps_len);
+
+    top->current = g_ptr_array_index(top->dir_stack, stack_len - 1);
+    file_finder_calc_curr_path(top);
+
+    return;
+}
+
+/*
+ * Enters the next directory of the frontier. The directories
+ * above it get components with nothing left to traverse, so that they are
+ * left as soon as it is. Returns FILEFIND_STATUS_END if there are none.
+ *
+ * If it runs out of memory, the components that it pushed are freed, so
+ * that the finder is left on the target, as it was.
+ * */
+static status_type file_finder_enter_frontier_dir(file_finder_t * const top)
+{
+    dir_frontier_node_t * const node = dir_frontier_pop(top->frontier);
+
+    if (! node)
+    {
+        return FILEFIND_STATUS_END;
+    }
+
+    dir_frontier_node_unref(top->frontier_current);
+    top->frontier_current = node;
+
+    const gint depth = node->depth;
+    const guint stack_len = top->dir_stack->len;
+    const guint comps_len = top->curr_comps->len;
+    dir_frontier_node_t * * chain = g_new(dir_frontier_node_t *, depth);
+    path_component_type * shell = g_ptr_array_index(top->dir_stack, 0);
+    GTree * find = NULL;
+
+    if (! chain)
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
+
+    {
+        dir_frontier_node_t * up = node;
+
+        for (gint i = depth - 1 ; i >= 0 ; i--)
+        {
+            chain[i] = up;
+            up = up->parent;
+        }
+    }
+
+    if (! (find = g_tree_new_full(
+                    inode_tree_cmp_with_context,
+                    NULL,
+                    inode_tree_destroy_key,
+                    NULL
+                )))
+    {
+        goto cleanup;
+    }
+
+    g_tree_foreach(shell->inodes, dup_inode_tree, (gpointer)find);
+
+    for (gint i = 0 ; i < depth ; i++)
+    {
+        /* Each directory is in the tree of the components below it. */
+        path_component_insert_inode_into_tree(shell, find, i + 1);
+
+        if (! (shell = g_new0(path_component_type, 1)))
+        {
+            goto cleanup;
+        }
+
+        g_ptr_array_add(top->dir_stack, shell);
+
+        shell->move_next = deep_path_move_next;
+        shell->dir_dev = chain[i]->dir_dev;
+        shell->dir_ino = chain[i]->dir_ino;
+        file_finder_fill_actions(top, shell);
+        shell->next_action_idx = NUM_ACTIONS;
+
+        if (! path_component_set_curr_file(shell, chain[i]->name))
+        {
+            goto cleanup;
+        }
+
+        g_ptr_array_add(top->curr_comps, shell->curr_file);
+
+        if ((i < depth - 1) && (! (shell->traverse_to = g_ptr_array_new())))
+        {
+            goto cleanup;
+        }
+    }
+
+    g_free(chain);
+    chain = NULL;
+
+    /* The tree of the directories above the one that is entered. */
+    shell->inodes = find;
+    find = NULL;
+
+    top->current = shell;
+    file_finder_calc_curr_path(top);
+    top->top_dir_dev = node->dir_dev;
+    top->top_dir_ino = node->dir_ino;
+
+    if (node->traverse_to)
+    {
+        shell->traverse_to = node->traverse_to;
+        node->traverse_to = NULL;
+
+        for (guint i = 0 ; i < shell->traverse_to->len ; i++)
+        {
+            shell->traverse_to_bytes += string_array_entry_bytes(
+                g_ptr_array_index(shell->traverse_to, i)
+            );
+        }
+
+        shell->is_traverse_to_set = TRUE;
+        shell->open_dir_ret = TRUE;
+
+        file_finder_add_listing_bytes(
+            top, 0, path_component_listing_bytes(shell)
+        );
+
+        if (! (shell->last_dir_scanned = g_strdup(top->curr_path)))
+        {
+            goto cleanup;
+        }
+    }
+
+    path_component_type * const deep_path = deep_path_new(top, shell);
+
+    if (! deep_path)
+    {
+        goto cleanup;
+    }
+
+    top->current = deep_path;
+    g_ptr_array_add(top->dir_stack, deep_path);
+
+    if (top->dir_stack->len > top->stats.peak_dir_stack_len)
+    {
+        top->stats.peak_dir_stack_len = top->dir_stack->len;
+    }
+
+    return FILEFIND_STATUS_OK;
+
+cleanup:
+
+    g_free(chain);
+
+    if (find)
+    {
+        g_tree_destroy(find);
+    }
+
+    file_finder_unwind_dir_stack(top, stack_len, comps_len);
+
+    return FILEFIND_STATUS_OUT_OF_MEM;
+}
+
+static status_type top_path_move_next(
+    path_component_type * self,
+    file_finder_t * top)
+{
+    if (top->frontier)
+    {
+        const status_type status = file_finder_enter_frontier_dir(top);
+
+        if (status != FILEFIND_STATUS_END)
+        {
+            return status;
+        }
+
+        /* The next target starts a frontier of its own. */
+        dir_frontier_node_unref(top->frontier_current);
+        top->frontier_current = NULL;
+    }
+
+    while (file_finder_increment_target_index(top))
+    {
+        const gchar * next_target;
+
+        /* next_target is a copy and should not be freed */
+        const status_type status = path_component_move_to_next_target(self, top, &next_target);
+
+        if (status == FILEFIND_STATUS_OUT_OF_MEM)
+        {
+            return FILEFIND_STATUS_OUT_OF_MEM;
+        }
+
+        my_stat_type target_stat;
+
+        top->stats.num_stat++;
+
+        if (top->backend->stat(
+                top->backend->context, next_target, TRUE, &target_stat) == 0)
+        {
+            GTree * find;
+
+            file_finder_fill_actions(top, self);
+
+            if (file_finder_mystat(top, NULL)
+                    == FILEFIND_STATUS_OUT_OF_MEM)
+            {
+                return FILEFIND_STATUS_OUT_OF_MEM;
+            }
+
+            self->stat_ret = top->top_stat;
+            self->dir_dev = top->top_dir_dev;
+            self->dir_ino = top->top_dir_ino;
+            top->dev = top->top_dir_dev;
+
+            if (file_finder_start_target_mounts(top)
+                    == FILEFIND_STATUS_OUT_OF_MEM)
+            {
+                return FILEFIND_STATUS_OUT_OF_MEM;
+            }
+
+            file_finder_du_account(top, self);
+
+            find = g_tree_new_full(
+                inode_tree_cmp_with_context,
+                NULL,
+                inode_tree_destroy_key,
+                NULL
+            );
+
+            if (! find)
+            {
+                return FILEFIND_STATUS_OUT_OF_MEM;
+            }
+
+            path_component_insert_inode_into_tree(self, find, 0);
+
+            /* The tree of the previous target. */
+            if (self->inodes)
+            {
+                g_tree_destroy(self->inodes);
+            }
+
+            self->inodes = find;
+
+            return FILEFIND_STATUS_OK;
+        }
+    }
+
+    return FILEFIND_STATUS_END;
+}
+
+static path_component_type * top_path_new(
+    file_finder_t * top
+)
+{
+    path_component_type * self;
+
+    self = g_new0(path_component_type, 1);
+
+    if (! self)
+    {
+        return NULL;
+    }
+
+    self->move_next = top_path_move_next;
+
+    file_finder_fill_actions(top, self);
+
+    return self;
+}
+
+static void path_component_free(
+    path_component_type * const self,
+    file_finder_t * const top)
+{
+    if (self->curr_file_buf)
+    {
+        g_string_free(self->curr_file_buf, TRUE);
+        self->curr_file_buf = NULL;
+    }
+    self->curr_file = NULL;
+
+    path_component_free_entry_stats(self);
+    path_component_close_listing(self, top);
+
+    if (self->files)
+    {
+        string_array_free(self->files);
+        self->files = NULL;
+    }
+
+    if (self->last_dir_scanned)
+    {
+        g_free( self->last_dir_scanned );
+        self->last_dir_scanned = NULL;
+    }
+
+    if (self->traverse_to)
+    {
+        string_array_free (self->traverse_to);
+        self->traverse_to = NULL;
+    }
+
+    if (self->inodes)
+    {
+        g_tree_destroy(self->inodes);
+        self->inodes = NULL;
+    }
+
+    g_free(self);
+
+    return;
+}
+
+static void destroy_string(gpointer data)
+{
+    g_free((gchar *)data);
+
+    return;
+}
+
+static void file_finder_calc_default_actions(file_finder_t * self);
+
+int file_find_new(file_find_handle_t * * output_handle, const char * first_target)
+{
+    return file_find_new_with_backend(output_handle, first_target, NULL);
+}
+
+int file_find_new_with_backend(
+    file_find_handle_t * * output_handle,
+    const char * first_target,
+    const file_find_backend_t * backend
+)
+{
+    file_finder_t * self = NULL;
+    path_component_type * top_path = NULL;
+
+    *output_handle = NULL;
+
+    if (! (self = g_new0(file_finder_t, 1)))
+    {
+        goto cleanup;
+    }
+
+    self->backend = (backend ? backend : file_find_backend_posix());
+
+    /*
+     * The *existence* of an _st key inside the struct
+     * indicates that the stack is full.
+     * So now it's empty.
+     */
+
+    self->dir_stack = NULL;
+
+    if (! (self->dir_stack = g_ptr_array_new()))
+    {
+        goto cleanup;
+    }
+
+    if (! (self->curr_comps = g_ptr_array_new()))
+    {
+        goto cleanup;
+    }
+
+    if (! (self->curr_path_buf = g_string_new(NULL)))
+    {
+        goto cleanup;
+    }
+
+    if (! (self->targets = g_ptr_array_new_with_free_func(destroy_string)))
+    {
+        goto cleanup;
+    }
+
+    if (first_target)
+    {
+        gchar * target_copy;
+
+        target_copy = g_strdup(first_target);
+
+        if (! target_copy)
+        {
+            goto cleanup;
+        }
+
+        g_ptr_array_add(self->targets, target_copy);
+    }
+
+    self->target_index = -1;
+
+    {
+        top_path = top_path_new(self);
+
+        if (! top_path)
+        {
+            goto cleanup;
+        }
+
+        self->current = top_path;
+
+        g_ptr_array_add(self->dir_stack, top_path);
+    }
+
+    self->callback = NULL;
+    self->callback_context = NULL;
+    self->should_traverse_depth_first = FALSE;
+    self->filter_callback = NULL;
+    self->filter_context = NULL;
+    self->should_follow_link = FALSE;
+    self->should_not_cross_fs = FALSE;
+    self->should_sort = TRUE;
+
+    *output_handle = (file_find_handle_t *)self;
+
+    file_finder_calc_default_actions(self);
+
+    return FILE_FIND_OK;
+
+cleanup:
+
+    if (top_path)
+    {
+        path_component_free(top_path, self);
+    }
+    if (self)
+    {
+        if (self->dir_stack)
+        {
+            g_ptr_array_free(self->dir_stack, 1);
+            self->dir_stack = NULL;
+        }
+
+        if (self->curr_comps)
+        {
+            g_ptr_array_free(self->curr_comps, 1);
+            self->curr_comps = NULL;
+        }
+
+        if (self->targets)
+        {
+            g_ptr_array_free(self->targets, 1);
+            self->targets = NULL;
+        }
+
+        g_free(self);
+    }
+
+    return FILE_FIND_OUT_OF_MEMORY;
+}
+
+static void file_finder_calc_default_actions(file_finder_t * const self)
+{
+    int calc_obj =
+        self->du_callback ? ACTION_NONE
+        : self->callback ? ACTION_RUN_CB
+        : ACTION_SET_OBJ;
+
+    /* Every directory is entered after it is returned in best-first order. */
+    if (self->should_traverse_depth_first && (! self->frontier))
+    {
+        self->def_actions[0] = ACTION_RECURSE;
+        self->def_actions[1] = calc_obj;
+    }
+    else
+    {
+        self->def_actions[0] = calc_obj;
+        self->def_actions[1] = ACTION_RECURSE;
+    }
+
+    return;
+}
+
+void file_find_set_callback(
+    file_find_handle_t * handle,
+    void (*callback)(const char * filename, void * context)
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->callback = callback;
+
+    file_finder_calc_default_actions(self);
+
+    return;
+}
+
+void file_find_set_du_callback(
+    file_find_handle_t * handle,
+    void (*callback)(const file_find_du_record_t * record, void * context),
+    void * context
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->du_callback = callback;
+    self->du_context = context;
+
+    if (callback && (! self->du_seen_links))
+    {
+        self->du_seen_links = inode_set_new();
+    }
+
+    file_finder_calc_default_actions(self);
+
+    return;
+}
+
+int file_find_add_target(
+    file_find_handle_t * handle,
+    const char * target
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+    gchar * target_copy;
+
+    if (self->roots_scanner)
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    if (! (target_copy = g_strdup(target)))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    g_ptr_array_add(self->targets, target_copy);
+
+    return FILE_FIND_OK;
+}
+
+void file_find_set_parallel_roots(
+    file_find_handle_t * handle,
+    int num_threads,
+    int order
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->should_scan_roots_in_parallel = TRUE;
+    self->num_root_threads = num_threads;
+    self->roots_in_target_order = (order == FILE_FIND_ROOTS_IN_TARGET_ORDER);
+
+    return;
+}
+
+void file_find_set_should_sort(
+    file_find_handle_t * handle,
+    int should_sort
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->should_sort = should_sort;
+
+    return;
+}
+
+void file_find_set_max_listing_bytes(
+    file_find_handle_t * handle,
+    unsigned long long max_listing_bytes
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->max_listing_bytes = max_listing_bytes;
+
+    return;
+}
+
+void file_find_set_should_stat_in_inode_order(
+    file_find_handle_t * handle,
+    int should_stat_in_inode_order
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->should_stat_in_inode_order = should_stat_in_inode_order;
+
+    return;
+}
+
+void file_find_set_prefetch(
+    file_find_handle_t * handle,
+    int num_dirs_ahead,
+    int num_threads
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->prefetch_num_dirs = num_dirs_ahead;
+    self->prefetch_num_threads = num_threads;
+
+    return;
+}
+
+void file_find_set_should_follow_link(
+    file_find_handle_t * handle,
+    int should_follow_link
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->should_follow_link = should_follow_link;
+
+    return;
+}
+
+void file_find_set_should_enter_dirs_once(
+    file_find_handle_t * handle,
+    int should_enter_dirs_once
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->should_enter_dirs_once = should_enter_dirs_once;
+
+    return;
+}
+
+void file_find_set_hard_links(
+    file_find_handle_t * handle,
+    int mode
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->hard_links_mode = mode;
+
+    return;
+}
+
+void file_find_set_no_cross_fs(
+    file_find_handle_t * handle,
+    int should_not_cross_fs
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->should_not_cross_fs = should_not_cross_fs;
+
+    return;
+}
+
+int file_find_set_skip_fs_types(
+    file_find_handle_t * handle,
+    int num_types,
+    const char * const * types
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+    gchar * * new_types = NULL;
+
+    if (num_types > 0)
+    {
+        if (! (new_types = g_new0(gchar *, num_types + 1)))
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        for (int i = 0 ; i < num_types ; i++)
+        {
+            if (! (new_types[i] = g_strdup(types[i])))
+            {
+                g_strfreev(new_types);
+                return FILE_FIND_OUT_OF_MEMORY;
+            }
+        }
+    }
+
+    g_strfreev(self->skip_fs_types);
+    self->skip_fs_types = new_types;
+
+    return FILE_FIND_OK;
+}
+
+int file_find_set_shard(
+    file_find_handle_t * handle,
+    int shard_index,
+    int num_shards,
+    int depth
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    if ((num_shards < 1) || (shard_index < 0) || (shard_index >= num_shards)
+        || (depth < 0))
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    self->shard_index = shard_index;
+    self->num_shards = ((num_shards > 1) ? num_shards : 0);
+    self->shard_depth = depth;
+
+    return FILE_FIND_OK;
+}
+
+typedef struct
+{
+    gchar * path;
+    unsigned long long cost;
+} shard_cost_type;
+
+/*
+ * Joins the non-empty components of path with single separators, the way
+ * file_finder_calc_shard() does, or returns NULL if it is not at depth.
+ * */
+static gchar * shard_normalise_path(const char * const path, const int depth)
+{
+    if (! depth)
+    {
+        return g_strdup(path);
+    }
+
+    gchar * * const comps = g_strsplit(path, "/", -1);
+
+    if (! comps)
+    {
+        return NULL;
+    }
+
+    gchar * * next_comp = comps;
+    int num_comps = 0;
+
+    for (gchar * * comp = comps ; *comp ; comp++)
+    {
+        if (**comp)
+        {
+            *(next_comp++) = *comp;
+            num_comps++;
+        }
+        else
+        {
+            g_free(*comp);
+        }
+    }
+
+    *next_comp = NULL;
+
+    gchar * const ret =
+        ((num_comps == depth) ? g_strjoinv("/", comps) : NULL);
+
+    g_strfreev(comps);
+
+    return ret;
+}
+
+/* By descending cost, and then by path, so every shard sorts the same. */
+static gint shard_cost_compare(gconstpointer a_void, gconstpointer b_void)
+{
+    const shard_cost_type * const a = (const shard_cost_type *)a_void;
+    const shard_cost_type * const b = (const shard_cost_type *)b_void;
+
+    if (a->cost != b->cost)
+    {
+        return ((a->cost > b->cost) ? -1 : 1);
+    }
+
+    return strcmp(a->path, b->path);
+}
+
+int file_find_set_shard_costs(
+    file_find_handle_t * handle,
+    int num_subtrees,
+    const char * const * paths,
+    const unsigned long long * costs
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+    shard_cost_type * sorted = NULL;
+    int num_sorted = 0;
+    unsigned long long * loads = NULL;
+    GHashTable * owners = NULL;
+
+    if (! self->num_shards)
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    if (self->owns_shard_owners)
+    {
+        g_hash_table_destroy(self->shard_owners);
+    }
+    self->shard_owners = NULL;
+    self->owns_shard_owners = FALSE;
+
+    if (num_subtrees <= 0)
+    {
+        return FILE_FIND_OK;
+    }
+
+    if ((! self->shard_path_buf)
+        && (! (self->shard_path_buf = g_string_new(NULL))))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    if (! (sorted = g_new(shard_cost_type, num_subtrees)))
+    {
+        goto cleanup;
+    }
+
+    if (! (loads = g_new0(unsigned long long, self->num_shards)))
+    {
+        goto cleanup;
+    }
+
+    if (! (owners = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL)))
+    {
+        goto cleanup;
+    }
+
+    /* The paths at other depths are not subtrees, and are skipped. */
+    for (int i = 0 ; i < num_subtrees ; i++)
+    {
+        if ((sorted[num_sorted].path =
+                shard_normalise_path(paths[i], self->shard_depth)))
+        {
+            sorted[num_sorted++].cost = costs[i];
+        }
+    }
+
+    qsort(sorted, num_sorted, sizeof(sorted[0]), shard_cost_compare);
+
+    /*
+     * The longest processing time first: every subtree goes to the least
+     * loaded shard so far.
+     * */
+    for (int i = 0 ; i < num_sorted ; i++)
+    {
+        int owner = 0;
+
+        for (int shard = 1 ; shard < self->num_shards ; shard++)
+        {
+            if (loads[shard] < loads[owner])
+            {
+                owner = shard;
+            }
+        }
+
+        gchar * const path = sorted[i].path;
+
+        sorted[i].path = NULL;
+
+        /* A repeated path keeps its first shard. */
+        if (g_hash_table_contains(owners, path))
+        {
+            g_free(path);
+            continue;
+        }
+
+        g_hash_table_insert(owners, path, GINT_TO_POINTER(owner));
+        loads[owner] += sorted[i].cost;
+    }
+
+    g_free(sorted);
+    g_free(loads);
+
+    self->shard_owners = owners;
+    self->owns_shard_owners = TRUE;
+
+    return FILE_FIND_OK;
+
+cleanup:
+
+    for (int i = 0 ; i < num_sorted ; i++)
+    {
+        g_free(sorted[i].path);
+    }
+
+    g_free(sorted);
+    g_free(loads);
+
+    if (owners)
+    {
+        g_hash_table_destroy(owners);
+    }
+
+    return FILE_FIND_OUT_OF_MEMORY;
+}
+
+void file_find_set_should_traverse_depth_first(
+    file_find_handle_t * handle,
+    int should_traverse_depth_first
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->should_traverse_depth_first = should_traverse_depth_first;
+
+    file_finder_calc_default_actions(self);
+
+    return;
+}
+
+/*
+ * Replaces the frontier with a heap by score, a queue (for breadth-first)
+ * or none.
+ * */
+static int file_finder_reset_frontier(file_finder_t * const self)
+{
+    if (self->frontier)
+    {
+        dir_frontier_free(self->frontier);
+        self->frontier = NULL;
+    }
+
+    if (self->dir_score)
+    {
+        self->frontier = dir_frontier_new();
+    }
+    else if (self->is_breadth_first)
+    {
+        self->frontier = dir_frontier_new_queue(self->max_frontier_bytes);
+    }
+
+    file_finder_calc_default_actions(self);
+
+    if ((self->dir_score || self->is_breadth_first) && (! self->frontier))
+    {
+        self->dir_score = NULL;
+        self->is_breadth_first = FALSE;
+        file_finder_calc_default_actions(self);
+
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    return FILE_FIND_OK;
+}
+
+int file_find_set_best_first(
+    file_find_handle_t * handle,
+    double (*score)(const file_find_item_t * item, void * context),
+    void * context
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->dir_score = score;
+    self->dir_score_context = context;
+    self->is_breadth_first = FALSE;
+
+    return file_finder_reset_frontier(self);
+}
+
+int file_find_set_breadth_first(
+    file_find_handle_t * handle,
+    int should_traverse_breadth_first,
+    unsigned long long max_frontier_bytes
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->dir_score = NULL;
+    self->dir_score_context = NULL;
+    self->is_breadth_first = (should_traverse_breadth_first != 0);
+    self->max_frontier_bytes = max_frontier_bytes;
+
+    return file_finder_reset_frontier(self);
+}
+
+int file_find_set_archives(
+    file_find_handle_t * handle,
+    int should_enter_archives
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    self->should_enter_archives = (should_enter_archives != 0);
+
+    if (self->should_enter_archives
+        && (! self->archive_path_buf)
+        && (! ((self->archive_path_buf = g_string_new(NULL))
+            && (self->archive_comps = g_ptr_array_new())
+            && (self->archive_comps_buf = g_string_new(NULL))
+            && (self->pruned_archive_dirs = g_hash_table_new_full(
+                    g_str_hash, g_str_equal, g_free, NULL
+                )))))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    return FILE_FIND_OK;
+}
+
+static GCC_INLINE gboolean file_finder_curr_not_a_dir(file_finder_t * const self)
+{
+    return (!self->top_is_dir);
+}
+
+/*
+ * Joins the first num_comps components of comps into buf, the same way
+ * g_build_filenamev() does: the leading separators of the first component
+ * and the trailing ones of the last are kept, empty components are skipped
+ * and the rest are joined with a single separator.
+ * */
+static void build_path_into(
+    GString * const buf,
+    GPtrArray * const comps,
+    const guint num_comps
+)
+{
+    const gchar * last_trailing = NULL;
+    const gchar * single_element = NULL;
+    gboolean have_leading = FALSE;
+    gboolean is_first = TRUE;
+
+    g_string_truncate(buf, 0);
+
+    for (guint i = 0 ; i < num_comps ; i++)
+    {
+        const gchar * const element = g_ptr_array_index(comps, i);
+
+        if (! *element)
+        {
+            continue;
+        }
+
+        const gchar * start = element;
+
+        while (G_IS_DIR_SEPARATOR(*start))
+        {
+            start++;
+        }
+
+        const gchar * end = start + strlen(start);
+
+        while ((end > start) && G_IS_DIR_SEPARATOR(end[-1]))
+        {
+            end--;
+        }
+
+        last_trailing = end;
+
+        while ((last_trailing > element) && G_IS_DIR_SEPARATOR(last_trailing[-1]))
+        {
+            last_trailing--;
+        }
+
+        if (! have_leading)
+        {
+            /* An element that consists only of separators. */
+            single_element = ((last_trailing <= start) ? element : NULL);
+            g_string_append_len(buf, element, start - element);
+            have_leading = TRUE;
+        }
+        else
+        {
+            single_element = NULL;
+        }
+
+        if (end == start)
+        {
+            continue;
+        }
+
+        if (! is_first)
+        {
+            g_string_append_c(buf, G_DIR_SEPARATOR);
+        }
+
+        g_string_append_len(buf, start, end - start);
+        is_first = FALSE;
+    }
+
+    if (single_element)
+    {
+        g_string_assign(buf, single_element);
+    }
+    else if (last_trailing)
+    {
+        g_string_append(buf, last_trailing);
+    }
+
+    return;
+}
+
+/*
+ * Calculates curr_path from self->curr_comps.
+ * Must be called whenever curr_comps is modified.
+ */
+static status_type file_finder_calc_curr_path(file_finder_t * const self)
+{
+    build_path_into(self->curr_path_buf, self->curr_comps, self->curr_comps->len);
+
+    self->curr_path = self->curr_path_buf->str;
+
+    return FILEFIND_STATUS_OK;
+}
+
+/*
+ * Points self->item at the current state of the finder. Nothing is copied:
+ * it stays valid until the finder moves.
+ * */
+static status_type file_finder_calc_current_item_obj(
+    file_finder_t * const self,
+    item_result_type * * item
+    )
+{
+    item_result_type * const ret = &(self->item);
+    const guint num_comps = self->curr_comps->len;
+
+    /* The first component is the target. */
+    const gchar * const * const comps =
+        (const gchar * const *)self->curr_comps->pdata;
+
+    ret->finder = self;
+    ret->path = self->curr_path;
+    ret->stat_ret = &(self->top_stat);
+    ret->base = comps[0];
+
+    /* A top target that is not a directory has no basename of its own. */
+    ret->basename =
+        ((file_finder_curr_not_a_dir(self) && (num_comps > 1))
+         ? comps[num_comps-1]
+         : NULL
+        );
+
+    ret->dir_components = comps + 1;
+    ret->num_dir_components = num_comps - 1 - (ret->basename ? 1 : 0);
+
+    ret->is_dir = self->top_is_dir;
+    ret->is_link = self->top_is_link;
+    ret->is_file = -1;
+    ret->is_dup_link = self->top_is_dup_link;
+    ret->is_archive_member = FALSE;
+
+    *item = ret;
+
+    return FILEFIND_STATUS_OK;
+}
+
+static status_type file_finder_process_current(file_finder_t * top);
+static status_type file_finder_master_move_to_next(file_finder_t * top);
+static status_type file_finder_check_hard_link(
+    file_finder_t * self,
+    const my_stat_type * stat_ret,
+    gboolean * is_dup_link
+);
+static status_type file_finder_me_die(file_finder_t * top);
+
+/*
+ * Creates the finder of a single root of a parallel scan, with the options
+ * of the top finder.
+ * */
+static int file_finder_new_root_finder(
+    file_find_handle_t * * output_handle,
+    const char * target,
+    void * context
+)
+{
+    file_finder_t * const self = (file_finder_t *)context;
+
+    const int status =
+        file_find_new_with_backend(output_handle, target, self->backend);
+
+    if (status != FILE_FIND_OK)
+    {
+        return status;
+    }
+
+    file_finder_t * const finder = (file_finder_t *)(*output_handle);
+
+    finder->callback = self->callback;
+    finder->callback_context = self->callback_context;
+    finder->should_traverse_depth_first = self->should_traverse_depth_first;
+    finder->filter_callback = self->filter_callback;
+    finder->filter_context = self->filter_context;
+    finder->should_follow_link = self->should_follow_link;
+    finder->should_enter_dirs_once = self->should_enter_dirs_once;
+    finder->should_not_cross_fs = self->should_not_cross_fs;
+    /* Read by file_finder_next_in_parallel() before the roots start. */
+    finder->mount_table = self->mount_table;
+    finder->should_sort = self->should_sort;
+    finder->should_stat_in_inode_order = self->should_stat_in_inode_order;
+    finder->max_listing_bytes = self->max_listing_bytes;
+    finder->prefetch_num_dirs = self->prefetch_num_dirs;
+    finder->prefetch_num_threads = self->prefetch_num_threads;
+    finder->shard_index = self->shard_index;
+    finder->num_shards = self->num_shards;
+    finder->shard_depth = self->shard_depth;
+    finder->shard_owners = self->shard_owners;
+
+    if ((self->skip_fs_types
+            && (! (finder->skip_fs_types = g_strdupv(self->skip_fs_types))))
+        || (self->shard_owners
+            && (! (finder->shard_path_buf = g_string_new(NULL)))))
+    {
+        file_find_free(*output_handle);
+        *output_handle = NULL;
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    if (self->du_callback)
+    {
+        file_find_set_du_callback(
+            *output_handle, self->du_callback, self->du_context
+        );
+    }
+
+    if ((self->dir_score
+            && (file_find_set_best_first(
+                    *output_handle, self->dir_score, self->dir_score_context
+                ) != FILE_FIND_OK))
+        || (self->is_breadth_first
+            && (file_find_set_breadth_first(
+                    *output_handle, TRUE, self->max_frontier_bytes
+                ) != FILE_FIND_OK))
+        || (file_find_set_archives(
+                *output_handle, self->should_enter_archives
+            ) != FILE_FIND_OK))
+    {
+        file_find_free(*output_handle);
+        *output_handle = NULL;
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    file_finder_calc_default_actions(finder);
+
+    return FILE_FIND_OK;
+}
+
+static int file_finder_next_in_parallel(file_finder_t * const self)
+{
+    const gchar * path;
+    const struct stat * stat_ret;
+    item_result_type * const item = &(self->item);
+
+    if (! self->roots_scanner)
+    {
+        if (file_finder_has_mount_policy(self)
+            && (! self->mount_table)
+            && (file_finder_init_mount_table(self) == FILEFIND_STATUS_OUT_OF_MEM))
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        if (! (self->roots_scanner = roots_scanner_new(
+                        self->targets,
+                        self->num_root_threads,
+                        self->roots_in_target_order,
+                        file_finder_new_root_finder,
+                        self
+                    )))
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+    }
+
+    free_item_obj(self);
+
+    /*
+     * The links are tracked here rather than by the finders of the roots,
+     * so that those in different roots are found too.
+     * */
+    gboolean is_dup_link;
+    status_type link_status;
+
+    do
+    {
+        const int status =
+            roots_scanner_next(self->roots_scanner, &path, &stat_ret);
+
+        if (status != FILE_FIND_OK)
+        {
+            return status;
+        }
+
+        link_status = file_finder_check_hard_link(self, stat_ret, &is_dup_link);
+
+        if (link_status == FILEFIND_STATUS_OUT_OF_MEM)
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+    } while (link_status == FILEFIND_STATUS_FALSE);
+
+    memset(item, '\0', sizeof(*item));
+    item->finder = self;
+    item->path = path;
+    item->stat_ret = stat_ret;
+    item->is_file = S_ISREG(stat_ret->st_mode);
+    item->is_dir = S_ISDIR(stat_ret->st_mode);
+    item->is_link = S_ISLNK(stat_ret->st_mode);
+    item->is_dup_link = is_dup_link;
+
+    self->item_obj = item;
+    self->consumer_start_time = stats_now();
+
+    return FILE_FIND_OK;
+}
+
+static GCC_INLINE void file_finder_end_consumer_time(file_finder_t * const self)
+{
+    if (self->consumer_start_time)
+    {
+        self->stats.consumer_ns += stats_now() - self->consumer_start_time;
+        self->consumer_start_time = 0;
+    }
+
+    return;
+}
+
+static void file_finder_close_archive(file_finder_t * const self)
+{
+    if (self->archive)
+    {
+        file_find_archive_free(self->archive);
+        self->archive = NULL;
+    }
+
+    return;
+}
+
+/*
+ * Opens the archive that is the current item. Its dir_components are
+ * those of the members, before their own.
+ * */
+static int file_finder_open_archive(file_finder_t * const self)
+{
+    const int fd = self->backend->open(self->backend->context, self->curr_path);
+
+    const int status = ((fd < 0)
+        ? FILE_FIND_INVALID_ARCHIVE
+        : file_find_archive_open_fd(&(self->archive), fd)
+    );
+
+    if (status != FILE_FIND_OK)
+    {
+        if (status != FILE_FIND_OUT_OF_MEMORY)
+        {
+            self->stats.num_archive_errors++;
+        }
+
+        return status;
+    }
+
+    self->stats.num_archives++;
+
+    g_string_assign(self->archive_path_buf, self->curr_path);
+    self->archive_path_len = self->archive_path_buf->len;
+
+    g_ptr_array_set_size(self->archive_comps, 0);
+
+    for (guint i = 1 ; i < self->curr_comps->len ; i++)
+    {
+        g_ptr_array_add(
+            self->archive_comps, g_ptr_array_index(self->curr_comps, i)
+        );
+    }
+
+    self->archive_num_outer_comps = self->archive_comps->len;
+
+    g_hash_table_remove_all(self->pruned_archive_dirs);
+
+    return FILE_FIND_OK;
+}
+
+static gboolean file_finder_is_archive_member_pruned(
+    file_finder_t * const self,
+    const gchar * const name
+)
+{
+    if (! g_hash_table_size(self->pruned_archive_dirs))
+    {
+        return FALSE;
+    }
+
+    GString * const buf = self->archive_comps_buf;
+
+    g_string_assign(buf, name);
+
+    for (gchar * slash = strchr(buf->str, '/') ; slash ; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+
+        const gboolean is_pruned =
+            g_hash_table_contains(self->pruned_archive_dirs, buf->str);
+
+        *slash = '/';
+
+        if (is_pruned)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * Points self->item at the member of the archive called name.
+ * */
+static void file_finder_set_archive_member_item(
+    file_finder_t * const self,
+    const gchar * const name,
+    const struct stat * const stat_ret
+)
+{
+    item_result_type * const item = &(self->item);
+    const gboolean is_dir = S_ISDIR(stat_ret->st_mode);
+
+    g_string_truncate(self->archive_path_buf, self->archive_path_len);
+    g_string_append_c(self->archive_path_buf, '/');
+    g_string_append(self->archive_path_buf, name);
+
+    /* Its components, without the trailing name of a non-directory. */
+    g_string_assign(self->archive_comps_buf, name);
+    g_ptr_array_set_size(self->archive_comps, self->archive_num_outer_comps);
+
+    gchar * comp = self->archive_comps_buf->str;
+    gchar * slash;
+
+    while ((slash = strchr(comp, '/')))
+    {
+        *slash = '\0';
+        g_ptr_array_add(self->archive_comps, comp);
+        comp = slash + 1;
+    }
+
+    if (is_dir)
+    {
+        g_ptr_array_add(self->archive_comps, comp);
+    }
+
+    memset(item, '\0', sizeof(*item));
+    item->finder = self;
+    item->path = self->archive_path_buf->str;
+    item->stat_ret = stat_ret;
+    item->base = g_ptr_array_index(self->curr_comps, 0);
+    item->basename = (is_dir ? NULL : comp);
+    item->dir_components = (const gchar * const *)self->archive_comps->pdata;
+    item->num_dir_components = self->archive_comps->len;
+    item->is_dir = is_dir;
+    item->is_link = S_ISLNK(stat_ret->st_mode);
+    item->is_file = S_ISREG(stat_ret->st_mode);
+    item->is_archive_member = TRUE;
+
+    self->item_obj = item;
+
+    return;
+}
+
+/*
+ * Returns the next member of the archive that is being entered, or
+ * FILE_FIND_END to go on with the walk.
+ * */
+static int file_finder_next_archive_member(file_finder_t * const self)
+{
+    const char * name;
+    const struct stat * stat_ret;
+    int status;
+
+    if (self->is_archive_pending)
+    {
+        self->is_archive_pending = FALSE;
+
+        status = file_finder_open_archive(self);
+
+        if (status == FILE_FIND_OUT_OF_MEMORY)
+        {
+            return status;
+        }
+    }
+
+    if (! self->archive)
+    {
+        return FILE_FIND_END;
+    }
+
+    do
+    {
+        status = file_find_archive_next(self->archive, &name, &stat_ret);
+
+        if (status != FILE_FIND_OK)
+        {
+            if (status == FILE_FIND_INVALID_ARCHIVE)
+            {
+                self->stats.num_archive_errors++;
+            }
+
+            file_finder_close_archive(self);
+            free_item_obj(self);
+
+            return ((status == FILE_FIND_OUT_OF_MEMORY) ? status : FILE_FIND_END);
+        }
+    } while (file_finder_is_archive_member_pruned(self, name));
+
+    file_finder_set_archive_member_item(self, name, stat_ret);
+
+    self->stats.num_items++;
+    self->stats.num_archive_members++;
+    self->consumer_start_time = stats_now();
+
+    return FILE_FIND_OK;
+}
+
+/*
+ * file_find_set_traverse_to() and file_find_prune() on an archive or one
+ * of its members.
+ * */
+static int file_finder_set_archive_traverse_to(
+    file_finder_t * const self,
+    const int num_children
+)
+{
+    if (num_children)
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    if (self->is_archive_pending)
+    {
+        self->is_archive_pending = FALSE;
+
+        return FILE_FIND_OK;
+    }
+
+    if (! self->item_obj->is_dir)
+    {
+        return FILE_FIND_COULD_NOT_OPEN_DIR;
+    }
+
+    gchar * const dir =
+        g_strdup(self->archive_path_buf->str + self->archive_path_len + 1);
+
+    if (! dir)
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    g_hash_table_add(self->pruned_archive_dirs, dir);
+
+    return FILE_FIND_OK;
+}
+
+static GCC_INLINE gboolean file_finder_is_in_archive(file_finder_t * const self)
+{
+    return (self->is_archive_pending
+        || (self->item_obj && self->item_obj->is_archive_member)
+    );
+}
+
+/*
+ * max_entries and max_ns are 0 for no limit. The walk is only stopped
+ * between its steps, where it would have continued from anyway, and at
+ * least one step is always taken.
+ * */
+static int file_finder_next_with_budget(
+    file_finder_t * const self,
+    const guint64 max_entries,
+    const guint64 max_ns
+)
+{
+    const guint64 deadline = (max_ns ? (stats_now() + max_ns) : 0);
+    guint64 num_entries = 0;
+    gboolean is_first_step = TRUE;
+
+    file_finder_end_consumer_time(self);
+
+    if (self->should_enter_archives)
+    {
+        const int archive_status = file_finder_next_archive_member(self);
+
+        if (archive_status != FILE_FIND_END)
+        {
+            return archive_status;
+        }
+    }
+
+    status_type total_status = FILEFIND_STATUS_FALSE;
+    while (! (total_status == FILEFIND_STATUS_OK))
+    {
+        if ((! is_first_step)
+            && ((max_entries && (num_entries >= max_entries))
+                || (deadline && (stats_now() >= deadline))))
+        {
+            free_item_obj(self);
+            self->consumer_start_time = stats_now();
+
+            return FILE_FIND_AGAIN;
+        }
+
+        is_first_step = FALSE;
+
+        total_status = file_finder_process_current(self);
+        if (total_status == FILEFIND_STATUS_OUT_OF_MEM)
+        {
+            goto cleanup;
+        }
+        else if (total_status == FILEFIND_STATUS_FALSE)
+        {
+            const status_type local_status = file_finder_master_move_to_next(self);
+
+            if (local_status == FILEFIND_STATUS_OUT_OF_MEM)
+            {
+                goto cleanup;
+            }
+            else if (local_status == FILEFIND_STATUS_OK)
+            {
+                num_entries++;
+                total_status = FILEFIND_STATUS_END;
+            }
+            else /* (local_status == FILEFIND_STATUS_END) */
+            {
+                total_status = file_finder_me_die(self);
+
+                if (total_status == FILEFIND_STATUS_OUT_OF_MEM)
+                {
+                    goto cleanup;
+                }
+            }
+        }
+    }
+
+    if (! self->item_obj)
+    {
+        return FILE_FIND_END;
+    }
+
+    if (self->curr_comps->len - 1 > self->stats.max_depth)
+    {
+        self->stats.max_depth = self->curr_comps->len - 1;
+    }
+
+    self->stats.num_items++;
+    self->consumer_start_time = stats_now();
+
+    self->is_archive_pending = (self->should_enter_archives
+        && S_ISREG(self->top_stat.st_mode)
+        && file_find_archive_is_archive_name(self->curr_path)
+    );
+
+    return FILE_FIND_OK;
+
+cleanup:
+    return FILE_FIND_OUT_OF_MEMORY;
+}
+
+int file_find_next(file_find_handle_t * handle)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    if (self->should_scan_roots_in_parallel && (self->targets->len > 1))
+    {
+        file_finder_end_consumer_time(self);
+
+        return file_finder_next_in_parallel(self);
+    }
+
+    return file_finder_next_with_budget(self, 0, 0);
+}
+
+int file_find_next_with_budget(
+    file_find_handle_t * handle,
+    unsigned long long max_entries,
+    unsigned long long max_ns
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    if (self->should_scan_roots_in_parallel && (self->targets->len > 1))
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    return file_finder_next_with_budget(self, max_entries, max_ns);
+}
+
+const gchar * file_find_get_path(file_find_handle_t * handle)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    return self->item_obj ? self->item_obj->path : NULL;
+}
+
+const struct stat * file_find_get_stat(file_find_handle_t * handle)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    return self->item_obj ? self->item_obj->stat_ret : NULL;
+}
+
+const file_find_item_t * file_find_get_item(file_find_handle_t * handle)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    return (const file_find_item_t *)(self->item_obj);
+}
+
+const char * file_find_item_get_path(const file_find_item_t * item)
+{
+    return ((const item_result_type *)item)->path;
+}
+
+const struct stat * file_find_item_get_stat(const file_find_item_t * item)
+{
+    return ((const item_result_type *)item)->stat_ret;
+}
+
+const char * file_find_item_get_base(const file_find_item_t * item)
+{
+    return ((const item_result_type *)item)->base;
+}
+
+const char * file_find_item_get_basename(const file_find_item_t * item)
+{
+    return ((const item_result_type *)item)->basename;
+}
+
+const char * const * file_find_item_get_dir_components(
+    const file_find_item_t * item,
+    int * ptr_to_num
+)
+{
+    const item_result_type * const self = (const item_result_type *)item;
+
+    *ptr_to_num = self->num_dir_components;
+
+    return self->dir_components;
+}
+
+int file_find_item_is_dir(const file_find_item_t * item)
+{
+    return ((const item_result_type *)item)->is_dir;
+}
+
+int file_find_item_is_link(const file_find_item_t * item)
+{
+    return ((const item_result_type *)item)->is_link;
+}
+
+int file_find_item_is_dup_link(const file_find_item_t * item)
+{
+    return ((const item_result_type *)item)->is_dup_link;
+}
+
+int file_find_item_is_archive_member(const file_find_item_t * item)
+{
+    return ((const item_result_type *)item)->is_archive_member;
+}
+
+file_find_archive_t * file_find_get_archive(file_find_handle_t * handle)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    return ((self->item_obj && self->item_obj->is_archive_member)
+        ? self->archive
+        : NULL
+    );
+}
+
+const file_find_backend_t * file_find_get_backend(file_find_handle_t * handle)
+{
+    return ((file_finder_t *)handle)->backend;
+}
+
+int file_find_item_is_file(const file_find_item_t * item)
+{
+    /* Only calculated on demand, since it needs a stat() for links. */
+    item_result_type * const self = (item_result_type *)item;
+
+    if (self->is_file < 0)
+    {
+        if (self->is_link)
+        {
+            const file_find_backend_t * const backend = (self->finder
+                ? self->finder->backend : file_find_backend_posix()
+            );
+            my_stat_type target_stat;
+            const guint64 start_time = stats_now();
+
+            self->is_file =
+                ((backend->stat(
+                        backend->context, self->path, TRUE, &target_stat) == 0)
+                 && S_ISREG(target_stat.st_mode));
+
+            if (self->finder)
+            {
+                self->finder->stats.num_stat++;
+                self->finder->stats.stat_ns += stats_now() - start_time;
+            }
+        }
+        else
+        {
+            self->is_file = S_ISREG(self->stat_ret->st_mode);
+        }
+    }
+
+    return self->is_file;
+}
+
+file_find_item_t * file_find_item_detach(const file_find_item_t * item)
+{
+    const item_result_type * const self = (const item_result_type *)item;
+    item_result_type * ret;
+
+    /* The copy cannot reach the finder to calculate it later. */
+    file_find_item_is_file(item);
+
+    if (! (ret = g_new0(item_result_type, 1)))
+    {
+        return NULL;
+    }
+
+    *ret = *self;
+    ret->finder = NULL;
+    ret->detached_stat = *(self->stat_ret);
+    ret->stat_ret = &(ret->detached_stat);
+
+    ret->path = g_strdup(self->path);
+    ret->base = g_strdup(self->base);
+    ret->basename = g_strdup(self->basename);
+    ret->dir_components = NULL;
+
+    if (self->dir_components)
+    {
+        gchar * * const dir_components =
+            g_new0(gchar *, self->num_dir_components + 1);
+
+        ret->dir_components = (const gchar * const *)dir_components;
+
+        if (! dir_components)
+        {
+            goto cleanup;
+        }
+
+        for (gint i = 0 ; i < self->num_dir_components ; i++)
+        {
+            if (! (dir_components[i] = g_strdup(self->dir_components[i])))
+            {
+                goto cleanup;
+            }
+        }
+    }
+
+    if ((! ret->path)
+        || (self->base && (! ret->base))
+        || (self->basename && (! ret->basename)))
+    {
+        goto cleanup;
+    }
+
+    return (file_find_item_t *)ret;
+
+cleanup:
+
+    file_find_item_free((file_find_item_t *)ret);
+
+    return NULL;
+}
+
+void file_find_item_free(file_find_item_t * item)
+{
+    item_result_type * const self = (item_result_type *)item;
+
+    /* Only detached items are owned by the caller. */
+    g_assert(! self->finder);
+
+    g_free((gchar *)self->path);
+    g_free((gchar *)self->base);
+    g_free((gchar *)self->basename);
+    g_strfreev((gchar * *)self->dir_components);
 
     g_free(self);
 
-    return;
+    return;
+}
+
+void file_find_get_stats(
+    file_find_handle_t * handle,
+    file_find_stats_t * stats
+)
+{
+    file_finder_t * const self = (file_finder_t *)handle;
+
+    *stats = self->stats;
+
+    if (self->seen_hard_links)
+    {
+        stats->num_hard_links_tracked =
+            inode_set_get_size(self->seen_hard_links);
+        stats->hard_links_bytes =
+            inode_set_get_memory_bytes(self->seen_hard_links);
+    }
+
+    if (self->frontier)
+    {
+        stats->num_spilled_dirs = dir_frontier_get_num_spilled(self->frontier);
+    }
+
+    if (self->roots_scanner)
+    {
+        roots_scanner_add_stats(self->roots_scanner, stats);
+    }
+
+    return;
+}
+
+static gboolean file_finder_increment_target_index(file_finder_t * const self)
+{
+    return (++self->target_index < self->targets->len);
+}
+
+/*
+ * TODO : can this return NULL if it reached the end rather than ran out
+ * of memory?
+ * */
+static gchar * file_finder_calc_next_target(file_finder_t * const self)
+{
+    gchar * target;
+
+    target = g_ptr_array_index(self->targets, self->target_index);
+
+    if (! target)
+    {
+        return NULL;
+    }
+    else
+    {
+        return g_strdup(target);
+    }
+}
+
+static status_type file_finder_master_move_to_next(file_finder_t * const self)
+{
+    return self->current->move_next(self->current, self);
+}
+
+static status_type file_finder_become_default(file_finder_t * self);
+static status_type file_finder_du_leave_dir(
+    file_finder_t * self,
+    path_component_type * component,
+    path_component_type * parent
+);
+
+static status_type file_finder_me_die(file_finder_t * const self)
+{
+    if (self->dir_stack->len > 1)
+    {
+        return file_finder_become_default(self);
+    }
+    else
+    {
+        free_item_obj(self);
+
+        return FILEFIND_STATUS_OK;
+    }
+}
+
+static status_type file_finder_become_default(file_finder_t * const self)
+{
+    if (self->du_callback)
+    {
+        const status_type status = file_finder_du_leave_dir(
+            self,
+            g_ptr_array_index(self->dir_stack, self->dir_stack->len - 1),
+            g_ptr_array_index(self->dir_stack, self->dir_stack->len - 2)
+        );
+
+        if (status != FILEFIND_STATUS_OK)
+        {
+            return status;
+        }
+    }
+
+    path_component_type * const leaving =
+        g_ptr_array_index(self->dir_stack, self->dir_stack->len - 1);
+
+    file_finder_add_listing_bytes(
+        self, path_component_listing_bytes(leaving), 0
+    );
+
+    if (self->should_traverse_depth_first)
+    {
+        /*
+         * The directory we are leaving is reported after its contents, so
+         * the stat of its last entry must not be used for it.
+         * */
+        self->top_stat = leaving->stat_ret;
+        self->top_is_dir = TRUE;
+        self->top_is_link = S_ISLNK(self->top_stat.st_mode);
+        self->top_is_dup_link = FALSE;
+    }
+
+    path_component_free(leaving, self);
+    g_ptr_array_remove_index (self->dir_stack, self->dir_stack->len - 1);
+
+    self->current =
+        (path_component_type *)
+        g_ptr_array_index(self->dir_stack, self->dir_stack->len - 1)
+        ;
+
+    g_ptr_array_remove_index (self->curr_comps, self->curr_comps->len - 1);
+
+    /*
+     * If depth is false, then we no longer need the _curr_path
+     * of the directories above the previously-set value, because we
+     * already traversed them. Otherwise, the directory itself (including
+     * the top target) is about to be reported.
+     */
+    if (self->should_traverse_depth_first)
+    {
+        const status_type status = file_finder_calc_curr_path(self);
+
+        if (status != FILEFIND_STATUS_OK)
+        {
+            return status;
+        }
+    }
+
+    return FILEFIND_STATUS_END;
+}
+
+
+static void file_finder_fill_actions(
+    file_finder_t * const self,
+    path_component_type * other
+)
+{
+    memcpy(other->actions, self->def_actions, sizeof(other->actions));
+    other->next_action_idx = 0;
+
+    return;
+}
+
+/*
+ * Sets top_is_dir and the top_dir_* identity from the target of the
+ * symbolic link at curr_path. When following links, the targets are
+ * cached, because the same links are reached again through the other
+ * links that lead to their directories.
+ * */
+static status_type file_finder_resolve_link(file_finder_t * const self)
+{
+    link_target_type resolved;
+    const link_target_type * target = NULL;
+
+    resolved.link.st_dev = self->top_stat.st_dev;
+    resolved.link.st_ino = self->top_stat.st_ino;
+
+    if (self->should_follow_link)
+    {
+        if ((! self->link_cache)
+            && (! (self->link_cache = g_hash_table_new_full(
+                        inode_data_hash, inode_data_equal, NULL, g_free))))
+        {
+            return FILEFIND_STATUS_OUT_OF_MEM;
+        }
+
+        if ((target = g_hash_table_lookup(self->link_cache, &(resolved.link))))
+        {
+            self->stats.num_link_cache_hits++;
+        }
+    }
+
+    if (! target)
+    {
+        my_stat_type target_stat;
+        const guint64 start_time = stats_now();
+
+        if (self->backend->stat(
+                self->backend->context, self->curr_path, TRUE, &target_stat
+            ) == 0)
+        {
+            resolved.is_dir = S_ISDIR(target_stat.st_mode);
+            resolved.target.st_dev = target_stat.st_dev;
+            resolved.target.st_ino = target_stat.st_ino;
+        }
+        else
+        {
+            resolved.is_dir = FALSE;
+            resolved.target.st_dev = 0;
+            resolved.target.st_ino = 0;
+        }
+
+        self->stats.num_stat++;
+        self->stats.stat_ns += stats_now() - start_time;
+
+        target = &resolved;
+
+        if (self->link_cache)
+        {
+            link_target_type * const cached =
+                g_memdup2(&resolved, sizeof(resolved));
+
+            if (! cached)
+            {
+                return FILEFIND_STATUS_OUT_OF_MEM;
+            }
+
+            g_hash_table_insert(self->link_cache, &(cached->link), cached);
+        }
+    }
+
+    self->top_is_dir = target->is_dir;
+    self->top_dir_dev = target->target.st_dev;
+    self->top_dir_ino = target->target.st_ino;
+
+    return FILEFIND_STATUS_SKIP;
+}
+
+/*
+ * entry_stat, if not NULL, holds the results of an earlier lstat() of the
+ * current path, that was taken when listing its directory.
+ * */
+static status_type file_finder_mystat(
+    file_finder_t * const self,
+    const entry_stat_type * const entry_stat
+)
+{
+    int lstat_ret;
+
+    self->top_is_dup_link = FALSE;
+
+    if (entry_stat)
+    {
+        self->top_stat = entry_stat->stat_ret;
+        lstat_ret = (entry_stat->stat_ok ? 0 : -1);
+    }
+    else
+    {
+        const guint64 start_time = stats_now();
+
+        lstat_ret = self->backend->stat(
+            self->backend->context, self->curr_path, FALSE, &(self->top_stat)
+        );
+
+        self->stats.num_stat++;
+        self->stats.stat_ns += stats_now() - start_time;
+    }
+
+    if (lstat_ret != 0)
+    {
+        memset(&(self->top_stat), '\0', sizeof(self->top_stat));
+        self->top_is_dir = FALSE;
+        self->top_is_link = FALSE;
+        self->top_dir_dev = 0;
+        self->top_dir_ino = 0;
+
+        return FILEFIND_STATUS_SKIP;
+    }
+
+    /*
+     * The lstat() results already tell us everything except what a
+     * symbolic link points to, so avoid the extra system calls for the
+     * other entries.
+     * */
+    self->top_is_link = S_ISLNK(self->top_stat.st_mode);
+
+    if (self->top_is_link)
+    {
+        return file_finder_resolve_link(self);
+    }
+
+    self->top_is_dir = S_ISDIR(self->top_stat.st_mode);
+    self->top_dir_dev = self->top_stat.st_dev;
+    self->top_dir_ino = self->top_stat.st_ino;
+
+    return FILEFIND_STATUS_SKIP;
+}
+
+static GCC_INLINE guint64 du_stat_blocks(const my_stat_type * const st)
+{
+#ifdef G_OS_WIN32
+    return ((st->st_size + 511) / 512);
+#else
+    return st->st_blocks;
+#endif
+}
+
+/*
+ * Adds the current item to the du totals of the component that lists it.
+ * */
+static void file_finder_du_account(
+    file_finder_t * const self,
+    path_component_type * const component
+)
+{
+    if (! self->du_callback)
+    {
+        return;
+    }
+
+    if ((! S_ISDIR(self->top_stat.st_mode)) && (self->top_stat.st_nlink > 1))
+    {
+        gboolean was_seen;
+
+        /* If out of memory, the file is counted again. */
+        if (self->du_seen_links
+            && inode_set_add(
+                self->du_seen_links,
+                self->top_stat.st_dev,
+                self->top_stat.st_ino,
+                &was_seen
+            )
+            && was_seen
+        )
+        {
+            return;
+        }
+    }
+
+    component->du_blocks += du_stat_blocks(&(self->top_stat));
+    component->du_size += self->top_stat.st_size;
+    component->du_num_entries++;
+
+    return;
+}
+
+/*
+ * Emits the rollup record of the directory whose listing component
+ * iterated over and adds its totals to its parent.
+ * */
+static status_type file_finder_du_leave_dir(
+    file_finder_t * const self,
+    path_component_type * const component,
+    path_component_type * const parent
+)
+{
+    file_find_du_record_t record;
+
+    GString * const path = g_string_new(NULL);
+
+    if (! path)
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
+
+    /* The last component is the last entry of the directory. */
+    build_path_into(path, self->curr_comps, self->curr_comps->len - 1);
+
+    /* The directory itself was already counted in its parent. */
+    record.path = path->str;
+    record.blocks = component->du_blocks + du_stat_blocks(&(component->stat_ret));
+    record.size = component->du_size + component->stat_ret.st_size;
+    record.num_entries = component->du_num_entries + 1;
+
+    (self->du_callback)(&record, self->du_context);
+
+    g_string_free(path, TRUE);
+
+    parent->du_blocks += component->du_blocks;
+    parent->du_size += component->du_size;
+    parent->du_num_entries += component->du_num_entries;
+
+    return FILEFIND_STATUS_OK;
+}
+
+static status_type file_finder_filter_wrapper(file_finder_t * self);
+
+/*
+ * FNV-1a, which unlike g_str_hash() is the same everywhere, so the shards
+ * agree on their subtrees across processes and machines.
+ * */
+static GCC_INLINE guint64 shard_hash_update(
+    guint64 hash,
+    const gchar * string,
+    const gchar separator
+)
+{
+    for ( ; *string ; string++)
+    {
+        hash = (hash ^ ((guchar)*string)) * 1099511628211ULL;
+    }
+
+    return ((hash ^ ((guchar)separator)) * 1099511628211ULL);
+}
+
+/*
+ * The shard of the subtree at the current item: the one it was given by
+ * file_find_set_shard_costs(), or by the hash of its path relative to the
+ * target (or of the target itself, at depth 0).
+ * */
+static int file_finder_calc_shard(file_finder_t * const self)
+{
+    gpointer owner;
+    guint64 hash = 14695981039346656037ULL;
+
+    if (self->shard_owners)
+    {
+        GString * const buf = self->shard_path_buf;
+
+        g_string_assign(buf, g_ptr_array_index(self->curr_comps, 0));
+
+        for (guint i = 1 ; i < self->curr_comps->len ; i++)
+        {
+            const gchar * const comp = g_ptr_array_index(self->curr_comps, i);
+
+            if (i == 1)
+            {
+                g_string_assign(buf, comp);
+            }
+            else
+            {
+                g_string_append_c(buf, '/');
+                g_string_append(buf, comp);
+            }
+        }
+
+        if (g_hash_table_lookup_extended(
+                self->shard_owners, buf->str, NULL, &owner
+            ))
+        {
+            return GPOINTER_TO_INT(owner);
+        }
+    }
+
+    if (self->curr_comps->len == 1)
+    {
+        hash = shard_hash_update(
+            hash, g_ptr_array_index(self->curr_comps, 0), '/'
+        );
+    }
+
+    for (guint i = 1 ; i < self->curr_comps->len ; i++)
+    {
+        hash = shard_hash_update(
+            hash, g_ptr_array_index(self->curr_comps, i), '/'
+        );
+    }
+
+    return (int)(hash % self->num_shards);
 }
 
-static void destroy_string(gpointer data)
+/*
+ * Whether the current item is walked by this shard, and sets
+ * top_is_shared_dir. The items below the shard depth are only reached
+ * through a subtree of this shard.
+ * */
+static gboolean file_finder_is_in_shard(file_finder_t * const self)
 {
-    g_free((gchar *)data);
+    const guint depth = self->dir_stack->len - 1;
 
-    return;
-}
+    self->top_is_shared_dir = FALSE;
 
-static void file_finder_calc_default_actions(file_finder_t * self);
+    if (depth > self->shard_depth)
+    {
+        return TRUE;
+    }
 
-int file_find_new(file_find_handle_t * * output_handle, const char * first_target)
+    if ((depth < self->shard_depth) && self->top_is_dir)
+    {
+        self->top_is_shared_dir = (self->shard_index != 0);
+
+        return TRUE;
+    }
+
+    return (file_finder_calc_shard(self) == self->shard_index);
+}
+
+/*
+ * Marks a regular file with more than one link as seen. Returns
+ * FILEFIND_STATUS_FALSE if it was seen before and is to be suppressed.
+ * */
+static status_type file_finder_check_hard_link(
+    file_finder_t * const self,
+    const my_stat_type * const stat_ret,
+    gboolean * const is_dup_link
+)
 {
-    file_finder_t * self = NULL;
-    path_component_type * top_path = NULL;
+    gboolean was_seen;
 
-    *output_handle = NULL;
+    *is_dup_link = FALSE;
 
-    if (! (self = g_new0(file_finder_t, 1)))
+    if ((self->hard_links_mode == FILE_FIND_HARD_LINKS_ALL)
+        || (! S_ISREG(stat_ret->st_mode))
+        || (stat_ret->st_nlink <= 1))
     {
-        goto cleanup;
+        return FILEFIND_STATUS_OK;
     }
 
-    /*
-     * The *existence* of an _st key inside the struct
-     * indicates that the stack is full.
-     * So now it's empty.
-     */
+    if ((! self->seen_hard_links)
+        && (! (self->seen_hard_links = inode_set_new())))
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
 
-    self->dir_stack = NULL;
+    if (! inode_set_add(
+            self->seen_hard_links,
+            stat_ret->st_dev,
+            stat_ret->st_ino,
+            &was_seen
+        ))
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
 
-    if (! (self->dir_stack = g_ptr_array_new()))
+    if (! was_seen)
     {
-        goto cleanup;
+        return FILEFIND_STATUS_OK;
     }
 
-    if (! (self->curr_comps = g_ptr_array_new_with_free_func(destroy_string)))
+    self->stats.num_dup_links++;
+    *is_dup_link = TRUE;
+
+    return ((self->hard_links_mode == FILE_FIND_HARD_LINKS_SUPPRESS)
+        ? FILEFIND_STATUS_FALSE : FILEFIND_STATUS_OK
+    );
+}
+
+static status_type file_finder_check_process_current(file_finder_t * const self)
+{
+    if (! self->current->curr_file)
     {
-        goto cleanup;
+        return FILEFIND_STATUS_FALSE;
     }
 
-    if (! (self->targets = g_ptr_array_new_with_free_func(destroy_string)))
+    if (self->num_shards && (! file_finder_is_in_shard(self)))
     {
-        goto cleanup;
+        return FILEFIND_STATUS_FALSE;
     }
 
-    if (first_target)
+    const status_type status = file_finder_filter_wrapper(self);
+
+    /* The item is processed again for each of its actions. */
+    if ((status != FILEFIND_STATUS_OK) || (self->current->next_action_idx > 0))
     {
-        gchar * target_copy;
+        return status;
+    }
 
-        target_copy = g_strdup(first_target);
+    return file_finder_check_hard_link(
+        self, &(self->top_stat), &(self->top_is_dup_link)
+    );
+}
 
-        if (! target_copy)
-        {
-            goto cleanup;
-        }
+static status_type file_finder_process_current_actions(file_finder_t * self);
 
-        g_ptr_array_add(self->targets, target_copy);
-    }
+static status_type file_finder_process_current(file_finder_t * const self)
+{
+    status_type ret;
 
-    self->target_index = -1;
+    ret = file_finder_check_process_current(self);
 
+    if (ret != FILEFIND_STATUS_OK)
     {
-        top_path = top_path_new(self);
+        return ret;
+    }
+    else
+    {
+        return file_finder_process_current_actions(self);
+    }
+}
 
-        if (! top_path)
-        {
-            goto cleanup;
-        }
+static status_type file_finder_set_obj(file_finder_t * const self)
+{
+    free_item_obj(self);
+    return file_finder_calc_current_item_obj(self, &(self->item_obj));
+}
 
-        self->current = top_path;
+static status_type file_finder_run_cb(file_finder_t * const self)
+{
+    status_type ret;
 
-        g_ptr_array_add(self->dir_stack, top_path);
+    ret = file_finder_set_obj(self);
+
+    if (ret != FILEFIND_STATUS_OK)
+    {
+        return ret;
     }
 
-    self->callback = NULL;
-    self->callback_context = NULL;
-    self->should_traverse_depth_first = FALSE;
-    self->filter_callback = NULL;
-    self->filter_context = NULL;
-    self->should_follow_link = FALSE;
-    self->should_not_cross_fs = FALSE;
+    const guint64 start_time = stats_now();
 
-    *output_handle = (file_find_handle_t *)self;
+    (self->callback)(self->curr_path, self->callback_context);
 
-    file_finder_calc_default_actions(self);
+    self->stats.num_callbacks++;
+    self->stats.callback_ns += stats_now() - start_time;
 
-    return FILE_FIND_OK;
+    return FILEFIND_STATUS_OK;
+}
 
-cleanup:
+static status_type file_finder_recurse(file_finder_t * self);
 
-    if (top_path)
+static status_type file_finder_process_current_actions(file_finder_t * const self)
+{
+    while (self->current->next_action_idx < NUM_ACTIONS)
     {
-        path_component_free(top_path);
+        status_type status;
+
+        const gint action = self->current->actions[(self->current->next_action_idx)++];
+
+        switch (action)
+        {
+            case ACTION_RUN_CB:
+                status = (self->top_is_shared_dir
+                    ? FILEFIND_STATUS_SKIP : file_finder_run_cb(self)
+                );
+                break;
+
+            case ACTION_SET_OBJ:
+                status = (self->top_is_shared_dir
+                    ? FILEFIND_STATUS_SKIP : file_finder_set_obj(self)
+                );
+                break;
+
+            case ACTION_RECURSE:
+                status = file_finder_recurse(self);
+                break;
+
+            case ACTION_NONE:
+                status = FILEFIND_STATUS_SKIP;
+                break;
+        }
+
+        if (status != FILEFIND_STATUS_SKIP)
+        {
+            return status;
+        }
     }
-    if (self)
+
+    return FILEFIND_STATUS_FALSE;
+}
+
+static status_type file_finder_check_subdir(file_finder_t * self);
+
+/*
+ * Queues the current directory (by its score), to be entered by
+ * file_finder_enter_frontier_dir() instead of now. What
+ * file_find_set_traverse_to() left in it goes along with it.
+ * */
+static status_type file_finder_defer_dir(file_finder_t * const self)
+{
+    path_component_type * const current = self->current;
+    GPtrArray * traverse_to = NULL;
+    item_result_type * item;
+
+    if (current->is_traverse_to_set)
     {
-        if (self->dir_stack)
+        const guint64 old_bytes = path_component_listing_bytes(current);
+        GPtrArray * const empty = g_ptr_array_new();
+
+        if (! empty)
         {
-            g_ptr_array_free(self->dir_stack, 1);
-            self->dir_stack = NULL;
+            return FILEFIND_STATUS_OUT_OF_MEM;
         }
 
-        if (self->curr_comps)
+        traverse_to = current->traverse_to;
+
+        for (gint i = 0 ; i < current->next_traverse_to_idx ; i++)
         {
-            g_ptr_array_free(self->curr_comps, 1);
-            self->curr_comps = NULL;
+            g_free(g_ptr_array_index(traverse_to, i));
         }
 
-        if (self->targets)
+        g_ptr_array_remove_range(traverse_to, 0, current->next_traverse_to_idx);
+
+        current->traverse_to = empty;
+        current->next_traverse_to_idx = 0;
+        current->traverse_to_bytes = 0;
+        current->is_traverse_to_set = FALSE;
+
+        /* So that it is listed again if needed. */
+        g_free(current->last_dir_scanned);
+        current->last_dir_scanned = NULL;
+
+        file_finder_add_listing_bytes(
+            self, old_bytes, path_component_listing_bytes(current)
+        );
+    }
+
+    gdouble score = 0;
+
+    if (self->dir_score)
+    {
+        file_finder_calc_current_item_obj(self, &item);
+
+        score = (self->dir_score)(
+            (const file_find_item_t *)item, self->dir_score_context
+        );
+    }
+
+    if (! dir_frontier_push(
+            self->frontier,
+            self->frontier_current,
+            current->curr_file,
+            self->top_dir_dev,
+            self->top_dir_ino,
+            traverse_to,
+            score
+        ))
+    {
+        if (traverse_to)
         {
-            g_ptr_array_free(self->targets, 1);
-            self->targets = NULL;
+            string_array_free(traverse_to);
         }
 
-        g_free(self);
+        return FILEFIND_STATUS_OUT_OF_MEM;
     }
 
-    return FILE_FIND_OUT_OF_MEMORY;
+    return FILEFIND_STATUS_SKIP;
 }
 
-static void file_finder_calc_default_actions(file_finder_t * const self)
+static status_type file_finder_recurse(file_finder_t * const self)
+{
+    const status_type status = file_finder_check_subdir(self);
+
+    if (status == FILEFIND_STATUS_FALSE)
+    {
+        return FILEFIND_STATUS_SKIP;
+    }
+    else if (status == FILEFIND_STATUS_OUT_OF_MEM)
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
+
+    /* The targets themselves are entered at once. */
+    if (self->frontier && (! self->du_callback) && (self->dir_stack->len > 1))
+    {
+        return file_finder_defer_dir(self);
+    }
+
+    path_component_type * const deep_path = deep_path_new(self, self->current);
+
+    if (!deep_path)
+    {
+        return FILEFIND_STATUS_OUT_OF_MEM;
+    }
+
+    self->current = deep_path;
+    g_ptr_array_add(self->dir_stack, deep_path);
+
+    if (self->dir_stack->len > self->stats.peak_dir_stack_len)
+    {
+        self->stats.peak_dir_stack_len = self->dir_stack->len;
+    }
+
+    return FILEFIND_STATUS_FALSE;
+}
+
+static status_type file_finder_filter_wrapper(file_finder_t * const self)
+{
+    if (self->filter_callback)
+    {
+        return
+        (
+            (self->filter_callback)(self->curr_path, self->filter_context)
+            ? FILEFIND_STATUS_OK
+            : FILEFIND_STATUS_FALSE
+        );
+    }
+    else
+    {
+        return FILEFIND_STATUS_OK;
+    }
+}
+
+static status_type file_finder_is_other_fs(file_finder_t * self);
+static status_type file_finder_is_loop(file_finder_t * self);
+static status_type file_finder_mark_dir_entered(
+    file_finder_t * self,
+    gboolean should_enter_anyway
+);
+
+static status_type file_finder_check_subdir(file_finder_t * const self)
 {
-    int calc_obj = self->callback ? ACTION_RUN_CB : ACTION_SET_OBJ;
+    /*
+     * If current is not a directory always return 0, because we may
+     * be asked to traverse single-files.
+     */
+
+    if (file_finder_curr_not_a_dir(self))
+    {
+        return FILEFIND_STATUS_FALSE;
+    }
 
-    if (self->should_traverse_depth_first)
+    if (self->dir_stack->len <= 1)
     {
-        self->def_actions[0] = ACTION_RECURSE;
-        self->def_actions[1] = calc_obj;
+        return file_finder_mark_dir_entered(self, TRUE);
     }
-    else
+
+    if ((!self->should_follow_link) && (self->top_is_link))
     {
-        self->def_actions[0] = calc_obj;
-        self->def_actions[1] = ACTION_RECURSE;
+        return FILEFIND_STATUS_FALSE;
     }
 
-    return;
-}
-
-void file_find_set_callback(
-    file_find_handle_t * handle,
-    void (*callback)(const char * filename, void * context)
-)
-{
-    file_finder_t * const self = (file_finder_t *)handle;
-
-    self->callback = callback;
-
-    file_finder_calc_default_actions(self);
-
-    return;
-}
+    if (file_finder_is_fs_type_skipped(self, self->top_dir_dev))
+    {
+        return FILEFIND_STATUS_FALSE;
+    }
 
-void file_find_set_should_traverse_depth_first(
-    file_find_handle_t * handle,
-    int should_traverse_depth_first
-)
-{
-    file_finder_t * const self = (file_finder_t *)handle;
+    if (self->should_not_cross_fs)
+    {
+        const status_type status = file_finder_is_other_fs(self);
 
-    self->should_traverse_depth_first = should_traverse_depth_first;
+        if (status != FILEFIND_STATUS_FALSE)
+        {
+            return ((status == FILEFIND_STATUS_OK) ? FILEFIND_STATUS_FALSE : status);
+        }
+    }
 
-    file_finder_calc_default_actions(self);
+    const status_type status = file_finder_is_loop(self);
 
-    return;
-}
+    if (status != FILEFIND_STATUS_FALSE)
+    {
+        return ((status == FILEFIND_STATUS_OK) ? FILEFIND_STATUS_FALSE : status);
+    }
 
-static GCC_INLINE gboolean file_finder_curr_not_a_dir(file_finder_t * const self)
-{
-    return (!self->top_is_dir);
+    return file_finder_mark_dir_entered(self, FALSE);
 }
 
 /*
- * Calculates curr_path from self->curr_comps.
- * Must be called whenever curr_comps is modified.
- */
-static status_type file_finder_calc_curr_path(file_finder_t * const self)
+ * Returns FILEFIND_STATUS_FALSE if should_enter_dirs_once is set and the
+ * current directory was already entered, unless it is to be entered
+ * anyway, as the targets are.
+ * */
+static status_type file_finder_mark_dir_entered(
+    file_finder_t * const self,
+    const gboolean should_enter_anyway
+)
 {
-    gchar * * components;
+    gboolean was_entered;
 
-    if (self->curr_path)
+    if (! self->should_enter_dirs_once)
     {
-        g_free(self->curr_path);
-        self->curr_path = NULL;
+        return FILEFIND_STATUS_OK;
     }
 
-    components = g_new0(gchar *, self->curr_comps->len+1);
-    if (! components)
+    if ((! self->entered_dirs)
+        && (! (self->entered_dirs = inode_set_new())))
     {
         return FILEFIND_STATUS_OUT_OF_MEM;
     }
 
-    int i;
-    for ( i = 0 ; i < self->curr_comps->len ; i++)
-    {
-        components[i] = g_ptr_array_index (self->curr_comps, i);
-    }
-    components[i] = NULL;
-
-    if (! (self->curr_path = g_build_filenamev(components)))
+    if (! inode_set_add(
+            self->entered_dirs,
+            self->top_dir_dev,
+            self->top_dir_ino,
+            &was_entered
+        ))
     {
-        g_free(components);
         return FILEFIND_STATUS_OUT_OF_MEM;
     }
 
-    g_free(components);
-
-    return FILEFIND_STATUS_OK;
+    return ((was_entered && (! should_enter_anyway))
+        ? FILEFIND_STATUS_FALSE : FILEFIND_STATUS_OK
+    );
 }
 
-static void item_result_free(item_result_type * item)
+/*
+ * Whether the current directory is on another file system than the
+ * target, or is a bind mount.
+ * */
+static status_type file_finder_is_other_fs(file_finder_t * const self)
 {
-    if (item->path)
+    if (self->top_dir_dev != self->dev)
     {
-        g_free(item->path);
-        item->path = NULL;
+        return FILEFIND_STATUS_OK;
     }
 
-    if (item->basename)
+    if (! self->target_real_path)
     {
-        g_free(item->basename);
-        item->basename = NULL;
+        return FILEFIND_STATUS_FALSE;
     }
 
-    if (item->base)
+    GString * const path = self->mount_path_buf;
+
+    g_string_assign(path, self->target_real_path);
+
+    for (guint i = 1 ; i < self->curr_comps->len ; i++)
     {
-        g_free(item->base);
-        item->base = NULL;
+        if ((! path->len) || (! G_IS_DIR_SEPARATOR(path->str[path->len-1])))
+        {
+            g_string_append_c(path, G_DIR_SEPARATOR);
+        }
+
+        g_string_append(path, g_ptr_array_index(self->curr_comps, i));
     }
 
-    if (item->dir_components)
+    return (mount_table_is_mount_point(self->mount_table, path->str)
+        ? FILEFIND_STATUS_OK : FILEFIND_STATUS_FALSE
+    );
+}
+
+static status_type file_finder_is_loop(file_finder_t * const self)
+{
+    ino_t inode;
+    inode_data_type key;
+
+    if ((inode = self->top_dir_ino))
     {
-        g_ptr_array_free(item->dir_components, 1);
-    }
+        key.st_ino = inode;
+        key.st_dev = self->top_dir_dev;
 
-    g_free(item);
+        const guint64 start_time = stats_now();
 
-    return;
+        const gboolean found =
+            (g_tree_search(
+                self->current->inodes,
+                inode_tree_cmp,
+                ((gconstpointer)&key)
+            ) != NULL);
+
+        self->stats.num_inode_lookups++;
+        self->stats.inode_lookup_ns += stats_now() - start_time;
+
+        return (found ? FILEFIND_STATUS_OK : FILEFIND_STATUS_FALSE);
+    }
+    else
+    {
+        return FILEFIND_STATUS_FALSE;
+    }
 }
 
-static status_type file_finder_calc_current_item_obj(
-    file_finder_t * const self,
-    item_result_type * * item
-    )
+static status_type file_finder_open_dir(file_finder_t * const self)
 {
-    item_result_type * ret;
-    int comp_idx, end_comp_idx;
-    gboolean curr_not_a_dir;
-    GPtrArray * dir_components;
-    gchar * comp_copy;
+    const guint64 old_bytes = path_component_listing_bytes(self->current);
+
+    const status_type status = path_component_component_open_dir(
+        self->current, self->curr_path, self
+    );
+
+    file_finder_add_listing_bytes(
+        self, old_bytes, path_component_listing_bytes(self->current)
+    );
+
+    return status;
+}
 
-    dir_components = NULL;
+int file_find_set_traverse_to(
+    file_find_handle_t * handle,
+    int num_children,
+    char * * children
+)
+{
+    int up_to_i;
+    GPtrArray * traverse_to;
+    gchar * new_string;
 
-    ret = g_new0(item_result_type, 1);
+    file_finder_t * const self = (file_finder_t *)handle;
 
-    if (!ret)
+    if (self->roots_scanner)
     {
-        return FILEFIND_STATUS_OUT_OF_MEM;
+        return FILE_FIND_NOT_SUPPORTED;
     }
 
-    ret->path = NULL;
-    ret->basename = NULL;
-    ret->dir_components = NULL;
-    ret->base = NULL;
-
-    if (! (ret->path = g_strdup(self->curr_path)))
+    if (file_finder_is_in_archive(self))
     {
-        goto cleanup;
+        return file_finder_set_archive_traverse_to(self, num_children);
     }
 
-    comp_idx = 0;
+    const status_type status = file_finder_open_dir(self);
 
-    if (!(ret->base = g_strdup(g_ptr_array_index(self->curr_comps, comp_idx))))
+    if (status == FILEFIND_STATUS_OUT_OF_MEM)
     {
-        goto cleanup;
+        return FILE_FIND_OUT_OF_MEMORY;
     }
 
-    comp_idx++;
+    if (status == FILEFIND_STATUS_OK)
+    {
+        const guint64 old_bytes = path_component_listing_bytes(self->current);
 
-    curr_not_a_dir = file_finder_curr_not_a_dir(self);
+        if (self->current->stream || self->current->spill)
+        {
+            path_component_close_listing(self->current, self);
+            self->current->files_bytes = 0;
+        }
 
-    end_comp_idx = self->curr_comps->len - 1 - (curr_not_a_dir ? 1 : 0);
+#ifdef G_OS_UNIX
+        /* The subdirectories that will be entered may have changed. */
+        if (self->prefetcher)
+        {
+            dir_prefetcher_drop_below(self->prefetcher, self->curr_path);
+        }
+#endif
 
-    dir_components = g_ptr_array_new_with_free_func(destroy_string);
+        traverse_to = self->current->traverse_to;
 
-    for (; comp_idx < end_comp_idx ; comp_idx++)
-    {
-        comp_copy =
-            g_strdup(
-                g_ptr_array_index(self->curr_comps, comp_idx)
-            );
+        self->current->next_traverse_to_idx = 0;
+        self->current->is_traverse_to_set = TRUE;
+        self->current->traverse_to_bytes = 0;
 
-        if (! comp_copy)
+        /*
+         * All the old entries are freed, including the first num_children
+         * ones, whose slots are overwritten by the copies of children.
+         * */
+        for (gint i = 0 ; i < traverse_to->len ; ++i)
         {
-            goto cleanup;
+            g_free(g_ptr_array_index(traverse_to, i));
         }
-        g_ptr_array_add(dir_components, comp_copy);
-    }
 
-    ret->dir_components = dir_components;
-    /* Avoid double-free. */
-    dir_components = NULL;
+        g_ptr_array_set_size(traverse_to, num_children);
 
-    if (curr_not_a_dir)
-    {
-        if (!(ret->basename =
-            g_strdup(
-                g_ptr_array_index(self->curr_comps, comp_idx)
-            ))
-        )
+        for (gint i=0 ; i < num_children ; ++i)
         {
-            goto cleanup;
+            if (!(new_string = g_strdup((gchar *)children[i])))
+            {
+                for (up_to_i = 0 ; up_to_i < i ; up_to_i++)
+                {
+                    g_free (g_ptr_array_index(traverse_to, up_to_i));
+                    g_ptr_array_index(traverse_to, up_to_i) = NULL;
+                }
+                return FILE_FIND_OUT_OF_MEMORY;
+            }
+
+            g_ptr_array_index(traverse_to, i) = new_string;
+            self->current->traverse_to_bytes +=
+                string_array_entry_bytes(new_string);
         }
-    }
 
-    ret->stat_ret = self->top_stat;
-    ret->is_file = g_file_test(self->curr_path, G_FILE_TEST_IS_REGULAR);
-    ret->is_dir = g_file_test(self->curr_path, G_FILE_TEST_IS_DIR);
-    ret->is_link = g_file_test(self->curr_path, G_FILE_TEST_IS_SYMLINK);
+        file_finder_add_listing_bytes(
+            self, old_bytes, path_component_listing_bytes(self->current)
+        );
 
-    *item = ret;
+        return FILE_FIND_OK;
+    }
+    else
+    {
+        return FILE_FIND_COULD_NOT_OPEN_DIR;
+    }
+}
 
-    return FILEFIND_STATUS_OK;
+static int glib_strings_array_to_c(
+    GPtrArray * array,
+    int start_idx,
+    int * ptr_to_num_strings,
+    char * * * ptr_to_strings
+)
+{
+    int num_strings;
+    int up_to_i;
+    char * * strings = NULL, * * next_string;
 
-cleanup:
+    num_strings = array->len - start_idx;
+    strings = malloc(sizeof(strings[0]) * (num_strings+1));
 
-    item_result_free(ret);
-    if (dir_components)
+    if (! strings)
     {
-        g_ptr_array_free(dir_components, 1);
+        return FILE_FIND_OUT_OF_MEMORY;
     }
 
-    ret = NULL;
-    return FILEFIND_STATUS_OUT_OF_MEM;
-}
-
-static status_type file_finder_process_current(file_finder_t * top);
-static status_type file_finder_master_move_to_next(file_finder_t * top);
-static status_type file_finder_me_die(file_finder_t * top);
-
-int file_find_next(file_find_handle_t * handle)
-{
-    file_finder_t * const self = (file_finder_t *)handle;
+    next_string = strings;
 
-    status_type total_status = FILEFIND_STATUS_FALSE;
-    while (! (total_status == FILEFIND_STATUS_OK))
+    for (gint i = 0 ; i < num_strings ; i++, next_string++ )
     {
-        total_status = file_finder_process_current(self);
-        if (total_status == FILEFIND_STATUS_OUT_OF_MEM)
-        {
-            goto cleanup;
-        }
-        else if (total_status == FILEFIND_STATUS_FALSE)
+        if (! ((*next_string)
+                    = strdup((char *)g_ptr_array_index(array, i+start_idx)))
+           )
         {
-            const status_type local_status = file_finder_master_move_to_next(self);
-
-            if (local_status == FILEFIND_STATUS_OUT_OF_MEM)
-            {
-                goto cleanup;
-            }
-            else if (local_status == FILEFIND_STATUS_OK)
+            for (up_to_i = 0; up_to_i < i; up_to_i++)
             {
-                total_status = FILEFIND_STATUS_END;
+                free(strings[up_to_i]);
             }
-            else /* (local_status == FILEFIND_STATUS_END) */
-            {
-                total_status = file_finder_me_die(self);
 
-                if (total_status == FILEFIND_STATUS_OUT_OF_MEM)
-                {
-                    goto cleanup;
-                }
-            }
+            free(strings);
+
+            return FILE_FIND_OUT_OF_MEMORY;
         }
     }
 
-    return (self->item_obj ? FILE_FIND_OK : FILE_FIND_END);
+    /* Add a NULL terminator at the end of the file names. */
+    *next_string = NULL;
 
-cleanup:
-    return FILE_FIND_OUT_OF_MEMORY;
+    *ptr_to_num_strings = num_strings;
+    *ptr_to_strings = strings;
+
+    return FILE_FIND_OK;
 }
 
-const gchar * file_find_get_path(file_find_handle_t * handle)
+/*
+ * Lists the current directory in full, for when its listing is streamed or
+ * spilled and so is not held in memory.
+ * */
+static GPtrArray * file_finder_read_full_listing(file_finder_t * const self)
 {
-    file_finder_t * const self = (file_finder_t *)handle;
+    const file_find_backend_t * const backend = self->backend;
+    const gchar * filename;
+
+    GPtrArray * const files = g_ptr_array_new();
+
+    if (! files)
+    {
+        return NULL;
+    }
+
+    void * const handle = backend->opendir(backend->context, self->curr_path);
+
+    if (handle)
+    {
+        while ((filename = backend->readdir(backend->context, handle)))
+        {
+            gchar * const fn_copy = g_strdup(filename);
+
+            if (! fn_copy)
+            {
+                backend->closedir(backend->context, handle);
+                string_array_free(files);
+                return NULL;
+            }
+
+            g_ptr_array_add(files, fn_copy);
+        }
+
+        backend->closedir(backend->context, handle);
+    }
 
-    return self->item_obj ? self->item_obj->path : NULL;
-}
+    if (self->should_sort)
+    {
+        g_ptr_array_sort(files, indirect_lexic_compare);
+    }
 
-static gboolean file_finder_increment_target_index(file_finder_t * const self)
-{
-    return (++self->target_index < self->targets->len);
+    return files;
 }
 
-/*
- * TODO : can this return NULL if it reached the end rather than ran out
- * of memory?
- * */
-static gchar * file_finder_calc_next_target(file_finder_t * const self)
+int file_find_get_current_node_files_list(
+    file_find_handle_t * handle,
+    int * ptr_to_num_files,
+    char * * * ptr_to_file_names
+)
 {
-    gchar * target;
+    file_finder_t * const self = (file_finder_t *)handle;
 
-    target = g_ptr_array_index(self->targets, self->target_index);
+    *ptr_to_num_files = 0;
+    *ptr_to_file_names = NULL;
 
-    if (! target)
+    if (self->roots_scanner || file_finder_is_in_archive(self))
     {
-        return NULL;
+        return FILE_FIND_NOT_SUPPORTED;
     }
-    else
+
+    const status_type status = file_finder_open_dir(self);
+
+    if (status == FILEFIND_STATUS_OUT_OF_MEM)
     {
-        return g_strdup(target);
+        return FILE_FIND_OUT_OF_MEMORY;
     }
-}
 
-static status_type file_finder_master_move_to_next(file_finder_t * const self)
-{
-    return self->current->move_next(self->current, self);
-}
+    if (status == FILEFIND_STATUS_OK)
+    {
+        if (! (self->current->stream || self->current->spill))
+        {
+            return glib_strings_array_to_c(
+                self->current->files,
+                0,
+                ptr_to_num_files,
+                ptr_to_file_names
+            );
+        }
 
-static status_type file_finder_become_default(file_finder_t * self);
+        GPtrArray * const files = file_finder_read_full_listing(self);
 
-static status_type file_finder_me_die(file_finder_t * const self)
-{
-    if (self->dir_stack->len > 1)
-    {
-        return file_finder_become_default(self);
+        if (! files)
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        const int ret = glib_strings_array_to_c(
+            files,
+            0,
+            ptr_to_num_files,
+            ptr_to_file_names
+        );
+
+        string_array_free(files);
+
+        return ret;
     }
     else
     {
-        free_item_obj(self);
-
-        return FILEFIND_STATUS_OK;
+        return FILE_FIND_COULD_NOT_OPEN_DIR;
     }
 }
 
-static status_type file_finder_become_default(file_finder_t * const self)
+int file_find_prune(
+    file_find_handle_t * handle
+)
 {
-    path_component_free(
-        (path_component_type *)g_ptr_array_index(self->dir_stack, self->dir_stack->len - 1)
-    );
-    g_ptr_array_remove_index (self->dir_stack, self->dir_stack->len - 1);
+    return file_find_set_traverse_to(handle, 0, NULL);
+}
 
-    self->current =
-        (path_component_type *)
-        g_ptr_array_index(self->dir_stack, self->dir_stack->len - 1)
-        ;
+int file_find_get_traverse_to(
+    file_find_handle_t * handle,
+    int * ptr_to_num_files,
+    char * * * ptr_to_file_names
+)
+{
+    file_finder_t * self;
 
-    g_ptr_array_remove_index (self->curr_comps, self->curr_comps->len - 1);
+    self = (file_finder_t *)handle;
 
-    if (self->dir_stack->len > 1)
-    {
-        /*
-         * If depth is false, then we no longer need the _curr_path
-         * of the directories above the previously-set value, because we
-         * already traversed them.
-         *
-         * TODO : should this be if (! self->depth)
-         */
-        if (self->should_traverse_depth_first)
-        {
-            const status_type status = file_finder_calc_curr_path(self);
+    *ptr_to_num_files = 0;
+    *ptr_to_file_names = NULL;
 
-            if (status != FILEFIND_STATUS_OK)
-            {
-                return status;
-            }
-        }
+    if (self->roots_scanner || file_finder_is_in_archive(self))
+    {
+        return FILE_FIND_NOT_SUPPORTED;
     }
 
-    return FILEFIND_STATUS_END;
-}
+    const guint64 old_bytes = path_component_listing_bytes(self->current);
 
+    if (path_component_materialise_traverse_to(self->current, self)
+        != FILEFIND_STATUS_OK)
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
 
-static void file_finder_fill_actions(
-    file_finder_t * const self,
-    path_component_type * other
-)
-{
-    memcpy(other->actions, self->def_actions, sizeof(other->actions));
-    other->next_action_idx = 0;
+    file_finder_add_listing_bytes(
+        self, old_bytes, path_component_listing_bytes(self->current)
+    );
 
-    return;
+    return glib_strings_array_to_c(
+            self->current->traverse_to,
+            self->current->next_traverse_to_idx,
+            ptr_to_num_files,
+            ptr_to_file_names
+            );
 }
 
-static status_type file_finder_mystat(file_finder_t * const self)
-{
-    g_lstat(self->curr_path, &(self->top_stat));
+#define CHECKPOINT_MAGIC "FFCKPT01"
+#define CHECKPOINT_MAGIC_LEN 8
 
-    self->top_is_dir = g_file_test(self->curr_path, G_FILE_TEST_IS_DIR);
+enum CHECKPOINT_FLAG
+{
+    CHECKPOINT_FLAG_DEPTH_FIRST = (1 << 0),
+};
 
-    self->top_is_link = g_file_test(self->curr_path, G_FILE_TEST_IS_SYMLINK);
+/*
+ * The number of names of a level whose traverse_to was not replaced, and
+ * so is not stored.
+ * */
+#define CHECKPOINT_NOT_SET 0xFFFFFFFFU
 
-    return FILEFIND_STATUS_SKIP;
-}
+/*
+ * A level takes at least its action index, the length and NUL of its name
+ * and its number of names.
+ * */
+#define CHECKPOINT_MIN_LEVEL_SIZE 13
 
-static status_type file_finder_filter_wrapper(file_finder_t * self);
+/*
+ * A checkpoint is:
+ *
+ * 1. CHECKPOINT_MAGIC, then little-endian uint32s of the flags, the number
+ * of targets, the target index (-1 before the first target) and the number
+ * of levels.
+ *
+ * 2. For every component on dir_stack, from the target down: a uint32 of
+ * its next_action_idx, its curr_file, and either CHECKPOINT_NOT_SET or the
+ * number of the names that are left in its replaced traverse_to, followed
+ * by the names.
+ *
+ * The strings are a uint32 of their length, followed by their bytes and a
+ * NUL.
+ * */
 
-static status_type file_finder_check_process_current(file_finder_t * const self)
+/*
+ * What file_find_checkpoint() does not keep: the order of the unsorted
+ * listings, and the sets of the inodes that were already seen.
+ * */
+static gboolean file_finder_can_checkpoint(file_finder_t * const self)
 {
-    if (! self->current->curr_file)
-    {
-        return FILEFIND_STATUS_FALSE;
-    }
-
-    return file_finder_filter_wrapper(self);
+    return (self->should_sort
+        && (! self->roots_scanner)
+        && (! (self->should_scan_roots_in_parallel && (self->targets->len > 1)))
+        && (! self->du_callback)
+        && (self->hard_links_mode == FILE_FIND_HARD_LINKS_ALL)
+        && (! self->should_enter_dirs_once)
+        && (! self->frontier)
+        && (! self->should_enter_archives)
+    );
 }
 
-static status_type file_finder_process_current_actions(file_finder_t * self);
+static guint32 file_finder_checkpoint_flags(file_finder_t * const self)
+{
+    return (self->should_traverse_depth_first
+        ? CHECKPOINT_FLAG_DEPTH_FIRST : 0
+    );
+}
 
-static status_type file_finder_process_current(file_finder_t * const self)
+static void checkpoint_append_u32(GString * const buf, const guint32 value)
 {
-    status_type ret;
+    const guint32 le_value = GUINT32_TO_LE(value);
 
-    ret = file_finder_check_process_current(self);
+    g_string_append_len(buf, (const gchar *)&le_value, sizeof(le_value));
 
-    if (ret != FILEFIND_STATUS_OK)
-    {
-        return ret;
-    }
-    else
-    {
-        return file_finder_process_current_actions(self);
-    }
+    return;
 }
 
-static status_type file_finder_set_obj(file_finder_t * const self)
+static void checkpoint_append_string(
+    GString * const buf,
+    const gchar * const string
+)
 {
-    free_item_obj(self);
-    return file_finder_calc_current_item_obj(self, &(self->item_obj));
+    const gsize len = strlen(string);
+
+    checkpoint_append_u32(buf, len);
+    g_string_append_len(buf, string, len + 1);
+
+    return;
 }
 
-static status_type file_finder_run_cb(file_finder_t * const self)
+int file_find_checkpoint(
+    file_find_handle_t * handle,
+    char * * output_buffer,
+    size_t * output_len
+)
 {
-    status_type ret;
+    file_finder_t * const self = (file_finder_t *)handle;
+    guint num_levels = 0;
 
-    ret = file_finder_set_obj(self);
+    *output_buffer = NULL;
+    *output_len = 0;
 
-    if (ret != FILEFIND_STATUS_OK)
+    if (! file_finder_can_checkpoint(self))
     {
-        return ret;
+        return FILE_FIND_NOT_SUPPORTED;
     }
 
-    (self->callback)(self->curr_path, self->callback_context);
+    GString * const buf = g_string_new(NULL);
 
-    return FILEFIND_STATUS_OK;
-}
+    if (! buf)
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
 
-static status_type file_finder_recurse(file_finder_t * self);
+    if ((self->target_index >= 0)
+        && (self->target_index < self->targets->len))
+    {
+        while ((num_levels < self->dir_stack->len)
+            && ((path_component_type *)
+                g_ptr_array_index(self->dir_stack, num_levels))->curr_file)
+        {
+            num_levels++;
+        }
+    }
 
-static status_type file_finder_process_current_actions(file_finder_t * const self)
-{
-    while (self->current->next_action_idx < NUM_ACTIONS)
+    g_string_append_len(buf, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN);
+    checkpoint_append_u32(buf, file_finder_checkpoint_flags(self));
+    checkpoint_append_u32(buf, self->targets->len);
+    checkpoint_append_u32(buf, (guint32)self->target_index);
+    checkpoint_append_u32(buf, num_levels);
+
+    for (guint i = 0 ; i < num_levels ; i++)
     {
-        status_type status;
+        path_component_type * const component =
+            g_ptr_array_index(self->dir_stack, i);
 
-        const gint action = self->current->actions[(self->current->next_action_idx)++];
+        checkpoint_append_u32(buf, component->next_action_idx);
+        checkpoint_append_string(buf, component->curr_file);
 
-        switch (action)
+        if (! component->is_traverse_to_set)
         {
-            case ACTION_RUN_CB:
-                status = file_finder_run_cb(self);
-                break;
+            checkpoint_append_u32(buf, CHECKPOINT_NOT_SET);
+            continue;
+        }
 
-            case ACTION_SET_OBJ:
-                status = file_finder_set_obj(self);
-                break;
+        GPtrArray * const traverse_to = component->traverse_to;
 
-            case ACTION_RECURSE:
-                status = file_finder_recurse(self);
-                break;
-        }
+        checkpoint_append_u32(
+            buf, traverse_to->len - component->next_traverse_to_idx
+        );
 
-        if (status != FILEFIND_STATUS_SKIP)
+        for (guint j = component->next_traverse_to_idx
+            ; j < traverse_to->len
+            ; j++)
         {
-            return status;
+            checkpoint_append_string(buf, g_ptr_array_index(traverse_to, j));
         }
     }
 
-    return FILEFIND_STATUS_FALSE;
+    if (! (*output_buffer = malloc(buf->len)))
+    {
+        g_string_free(buf, TRUE);
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    memcpy(*output_buffer, buf->str, buf->len);
+    *output_len = buf->len;
+
+    g_string_free(buf, TRUE);
+
+    return FILE_FIND_OK;
 }
 
-static status_type file_finder_check_subdir(file_finder_t * self);
+typedef struct
+{
+    const gchar * pos;
+    const gchar * end;
+} checkpoint_reader_type;
 
-static status_type file_finder_recurse(file_finder_t * const self)
+static gboolean checkpoint_read_u32(
+    checkpoint_reader_type * const reader,
+    guint32 * const value
+)
 {
-    const status_type status = file_finder_check_subdir(self);
+    guint32 le_value;
 
-    if (status == FILEFIND_STATUS_FALSE)
+    if (reader->end - reader->pos < sizeof(le_value))
     {
-        return FILEFIND_STATUS_SKIP;
-    }
-    else if (status == FILEFIND_STATUS_OUT_OF_MEM)
-    {
-        return FILEFIND_STATUS_OUT_OF_MEM;
+        return FALSE;
     }
 
-    path_component_type * const deep_path = deep_path_new(self, self->current);
-
-    if (!deep_path)
-    {
-        return FILEFIND_STATUS_OUT_OF_MEM;
-    }
+    memcpy(&le_value, reader->pos, sizeof(le_value));
+    reader->pos += sizeof(le_value);
 
-    self->current = deep_path;
-    g_ptr_array_add(self->dir_stack, deep_path);
+    *value = GUINT32_FROM_LE(le_value);
 
-    return FILEFIND_STATUS_FALSE;
+    return TRUE;
 }
 
-static status_type file_finder_filter_wrapper(file_finder_t * const self)
+/*
+ * Returns a view of the string in the buffer of the checkpoint, or NULL if
+ * it is malformed.
+ * */
+static const gchar * checkpoint_read_string(
+    checkpoint_reader_type * const reader
+)
 {
-    if (self->filter_callback)
-    {
-        return
-        (
-            (self->filter_callback)(self->curr_path, self->filter_context)
-            ? FILEFIND_STATUS_OK
-            : FILEFIND_STATUS_FALSE
-        );
-    }
-    else
+    guint32 len;
+
+    if ((! checkpoint_read_u32(reader, &len))
+        || (reader->end - reader->pos < ((gint64)len) + 1)
+        || reader->pos[len]
+        || (memchr(reader->pos, '\0', len)))
     {
-        return FILEFIND_STATUS_OK;
+        return NULL;
     }
+
+    const gchar * const string = reader->pos;
+
+    reader->pos += len + 1;
+
+    return string;
 }
 
-static status_type file_finder_is_loop(file_finder_t * self);
+typedef struct
+{
+    guint32 next_action_idx;
+    const gchar * name;
+    /* Or CHECKPOINT_NOT_SET. */
+    guint32 num_traverse_to;
+    /* Views of the names in the buffer of the checkpoint. */
+    gchar * * traverse_to;
+} checkpoint_level_type;
 
-static status_type file_finder_check_subdir(file_finder_t * const self)
+/*
+ * Brings the finder to the position of the levels, by going down the
+ * stored path the way file_find_next() does, but seeking each listing to
+ * the stored name instead of going over the names before it. The levels
+ * whose names are gone are not restored: the walk continues with the
+ * name that follows them.
+ * */
+static int file_finder_resume_levels(
+    file_finder_t * const self,
+    const gint target_index,
+    checkpoint_level_type * const levels,
+    const guint num_levels
+)
 {
-    /*
-     * If current is not a directory always return 0, because we may
-     * be asked to traverse single-files.
-     */
+    status_type status;
 
-    if (file_finder_curr_not_a_dir(self))
+    if (! num_levels)
     {
-        return FILEFIND_STATUS_FALSE;
+        self->target_index = target_index;
+
+        return FILE_FIND_OK;
     }
 
-    if (self->dir_stack->len <= 1)
+    self->target_index = target_index - 1;
+
+    status = top_path_move_next(self->current, self);
+
+    if (status == FILEFIND_STATUS_OUT_OF_MEM)
     {
-        return FILEFIND_STATUS_OK;
+        return FILE_FIND_OUT_OF_MEMORY;
     }
+    else if (status == FILEFIND_STATUS_END)
+    {
+        /* None of the targets from the stored one on exists. */
+        self->current->next_action_idx = NUM_ACTIONS;
 
-    if ((!self->should_follow_link) && (self->top_is_link))
+        return FILE_FIND_OK;
+    }
+    else if (self->target_index != target_index)
     {
-        return FILEFIND_STATUS_FALSE;
+        return FILE_FIND_OK;
     }
 
-    if ((!self->should_not_cross_fs) && (self->top_stat.st_dev != self->dev))
+    for (guint i = 0 ; ; i++)
     {
-        return FILEFIND_STATUS_FALSE;
-    }
+        const checkpoint_level_type * const level = &(levels[i]);
+        gboolean is_found;
 
-    const status_type status = file_finder_is_loop(self);
+        self->current->next_action_idx = level->next_action_idx;
 
-    if (status == FILEFIND_STATUS_OUT_OF_MEM)
-    {
-        return status;
-    }
+        if (level->num_traverse_to != CHECKPOINT_NOT_SET)
+        {
+            const int ret = file_find_set_traverse_to(
+                (file_find_handle_t *)self,
+                level->num_traverse_to,
+                level->traverse_to
+            );
 
-    return ((status == FILEFIND_STATUS_OK) ? FILEFIND_STATUS_FALSE : FILEFIND_STATUS_OK);
+            if (ret == FILE_FIND_OUT_OF_MEMORY)
+            {
+                return ret;
+            }
+            else if (ret != FILE_FIND_OK)
+            {
+                /* It is no longer a directory. */
+                return FILE_FIND_OK;
+            }
+        }
+
+        if (i + 1 == num_levels)
+        {
+            return FILE_FIND_OK;
+        }
+
+        const guint depth = self->dir_stack->len;
+
+        if (file_finder_recurse(self) == FILEFIND_STATUS_OUT_OF_MEM)
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        if (self->dir_stack->len == depth)
+        {
+            return FILE_FIND_OK;
+        }
+
+        /* A replaced traverse_to no longer holds the stored name. */
+        if (level->num_traverse_to != CHECKPOINT_NOT_SET)
+        {
+            is_found = TRUE;
+            status = deep_path_move_to(self->current, self, levels[i+1].name);
+        }
+        else
+        {
+            status = deep_path_seek(
+                self->current, self, levels[i+1].name, &is_found
+            );
+        }
+
+        if (status == FILEFIND_STATUS_OUT_OF_MEM)
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        if (! is_found)
+        {
+            return FILE_FIND_OK;
+        }
+    }
 }
 
-static status_type file_finder_is_loop(file_finder_t * const self)
+int file_find_resume(
+    file_find_handle_t * handle,
+    const char * buffer,
+    size_t len
+)
 {
-    ino_t inode;
-    inode_data_type key;
+    file_finder_t * const self = (file_finder_t *)handle;
+    checkpoint_reader_type reader;
+    checkpoint_level_type * levels = NULL;
+    guint32 flags, num_targets, target_index_u32, num_levels;
+    int ret = FILE_FIND_INVALID_CHECKPOINT;
 
-    if ((inode = self->top_stat.st_ino))
+    if (! file_finder_can_checkpoint(self))
     {
-        key.st_ino = inode;
-        key.st_dev = self->top_stat.st_dev;
+        return FILE_FIND_NOT_SUPPORTED;
+    }
 
-        return
-            g_tree_search(
-                self->current->inodes,
-                inode_tree_cmp,
-                ((gconstpointer)&key)
-            )
-            ? FILEFIND_STATUS_OK
-            : FILEFIND_STATUS_FALSE
-            ;
+    /* Only a walk that did not start yet can be resumed. */
+    if ((self->target_index != -1) || (self->dir_stack->len != 1))
+    {
+        return FILE_FIND_NOT_SUPPORTED;
     }
-    else
+
+    reader.pos = buffer;
+    reader.end = buffer + len;
+
+    if ((len < CHECKPOINT_MAGIC_LEN)
+        || memcmp(buffer, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN))
     {
-        return FILEFIND_STATUS_FALSE;
+        return FILE_FIND_INVALID_CHECKPOINT;
     }
-}
 
-static status_type file_finder_open_dir(file_finder_t * const self)
-{
-    return path_component_component_open_dir(self->current, self->curr_path);
-}
+    reader.pos += CHECKPOINT_MAGIC_LEN;
 
-int file_find_set_traverse_to(
-    file_find_handle_t * handle,
-    int num_children,
-    char * * children
-)
-{
-    int up_to_i;
-    GPtrArray * traverse_to;
-    gchar * new_string;
+    if ((! checkpoint_read_u32(&reader, &flags))
+        || (! checkpoint_read_u32(&reader, &num_targets))
+        || (! checkpoint_read_u32(&reader, &target_index_u32))
+        || (! checkpoint_read_u32(&reader, &num_levels)))
+    {
+        return FILE_FIND_INVALID_CHECKPOINT;
+    }
 
-    file_finder_t * const self = (file_finder_t *)handle;
+    const gint target_index = (gint32)target_index_u32;
 
-    const status_type status = file_finder_open_dir(self);
+    if ((flags != file_finder_checkpoint_flags(self))
+        || (num_targets != self->targets->len)
+        || (target_index < -1)
+        || (target_index > ((gint)num_targets))
+        || (num_levels
+            && ((target_index < 0) || (target_index == num_targets)))
+        || (num_levels > (reader.end - reader.pos) / CHECKPOINT_MIN_LEVEL_SIZE))
+    {
+        return FILE_FIND_INVALID_CHECKPOINT;
+    }
 
-    if (status == FILEFIND_STATUS_OUT_OF_MEM)
+    if (num_levels && (! (levels = g_new0(checkpoint_level_type, num_levels))))
     {
         return FILE_FIND_OUT_OF_MEMORY;
     }
 
-    if (status == FILEFIND_STATUS_OK)
+    for (guint32 level_idx = 0 ; level_idx < num_levels ; level_idx++)
     {
-        traverse_to = self->current->traverse_to;
+        checkpoint_level_type * const level = &(levels[level_idx]);
 
-        self->current->next_traverse_to_idx = 0;
+        if ((! checkpoint_read_u32(&reader, &(level->next_action_idx)))
+            || (level->next_action_idx > NUM_ACTIONS)
+            || (! (level->name = checkpoint_read_string(&reader)))
+            || (! checkpoint_read_u32(&reader, &(level->num_traverse_to))))
+        {
+            goto cleanup;
+        }
 
-        for (gint i = num_children ; i < traverse_to->len ; ++i)
+        if (level->num_traverse_to == CHECKPOINT_NOT_SET)
         {
-            g_free(g_ptr_array_index(traverse_to, i));
+            continue;
         }
 
-        g_ptr_array_set_size(traverse_to, num_children);
+        /* Every name takes at least its length and NUL. */
+        if (level->num_traverse_to > (reader.end - reader.pos) / 5)
+        {
+            goto cleanup;
+        }
 
-        for (gint i=0 ; i < num_children ; ++i)
+        if (! (level->traverse_to =
+                g_new0(gchar *, level->num_traverse_to + 1)))
         {
-            if (!(new_string = g_strdup((gchar *)children[i])))
+            ret = FILE_FIND_OUT_OF_MEMORY;
+            goto cleanup;
+        }
+
+        for (guint32 i = 0 ; i < level->num_traverse_to ; i++)
+        {
+            if (! (level->traverse_to[i] =
+                    (gchar *)checkpoint_read_string(&reader)))
             {
-                for (up_to_i = 0 ; up_to_i < i ; up_to_i++)
-                {
-                    g_free (g_ptr_array_index(traverse_to, up_to_i));
-                    g_ptr_array_index(traverse_to, up_to_i) = NULL;
-                }
-                return FILE_FIND_OUT_OF_MEMORY;
+                goto cleanup;
             }
-
-            g_ptr_array_index(traverse_to, i) = new_string;
         }
+    }
 
-        return FILE_FIND_OK;
+    if ((reader.pos != reader.end)
+        || (num_levels
+            && strcmp(
+                levels[0].name,
+                g_ptr_array_index(self->targets, target_index)
+            )))
+    {
+        goto cleanup;
     }
-    else
+
+    ret = file_finder_resume_levels(self, target_index, levels, num_levels);
+
+cleanup:
+
+    for (guint32 i = 0 ; i < num_levels ; i++)
     {
-        return FILE_FIND_COULD_NOT_OPEN_DIR;
+        g_free(levels[i].traverse_to);
     }
+
+    g_free(levels);
+
+    return ret;
 }
 
-static int glib_strings_array_to_c(
-    GPtrArray * array,
-    int start_idx,
-    int * ptr_to_num_strings,
-    char * * * ptr_to_strings
+extern int file_find_free(
+    file_find_handle_t * handle
 )
 {
-    int num_strings;
-    int up_to_i;
-    char * * strings = NULL, * * next_string;
-
-    num_strings = array->len - start_idx;
-    strings = malloc(sizeof(strings[0]) * (num_strings+1));
+    file_finder_t * const self = (file_finder_t *)handle;
 
-    if (! strings)
+    if (self->roots_scanner)
     {
-        return FILE_FIND_OUT_OF_MEMORY;
+        roots_scanner_free(self->roots_scanner);
+        self->roots_scanner = NULL;
     }
 
-    next_string = strings;
+    file_finder_close_archive(self);
 
-    for (gint i = 0 ; i < num_strings ; i++, next_string++ )
+    if (self->archive_path_buf)
     {
-        if (! ((*next_string)
-                    = strdup((char *)g_ptr_array_index(array, i+start_idx)))
-           )
-        {
-            for (up_to_i = 0; up_to_i < i; up_to_i++)
-            {
-                free(strings[up_to_i]);
-            }
-
-            free(strings);
-
-            return FILE_FIND_OUT_OF_MEMORY;
-        }
+        g_string_free(self->archive_path_buf, TRUE);
+        self->archive_path_buf = NULL;
     }
 
-    /* Add a NULL terminator at the end of the file names. */
-    *next_string = NULL;
-
-    *ptr_to_num_strings = num_strings;
-    *ptr_to_strings = strings;
+    if (self->archive_comps)
+    {
+        g_ptr_array_free(self->archive_comps, TRUE);
+        self->archive_comps = NULL;
+    }
 
-    return FILE_FIND_OK;
-}
+    if (self->archive_comps_buf)
+    {
+        g_string_free(self->archive_comps_buf, TRUE);
+        self->archive_comps_buf = NULL;
+    }
 
-int file_find_get_current_node_files_list(
-    file_find_handle_t * handle,
-    int * ptr_to_num_files,
-    char * * * ptr_to_file_names
-)
-{
-    file_finder_t * const self = (file_finder_t *)handle;
+    if (self->pruned_archive_dirs)
+    {
+        g_hash_table_destroy(self->pruned_archive_dirs);
+        self->pruned_archive_dirs = NULL;
+    }
 
-    *ptr_to_num_files = 0;
-    *ptr_to_file_names = NULL;
+#ifdef G_OS_UNIX
+    if (self->prefetcher)
+    {
+        dir_prefetcher_free(self->prefetcher);
+        self->prefetcher = NULL;
+    }
+#endif
 
-    const status_type status = file_finder_open_dir(self);
+    if (self->owns_mount_table)
+    {
+        mount_table_free(self->mount_table);
+    }
+    self->mount_table = NULL;
 
-    if (status == FILEFIND_STATUS_OUT_OF_MEM)
+    if (self->owns_shard_owners)
     {
-        return FILE_FIND_OUT_OF_MEMORY;
+        g_hash_table_destroy(self->shard_owners);
     }
+    self->shard_owners = NULL;
 
-    if (status == FILEFIND_STATUS_OK)
+    if (self->shard_path_buf)
     {
-        return glib_strings_array_to_c(
-            self->current->files,
-            0,
-            ptr_to_num_files,
-            ptr_to_file_names
-        );
+        g_string_free(self->shard_path_buf, TRUE);
+        self->shard_path_buf = NULL;
     }
-    else
+
+    if (self->target_real_path)
     {
-        return FILE_FIND_COULD_NOT_OPEN_DIR;
+        free(self->target_real_path);
+        self->target_real_path = NULL;
     }
-}
 
-int file_find_prune(
-    file_find_handle_t * handle
-)
-{
-    return file_find_set_traverse_to(handle, 0, NULL);
-}
+    if (self->mount_path_buf)
+    {
+        g_string_free(self->mount_path_buf, TRUE);
+        self->mount_path_buf = NULL;
+    }
 
-int file_find_get_traverse_to(
-    file_find_handle_t * handle,
-    int * ptr_to_num_files,
-    char * * * ptr_to_file_names
-)
-{
-    file_finder_t * self;
+    g_strfreev(self->skip_fs_types);
+    self->skip_fs_types = NULL;
 
-    self = (file_finder_t *)handle;
+    if (self->link_cache)
+    {
+        g_hash_table_destroy(self->link_cache);
+        self->link_cache = NULL;
+    }
 
-    *ptr_to_num_files = 0;
-    *ptr_to_file_names = NULL;
+    if (self->entered_dirs)
+    {
+        inode_set_free(self->entered_dirs);
+        self->entered_dirs = NULL;
+    }
 
-    return glib_strings_array_to_c(
-            self->current->traverse_to,
-            self->current->next_traverse_to_idx,
-            ptr_to_num_files,
-            ptr_to_file_names
-            );
-}
+    dir_frontier_node_unref(self->frontier_current);
+    self->frontier_current = NULL;
 
-extern int file_find_free(
-    file_find_handle_t * handle
-)
-{
-    file_finder_t * const self = (file_finder_t *)handle;
+    if (self->frontier)
+    {
+        dir_frontier_free(self->frontier);
+        self->frontier = NULL;
+    }
 
     for (gint i = 0 ; i < self->dir_stack->len ; i++)
     {
-        path_component_free(g_ptr_array_index(self->dir_stack, i));
+        path_component_free(g_ptr_array_index(self->dir_stack, i), self);
     }
     g_ptr_array_free(self->dir_stack, 1);
     self->dir_stack = NULL;
@@ -1637,14 +5424,27 @@ extern int file_find_free(
         self->targets = NULL;
     }
 
-    if (self->curr_path)
+    if (self->curr_path_buf)
     {
-        g_free(self->curr_path);
-        self->curr_path = NULL;
+        g_string_free(self->curr_path_buf, TRUE);
+        self->curr_path_buf = NULL;
     }
+    self->curr_path = NULL;
 
     free_item_obj(self);
 
+    if (self->du_seen_links)
+    {
+        inode_set_free(self->du_seen_links);
+        self->du_seen_links = NULL;
+    }
+
+    if (self->seen_hard_links)
+    {
+        inode_set_free(self->seen_hard_links);
+        self->seen_hard_links = NULL;
+    }
+
     g_free (self);
 
     return FILE_FIND_OK;
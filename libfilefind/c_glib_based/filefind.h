@@ -33,12 +33,20 @@ http://www.perlfoundation.org/legal/licenses/artistic-2_0.html
 #ifndef FILEFIND_H
 #define FILEFIND_H
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 enum FILE_FIND_IFACE_STATUS
 {
     FILE_FIND_OK = 0,
     FILE_FIND_OUT_OF_MEMORY,
     FILE_FIND_END,
     FILE_FIND_COULD_NOT_OPEN_DIR,
+    FILE_FIND_NOT_SUPPORTED,
+    FILE_FIND_COULD_NOT_WRITE,
+    FILE_FIND_INVALID_CHECKPOINT,
+    FILE_FIND_AGAIN,
+    FILE_FIND_INVALID_ARCHIVE,
 };
 
 typedef struct
@@ -46,22 +54,481 @@ typedef struct
     int stub;
 } file_find_handle_t;
 
+/*
+ * Creates a finder of the file system of the process. See
+ * file_find_new_with_backend() in findbackend.h for walking other trees.
+ * */
 extern int file_find_new(file_find_handle_t * * output_handle, const char * first_target);
 
+/*
+ * Appends a target to be scanned after the existing ones. Returns
+ * FILE_FIND_NOT_SUPPORTED once a parallel scan of the targets has started.
+ * */
+extern int file_find_add_target(
+    file_find_handle_t * handle,
+    const char * target
+);
+
+enum FILE_FIND_ROOTS_ORDER
+{
+    /* All the items of the first target, then the second, etc. */
+    FILE_FIND_ROOTS_IN_TARGET_ORDER = 0,
+    /* The items of the targets interleaved, as soon as they are found. */
+    FILE_FIND_ROOTS_AS_READY,
+};
+
+/*
+ * Scans the targets concurrently, on up to num_threads threads (<= 0 means
+ * one per processor), each target with a finder of its own. Targets on the
+ * same device are scanned one after the other, and targets on different
+ * devices in parallel. The device of each target is found by the worker
+ * that scans it, so a target that hangs only holds up its own device.
+ *
+ * Must be called before the first file_find_next(), and the other options
+ * may not be changed afterwards. The callbacks are called from the worker
+ * threads. When returning the items in target order, the items of the
+ * later targets are buffered until their turn. Up to about a thousand items
+ * of each target are buffered, after which its worker waits for the
+ * caller to catch up.
+ *
+ * file_find_set_traverse_to(), file_find_prune() and the listing functions
+ * return FILE_FIND_NOT_SUPPORTED in this mode.
+ * */
+extern void file_find_set_parallel_roots(
+    file_find_handle_t * handle,
+    int num_threads,
+    int order
+);
+
 extern void file_find_set_callback(
     file_find_handle_t * handle,
     void (*callback)(const char * filename, void * context)
 );
 
+/*
+ * A rollup of the disk usage of a directory and everything below it.
+ * Multiply-linked files are only counted once.
+ * */
+typedef struct
+{
+    const char * path;
+    /* In 512-byte units, like st_blocks. */
+    unsigned long long blocks;
+    /* The sum of the apparent sizes. */
+    unsigned long long size;
+    /* Including the directory itself. */
+    unsigned long long num_entries;
+} file_find_du_record_t;
+
+/*
+ * Puts the finder in disk-usage aggregation mode: callback is called once
+ * for every directory after all of its contents were visited, and no
+ * per-file items are returned, so a single file_find_next() call performs
+ * the entire scan and returns FILE_FIND_END.
+ * */
+extern void file_find_set_du_callback(
+    file_find_handle_t * handle,
+    void (*callback)(const file_find_du_record_t * record, void * context),
+    void * context
+);
+
 extern void file_find_set_should_traverse_depth_first(
     file_find_handle_t * handle,
     int should_traverse_depth_first
 );
 
+/*
+ * Directory listings are sorted lexicographically by default. Turning this
+ * off yields the entries in the order the file system returns them, and
+ * reads them from the directory as they are needed instead of holding the
+ * whole listing in memory.
+ * */
+extern void file_find_set_should_sort(
+    file_find_handle_t * handle,
+    int should_sort
+);
+
+/*
+ * Limits the memory used by a single sorted directory listing. Above it,
+ * the listing is sorted in runs that are written to a temporary file (in
+ * $TMPDIR) and merged back as the directory is traversed. 0, the default,
+ * means no limit. If the temporary file cannot be written, the listing
+ * stays in memory.
+ *
+ * file_find_get_current_node_files_list() reads a spilled listing again in
+ * full, and file_find_get_traverse_to() reads its rest into memory.
+ * */
+extern void file_find_set_max_listing_bytes(
+    file_find_handle_t * handle,
+    unsigned long long max_listing_bytes
+);
+
+/*
+ * Stats the entries of every directory when it is listed, in ascending
+ * inode order, instead of one at a time in name order when they are
+ * visited. This makes the access to the inode tables of cold ext4/xfs
+ * volumes close to sequential. The output is unchanged, but the stat()
+ * results may be older. Does nothing on non-POSIX systems, and with other
+ * backends than file_find_backend_posix().
+ * */
+extern void file_find_set_should_stat_in_inode_order(
+    file_find_handle_t * handle,
+    int should_stat_in_inode_order
+);
+
+/*
+ * Lists and stats up to num_dirs_ahead of the directories that the walk is
+ * predicted to enter next, on num_threads helper threads, so they are ready
+ * by the time file_find_next() gets to them. This hides the latency of
+ * slow (e.g: network) file systems. 0, the default, turns it off.
+ *
+ * Only applies to sorted listings without a file_find_set_max_listing_bytes()
+ * limit. The stat() results may be older, as with
+ * file_find_set_should_stat_in_inode_order(). Prefetched directories below
+ * the current one are discarded by file_find_set_traverse_to() and
+ * file_find_prune(). Does nothing on non-POSIX systems, and with other
+ * backends than file_find_backend_posix().
+ * */
+extern void file_find_set_prefetch(
+    file_find_handle_t * handle,
+    int num_dirs_ahead,
+    int num_threads
+);
+
+/*
+ * Enters the directories that symbolic links point to. This is
+ * 'followlink' from File-Find-Object. A link back to a directory that
+ * contains it is not entered. What the links resolve to is cached for the
+ * rest of the walk, so a link that is reached again is not stat()ed again.
+ * The items of the links are still their lstat() results.
+ * */
+extern void file_find_set_should_follow_link(
+    file_find_handle_t * handle,
+    int should_follow_link
+);
+
+/*
+ * Enters every real directory at most once, by its device and inode, even
+ * if it is reached through several symbolic links or bind mounts. The
+ * other paths to it are returned but not entered. The targets are always
+ * entered. With file_find_set_parallel_roots(), it applies to each root
+ * separately.
+ * */
+extern void file_find_set_should_enter_dirs_once(
+    file_find_handle_t * handle,
+    int should_enter_dirs_once
+);
+
+enum FILE_FIND_HARD_LINKS
+{
+    /* Every name of a file is returned alike. The default. */
+    FILE_FIND_HARD_LINKS_ALL = 0,
+    /*
+     * The names of a file after the first one are returned with
+     * file_find_item_is_dup_link() set.
+     * */
+    FILE_FIND_HARD_LINKS_FLAG,
+    /* Only the first name of every file is returned. */
+    FILE_FIND_HARD_LINKS_SUPPRESS,
+};
+
+/*
+ * Sets how the regular files with more than one hard link are returned,
+ * for backup and deduplication scans that should process each file once.
+ * Their (st_dev, st_ino) pairs are tracked, which takes at most about 43
+ * bytes per file, as reported in file_find_stats_t. The callback of
+ * file_find_set_callback() is not called for suppressed names either.
+ * With file_find_set_parallel_roots(), the links are tracked across all
+ * the roots.
+ * */
+extern void file_find_set_hard_links(
+    file_find_handle_t * handle,
+    int mode
+);
+
+/*
+ * Does not enter directories that are on other file systems than their
+ * target, including bind mounts of the target's own file system. This is
+ * ->nocrossfs() from File-Find-Object. The targets themselves are always
+ * entered.
+ * */
+extern void file_find_set_no_cross_fs(
+    file_find_handle_t * handle,
+    int should_not_cross_fs
+);
+
+/*
+ * Walks only shard shard_index (from 0) of num_shards, so that a scan can
+ * be split between processes or machines without coordinating them. The
+ * tree is carved into the subtrees at depth (where 0 is the targets, and 1
+ * is the entries of the targets), and every subtree, or file above depth,
+ * belongs to one shard: the one that file_find_set_shard_costs() gave it,
+ * or else the one chosen by a hash of its path relative to the target,
+ * which is the same for every process. The directories above depth are
+ * entered by every shard, but only returned by shard 0.
+ *
+ * The items of every shard are in the order of the walk, so merging the
+ * outputs of all the shards by it gives the output of the whole scan. The
+ * du records of the directories above depth only cover the shard, and
+ * hard links are only tracked within it.
+ *
+ * Returns FILE_FIND_NOT_SUPPORTED if shard_index is not below num_shards.
+ * */
+extern int file_find_set_shard(
+    file_find_handle_t * handle,
+    int shard_index,
+    int num_shards,
+    int depth
+);
+
+/*
+ * Balances the shards by the costs of the subtrees at the shard depth,
+ * e.g: their num_entries in the du records of a previous run. paths are
+ * relative to the target (e.g: "src/lib" at depth 2), or are the targets
+ * themselves at depth 0, and the paths at other depths are skipped. The
+ * subtrees are given to the least loaded shard so far from the most costly
+ * down, and the subtrees that are not listed are hashed. Every shard must
+ * be given the same costs.
+ *
+ * Must be called after file_find_set_shard(), and returns
+ * FILE_FIND_NOT_SUPPORTED if it was not.
+ * */
+extern int file_find_set_shard_costs(
+    file_find_handle_t * handle,
+    int num_subtrees,
+    const char * const * paths,
+    const unsigned long long * costs
+);
+
+/*
+ * Does not enter directories on file systems of the types in types (e.g:
+ * "proc", "sysfs", "nfs"), as listed in /proc/self/mountinfo. A type also
+ * matches its subtypes and versions, so "fuse" matches "fuse.sshfs" and
+ * "nfs" matches "nfs4". The directories themselves are still returned.
+ * Replaces the previous list; 0 types turns it off. Does nothing where
+ * there is no /proc/self/mountinfo.
+ *
+ * Returns FILE_FIND_OK or FILE_FIND_OUT_OF_MEMORY.
+ * */
+extern int file_find_set_skip_fs_types(
+    file_find_handle_t * handle,
+    int num_types,
+    const char * const * types
+);
+
+/*
+ * Enters the tar (also gzip-compressed) and zip archives among the regular
+ * files, as told by file_find_archive_is_archive_name(), as if they were
+ * directories: the archive is returned first, and then its members, as
+ * "dir/a.zip/member/path", in the order of the archive and in every
+ * traversal order. Only the index of a zip and the headers of a tar are
+ * read, and the contents of a member can be read with findarchive.h. The
+ * stat() results of a member are what the archive says about it, and its
+ * dir_components are those of the archive followed by its name.
+ *
+ * file_find_prune() on an archive does not enter it, and on a directory
+ * of an archive skips its members. file_find_set_traverse_to() with
+ * children returns FILE_FIND_NOT_SUPPORTED on them. The archives inside
+ * archives are not entered. Links to archives are not entered, and hard
+ * links are not tracked for members. file_find_set_callback() is not
+ * called for members. Archives that cannot be read are counted in
+ * file_find_stats_t, and the walk goes on after their members that were
+ * read.
+ * */
+extern int file_find_set_archives(
+    file_find_handle_t * handle,
+    int should_enter_archives
+);
+
 extern int file_find_next(file_find_handle_t * handle);
 
+/*
+ * Like file_find_next(), but returns FILE_FIND_AGAIN without an item once
+ * the walk went over max_entries entries or took max_ns nanoseconds (0 for
+ * no limit), so it can be run in slices from an event loop. The next call
+ * continues from where it stopped. This bounds the entries that are
+ * filtered out or skipped, and the du mode, which otherwise run to the
+ * next item; a single directory listing or stat() still blocks, see
+ * findasync.h for those.
+ *
+ * Returns FILE_FIND_NOT_SUPPORTED for parallel scans.
+ * */
+extern int file_find_next_with_budget(
+    file_find_handle_t * handle,
+    unsigned long long max_entries,
+    unsigned long long max_ns
+);
+
 extern const char * file_find_get_path(file_find_handle_t * handle);
 
+/*
+ * Returns the lstat() results of the current item, or NULL if there is
+ * no current item. The pointer is valid until the next call to
+ * file_find_next().
+ * */
+extern const struct stat * file_find_get_stat(file_find_handle_t * handle);
+
+typedef struct
+{
+    int stub;
+} file_find_item_t;
+
+/*
+ * Returns the current item, or NULL if there is none. Getting it and
+ * reading its fields does not allocate: they point into the state of the
+ * finder and are only valid until the next call to file_find_next(). Use
+ * file_find_item_detach() to keep an item for longer.
+ * */
+extern const file_find_item_t * file_find_get_item(file_find_handle_t * handle);
+
+extern const char * file_find_item_get_path(const file_find_item_t * item);
+
+extern const struct stat * file_find_item_get_stat(
+    const file_find_item_t * item
+);
+
+/*
+ * The target the item was found under.
+ * */
+extern const char * file_find_item_get_base(const file_find_item_t * item);
+
+/*
+ * The name of the item, or NULL for directories and top targets.
+ * */
+extern const char * file_find_item_get_basename(const file_find_item_t * item);
+
+/*
+ * The directories between the base and the item (including the item itself
+ * if it is a directory), like ->dir_components() of File-Find-Object.
+ * Sets *ptr_to_num to their number.
+ * */
+extern const char * const * file_find_item_get_dir_components(
+    const file_find_item_t * item,
+    int * ptr_to_num
+);
+
+/*
+ * Symbolic links are followed by is_dir and is_file, but not by is_link.
+ * */
+extern int file_find_item_is_dir(const file_find_item_t * item);
+
+extern int file_find_item_is_link(const file_find_item_t * item);
+
+extern int file_find_item_is_file(const file_find_item_t * item);
+
+/*
+ * Whether item is a regular file that was already returned under another
+ * name. Only set with FILE_FIND_HARD_LINKS_FLAG.
+ * */
+extern int file_find_item_is_dup_link(const file_find_item_t * item);
+
+/*
+ * Whether item is a member of an archive. See file_find_set_archives().
+ * */
+extern int file_find_item_is_archive_member(const file_find_item_t * item);
+
+/*
+ * Returns a copy of item that owns its fields and remains valid after the
+ * finder moves on or is freed, or NULL if out of memory. Free it with
+ * file_find_item_free().
+ * */
+extern file_find_item_t * file_find_item_detach(const file_find_item_t * item);
+
+extern void file_find_item_free(file_find_item_t * item);
+
+/*
+ * Walks in best-first order, for finding the most promising subtrees (e.g:
+ * the newest ones) before the rest. The entries of a directory are
+ * returned together when it is entered, and its subdirectories are queued
+ * with the score that score() gives to their items. The queued directory
+ * with the highest score is entered next, and those of equal scores in the
+ * order they were found. The queue of a target is drained before the next
+ * target is walked. NULL restores the depth-first order.
+ *
+ * Overrides file_find_set_should_traverse_depth_first(), and is ignored in
+ * the du mode. file_find_prune() and file_find_set_traverse_to() on a
+ * directory apply when it is entered.
+ * */
+extern int file_find_set_best_first(
+    file_find_handle_t * handle,
+    double (*score)(const file_find_item_t * item, void * context),
+    void * context
+);
+
+/*
+ * Walks each target breadth-first, so that all the items at one depth are
+ * returned before those deeper down, e.g: to find the files that are
+ * nearest to it first. This is file_find_set_best_first() with a queue
+ * instead of scores: a queued directory is only its name, its identity
+ * and a reference to its parent. If max_frontier_bytes is not 0, the
+ * directories that are queued beyond it are kept in a temporary file
+ * until they are entered.
+ *
+ * Overrides file_find_set_best_first() and vice versa, and so do its
+ * limitations.
+ * */
+extern int file_find_set_breadth_first(
+    file_find_handle_t * handle,
+    int should_traverse_breadth_first,
+    unsigned long long max_frontier_bytes
+);
+
+/*
+ * Counters of the work done by a finder. The *_ns fields are cumulative
+ * wall-clock nanoseconds. They are always collected.
+ * */
+typedef struct
+{
+    unsigned long long num_items;
+    unsigned long long num_opendir;
+    unsigned long long opendir_ns;
+    /* The number of directory entries read. */
+    unsigned long long num_readdir;
+    unsigned long long readdir_ns;
+    unsigned long long num_stat;
+    unsigned long long stat_ns;
+    unsigned long long num_sort;
+    unsigned long long sort_ns;
+    /* Sorted runs of listings that were written to a temporary file. */
+    unsigned long long num_spilled_runs;
+    /* See file_find_set_breadth_first(). */
+    unsigned long long num_spilled_dirs;
+    /* Directories whose listing the prefetcher did or did not have ready. */
+    unsigned long long num_prefetch_hits;
+    unsigned long long num_prefetch_misses;
+    /* See file_find_set_archives(). */
+    unsigned long long num_archives;
+    unsigned long long num_archive_members;
+    unsigned long long num_archive_errors;
+    /* Symbolic links whose targets were found in the cache. */
+    unsigned long long num_link_cache_hits;
+    /* See file_find_set_hard_links(). */
+    unsigned long long num_hard_links_tracked;
+    unsigned long long hard_links_bytes;
+    /* The names of files that were already returned. */
+    unsigned long long num_dup_links;
+    /* Loop detection in the inode trees. */
+    unsigned long long num_inode_lookups;
+    unsigned long long inode_lookup_ns;
+    /* Time spent in the file_find_set_callback() callback. */
+    unsigned long long num_callbacks;
+    unsigned long long callback_ns;
+    /* Time spent by the caller between calls to file_find_next(). */
+    unsigned long long consumer_ns;
+    unsigned long long max_depth;
+    unsigned long long peak_dir_stack_len;
+    /* The memory held by the directory listings. */
+    unsigned long long listing_bytes;
+    unsigned long long peak_listing_bytes;
+    /* The items that the file_find_set_parallel_roots() workers held. */
+    unsigned long long peak_roots_queue_len;
+} file_find_stats_t;
+
+extern void file_find_get_stats(
+    file_find_handle_t * handle,
+    file_find_stats_t * stats
+);
+
 extern int file_find_set_traverse_to(
     file_find_handle_t * handle,
     int num_children,
@@ -85,6 +552,43 @@ extern int file_find_get_traverse_to(
     char * * * ptr_to_file_names
 );
 
+/*
+ * Serializes the position of the walk into *output_buffer, which is
+ * allocated with malloc() and freed by the caller. Only the names on the
+ * path to the current item are kept, and the directories are listed again
+ * on resume, so a checkpoint is small and cheap to take regardless of the
+ * size of the directories. The rest of the traverse_to of the directories
+ * that were passed to file_find_set_traverse_to() or file_find_prune() is
+ * kept in full.
+ *
+ * Returns FILE_FIND_NOT_SUPPORTED for unsorted listings, parallel scans,
+ * file_find_set_du_callback(), file_find_set_hard_links() other than
+ * FILE_FIND_HARD_LINKS_ALL, file_find_set_should_enter_dirs_once(),
+ * file_find_set_best_first(), file_find_set_breadth_first() and
+ * file_find_set_archives(), whose state is not kept.
+ * */
+extern int file_find_checkpoint(
+    file_find_handle_t * handle,
+    char * * output_buffer,
+    size_t * output_len
+);
+
+/*
+ * Continues the walk of a checkpoint on a new finder, which has the same
+ * targets and options and was not advanced yet. The next file_find_next()
+ * returns the item that followed the current item of the checkpoint. If
+ * the entries on its path were removed since then, the walk continues
+ * with the names that follow them.
+ *
+ * Returns FILE_FIND_INVALID_CHECKPOINT if the buffer is malformed or does
+ * not match the targets and the depth-first option of the finder.
+ * */
+extern int file_find_resume(
+    file_find_handle_t * handle,
+    const char * buffer,
+    size_t len
+);
+
 extern int file_find_free(
     file_find_handle_t * handle
 );
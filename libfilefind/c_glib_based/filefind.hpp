@@ -0,0 +1,821 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  filefind.hpp
+ *
+ *    Description:  a header-only C++20 interface to libfilefind.
+ *
+ *        Created:  19/10/26 23:58:12
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_HPP
+#define FILEFIND_HPP
+
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+extern "C"
+{
+#include "filefind.h"
+#include "findmatch.h"
+}
+
+/*
+ * A finder is walked as an input range of file_find::entry, which are views
+ * of the items of the finder, so a walk allocates no strings of its own:
+ *
+ *     file_find::finder tree("src");
+ *
+ *     for (const file_find::entry & e : tree.filter(
+ *             file_find::name("*.c") && file_find::is(file_find::type::file)
+ *             && file_find::max_depth(3)))
+ *     {
+ *         std::cout << e.path() << '\n';
+ *     }
+ *
+ * The filters are composed as templates, so the whole predicate is inlined
+ * into the loop that calls file_find_next(), instead of being called
+ * through a std::function for every entry. A filter that knows that
+ * nothing under a directory can match it (e.g: max_depth()) prunes the
+ * directory.
+ *
+ * An entry is only valid until the walk moves on; use
+ * file_find_item_detach() on entry::native_handle() to keep one.
+ * */
+
+namespace file_find
+{
+
+class error : public std::runtime_error
+{
+public:
+    explicit error(const int status)
+        : std::runtime_error(describe(status)), status_(status)
+    {
+    }
+
+    /* One of FILE_FIND_IFACE_STATUS. */
+    int status() const noexcept
+    {
+        return status_;
+    }
+
+private:
+    static const char * describe(const int status) noexcept
+    {
+        switch (status)
+        {
+            case FILE_FIND_OUT_OF_MEMORY:
+                return "libfilefind: out of memory";
+            case FILE_FIND_COULD_NOT_OPEN_DIR:
+                return "libfilefind: could not open a directory";
+            case FILE_FIND_NOT_SUPPORTED:
+                return "libfilefind: not supported";
+            case FILE_FIND_COULD_NOT_WRITE:
+                return "libfilefind: could not write";
+            case FILE_FIND_INVALID_CHECKPOINT:
+                return "libfilefind: invalid checkpoint";
+            default:
+                return "libfilefind: error";
+        }
+    }
+
+    int status_;
+};
+
+inline void check(const int status)
+{
+    if (status != FILE_FIND_OK)
+    {
+        throw error(status);
+    }
+}
+
+enum class type
+{
+    file,
+    dir,
+    link,
+};
+
+class entry
+{
+public:
+    entry() noexcept = default;
+
+    explicit entry(const file_find_item_t * const item) noexcept
+        : item_(item)
+    {
+    }
+
+    std::string_view path() const noexcept
+    {
+        return file_find_item_get_path(item_);
+    }
+
+    /* The target the entry was found under. */
+    std::string_view base() const noexcept
+    {
+        return file_find_item_get_base(item_);
+    }
+
+    /* The last component of the path, for directories too. */
+    std::string_view name() const noexcept
+    {
+        const char * const basename = file_find_item_get_basename(item_);
+
+        if (basename)
+        {
+            return basename;
+        }
+
+        const std::string_view p = path();
+        const std::string_view::size_type slash = p.find_last_of('/');
+
+        return (((slash == std::string_view::npos) || (slash + 1 == p.size()))
+            ? p : p.substr(slash + 1)
+        );
+    }
+
+    /* 0 for the targets, 1 for their entries, and so on. */
+    int depth() const noexcept
+    {
+        int num_components;
+
+        file_find_item_get_dir_components(item_, &num_components);
+
+        return (num_components
+            + (file_find_item_get_basename(item_) ? 1 : 0)
+        );
+    }
+
+    /* Follows symbolic links, like is_file(). */
+    bool is_dir() const noexcept
+    {
+        return file_find_item_is_dir(item_);
+    }
+
+    /* Follows symbolic links, which costs a stat() for them. */
+    bool is_file() const noexcept
+    {
+        return file_find_item_is_file(item_);
+    }
+
+    bool is_link() const noexcept
+    {
+        return file_find_item_is_link(item_);
+    }
+
+    bool is(const type t) const noexcept
+    {
+        switch (t)
+        {
+            case type::file:
+                return is_file();
+            case type::dir:
+                return is_dir();
+            default:
+                return is_link();
+        }
+    }
+
+    /* The results of lstat(). */
+    const struct stat & stat() const noexcept
+    {
+        return *file_find_item_get_stat(item_);
+    }
+
+    off_t size() const noexcept
+    {
+        return stat().st_size;
+    }
+
+    const file_find_item_t * native_handle() const noexcept
+    {
+        return item_;
+    }
+
+private:
+    const file_find_item_t * item_ = nullptr;
+};
+
+/*
+ * The filters derive from predicate_tag so that &&, || and ! only compose
+ * them. A filter may define should_prune(e), which returns true if nothing
+ * under the directory e can match.
+ * */
+struct predicate_tag
+{
+};
+
+template <typename P>
+concept predicate = std::derived_from<P, predicate_tag>
+    && requires(const P & p, const entry & e)
+    {
+        { p(e) } -> std::convertible_to<bool>;
+    };
+
+template <predicate P>
+inline bool should_prune(const P & p, const entry & e) noexcept
+{
+    if constexpr (requires { { p.should_prune(e) } -> std::convertible_to<bool>; })
+    {
+        return p.should_prune(e);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+struct any : predicate_tag
+{
+    constexpr bool operator()(const entry &) const noexcept
+    {
+        return true;
+    }
+};
+
+template <predicate L, predicate R>
+struct and_ : predicate_tag
+{
+    L left;
+    R right;
+
+    bool operator()(const entry & e) const
+    {
+        return (left(e) && right(e));
+    }
+
+    bool should_prune(const entry & e) const noexcept
+    {
+        return (file_find::should_prune(left, e)
+            || file_find::should_prune(right, e));
+    }
+};
+
+template <predicate L, predicate R>
+struct or_ : predicate_tag
+{
+    L left;
+    R right;
+
+    bool operator()(const entry & e) const
+    {
+        return (left(e) || right(e));
+    }
+
+    bool should_prune(const entry & e) const noexcept
+    {
+        return (file_find::should_prune(left, e)
+            && file_find::should_prune(right, e));
+    }
+};
+
+/* Never prunes, since its operand not matching below says nothing. */
+template <predicate P>
+struct not_ : predicate_tag
+{
+    P operand;
+
+    bool operator()(const entry & e) const
+    {
+        return (! operand(e));
+    }
+};
+
+template <predicate L, predicate R>
+inline and_<L, R> operator&&(L left, R right)
+{
+    return { {}, std::move(left), std::move(right) };
+}
+
+template <predicate L, predicate R>
+inline or_<L, R> operator||(L left, R right)
+{
+    return { {}, std::move(left), std::move(right) };
+}
+
+template <predicate P>
+inline not_<P> operator!(P operand)
+{
+    return { {}, std::move(operand) };
+}
+
+/*
+ * Matches the name of the entry against shell globs, like find -name, with
+ * the syntax of findmatch.h, e.g: name({ "*.c", "*.{h,hpp}" }). Throws
+ * file_find::error if a glob is malformed.
+ * */
+class name : public predicate_tag
+{
+public:
+    explicit name(const std::string & glob)
+    {
+        compile(&glob, &glob + 1);
+    }
+
+    explicit name(const std::initializer_list<std::string> globs)
+    {
+        compile(globs.begin(), globs.end());
+    }
+
+    bool operator()(const entry & e) const noexcept
+    {
+        /* The name is a suffix of a C string, so it is NUL-terminated. */
+        return (file_find_matcher_match(matcher_.get(), e.name().data()) != 0);
+    }
+
+private:
+    void compile(const std::string * const begin, const std::string * const end)
+    {
+        file_find_matcher_t * handle;
+
+        check(file_find_matcher_new(&handle));
+        matcher_.reset(handle, file_find_matcher_free);
+
+        for (const std::string * glob = begin ; glob != end ; ++glob)
+        {
+            check(file_find_matcher_add_glob(handle, glob->c_str()));
+        }
+
+        check(file_find_matcher_compile(handle));
+    }
+
+    /* Shared by the copies, since it is only read once it is compiled. */
+    std::shared_ptr<file_find_matcher_t> matcher_;
+};
+
+struct is : predicate_tag
+{
+    constexpr explicit is(const type t) noexcept : t(t)
+    {
+    }
+
+    bool operator()(const entry & e) const noexcept
+    {
+        return e.is(t);
+    }
+
+    type t;
+};
+
+struct min_depth : predicate_tag
+{
+    constexpr explicit min_depth(const int depth) noexcept : depth(depth)
+    {
+    }
+
+    bool operator()(const entry & e) const noexcept
+    {
+        return (e.depth() >= depth);
+    }
+
+    int depth;
+};
+
+struct max_depth : predicate_tag
+{
+    constexpr explicit max_depth(const int depth) noexcept : depth(depth)
+    {
+    }
+
+    bool operator()(const entry & e) const noexcept
+    {
+        return (e.depth() <= depth);
+    }
+
+    bool should_prune(const entry & e) const noexcept
+    {
+        return (e.depth() >= depth);
+    }
+
+    int depth;
+};
+
+/* Sizes are in bytes, as in the results of lstat(). */
+struct min_size : predicate_tag
+{
+    constexpr explicit min_size(const off_t size) noexcept : size(size)
+    {
+    }
+
+    bool operator()(const entry & e) const noexcept
+    {
+        return (e.size() >= size);
+    }
+
+    off_t size;
+};
+
+struct max_size : predicate_tag
+{
+    constexpr explicit max_size(const off_t size) noexcept : size(size)
+    {
+    }
+
+    bool operator()(const entry & e) const noexcept
+    {
+        return (e.size() <= size);
+    }
+
+    off_t size;
+};
+
+/* Wraps any callable, e.g: a lambda, as a filter. */
+template <typename F>
+struct where : predicate_tag
+{
+    explicit where(F f) : f(std::move(f))
+    {
+    }
+
+    F f;
+
+    bool operator()(const entry & e) const
+    {
+        return static_cast<bool>(f(e));
+    }
+};
+
+template <predicate P>
+class iterator
+{
+public:
+    using value_type = entry;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::input_iterator_tag;
+
+    iterator() noexcept = default;
+
+    iterator(
+        file_find_handle_t * const handle,
+        const P * const pred,
+        const bool can_prune
+    )
+        : handle_(handle), pred_(pred), can_prune_(can_prune)
+    {
+        advance();
+    }
+
+    iterator(iterator &&) noexcept = default;
+    iterator & operator=(iterator &&) noexcept = default;
+
+    entry operator*() const noexcept
+    {
+        return entry(item_);
+    }
+
+    iterator & operator++()
+    {
+        advance();
+
+        return *this;
+    }
+
+    void operator++(int)
+    {
+        advance();
+    }
+
+    friend bool operator==(const iterator & it, std::default_sentinel_t) noexcept
+    {
+        return (! it.item_);
+    }
+
+private:
+    void advance()
+    {
+        int status;
+
+        while ((status = file_find_next(handle_)) == FILE_FIND_OK)
+        {
+            const entry e(file_find_get_item(handle_));
+
+            /* Pruning is only an optimisation, so it may be unsupported. */
+            if (can_prune_ && e.is_dir() && file_find::should_prune(*pred_, e))
+            {
+                file_find_prune(handle_);
+            }
+
+            if ((*pred_)(e))
+            {
+                item_ = e.native_handle();
+
+                return;
+            }
+        }
+
+        item_ = nullptr;
+
+        if (status != FILE_FIND_END)
+        {
+            throw error(status);
+        }
+    }
+
+    file_find_handle_t * handle_ = nullptr;
+    const P * pred_ = nullptr;
+    bool can_prune_ = false;
+    const file_find_item_t * item_ = nullptr;
+};
+
+class finder;
+
+template <predicate P>
+class filtered_range
+{
+public:
+    filtered_range(finder & tree, P pred) : tree_(&tree), pred_(std::move(pred))
+    {
+    }
+
+    iterator<P> begin();
+
+    std::default_sentinel_t end() const noexcept
+    {
+        return {};
+    }
+
+private:
+    finder * tree_;
+    P pred_;
+};
+
+/*
+ * A minimal std::generator (which is only in C++23), for walk().
+ * */
+template <typename T>
+class generator
+{
+public:
+    struct promise_type
+    {
+        const T * current = nullptr;
+        std::exception_ptr exception;
+
+        generator get_return_object() noexcept
+        {
+            return generator(
+                std::coroutine_handle<promise_type>::from_promise(*this)
+            );
+        }
+
+        std::suspend_always initial_suspend() const noexcept
+        {
+            return {};
+        }
+
+        std::suspend_always final_suspend() const noexcept
+        {
+            return {};
+        }
+
+        std::suspend_always yield_value(const T & value) noexcept
+        {
+            current = std::addressof(value);
+
+            return {};
+        }
+
+        void return_void() const noexcept
+        {
+        }
+
+        void unhandled_exception() noexcept
+        {
+            exception = std::current_exception();
+        }
+
+        /* co_await is meaningless in a generator. */
+        void await_transform() = delete;
+    };
+
+    class iterator
+    {
+    public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using iterator_concept = std::input_iterator_tag;
+
+        iterator() noexcept = default;
+
+        explicit iterator(const std::coroutine_handle<promise_type> coro)
+            : coro_(coro)
+        {
+            resume();
+        }
+
+        const T & operator*() const noexcept
+        {
+            return *coro_.promise().current;
+        }
+
+        iterator & operator++()
+        {
+            resume();
+
+            return *this;
+        }
+
+        void operator++(int)
+        {
+            resume();
+        }
+
+        friend bool operator==(const iterator & it, std::default_sentinel_t) noexcept
+        {
+            return it.coro_.done();
+        }
+
+    private:
+        void resume()
+        {
+            coro_.resume();
+
+            if (coro_.promise().exception)
+            {
+                std::rethrow_exception(
+                    std::exchange(coro_.promise().exception, nullptr)
+                );
+            }
+        }
+
+        std::coroutine_handle<promise_type> coro_;
+    };
+
+    generator(generator && other) noexcept
+        : coro_(std::exchange(other.coro_, nullptr))
+    {
+    }
+
+    generator & operator=(generator other) noexcept
+    {
+        std::swap(coro_, other.coro_);
+
+        return *this;
+    }
+
+    ~generator()
+    {
+        if (coro_)
+        {
+            coro_.destroy();
+        }
+    }
+
+    /* Can only be called once. */
+    iterator begin()
+    {
+        return iterator(coro_);
+    }
+
+    std::default_sentinel_t end() const noexcept
+    {
+        return {};
+    }
+
+private:
+    explicit generator(const std::coroutine_handle<promise_type> coro) noexcept
+        : coro_(coro)
+    {
+    }
+
+    std::coroutine_handle<promise_type> coro_;
+};
+
+/*
+ * Owns a file_find_handle_t. The setters are those that are commonly used;
+ * the rest of the C API is available through native_handle(), but the
+ * depth-first order must be set with set_depth_first(), since filters
+ * cannot prune the directories that are returned after their contents.
+ * */
+class finder
+{
+public:
+    explicit finder(const std::string & target)
+    {
+        file_find_handle_t * handle;
+
+        check(file_find_new(&handle, target.c_str()));
+        handle_.reset(handle);
+    }
+
+    finder(const std::initializer_list<std::string> targets)
+        : finder(*targets.begin())
+    {
+        for (auto it = targets.begin() + 1 ; it != targets.end() ; ++it)
+        {
+            add_target(*it);
+        }
+    }
+
+    finder & add_target(const std::string & target)
+    {
+        check(file_find_add_target(handle_.get(), target.c_str()));
+
+        return *this;
+    }
+
+    finder & set_depth_first(const bool is_depth_first) noexcept
+    {
+        file_find_set_should_traverse_depth_first(
+            handle_.get(), is_depth_first
+        );
+        is_depth_first_ = is_depth_first;
+
+        return *this;
+    }
+
+    finder & set_sort(const bool should_sort) noexcept
+    {
+        file_find_set_should_sort(handle_.get(), should_sort);
+
+        return *this;
+    }
+
+    finder & set_follow_links(const bool should_follow) noexcept
+    {
+        file_find_set_should_follow_link(handle_.get(), should_follow);
+
+        return *this;
+    }
+
+    iterator<any> begin()
+    {
+        return iterator<any>(handle_.get(), &all_, false);
+    }
+
+    std::default_sentinel_t end() const noexcept
+    {
+        return {};
+    }
+
+    /* The range refers to the finder, so it may not outlive it. */
+    template <predicate P>
+    filtered_range<P> filter(P pred) &
+    {
+        return filtered_range<P>(*this, std::move(pred));
+    }
+
+    /*
+     * The same as filter(), as a coroutine, for code that passes around
+     * generators.
+     * */
+    template <predicate P = any>
+    generator<entry> walk(P pred = {}) &
+    {
+        for (const entry & e : filter(std::move(pred)))
+        {
+            co_yield e;
+        }
+    }
+
+    bool can_prune() const noexcept
+    {
+        return (! is_depth_first_);
+    }
+
+    file_find_handle_t * native_handle() const noexcept
+    {
+        return handle_.get();
+    }
+
+private:
+    struct deleter
+    {
+        void operator()(file_find_handle_t * const handle) const noexcept
+        {
+            file_find_free(handle);
+        }
+    };
+
+    std::unique_ptr<file_find_handle_t, deleter> handle_;
+    bool is_depth_first_ = false;
+    static constexpr any all_ {};
+};
+
+template <predicate P>
+inline iterator<P> filtered_range<P>::begin()
+{
+    return iterator<P>(tree_->native_handle(), &pred_, tree_->can_prune());
+}
+
+} /* namespace file_find */
+
+#endif /* #ifndef FILEFIND_HPP */
@@ -0,0 +1,1509 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findarchive.c
+ *
+ *    Description:  lists and reads the members of tar and zip archives
+ *                  without extracting them.
+ *
+ *        Created:  20/10/26 06:14:51
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "inline.h"
+
+#ifdef FILEFIND_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "findarchive.h"
+
+#define ARCHIVE_BLOCK_SIZE 512
+#define ARCHIVE_BUFFER_SIZE (64 * 1024)
+/* Of the GNU long names and the pax headers, which are read into memory. */
+#define ARCHIVE_MAX_META_SIZE (1024 * 1024)
+
+#define ZIP_EOCD_SIZE 22
+#define ZIP_MAX_COMMENT_SIZE 65535
+#define ZIP_EOCD64_LOCATOR_SIZE 20
+#define ZIP_EOCD64_SIZE 56
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_LOCAL_HEADER_SIZE 30
+
+#define ZIP_EOCD_SIGNATURE 0x06054b50
+#define ZIP_EOCD64_LOCATOR_SIGNATURE 0x07064b50
+#define ZIP_EOCD64_SIGNATURE 0x06064b50
+#define ZIP_CENTRAL_HEADER_SIGNATURE 0x02014b50
+#define ZIP_LOCAL_HEADER_SIGNATURE 0x04034b50
+
+#define ZIP_EXTRA_ZIP64 0x0001
+#define ZIP_EXTRA_TIMESTAMP 0x5455
+#define ZIP_HOST_UNIX 3
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+
+enum
+{
+    ARCHIVE_FORMAT_TAR = 0,
+    ARCHIVE_FORMAT_TAR_GZ,
+    ARCHIVE_FORMAT_ZIP,
+};
+
+typedef struct
+{
+    int format;
+    int fd;
+    struct stat archive_stat;
+
+    /* The current member. */
+    GString * name;
+    struct stat member_stat;
+    /* Whether it is a directory that only holds members. */
+    gboolean is_implied_dir;
+    /*
+     * A member that was read from the archive, but whose directories are
+     * returned before it.
+     * */
+    gboolean has_pending;
+    GString * pending_name;
+    struct stat pending_stat;
+    /* The directories that were returned. */
+    GHashTable * seen_dirs;
+
+    /* The compressed data, and the data that a tar.gz skips. */
+    guint8 * in_buf;
+    guint8 * scratch_buf;
+#ifdef FILEFIND_HAVE_ZLIB
+    z_stream zs;
+    gboolean is_zs_init;
+#endif
+    gboolean is_in_eof;
+
+    /* Tar: what is left of the current member, which is read or skipped. */
+    guint64 data_left;
+    guint64 padding_left;
+    gboolean is_tar_end;
+    /* Of the GNU long name and pax headers, for the next header. */
+    GString * next_name;
+    gboolean has_next_name;
+    gboolean has_next_size;
+    guint64 next_size;
+    gboolean has_next_mtime;
+    time_t next_mtime;
+
+    /* Zip: the central directory is read in chunks. */
+    guint8 * cd_buf;
+    gsize cd_buf_size;
+    gsize cd_start;
+    gsize cd_len;
+    guint64 cd_offset;
+    guint64 cd_end;
+    guint64 num_entries_left;
+    /* The current zip member. */
+    int method;
+    gboolean is_encrypted;
+    guint64 comp_size;
+    guint64 local_offset;
+    gboolean is_data_located;
+    guint64 data_offset;
+    guint64 comp_pos;
+    gboolean is_member_end;
+} archive_type;
+
+static GCC_INLINE guint16 archive_le16(const guint8 * const p)
+{
+    return (guint16)(p[0] | (p[1] << 8));
+}
+
+static GCC_INLINE guint32 archive_le32(const guint8 * const p)
+{
+    return (((guint32)p[0]) | (((guint32)p[1]) << 8)
+        | (((guint32)p[2]) << 16) | (((guint32)p[3]) << 24));
+}
+
+static GCC_INLINE guint64 archive_le64(const guint8 * const p)
+{
+    return (((guint64)archive_le32(p)) | (((guint64)archive_le32(p + 4)) << 32));
+}
+
+static gboolean archive_pread_full(
+    archive_type * const self,
+    guint8 * const buf,
+    const gsize len,
+    const guint64 offset
+)
+{
+    gsize done = 0;
+
+    while (done < len)
+    {
+        const ssize_t ret = pread(self->fd, buf + done, len - done, offset + done);
+
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return FALSE;
+        }
+
+        if (ret == 0)
+        {
+            return FALSE;
+        }
+
+        done += ret;
+    }
+
+    return TRUE;
+}
+
+int file_find_archive_is_archive_name(const char * name)
+{
+    static const gchar * const suffixes[] =
+    {
+        ".tar", ".tar.gz", ".tgz", ".zip", ".jar", NULL
+    };
+    const gsize len = strlen(name);
+
+    for (int i = 0 ; suffixes[i] ; i++)
+    {
+        const gsize suffix_len = strlen(suffixes[i]);
+
+        if ((len > suffix_len)
+            && (! g_ascii_strcasecmp(name + len - suffix_len, suffixes[i])))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * Sets out to name (of len bytes) without empty and "." components.
+ * Returns FALSE if nothing is left, or if it has ".." components.
+ * */
+static gboolean archive_normalise_name(
+    GString * const out,
+    const gchar * const name,
+    const gsize len
+)
+{
+    const gchar * const end = name + len;
+    const gchar * comp = name;
+
+    g_string_truncate(out, 0);
+
+    while (comp < end)
+    {
+        const gchar * const slash = memchr(comp, '/', end - comp);
+        const gchar * const comp_end = (slash ? slash : end);
+        const gsize comp_len = comp_end - comp;
+
+        if ((comp_len == 2) && (comp[0] == '.') && (comp[1] == '.'))
+        {
+            return FALSE;
+        }
+
+        if (comp_len && (! ((comp_len == 1) && (comp[0] == '.'))))
+        {
+            if (out->len)
+            {
+                g_string_append_c(out, '/');
+            }
+            g_string_append_len(out, comp, comp_len);
+        }
+
+        comp = comp_end + 1;
+    }
+
+    return (out->len > 0);
+}
+
+static void archive_fill_dir_stat(
+    archive_type * const self,
+    struct stat * const st
+)
+{
+    memset(st, '\0', sizeof(*st));
+
+    st->st_mode = (S_IFDIR | 0755);
+    st->st_nlink = 1;
+    st->st_dev = self->archive_stat.st_dev;
+    st->st_uid = self->archive_stat.st_uid;
+    st->st_gid = self->archive_stat.st_gid;
+    st->st_mtime = self->archive_stat.st_mtime;
+
+    return;
+}
+
+/*
+ * Reads up to len bytes of the tar stream into buf. Returns their number,
+ * 0 at its end, or -1 on errors.
+ * */
+static gssize tar_read_some(
+    archive_type * const self,
+    guint8 * const buf,
+    const gsize len
+)
+{
+    if (self->format == ARCHIVE_FORMAT_TAR)
+    {
+        ssize_t ret;
+
+        while (((ret = read(self->fd, buf, len)) < 0) && (errno == EINTR))
+        {
+        }
+
+        return ret;
+    }
+
+#ifdef FILEFIND_HAVE_ZLIB
+    z_stream * const zs = &(self->zs);
+
+    zs->next_out = buf;
+    zs->avail_out = len;
+
+    while (zs->avail_out == len)
+    {
+        if ((! zs->avail_in) && (! self->is_in_eof))
+        {
+            ssize_t num_read;
+
+            while (((num_read = read(self->fd, self->in_buf, ARCHIVE_BUFFER_SIZE)) < 0)
+                && (errno == EINTR))
+            {
+            }
+
+            if (num_read < 0)
+            {
+                return -1;
+            }
+
+            self->is_in_eof = (num_read == 0);
+            zs->next_in = self->in_buf;
+            zs->avail_in = num_read;
+        }
+
+        if ((! zs->avail_in) && self->is_in_eof)
+        {
+            /* A truncated gzip stream, or the end of the last one. */
+            return (zs->total_in ? -1 : 0);
+        }
+
+        const int ret = inflate(zs, Z_NO_FLUSH);
+
+        if (ret == Z_STREAM_END)
+        {
+            /* Concatenated gzip streams continue the tar. */
+            if (inflateReset(zs) != Z_OK)
+            {
+                return -1;
+            }
+        }
+        else if ((ret != Z_OK) && (ret != Z_BUF_ERROR))
+        {
+            return -1;
+        }
+    }
+
+    return (len - zs->avail_out);
+#else
+    return -1;
+#endif
+}
+
+/*
+ * Returns 1 if len bytes were read, 0 if the stream ended before the
+ * first one, or -1 otherwise.
+ * */
+static int tar_read_full(
+    archive_type * const self,
+    guint8 * const buf,
+    const gsize len
+)
+{
+    gsize done = 0;
+
+    while (done < len)
+    {
+        const gssize ret = tar_read_some(self, buf + done, len - done);
+
+        if (ret <= 0)
+        {
+            return (((ret == 0) && (done == 0)) ? 0 : -1);
+        }
+
+        done += ret;
+    }
+
+    return 1;
+}
+
+static gboolean tar_skip(archive_type * const self, guint64 len)
+{
+    if (! len)
+    {
+        return TRUE;
+    }
+
+    if (self->format == ARCHIVE_FORMAT_TAR)
+    {
+        const off_t offset = lseek(self->fd, len, SEEK_CUR);
+
+        /* A truncated tar. */
+        return ((offset != (off_t)-1) && (offset <= self->archive_stat.st_size));
+    }
+
+    if ((! self->scratch_buf)
+        && (! (self->scratch_buf = g_malloc(ARCHIVE_BUFFER_SIZE))))
+    {
+        return FALSE;
+    }
+
+    while (len)
+    {
+        const gssize ret = tar_read_some(
+            self, self->scratch_buf, MIN(len, ARCHIVE_BUFFER_SIZE)
+        );
+
+        if (ret <= 0)
+        {
+            return FALSE;
+        }
+
+        len -= ret;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Parses an octal field of a header, or a base-256 one, which GNU tar
+ * uses for the values that do not fit.
+ * */
+static gboolean tar_parse_number(
+    const guint8 * const field,
+    const gsize len,
+    guint64 * const value
+)
+{
+    gsize i = 0;
+    gboolean has_digits = FALSE;
+
+    *value = 0;
+
+    if (field[0] & 0x80)
+    {
+        /* Negative numbers start with 0xFF. */
+        if (field[0] != 0x80)
+        {
+            return FALSE;
+        }
+
+        for (i = 1 ; i < len ; i++)
+        {
+            *value = ((*value) << 8) | field[i];
+        }
+
+        return TRUE;
+    }
+
+    while ((i < len) && (field[i] == ' '))
+    {
+        i++;
+    }
+
+    for ( ; (i < len) && (field[i] >= '0') && (field[i] <= '7') ; i++)
+    {
+        *value = ((*value) << 3) | (field[i] - '0');
+        has_digits = TRUE;
+    }
+
+    return (has_digits
+        && ((i == len) || (field[i] == ' ') || (field[i] == '\0'))
+    );
+}
+
+/*
+ * Whether block is a tar header, by its checksum, which some old tars
+ * calculated with signed chars.
+ * */
+static gboolean tar_is_header(const guint8 * const block)
+{
+    guint64 expected;
+    guint64 sum = 0;
+    gint64 signed_sum = 0;
+
+    if (! tar_parse_number(block + 148, 8, &expected))
+    {
+        return FALSE;
+    }
+
+    for (int i = 0 ; i < ARCHIVE_BLOCK_SIZE ; i++)
+    {
+        const guint8 c = (((i >= 148) && (i < 156)) ? ' ' : block[i]);
+
+        sum += c;
+        signed_sum += (gint8)c;
+    }
+
+    return ((expected == sum) || (((gint64)expected) == signed_sum));
+}
+
+static gboolean archive_is_zero_block(const guint8 * const block)
+{
+    for (int i = 0 ; i < ARCHIVE_BLOCK_SIZE ; i++)
+    {
+        if (block[i])
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * Reads the data of a GNU long name or pax header, of size bytes, into
+ * self->next_name, which is reused as the buffer.
+ * */
+static gboolean tar_read_meta(archive_type * const self, const guint64 size)
+{
+    if (size > ARCHIVE_MAX_META_SIZE)
+    {
+        return FALSE;
+    }
+
+    g_string_set_size(self->next_name, size);
+
+    if (size && (tar_read_full(self, (guint8 *)self->next_name->str, size) != 1))
+    {
+        return FALSE;
+    }
+
+    self->data_left = 0;
+
+    return TRUE;
+}
+
+/*
+ * Keeps the path, size and mtime records of a pax header, which are
+ * "LENGTH KEY=VALUE\n".
+ * */
+static gboolean tar_parse_pax(archive_type * const self)
+{
+    GString * const records = self->next_name;
+    gsize pos = 0;
+    gboolean has_path = FALSE;
+    gsize path_start = 0;
+    gsize path_len = 0;
+
+    while (pos < records->len)
+    {
+        gchar * end_of_len;
+        const guint64 record_len =
+            g_ascii_strtoull(records->str + pos, &end_of_len, 10);
+        const gchar * const record = records->str + pos;
+
+        /*
+         * The length counts itself, the space, at least one byte of key
+         * and the newline, so that the record can neither be empty, which
+         * would never end the loop, nor end before its key starts.
+         * */
+        if ((end_of_len == record) || (*end_of_len != ' ')
+            || (record_len < (guint64)(end_of_len - record) + 3)
+            || (record_len > records->len - pos)
+            || (record[record_len - 1] != '\n'))
+        {
+            return FALSE;
+        }
+
+        const gchar * const key = end_of_len + 1;
+        const gchar * const equals =
+            memchr(key, '=', record + record_len - 1 - key);
+
+        if (equals)
+        {
+            const gchar * const value = equals + 1;
+            const gsize value_len = record + record_len - 1 - value;
+            const gsize key_len = equals - key;
+
+            if ((key_len == 4) && (! strncmp(key, "path", 4)))
+            {
+                has_path = TRUE;
+                path_start = value - records->str;
+                path_len = value_len;
+            }
+            else if ((key_len == 4) && (! strncmp(key, "size", 4)))
+            {
+                self->has_next_size = TRUE;
+                self->next_size = g_ascii_strtoull(value, NULL, 10);
+            }
+            else if ((key_len == 5) && (! strncmp(key, "mtime", 5)))
+            {
+                self->has_next_mtime = TRUE;
+                self->next_mtime = (time_t)g_ascii_strtoll(value, NULL, 10);
+            }
+        }
+
+        pos += record_len;
+    }
+
+    if (has_path)
+    {
+        g_string_erase(records, 0, path_start);
+        g_string_truncate(records, path_len);
+        self->has_next_name = TRUE;
+    }
+
+    return TRUE;
+}
+
+static mode_t tar_type_to_mode(const gchar typeflag)
+{
+    switch (typeflag)
+    {
+        case '2':
+            return S_IFLNK;
+
+        case '3':
+            return S_IFCHR;
+
+        case '4':
+            return S_IFBLK;
+
+        case '5':
+            return S_IFDIR;
+
+        case '6':
+            return S_IFIFO;
+
+        default:
+            /* Including hard links, which have no data of their own. */
+            return S_IFREG;
+    }
+}
+
+/*
+ * Sets the pending member to that of the next header, after skipping
+ * the data of the previous one.
+ * */
+static int tar_read_header(archive_type * const self)
+{
+    guint8 block[ARCHIVE_BLOCK_SIZE];
+
+    while (! self->is_tar_end)
+    {
+        if (! tar_skip(self, self->data_left + self->padding_left))
+        {
+            return FILE_FIND_INVALID_ARCHIVE;
+        }
+
+        self->data_left = self->padding_left = 0;
+
+        const int read_ret = tar_read_full(self, block, sizeof(block));
+
+        /* The end-of-archive blocks are missing from some tars. */
+        if ((read_ret == 0) || ((read_ret == 1) && archive_is_zero_block(block)))
+        {
+            self->is_tar_end = TRUE;
+            break;
+        }
+
+        guint64 size;
+        guint64 value;
+
+        if ((read_ret < 0)
+            || (! tar_is_header(block))
+            || (! tar_parse_number(block + 124, 12, &size)))
+        {
+            return FILE_FIND_INVALID_ARCHIVE;
+        }
+
+        const gchar typeflag = block[156];
+
+        self->data_left = size;
+        self->padding_left = ((ARCHIVE_BLOCK_SIZE - (size % ARCHIVE_BLOCK_SIZE))
+            % ARCHIVE_BLOCK_SIZE
+        );
+
+        if (typeflag == 'L')
+        {
+            if (! tar_read_meta(self, size))
+            {
+                return FILE_FIND_INVALID_ARCHIVE;
+            }
+            g_string_truncate(self->next_name, strlen(self->next_name->str));
+            self->has_next_name = TRUE;
+            continue;
+        }
+
+        if (typeflag == 'x')
+        {
+            if ((! tar_read_meta(self, size)) || (! tar_parse_pax(self)))
+            {
+                return FILE_FIND_INVALID_ARCHIVE;
+            }
+            continue;
+        }
+
+        /* Long link names, global pax headers and volume labels. */
+        if ((typeflag == 'K') || (typeflag == 'g') || (typeflag == 'V'))
+        {
+            continue;
+        }
+
+        gboolean is_name_ok;
+        mode_t type = tar_type_to_mode(typeflag);
+
+        if (self->has_next_name)
+        {
+            is_name_ok = archive_normalise_name(
+                self->pending_name, self->next_name->str, self->next_name->len
+            );
+        }
+        else
+        {
+            gchar path[155 + 1 + 100];
+            gsize path_len = 0;
+            const gsize name_len = strnlen((const gchar *)block, 100);
+
+            /* Only POSIX ustar has a prefix, which old GNU tars use else. */
+            if (! memcmp(block + 257, "ustar", 6))
+            {
+                const gsize prefix_len = strnlen((const gchar *)block + 345, 155);
+
+                if (prefix_len)
+                {
+                    memcpy(path, block + 345, prefix_len);
+                    path[prefix_len] = '/';
+                    path_len = prefix_len + 1;
+                }
+            }
+
+            memcpy(path + path_len, block, name_len);
+            path_len += name_len;
+
+            /* Old tars mark directories by a trailing slash. */
+            if ((type == S_IFREG) && path_len && (path[path_len - 1] == '/'))
+            {
+                type = S_IFDIR;
+            }
+
+            is_name_ok = archive_normalise_name(self->pending_name, path, path_len);
+        }
+
+        if (self->has_next_size)
+        {
+            size = self->data_left = self->next_size;
+            self->padding_left = ((ARCHIVE_BLOCK_SIZE - (size % ARCHIVE_BLOCK_SIZE))
+                % ARCHIVE_BLOCK_SIZE
+            );
+        }
+
+        struct stat * const st = &(self->pending_stat);
+
+        memset(st, '\0', sizeof(*st));
+
+        st->st_mode = type;
+        if (tar_parse_number(block + 100, 8, &value))
+        {
+            st->st_mode |= (value & 07777);
+        }
+        st->st_nlink = 1;
+        st->st_dev = self->archive_stat.st_dev;
+        if (tar_parse_number(block + 108, 8, &value))
+        {
+            st->st_uid = value;
+        }
+        if (tar_parse_number(block + 116, 8, &value))
+        {
+            st->st_gid = value;
+        }
+        if (self->has_next_mtime)
+        {
+            st->st_mtime = self->next_mtime;
+        }
+        else if (tar_parse_number(block + 136, 12, &value))
+        {
+            st->st_mtime = value;
+        }
+
+        if (type == S_IFLNK)
+        {
+            st->st_size = strnlen((const gchar *)block + 157, 100);
+        }
+        else if ((type == S_IFREG) && (typeflag != '1'))
+        {
+            st->st_size = size;
+        }
+
+        self->has_next_name = self->has_next_size = self->has_next_mtime = FALSE;
+
+        if (is_name_ok)
+        {
+            self->has_pending = TRUE;
+            return FILE_FIND_OK;
+        }
+    }
+
+    return FILE_FIND_END;
+}
+
+static int tar_read(
+    archive_type * const self,
+    guint8 * const buf,
+    const gsize len,
+    gsize * const num_read
+)
+{
+    const gsize to_read = MIN(len, self->data_left);
+
+    if (! to_read)
+    {
+        return FILE_FIND_OK;
+    }
+
+    const gssize ret = tar_read_some(self, buf, to_read);
+
+    if (ret <= 0)
+    {
+        return FILE_FIND_INVALID_ARCHIVE;
+    }
+
+    self->data_left -= ret;
+    *num_read = ret;
+
+    return FILE_FIND_OK;
+}
+
+/*
+ * Makes the next len bytes of the central directory available at
+ * self->cd_buf + self->cd_start.
+ * */
+static gboolean zip_cd_fill(archive_type * const self, const gsize len)
+{
+    if (self->cd_len - self->cd_start >= len)
+    {
+        return TRUE;
+    }
+
+    memmove(self->cd_buf, self->cd_buf + self->cd_start, self->cd_len - self->cd_start);
+    self->cd_len -= self->cd_start;
+    self->cd_start = 0;
+
+    if (len > self->cd_buf_size)
+    {
+        guint8 * const new_buf = g_realloc(self->cd_buf, len);
+
+        if (! new_buf)
+        {
+            return FALSE;
+        }
+
+        self->cd_buf = new_buf;
+        self->cd_buf_size = len;
+    }
+
+    while (self->cd_len < len)
+    {
+        const gsize to_read = MIN(
+            self->cd_buf_size - self->cd_len, self->cd_end - self->cd_offset
+        );
+
+        if ((! to_read)
+            || (! archive_pread_full(
+                    self, self->cd_buf + self->cd_len, to_read, self->cd_offset
+                )))
+        {
+            return FALSE;
+        }
+
+        self->cd_len += to_read;
+        self->cd_offset += to_read;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Finds the central directory from the end-of-central-directory record,
+ * and from its zip64 counterpart if the values do not fit there.
+ * */
+static int zip_open(archive_type * const self)
+{
+    const guint64 size = self->archive_stat.st_size;
+    const gsize tail_len = MIN(size, ZIP_EOCD_SIZE + ZIP_MAX_COMMENT_SIZE);
+    const guint64 tail_offset = size - tail_len;
+    guint8 * tail = NULL;
+    const guint8 * eocd = NULL;
+    int ret = FILE_FIND_INVALID_ARCHIVE;
+
+    if (tail_len < ZIP_EOCD_SIZE)
+    {
+        goto cleanup;
+    }
+
+    if (! (tail = g_malloc(tail_len)))
+    {
+        ret = FILE_FIND_OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    if (! archive_pread_full(self, tail, tail_len, tail_offset))
+    {
+        goto cleanup;
+    }
+
+    for (gsize i = tail_len - ZIP_EOCD_SIZE + 1 ; i-- > 0 ; )
+    {
+        if ((archive_le32(tail + i) == ZIP_EOCD_SIGNATURE)
+            && (i + ZIP_EOCD_SIZE + archive_le16(tail + i + 20) <= tail_len))
+        {
+            eocd = tail + i;
+            break;
+        }
+    }
+
+    if (! eocd)
+    {
+        goto cleanup;
+    }
+
+    const guint64 eocd_offset = tail_offset + (eocd - tail);
+    guint64 num_entries = archive_le16(eocd + 10);
+    guint64 cd_size = archive_le32(eocd + 12);
+    guint64 cd_offset = archive_le32(eocd + 16);
+
+    if ((num_entries == 0xFFFF) || (cd_size == 0xFFFFFFFF)
+        || (cd_offset == 0xFFFFFFFF))
+    {
+        guint8 locator[ZIP_EOCD64_LOCATOR_SIZE];
+        guint8 eocd64[ZIP_EOCD64_SIZE];
+
+        if ((eocd_offset < ZIP_EOCD64_LOCATOR_SIZE)
+            || (! archive_pread_full(
+                    self, locator, sizeof(locator),
+                    eocd_offset - ZIP_EOCD64_LOCATOR_SIZE
+                ))
+            || (archive_le32(locator) != ZIP_EOCD64_LOCATOR_SIGNATURE)
+            || (! archive_pread_full(
+                    self, eocd64, sizeof(eocd64), archive_le64(locator + 8)
+                ))
+            || (archive_le32(eocd64) != ZIP_EOCD64_SIGNATURE))
+        {
+            goto cleanup;
+        }
+
+        num_entries = archive_le64(eocd64 + 32);
+        cd_size = archive_le64(eocd64 + 40);
+        cd_offset = archive_le64(eocd64 + 48);
+    }
+    /* Split archives. */
+    else if (archive_le16(eocd + 4) || archive_le16(eocd + 6))
+    {
+        ret = FILE_FIND_NOT_SUPPORTED;
+        goto cleanup;
+    }
+
+    if ((cd_offset > size) || (cd_size > size - cd_offset))
+    {
+        goto cleanup;
+    }
+
+    self->cd_offset = cd_offset;
+    self->cd_end = cd_offset + cd_size;
+    self->num_entries_left = num_entries;
+    self->cd_buf_size = ARCHIVE_BUFFER_SIZE;
+
+    if (! (self->cd_buf = g_malloc(self->cd_buf_size)))
+    {
+        ret = FILE_FIND_OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    ret = FILE_FIND_OK;
+
+cleanup:
+
+    g_free(tail);
+
+    return ret;
+}
+
+static time_t zip_dos_time_to_time(const guint16 dos_time, const guint16 dos_date)
+{
+    struct tm tm;
+
+    memset(&tm, '\0', sizeof(tm));
+
+    tm.tm_year = (dos_date >> 9) + 80;
+    tm.tm_mon = ((dos_date >> 5) & 0xF) - 1;
+    tm.tm_mday = (dos_date & 0x1F);
+    tm.tm_hour = (dos_time >> 11);
+    tm.tm_min = ((dos_time >> 5) & 0x3F);
+    tm.tm_sec = ((dos_time & 0x1F) * 2);
+    /* It is in local time. */
+    tm.tm_isdst = -1;
+
+    return mktime(&tm);
+}
+
+/*
+ * Sets the pending member to that of the next entry of the central
+ * directory.
+ * */
+static int zip_read_entry(archive_type * const self)
+{
+    while (self->num_entries_left)
+    {
+        if (! zip_cd_fill(self, ZIP_CENTRAL_HEADER_SIZE))
+        {
+            return FILE_FIND_INVALID_ARCHIVE;
+        }
+
+        const guint8 * header = self->cd_buf + self->cd_start;
+
+        if (archive_le32(header) != ZIP_CENTRAL_HEADER_SIGNATURE)
+        {
+            return FILE_FIND_INVALID_ARCHIVE;
+        }
+
+        const gsize name_len = archive_le16(header + 28);
+        const gsize extra_len = archive_le16(header + 30);
+        const gsize entry_len = ZIP_CENTRAL_HEADER_SIZE + name_len + extra_len
+            + archive_le16(header + 32);
+
+        if (! zip_cd_fill(self, entry_len))
+        {
+            return FILE_FIND_INVALID_ARCHIVE;
+        }
+
+        header = self->cd_buf + self->cd_start;
+
+        const guint8 * const name = header + ZIP_CENTRAL_HEADER_SIZE;
+        const guint8 * const extra = name + name_len;
+        const guint32 external_attrs = archive_le32(header + 38);
+        guint64 uncomp_size = archive_le32(header + 24);
+        guint64 comp_size = archive_le32(header + 20);
+        guint64 local_offset = archive_le32(header + 42);
+        gboolean has_mtime = FALSE;
+        time_t mtime = 0;
+
+        for (gsize pos = 0 ; pos + 4 <= extra_len ; )
+        {
+            const guint16 id = archive_le16(extra + pos);
+            const gsize len = MIN(archive_le16(extra + pos + 2), extra_len - pos - 4);
+            const guint8 * const data = extra + pos + 4;
+
+            if (id == ZIP_EXTRA_ZIP64)
+            {
+                /* Only the values that did not fit, in this order. */
+                guint64 * const values[3] = { &uncomp_size, &comp_size, &local_offset };
+                gsize data_pos = 0;
+
+                for (int i = 0 ; i < 3 ; i++)
+                {
+                    if ((*(values[i]) == 0xFFFFFFFF) && (data_pos + 8 <= len))
+                    {
+                        *(values[i]) = archive_le64(data + data_pos);
+                        data_pos += 8;
+                    }
+                }
+            }
+            else if ((id == ZIP_EXTRA_TIMESTAMP) && (len >= 5) && (data[0] & 0x1))
+            {
+                has_mtime = TRUE;
+                mtime = (time_t)(gint32)archive_le32(data + 1);
+            }
+
+            pos += 4 + len;
+        }
+
+        const gboolean is_dir =
+            ((name_len && (name[name_len - 1] == '/')) || (external_attrs & 0x10));
+        const mode_t unix_mode = (external_attrs >> 16);
+        struct stat * const st = &(self->pending_stat);
+
+        memset(st, '\0', sizeof(*st));
+
+        if ((header[5] == ZIP_HOST_UNIX) && (unix_mode & S_IFMT))
+        {
+            st->st_mode = unix_mode;
+        }
+        else
+        {
+            st->st_mode = (is_dir ? (S_IFDIR | 0755) : (S_IFREG | 0644));
+        }
+        st->st_nlink = 1;
+        st->st_dev = self->archive_stat.st_dev;
+        st->st_uid = self->archive_stat.st_uid;
+        st->st_gid = self->archive_stat.st_gid;
+        st->st_size = (S_ISDIR(st->st_mode) ? 0 : uncomp_size);
+        st->st_mtime = (has_mtime
+            ? mtime
+            : zip_dos_time_to_time(archive_le16(header + 12), archive_le16(header + 14))
+        );
+
+        self->method = archive_le16(header + 10);
+        self->is_encrypted = (archive_le16(header + 8) & 0x1);
+        self->comp_size = comp_size;
+        self->local_offset = local_offset;
+
+        const gboolean is_name_ok = archive_normalise_name(
+            self->pending_name, (const gchar *)name, name_len
+        );
+
+        self->cd_start += entry_len;
+        self->num_entries_left--;
+
+        if (is_name_ok)
+        {
+            self->has_pending = TRUE;
+            return FILE_FIND_OK;
+        }
+    }
+
+    return FILE_FIND_END;
+}
+
+static int zip_read(
+    archive_type * const self,
+    guint8 * const buf,
+    const gsize len,
+    gsize * const num_read
+)
+{
+    if (self->is_encrypted)
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    if ((self->method != ZIP_METHOD_STORED)
+#ifdef FILEFIND_HAVE_ZLIB
+        && (self->method != ZIP_METHOD_DEFLATED)
+#endif
+    )
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    if (! self->is_data_located)
+    {
+        guint8 local_header[ZIP_LOCAL_HEADER_SIZE];
+
+        if ((! archive_pread_full(
+                    self, local_header, sizeof(local_header), self->local_offset
+                ))
+            || (archive_le32(local_header) != ZIP_LOCAL_HEADER_SIGNATURE))
+        {
+            return FILE_FIND_INVALID_ARCHIVE;
+        }
+
+        self->data_offset = self->local_offset + ZIP_LOCAL_HEADER_SIZE
+            + archive_le16(local_header + 26) + archive_le16(local_header + 28);
+        self->is_data_located = TRUE;
+
+#ifdef FILEFIND_HAVE_ZLIB
+        if (self->method == ZIP_METHOD_DEFLATED)
+        {
+            self->zs.avail_in = 0;
+
+            if ((self->is_zs_init
+                    ? inflateReset(&(self->zs))
+                    : inflateInit2(&(self->zs), -MAX_WBITS)) != Z_OK)
+            {
+                return FILE_FIND_OUT_OF_MEMORY;
+            }
+
+            self->is_zs_init = TRUE;
+        }
+#endif
+    }
+
+    if (self->method == ZIP_METHOD_STORED)
+    {
+        const gsize to_read = MIN(len, self->comp_size - self->comp_pos);
+
+        if (to_read
+            && (! archive_pread_full(
+                    self, buf, to_read, self->data_offset + self->comp_pos
+                )))
+        {
+            return FILE_FIND_INVALID_ARCHIVE;
+        }
+
+        self->comp_pos += to_read;
+        *num_read = to_read;
+
+        return FILE_FIND_OK;
+    }
+
+#ifdef FILEFIND_HAVE_ZLIB
+    z_stream * const zs = &(self->zs);
+
+    zs->next_out = buf;
+    zs->avail_out = len;
+
+    while ((zs->avail_out == len) && (! self->is_member_end))
+    {
+        if (! zs->avail_in)
+        {
+            const gsize to_read =
+                MIN(ARCHIVE_BUFFER_SIZE, self->comp_size - self->comp_pos);
+
+            if ((! to_read)
+                || (! archive_pread_full(
+                        self, self->in_buf, to_read,
+                        self->data_offset + self->comp_pos
+                    )))
+            {
+                return FILE_FIND_INVALID_ARCHIVE;
+            }
+
+            self->comp_pos += to_read;
+            zs->next_in = self->in_buf;
+            zs->avail_in = to_read;
+        }
+
+        const int ret = inflate(zs, Z_NO_FLUSH);
+
+        if (ret == Z_STREAM_END)
+        {
+            self->is_member_end = TRUE;
+        }
+        else if ((ret != Z_OK) && (ret != Z_BUF_ERROR))
+        {
+            return FILE_FIND_INVALID_ARCHIVE;
+        }
+    }
+
+    *num_read = len - zs->avail_out;
+#endif
+
+    return FILE_FIND_OK;
+}
+
+/*
+ * Tells the format by the contents, and gets ready to read the first
+ * member.
+ * */
+static int archive_detect_format(archive_type * const self)
+{
+    guint8 block[ARCHIVE_BLOCK_SIZE];
+    ssize_t len;
+
+    while (((len = pread(self->fd, block, sizeof(block), 0)) < 0)
+        && (errno == EINTR))
+    {
+    }
+
+    if (len < 0)
+    {
+        return FILE_FIND_INVALID_ARCHIVE;
+    }
+
+    if ((len >= 4) && (! memcmp(block, "PK", 2))
+        && ((archive_le16(block + 2) == 0x0403)
+            || (archive_le16(block + 2) == 0x0605)))
+    {
+        self->format = ARCHIVE_FORMAT_ZIP;
+
+        return zip_open(self);
+    }
+
+    if ((len >= 2) && (block[0] == 0x1f) && (block[1] == 0x8b))
+    {
+#ifdef FILEFIND_HAVE_ZLIB
+        self->format = ARCHIVE_FORMAT_TAR_GZ;
+
+        if (inflateInit2(&(self->zs), 16 + MAX_WBITS) != Z_OK)
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        self->is_zs_init = TRUE;
+
+        /* Only a gzip-compressed tar is an archive. */
+        const int read_ret = tar_read_full(self, block, sizeof(block));
+
+        if ((read_ret != 1)
+            || (! (tar_is_header(block) || archive_is_zero_block(block))))
+        {
+            return FILE_FIND_NOT_SUPPORTED;
+        }
+
+        self->zs.avail_in = 0;
+        self->is_in_eof = FALSE;
+
+        if ((inflateReset(&(self->zs)) != Z_OK)
+            || (lseek(self->fd, 0, SEEK_SET) != 0))
+        {
+            return FILE_FIND_INVALID_ARCHIVE;
+        }
+
+        return FILE_FIND_OK;
+#else
+        return FILE_FIND_NOT_SUPPORTED;
+#endif
+    }
+
+    if ((len == ARCHIVE_BLOCK_SIZE)
+        && (tar_is_header(block) || archive_is_zero_block(block)))
+    {
+        self->format = ARCHIVE_FORMAT_TAR;
+
+        return FILE_FIND_OK;
+    }
+
+    return FILE_FIND_NOT_SUPPORTED;
+}
+
+int file_find_archive_open(
+    file_find_archive_t * * output_handle,
+    const char * path
+)
+{
+    const int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        *output_handle = NULL;
+        return FILE_FIND_INVALID_ARCHIVE;
+    }
+
+    return file_find_archive_open_fd(output_handle, fd);
+}
+
+int file_find_archive_open_fd(
+    file_find_archive_t * * output_handle,
+    int fd
+)
+{
+    archive_type * self;
+    int ret = FILE_FIND_OUT_OF_MEMORY;
+
+    *output_handle = NULL;
+
+    if (! (self = g_new0(archive_type, 1)))
+    {
+        close(fd);
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    self->fd = fd;
+
+    if (! ((self->name = g_string_new(NULL))
+        && (self->pending_name = g_string_new(NULL))
+        && (self->next_name = g_string_new(NULL))
+        && (self->in_buf = g_malloc(ARCHIVE_BUFFER_SIZE))
+        && (self->seen_dirs = g_hash_table_new_full(
+                g_str_hash, g_str_equal, g_free, NULL
+            ))))
+    {
+        goto cleanup;
+    }
+
+    ret = FILE_FIND_INVALID_ARCHIVE;
+
+    if (fstat(self->fd, &(self->archive_stat)) != 0)
+    {
+        goto cleanup;
+    }
+
+    if (! S_ISREG(self->archive_stat.st_mode))
+    {
+        ret = FILE_FIND_NOT_SUPPORTED;
+        goto cleanup;
+    }
+
+    if ((ret = archive_detect_format(self)) != FILE_FIND_OK)
+    {
+        goto cleanup;
+    }
+
+    *output_handle = (file_find_archive_t *)self;
+
+    return FILE_FIND_OK;
+
+cleanup:
+
+    file_find_archive_free((file_find_archive_t *)self);
+
+    return ret;
+}
+
+int file_find_archive_next(
+    file_find_archive_t * handle,
+    const char * * name,
+    const struct stat * * stat_ret
+)
+{
+    archive_type * const self = (archive_type *)handle;
+
+    *name = NULL;
+    *stat_ret = NULL;
+
+    while (TRUE)
+    {
+        if (! self->has_pending)
+        {
+            const int ret = ((self->format == ARCHIVE_FORMAT_ZIP)
+                ? zip_read_entry(self)
+                : tar_read_header(self)
+            );
+
+            if (ret != FILE_FIND_OK)
+            {
+                return ret;
+            }
+
+            self->is_data_located = self->is_member_end = FALSE;
+            self->comp_pos = 0;
+        }
+
+        gchar * const pending = self->pending_name->str;
+
+        /* The first directory above the member that was not returned. */
+        for (gchar * slash = strchr(pending, '/') ; slash ; slash = strchr(slash + 1, '/'))
+        {
+            *slash = '\0';
+
+            if (! g_hash_table_contains(self->seen_dirs, pending))
+            {
+                gchar * const dir = g_strdup(pending);
+
+                if (! dir)
+                {
+                    *slash = '/';
+                    return FILE_FIND_OUT_OF_MEMORY;
+                }
+
+                g_hash_table_add(self->seen_dirs, dir);
+                g_string_assign(self->name, pending);
+                *slash = '/';
+
+                archive_fill_dir_stat(self, &(self->member_stat));
+                self->is_implied_dir = TRUE;
+
+                *name = self->name->str;
+                *stat_ret = &(self->member_stat);
+
+                return FILE_FIND_OK;
+            }
+
+            *slash = '/';
+        }
+
+        self->has_pending = FALSE;
+
+        if (S_ISDIR(self->pending_stat.st_mode))
+        {
+            if (g_hash_table_contains(self->seen_dirs, pending))
+            {
+                continue;
+            }
+
+            gchar * const dir = g_strdup(pending);
+
+            if (! dir)
+            {
+                return FILE_FIND_OUT_OF_MEMORY;
+            }
+
+            g_hash_table_add(self->seen_dirs, dir);
+        }
+
+        g_string_assign(self->name, pending);
+        self->member_stat = self->pending_stat;
+        self->is_implied_dir = FALSE;
+
+        *name = self->name->str;
+        *stat_ret = &(self->member_stat);
+
+        return FILE_FIND_OK;
+    }
+}
+
+int file_find_archive_read(
+    file_find_archive_t * handle,
+    void * buf,
+    size_t len,
+    size_t * num_read
+)
+{
+    archive_type * const self = (archive_type *)handle;
+
+    *num_read = 0;
+
+    /* The data that follows belongs to the pending member. */
+    if ((! self->name->len) || self->is_implied_dir || (! len)
+        || S_ISDIR(self->member_stat.st_mode))
+    {
+        return FILE_FIND_OK;
+    }
+
+    return ((self->format == ARCHIVE_FORMAT_ZIP)
+        ? zip_read(self, buf, len, num_read)
+        : tar_read(self, buf, len, num_read)
+    );
+}
+
+void file_find_archive_free(file_find_archive_t * handle)
+{
+    archive_type * const self = (archive_type *)handle;
+
+    if (self->fd >= 0)
+    {
+        close(self->fd);
+    }
+
+#ifdef FILEFIND_HAVE_ZLIB
+    if (self->is_zs_init)
+    {
+        inflateEnd(&(self->zs));
+    }
+#endif
+
+    if (self->name)
+    {
+        g_string_free(self->name, TRUE);
+    }
+
+    if (self->pending_name)
+    {
+        g_string_free(self->pending_name, TRUE);
+    }
+
+    if (self->next_name)
+    {
+        g_string_free(self->next_name, TRUE);
+    }
+
+    if (self->seen_dirs)
+    {
+        g_hash_table_destroy(self->seen_dirs);
+    }
+
+    g_free(self->in_buf);
+    g_free(self->scratch_buf);
+    g_free(self->cd_buf);
+    g_free(self);
+
+    return;
+}
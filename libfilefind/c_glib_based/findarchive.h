@@ -0,0 +1,117 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findarchive.h
+ *
+ *    Description:  lists and reads the members of tar and zip archives
+ *                  without extracting them.
+ *
+ *        Created:  20/10/26 06:14:51
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_FINDARCHIVE_H
+#define FILEFIND_FINDARCHIVE_H
+
+#include <stddef.h>
+
+#include "filefind.h"
+
+/*
+ * A tar archive is read as a stream of headers: the data of the members
+ * that are not read is skipped with lseek(), or decompressed and thrown
+ * away for a gzip-compressed one. A zip archive is listed from its central
+ * directory at the end of the file, and only the data of the members that
+ * are read is touched. The ustar, GNU (long names) and pax (path and size)
+ * extensions of tar, and the zip64 extensions of zip are understood.
+ *
+ * The names of the members are relative, without "." components or a
+ * trailing "/". The directories that hold members but have no entries of
+ * their own are returned before their first member, and every directory
+ * is returned once. Members whose names have ".." components are skipped.
+ *
+ * gzip-compressed tars and deflated zip members need zlib, and are
+ * FILE_FIND_NOT_SUPPORTED without it.
+ * */
+
+typedef struct
+{
+    int stub;
+} file_find_archive_t;
+
+/*
+ * Whether the name of a file is that of an archive that the finder enters:
+ * one that ends with ".tar", ".tar.gz", ".tgz", ".zip" or ".jar", in any
+ * case.
+ * */
+extern int file_find_archive_is_archive_name(const char * name);
+
+/*
+ * Opens the archive at path, whose format is told by its contents rather
+ * than by its name.
+ *
+ * Returns FILE_FIND_NOT_SUPPORTED if it is not an archive of a known
+ * format, and FILE_FIND_INVALID_ARCHIVE if it could not be read.
+ * */
+extern int file_find_archive_open(
+    file_find_archive_t * * output_handle,
+    const char * path
+);
+
+/*
+ * Like file_find_archive_open(), but reads the archive from fd, which it
+ * takes over, and closes even if it fails.
+ * */
+extern int file_find_archive_open_fd(
+    file_find_archive_t * * output_handle,
+    int fd
+);
+
+/*
+ * Moves to the next member, and sets *name and *stat_ret to its name and
+ * to what its header says about it. st_dev is that of the archive and
+ * st_ino is 0. They are valid until the next call.
+ *
+ * Returns FILE_FIND_END after the last member, and
+ * FILE_FIND_INVALID_ARCHIVE if the rest of the archive could not be read.
+ * */
+extern int file_find_archive_next(
+    file_find_archive_t * handle,
+    const char * * name,
+    const struct stat * * stat_ret
+);
+
+/*
+ * Reads up to len bytes of the data of the current member into buf, and
+ * sets *num_read to their number, which is 0 at its end. The members of a
+ * tar can only be read as they are reached.
+ *
+ * Returns FILE_FIND_NOT_SUPPORTED for encrypted zip members and unknown
+ * compression methods, and FILE_FIND_INVALID_ARCHIVE if the data could not
+ * be read.
+ * */
+extern int file_find_archive_read(
+    file_find_archive_t * handle,
+    void * buf,
+    size_t len,
+    size_t * num_read
+);
+
+extern void file_find_archive_free(file_find_archive_t * handle);
+
+/*
+ * Returns the archive that the current item of the finder is a member of
+ * (see file_find_set_archives()), whose current member it is, or NULL.
+ * It belongs to the finder, and is only valid until the next call to
+ * file_find_next(). It is always NULL in parallel scans.
+ * */
+extern file_find_archive_t * file_find_get_archive(
+    file_find_handle_t * handle
+);
+
+#endif /* #ifndef FILEFIND_FINDARCHIVE_H */
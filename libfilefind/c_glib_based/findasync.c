@@ -0,0 +1,321 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findasync.c
+ *
+ *    Description:  walks a finder in the background, for event loops.
+ *
+ *        Created:  19/10/26 23:41:09
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#include "inline.h"
+
+#include "findasync.h"
+
+typedef struct
+{
+    file_find_handle_t * finder;
+    GThread * thread;
+    gint should_stop;
+    /* Guards everything below. */
+    GMutex lock;
+    GCond not_full;
+    /* A ring of the detached items. */
+    file_find_item_t * * items;
+    guint capacity;
+    guint head;
+    guint num_items;
+    /* FILE_FIND_OK while the walk goes on, and then how it ended. */
+    int status;
+    /*
+     * A pipe that holds a single byte while there is something to return,
+     * so that its read end is readable exactly then.
+     * */
+    int fds[2];
+    gboolean is_signalled;
+} file_find_async_struct_t;
+
+/*
+ * Must be called with the lock held, whenever the queue or the status
+ * changes.
+ * */
+static void file_find_async_update_signal(file_find_async_struct_t * const self)
+{
+#ifdef G_OS_UNIX
+    const gboolean is_ready =
+        (self->num_items || (self->status != FILE_FIND_OK));
+    gchar byte = '\0';
+
+    if (is_ready && (! self->is_signalled))
+    {
+        self->is_signalled = (write(self->fds[1], &byte, 1) == 1);
+    }
+    else if ((! is_ready) && self->is_signalled)
+    {
+        self->is_signalled = (read(self->fds[0], &byte, 1) != 1);
+    }
+#endif
+
+    return;
+}
+
+static gpointer file_find_async_walk(gpointer data)
+{
+    file_find_async_struct_t * const self = (file_find_async_struct_t *)data;
+    int status = FILE_FIND_END;
+
+    while ((! g_atomic_int_get(&(self->should_stop)))
+        && ((status = file_find_next(self->finder)) == FILE_FIND_OK))
+    {
+        file_find_item_t * const item =
+            file_find_item_detach(file_find_get_item(self->finder));
+
+        if (! item)
+        {
+            status = FILE_FIND_OUT_OF_MEMORY;
+            break;
+        }
+
+        g_mutex_lock(&(self->lock));
+
+        while ((self->num_items == self->capacity)
+            && (! g_atomic_int_get(&(self->should_stop))))
+        {
+            g_cond_wait(&(self->not_full), &(self->lock));
+        }
+
+        if (self->num_items == self->capacity)
+        {
+            g_mutex_unlock(&(self->lock));
+            file_find_item_free(item);
+            status = FILE_FIND_END;
+            break;
+        }
+
+        self->items[(self->head + self->num_items) % self->capacity] = item;
+        self->num_items++;
+
+        file_find_async_update_signal(self);
+
+        g_mutex_unlock(&(self->lock));
+    }
+
+    if (status == FILE_FIND_OK)
+    {
+        status = FILE_FIND_END;
+    }
+
+    g_mutex_lock(&(self->lock));
+
+    self->status = status;
+    file_find_async_update_signal(self);
+
+    g_mutex_unlock(&(self->lock));
+
+    return NULL;
+}
+
+static void file_find_async_close_fds(file_find_async_struct_t * const self)
+{
+#ifdef G_OS_UNIX
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        if (self->fds[i] >= 0)
+        {
+            close(self->fds[i]);
+            self->fds[i] = -1;
+        }
+    }
+#endif
+
+    return;
+}
+
+int file_find_async_new(
+    file_find_async_t * * output_handle,
+    file_find_handle_t * finder,
+    int max_queued_items
+)
+{
+    file_find_async_struct_t * self;
+
+    *output_handle = NULL;
+
+#ifndef G_OS_UNIX
+    return FILE_FIND_NOT_SUPPORTED;
+#endif
+
+    if (! (self = g_new0(file_find_async_struct_t, 1)))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    self->finder = finder;
+    self->capacity = ((max_queued_items > 0)
+        ? max_queued_items : FILE_FIND_ASYNC_DEFAULT_QUEUED_ITEMS
+    );
+    self->status = FILE_FIND_OK;
+    self->fds[0] = self->fds[1] = -1;
+
+    g_mutex_init(&(self->lock));
+    g_cond_init(&(self->not_full));
+
+    if (! (self->items = g_new(file_find_item_t *, self->capacity)))
+    {
+        goto cleanup;
+    }
+
+#ifdef G_OS_UNIX
+    if (pipe(self->fds) != 0)
+    {
+        goto cleanup;
+    }
+
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        fcntl(self->fds[i], F_SETFD, FD_CLOEXEC);
+        fcntl(self->fds[i], F_SETFL, fcntl(self->fds[i], F_GETFL) | O_NONBLOCK);
+    }
+#endif
+
+    if (! (self->thread = g_thread_try_new(
+                    "file_find_async", file_find_async_walk, self, NULL)))
+    {
+        goto cleanup;
+    }
+
+    *output_handle = (file_find_async_t *)self;
+
+    return FILE_FIND_OK;
+
+cleanup:
+
+    file_find_async_close_fds(self);
+    g_free(self->items);
+    g_mutex_clear(&(self->lock));
+    g_cond_clear(&(self->not_full));
+    g_free(self);
+
+    return FILE_FIND_OUT_OF_MEMORY;
+}
+
+int file_find_async_get_fd(file_find_async_t * handle)
+{
+    return ((file_find_async_struct_t *)handle)->fds[0];
+}
+
+int file_find_async_next(
+    file_find_async_t * handle,
+    file_find_item_t * * item
+)
+{
+    file_find_async_struct_t * const self = (file_find_async_struct_t *)handle;
+    int ret;
+
+    *item = NULL;
+
+    g_mutex_lock(&(self->lock));
+
+    if (self->num_items)
+    {
+        *item = self->items[self->head];
+        self->head = (self->head + 1) % self->capacity;
+
+        if ((self->num_items--) == self->capacity)
+        {
+            g_cond_signal(&(self->not_full));
+        }
+
+        ret = FILE_FIND_OK;
+    }
+    else
+    {
+        ret = ((self->status == FILE_FIND_OK) ? FILE_FIND_AGAIN : self->status);
+    }
+
+    file_find_async_update_signal(self);
+
+    g_mutex_unlock(&(self->lock));
+
+    return ret;
+}
+
+static gboolean file_find_async_source_dispatch(
+    GSource * source,
+    GSourceFunc callback,
+    gpointer user_data
+)
+{
+    return (callback ? callback(user_data) : G_SOURCE_REMOVE);
+}
+
+/* The source is ready whenever its fd is, so it needs no prepare or check. */
+static GSourceFuncs file_find_async_source_funcs =
+{
+    NULL,
+    NULL,
+    file_find_async_source_dispatch,
+    NULL,
+};
+
+GSource * file_find_async_create_source(file_find_async_t * handle)
+{
+    file_find_async_struct_t * const self = (file_find_async_struct_t *)handle;
+
+    GSource * const source =
+        g_source_new(&file_find_async_source_funcs, sizeof(GSource));
+
+    if (! source)
+    {
+        return NULL;
+    }
+
+#ifdef G_OS_UNIX
+    g_source_add_unix_fd(source, self->fds[0], G_IO_IN);
+#endif
+
+    return source;
+}
+
+void file_find_async_free(file_find_async_t * handle)
+{
+    file_find_async_struct_t * const self = (file_find_async_struct_t *)handle;
+
+    g_mutex_lock(&(self->lock));
+
+    g_atomic_int_set(&(self->should_stop), 1);
+    g_cond_signal(&(self->not_full));
+
+    g_mutex_unlock(&(self->lock));
+
+    g_thread_join(self->thread);
+    self->thread = NULL;
+
+    for ( ; self->num_items ; self->num_items--)
+    {
+        file_find_item_free(self->items[self->head]);
+        self->head = (self->head + 1) % self->capacity;
+    }
+
+    file_find_async_close_fds(self);
+    g_free(self->items);
+    g_mutex_clear(&(self->lock));
+    g_cond_clear(&(self->not_full));
+    g_free(self);
+
+    return;
+}
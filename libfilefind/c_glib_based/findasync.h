@@ -0,0 +1,86 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findasync.h
+ *
+ *    Description:  walks a finder in the background, for event loops.
+ *
+ *        Created:  19/10/26 23:41:09
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_FINDASYNC_H
+#define FILEFIND_FINDASYNC_H
+
+#include <glib.h>
+
+#include "filefind.h"
+
+/*
+ * The finder is walked on a thread of its own, so its blocking directory
+ * listings and stat()s (e.g: of a stalled NFS server) never hold up the
+ * thread that consumes the items. Up to max_queued_items items are
+ * detached and queued ahead of the consumer, and a file descriptor is
+ * readable while there are items in the queue or the walk is over, so it
+ * can be polled along with the other work of an event loop.
+ * */
+
+typedef struct
+{
+    int stub;
+} file_find_async_t;
+
+#define FILE_FIND_ASYNC_DEFAULT_QUEUED_ITEMS 1024
+
+/*
+ * Starts walking finder, which may not be used until file_find_async_free()
+ * returns. Its callbacks are called on the walking thread. max_queued_items
+ * <= 0 means FILE_FIND_ASYNC_DEFAULT_QUEUED_ITEMS.
+ *
+ * Returns FILE_FIND_NOT_SUPPORTED where there are no pipes.
+ * */
+extern int file_find_async_new(
+    file_find_async_t * * output_handle,
+    file_find_handle_t * finder,
+    int max_queued_items
+);
+
+/*
+ * Readable while file_find_async_next() would not return FILE_FIND_AGAIN.
+ * It is only to be polled, not read from.
+ * */
+extern int file_find_async_get_fd(file_find_async_t * handle);
+
+/*
+ * Never blocks. Returns FILE_FIND_OK and sets *item to the next item, which
+ * is freed with file_find_item_free(), FILE_FIND_AGAIN if there is none
+ * yet, or, once the walk is over, FILE_FIND_END or the error that ended it.
+ * */
+extern int file_find_async_next(
+    file_find_async_t * handle,
+    file_find_item_t * * item
+);
+
+/*
+ * Returns a GSource that is dispatched while file_find_async_next() has
+ * something to return, for g_source_set_callback() and g_source_attach().
+ * The callback should take the items that are ready and return
+ * G_SOURCE_REMOVE after the end of the walk. It must be destroyed before
+ * file_find_async_free().
+ * */
+extern GSource * file_find_async_create_source(file_find_async_t * handle);
+
+/*
+ * Stops the walk if it is not over, and waits for the walking thread,
+ * which may be in the middle of a blocking call. The items that were not
+ * taken are freed. The finder can be used again afterwards, e.g: for
+ * file_find_get_stats().
+ * */
+extern void file_find_async_free(file_find_async_t * handle);
+
+#endif /* #ifndef FILEFIND_FINDASYNC_H */
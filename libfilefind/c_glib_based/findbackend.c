@@ -0,0 +1,930 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findbackend.c
+ *
+ *    Description:  the file systems that a finder can walk: the one of the
+ *                  process, and trees that are kept in memory.
+ *
+ *        Created:  20/10/26 07:02:18
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "inline.h"
+
+#include "findbackend.h"
+
+static void * posix_opendir(void * context, const char * path)
+{
+    return g_dir_open(path, 0, NULL);
+}
+
+static const char * posix_readdir(void * context, void * dir)
+{
+    return g_dir_read_name((GDir *)dir);
+}
+
+static void posix_closedir(void * context, void * dir)
+{
+    g_dir_close((GDir *)dir);
+
+    return;
+}
+
+static int posix_stat(
+    void * context,
+    const char * path,
+    int follow_links,
+    struct stat * stat_ret
+)
+{
+    return (follow_links ? g_stat(path, stat_ret) : g_lstat(path, stat_ret));
+}
+
+static int posix_open(void * context, const char * path)
+{
+    return g_open(path, O_RDONLY, 0);
+}
+
+static const file_find_backend_t posix_backend =
+{
+    posix_opendir,
+    posix_readdir,
+    posix_closedir,
+    posix_stat,
+    posix_open,
+    NULL,
+    TRUE,
+};
+
+const file_find_backend_t * file_find_backend_posix(void)
+{
+    return &posix_backend;
+}
+
+#ifdef __linux__
+
+#define GETDENTS_BUFFER_SIZE (64 * 1024)
+
+/* What getdents64() returns, which glibc only declares since 2.30. */
+typedef struct
+{
+    guint64 d_ino;
+    gint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} getdents_entry_type;
+
+typedef struct
+{
+    int fd;
+    gsize pos;
+    gsize len;
+    /* As guint64s, so that the entries are aligned. */
+    guint64 buffer[GETDENTS_BUFFER_SIZE / sizeof(guint64)];
+} getdents_dir_type;
+
+static void * getdents_opendir(void * context, const char * path)
+{
+    int fd;
+
+    while (((fd = openat(
+                    AT_FDCWD, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC
+                )) < 0)
+        && (errno == EINTR))
+    {
+    }
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    getdents_dir_type * const dir = g_try_new(getdents_dir_type, 1);
+
+    if (! dir)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    dir->fd = fd;
+    dir->pos = 0;
+    dir->len = 0;
+
+    return dir;
+}
+
+static const char * getdents_readdir(void * context, void * dir_void)
+{
+    getdents_dir_type * const dir = (getdents_dir_type *)dir_void;
+
+    while (TRUE)
+    {
+        if (dir->pos >= dir->len)
+        {
+            const long len = syscall(
+                SYS_getdents64, dir->fd, dir->buffer, sizeof(dir->buffer)
+            );
+
+            if (len <= 0)
+            {
+                if ((len < 0) && (errno == EINTR))
+                {
+                    continue;
+                }
+
+                return NULL;
+            }
+
+            dir->pos = 0;
+            dir->len = len;
+        }
+
+        const getdents_entry_type * const entry = (const getdents_entry_type *)
+            (((const gchar *)dir->buffer) + dir->pos);
+
+        dir->pos += entry->d_reclen;
+
+        const char * const name = entry->d_name;
+
+        if (! ((name[0] == '.')
+            && ((! name[1]) || ((name[1] == '.') && (! name[2])))))
+        {
+            return name;
+        }
+    }
+}
+
+static void getdents_closedir(void * context, void * dir_void)
+{
+    getdents_dir_type * const dir = (getdents_dir_type *)dir_void;
+
+    close(dir->fd);
+    g_free(dir);
+
+    return;
+}
+
+static int getdents_stat(
+    void * context,
+    const char * path,
+    int follow_links,
+    struct stat * stat_ret
+)
+{
+    return fstatat(
+        AT_FDCWD, path, stat_ret, (follow_links ? 0 : AT_SYMLINK_NOFOLLOW)
+    );
+}
+
+static int getdents_open(void * context, const char * path)
+{
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static const file_find_backend_t getdents_backend =
+{
+    getdents_opendir,
+    getdents_readdir,
+    getdents_closedir,
+    getdents_stat,
+    getdents_open,
+    NULL,
+    TRUE,
+};
+
+#endif
+
+const file_find_backend_t * file_find_backend_getdents(void)
+{
+#ifdef __linux__
+    return &getdents_backend;
+#else
+    return &posix_backend;
+#endif
+}
+
+#define MEMORY_NODE_NONE G_MAXUINT32
+#define MEMORY_TREE_DEV 1
+#define MEMORY_DIR_SIZE 4096
+
+/*
+ * Until the tree is sealed by file_find_memory_tree_get_backend(), the
+ * entries of a directory are a list that starts at first_child and goes
+ * through next_sibling. Sealing puts them in children, sorted by name,
+ * from first_child on.
+ * */
+typedef struct
+{
+    guint32 name_offset;
+    guint32 first_child;
+    guint32 next_sibling;
+    guint32 num_children;
+    guint32 mode;
+    /* In seconds since the epoch, so up to 2106. */
+    guint32 mtime;
+    guint64 size;
+} memory_node_type;
+
+typedef struct
+{
+    file_find_backend_t backend;
+    /* The root is node 0. */
+    GArray * nodes;
+    /* The names of the nodes, each followed by its '\0'. */
+    GString * names;
+    guint32 * children;
+    gboolean is_sealed;
+} memory_tree_type;
+
+typedef struct
+{
+    guint32 next;
+    guint32 end;
+} memory_dir_type;
+
+typedef struct
+{
+    const gchar * name;
+    guint32 idx;
+} memory_sorted_child_type;
+
+static GCC_INLINE memory_node_type * memory_tree_get_node(
+    memory_tree_type * const self,
+    const guint32 idx
+)
+{
+    return &g_array_index(self->nodes, memory_node_type, idx);
+}
+
+static GCC_INLINE const gchar * memory_tree_get_name(
+    memory_tree_type * const self,
+    const guint32 idx
+)
+{
+    return self->names->str + memory_tree_get_node(self, idx)->name_offset;
+}
+
+/*
+ * Compares name to the first len bytes of component, the way strcmp()
+ * would compare it to them as a string.
+ * */
+static int memory_name_cmp(
+    const gchar * const name,
+    const gchar * const component,
+    const gsize len
+)
+{
+    const int ret = strncmp(name, component, len);
+
+    if (ret)
+    {
+        return ret;
+    }
+
+    return (name[len] ? 1 : 0);
+}
+
+/*
+ * Moves *path past the next component, and returns it and sets *len to
+ * its length, or returns NULL at the end. "." components are skipped.
+ * */
+static const gchar * memory_path_next_component(
+    const gchar * * const path,
+    gsize * const len
+)
+{
+    const gchar * s = *path;
+
+    while (TRUE)
+    {
+        while (G_IS_DIR_SEPARATOR(*s))
+        {
+            s++;
+        }
+
+        if (! *s)
+        {
+            *path = s;
+            return NULL;
+        }
+
+        const gchar * const start = s;
+
+        while (*s && (! G_IS_DIR_SEPARATOR(*s)))
+        {
+            s++;
+        }
+
+        if (! ((s - start == 1) && (start[0] == '.')))
+        {
+            *path = s;
+            *len = s - start;
+            return start;
+        }
+    }
+}
+
+static guint32 memory_tree_find_child(
+    memory_tree_type * const self,
+    const guint32 dir,
+    const gchar * const component,
+    const gsize len
+)
+{
+    const memory_node_type * const node = memory_tree_get_node(self, dir);
+
+    if (! self->is_sealed)
+    {
+        for (guint32 child = node->first_child ;
+            child != MEMORY_NODE_NONE ;
+            child = memory_tree_get_node(self, child)->next_sibling)
+        {
+            if (! memory_name_cmp(
+                    memory_tree_get_name(self, child), component, len))
+            {
+                return child;
+            }
+        }
+
+        return MEMORY_NODE_NONE;
+    }
+
+    guint32 low = node->first_child;
+    guint32 high = node->first_child + node->num_children;
+
+    while (low < high)
+    {
+        const guint32 mid = low + (high - low) / 2;
+        const guint32 child = self->children[mid];
+        const int cmp =
+            memory_name_cmp(memory_tree_get_name(self, child), component, len);
+
+        if (! cmp)
+        {
+            return child;
+        }
+        else if (cmp < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return MEMORY_NODE_NONE;
+}
+
+/*
+ * Returns the node of path, or MEMORY_NODE_NONE if there is none.
+ * */
+static guint32 memory_tree_lookup(
+    memory_tree_type * const self,
+    const gchar * path
+)
+{
+    const gchar * component;
+    gsize len;
+    guint32 idx = 0;
+
+    while ((component = memory_path_next_component(&path, &len)))
+    {
+        if ((! S_ISDIR(memory_tree_get_node(self, idx)->mode))
+            || ((len == 2) && (! strncmp(component, "..", 2))))
+        {
+            return MEMORY_NODE_NONE;
+        }
+
+        if ((idx = memory_tree_find_child(self, idx, component, len))
+                == MEMORY_NODE_NONE)
+        {
+            return MEMORY_NODE_NONE;
+        }
+    }
+
+    return idx;
+}
+
+/*
+ * Adds a node named by the first len bytes of name to the directory
+ * parent, and returns it, or MEMORY_NODE_NONE if out of memory.
+ * */
+static guint32 memory_tree_new_node(
+    memory_tree_type * const self,
+    const guint32 parent,
+    const gchar * const name,
+    const gsize len,
+    const mode_t mode,
+    const guint64 size,
+    const time_t mtime
+)
+{
+    const gsize name_offset = self->names->len;
+    const guint32 idx = self->nodes->len;
+    memory_node_type node;
+
+    if ((name_offset + len + 1 > G_MAXUINT32) || (idx == MEMORY_NODE_NONE))
+    {
+        return MEMORY_NODE_NONE;
+    }
+
+    g_string_append_len(self->names, name, len);
+    g_string_append_c(self->names, '\0');
+
+    memory_node_type * const parent_node = memory_tree_get_node(self, parent);
+
+    node.name_offset = name_offset;
+    node.first_child = MEMORY_NODE_NONE;
+    node.next_sibling = parent_node->first_child;
+    node.num_children = 0;
+    node.mode = mode;
+    node.mtime = mtime;
+    node.size = size;
+
+    parent_node->first_child = idx;
+    parent_node->num_children++;
+
+    g_array_append_val(self->nodes, node);
+
+    return idx;
+}
+
+/*
+ * Sets *idx to the node of path, after adding it (as a directory) and the
+ * directories above it if they are not there yet.
+ * */
+static int memory_tree_add_path(
+    memory_tree_type * const self,
+    const gchar * path,
+    guint32 * const idx
+)
+{
+    const gchar * component;
+    gsize len;
+
+    *idx = 0;
+
+    while ((component = memory_path_next_component(&path, &len)))
+    {
+        if ((! S_ISDIR(memory_tree_get_node(self, *idx)->mode))
+            || ((len == 2) && (! strncmp(component, "..", 2))))
+        {
+            return FILE_FIND_NOT_SUPPORTED;
+        }
+
+        guint32 child = memory_tree_find_child(self, *idx, component, len);
+
+        if ((child == MEMORY_NODE_NONE)
+            && ((child = memory_tree_new_node(
+                        self, *idx, component, len,
+                        S_IFDIR | 0755, MEMORY_DIR_SIZE, 0
+                    )) == MEMORY_NODE_NONE))
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        *idx = child;
+    }
+
+    return FILE_FIND_OK;
+}
+
+int file_find_memory_tree_new(file_find_memory_tree_t * * output_handle)
+{
+    memory_tree_type * self;
+
+    *output_handle = NULL;
+
+    if (! (self = g_new0(memory_tree_type, 1)))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    if (! ((self->nodes = g_array_new(FALSE, FALSE, sizeof(memory_node_type)))
+        && (self->names = g_string_new(NULL))))
+    {
+        file_find_memory_tree_free((file_find_memory_tree_t *)self);
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    /* The root, whose name is "". */
+    memory_node_type root;
+
+    root.name_offset = 0;
+    root.first_child = MEMORY_NODE_NONE;
+    root.next_sibling = MEMORY_NODE_NONE;
+    root.num_children = 0;
+    root.mode = S_IFDIR | 0755;
+    root.mtime = 0;
+    root.size = MEMORY_DIR_SIZE;
+
+    g_string_append_c(self->names, '\0');
+    g_array_append_val(self->nodes, root);
+
+    *output_handle = (file_find_memory_tree_t *)self;
+
+    return FILE_FIND_OK;
+}
+
+int file_find_memory_tree_add(
+    file_find_memory_tree_t * handle,
+    const char * path,
+    mode_t mode,
+    unsigned long long size,
+    time_t mtime
+)
+{
+    memory_tree_type * const self = (memory_tree_type *)handle;
+    guint32 idx;
+    int ret;
+
+    if (self->is_sealed || S_ISLNK(mode))
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    if ((ret = memory_tree_add_path(self, path, &idx)) != FILE_FIND_OK)
+    {
+        return ret;
+    }
+
+    memory_node_type * const node = memory_tree_get_node(self, idx);
+
+    if ((! S_ISDIR(mode)) && ((! idx) || node->num_children))
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    node->mode = mode;
+    node->size = size;
+    node->mtime = mtime;
+
+    return FILE_FIND_OK;
+}
+
+/* splitmix64, for sizes and mtimes that only depend on the arguments. */
+static GCC_INLINE guint64 memory_tree_hash(guint64 x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+    return (x ^ (x >> 31));
+}
+
+typedef struct
+{
+    int num_subdirs;
+    int num_files;
+    guint64 num_added;
+} memory_synthetic_type;
+
+static gboolean memory_tree_add_synthetic_dir(
+    memory_tree_type * const self,
+    memory_synthetic_type * const synthetic,
+    const guint32 dir,
+    const int depth
+)
+{
+    gchar name[32];
+
+    for (int i = 0 ; i < synthetic->num_files ; i++)
+    {
+        const guint64 hash = memory_tree_hash(synthetic->num_added++);
+        const int len = g_snprintf(name, sizeof(name), "f%d", i);
+
+        if (memory_tree_new_node(
+                self, dir, name, len, S_IFREG | 0644,
+                hash % (1024 * 1024),
+                1600000000 + (hash >> 32) % (365 * 24 * 60 * 60)
+            ) == MEMORY_NODE_NONE)
+        {
+            return FALSE;
+        }
+    }
+
+    if (! depth)
+    {
+        return TRUE;
+    }
+
+    for (int i = 0 ; i < synthetic->num_subdirs ; i++)
+    {
+        const int len = g_snprintf(name, sizeof(name), "d%d", i);
+        const guint32 subdir = memory_tree_new_node(
+            self, dir, name, len, S_IFDIR | 0755, MEMORY_DIR_SIZE, 1600000000
+        );
+
+        synthetic->num_added++;
+
+        if ((subdir == MEMORY_NODE_NONE)
+            || (! memory_tree_add_synthetic_dir(
+                    self, synthetic, subdir, depth - 1)))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+int file_find_memory_tree_add_synthetic(
+    file_find_memory_tree_t * handle,
+    const char * path,
+    int num_subdirs,
+    int num_files,
+    int depth
+)
+{
+    memory_tree_type * const self = (memory_tree_type *)handle;
+    memory_synthetic_type synthetic;
+    guint32 dir;
+    int ret;
+
+    if (self->is_sealed || (num_subdirs < 0) || (num_files < 0) || (depth < 0))
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    /* The number of nodes, so that nodes is only allocated once. */
+    const guint64 max_num_nodes = MEMORY_NODE_NONE - self->nodes->len - 1;
+    guint64 num_nodes = 0;
+    guint64 num_dirs_at_level = 1;
+
+    for (int level = 0 ; level <= depth ; level++)
+    {
+        if (level)
+        {
+            if (num_subdirs
+                && (num_dirs_at_level > max_num_nodes / num_subdirs))
+            {
+                return FILE_FIND_NOT_SUPPORTED;
+            }
+
+            num_dirs_at_level *= num_subdirs;
+            num_nodes += num_dirs_at_level;
+        }
+
+        if (num_files
+            && (num_dirs_at_level > (max_num_nodes - num_nodes) / num_files))
+        {
+            return FILE_FIND_NOT_SUPPORTED;
+        }
+
+        num_nodes += num_dirs_at_level * num_files;
+
+        if (num_nodes > max_num_nodes)
+        {
+            return FILE_FIND_NOT_SUPPORTED;
+        }
+    }
+
+    if ((ret = memory_tree_add_path(self, path, &dir)) != FILE_FIND_OK)
+    {
+        return ret;
+    }
+
+    if ((! S_ISDIR(memory_tree_get_node(self, dir)->mode))
+        || memory_tree_get_node(self, dir)->num_children)
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    const guint old_len = self->nodes->len;
+
+    g_array_set_size(self->nodes, old_len + num_nodes);
+    g_array_set_size(self->nodes, old_len);
+
+    synthetic.num_subdirs = num_subdirs;
+    synthetic.num_files = num_files;
+    synthetic.num_added = 0;
+
+    return (memory_tree_add_synthetic_dir(self, &synthetic, dir, depth)
+        ? FILE_FIND_OK : FILE_FIND_OUT_OF_MEMORY
+    );
+}
+
+unsigned long long file_find_memory_tree_get_num_nodes(
+    file_find_memory_tree_t * handle
+)
+{
+    return ((memory_tree_type *)handle)->nodes->len;
+}
+
+static int memory_sorted_child_cmp(const void * a_void, const void * b_void)
+{
+    return strcmp(
+        ((const memory_sorted_child_type *)a_void)->name,
+        ((const memory_sorted_child_type *)b_void)->name
+    );
+}
+
+static gboolean memory_tree_seal(memory_tree_type * const self)
+{
+    const guint num_nodes = self->nodes->len;
+    guint32 max_num_children = 0;
+    guint32 pos = 0;
+
+    for (guint32 i = 0 ; i < num_nodes ; i++)
+    {
+        max_num_children =
+            MAX(max_num_children, memory_tree_get_node(self, i)->num_children);
+    }
+
+    /* Every node but the root is the child of one directory. */
+    if (! (self->children = g_try_new(guint32, MAX(num_nodes - 1, 1))))
+    {
+        return FALSE;
+    }
+
+    memory_sorted_child_type * const sorted =
+        g_try_new(memory_sorted_child_type, MAX(max_num_children, 1));
+
+    if (! sorted)
+    {
+        g_free(self->children);
+        self->children = NULL;
+        return FALSE;
+    }
+
+    for (guint32 i = 0 ; i < num_nodes ; i++)
+    {
+        memory_node_type * const node = memory_tree_get_node(self, i);
+        guint32 num_sorted = 0;
+
+        for (guint32 child = node->first_child ;
+            child != MEMORY_NODE_NONE ;
+            child = memory_tree_get_node(self, child)->next_sibling)
+        {
+            sorted[num_sorted].name = memory_tree_get_name(self, child);
+            sorted[num_sorted].idx = child;
+            num_sorted++;
+        }
+
+        qsort(sorted, num_sorted, sizeof(sorted[0]), memory_sorted_child_cmp);
+
+        node->first_child = pos;
+
+        for (guint32 j = 0 ; j < num_sorted ; j++)
+        {
+            self->children[pos++] = sorted[j].idx;
+        }
+    }
+
+    g_free(sorted);
+
+    self->is_sealed = TRUE;
+
+    return TRUE;
+}
+
+static void * memory_opendir(void * context, const char * path)
+{
+    memory_tree_type * const self = (memory_tree_type *)context;
+    const guint32 idx = memory_tree_lookup(self, path);
+
+    if ((idx == MEMORY_NODE_NONE)
+        || (! S_ISDIR(memory_tree_get_node(self, idx)->mode)))
+    {
+        return NULL;
+    }
+
+    memory_dir_type * const dir = g_try_new(memory_dir_type, 1);
+
+    if (dir)
+    {
+        const memory_node_type * const node = memory_tree_get_node(self, idx);
+
+        dir->next = node->first_child;
+        dir->end = node->first_child + node->num_children;
+    }
+
+    return dir;
+}
+
+static const char * memory_readdir(void * context, void * dir_void)
+{
+    memory_tree_type * const self = (memory_tree_type *)context;
+    memory_dir_type * const dir = (memory_dir_type *)dir_void;
+
+    if (dir->next == dir->end)
+    {
+        return NULL;
+    }
+
+    return memory_tree_get_name(self, self->children[dir->next++]);
+}
+
+static void memory_closedir(void * context, void * dir)
+{
+    g_free(dir);
+
+    return;
+}
+
+static int memory_stat(
+    void * context,
+    const char * path,
+    int follow_links,
+    struct stat * stat_ret
+)
+{
+    memory_tree_type * const self = (memory_tree_type *)context;
+    const guint32 idx = memory_tree_lookup(self, path);
+
+    if (idx == MEMORY_NODE_NONE)
+    {
+        return -1;
+    }
+
+    const memory_node_type * const node = memory_tree_get_node(self, idx);
+
+    memset(stat_ret, '\0', sizeof(*stat_ret));
+
+    stat_ret->st_dev = MEMORY_TREE_DEV;
+    stat_ret->st_ino = idx + 1;
+    stat_ret->st_mode = node->mode;
+    stat_ret->st_nlink = (S_ISDIR(node->mode) ? 2 : 1);
+    stat_ret->st_size = node->size;
+    stat_ret->st_mtime = node->mtime;
+    stat_ret->st_atime = node->mtime;
+    stat_ret->st_ctime = node->mtime;
+#ifdef G_OS_UNIX
+    stat_ret->st_blksize = 4096;
+    stat_ret->st_blocks = (node->size + 511) / 512;
+#endif
+
+    return 0;
+}
+
+static int memory_open(void * context, const char * path)
+{
+    return -1;
+}
+
+const file_find_backend_t * file_find_memory_tree_get_backend(
+    file_find_memory_tree_t * handle
+)
+{
+    memory_tree_type * const self = (memory_tree_type *)handle;
+
+    if ((! self->is_sealed) && (! memory_tree_seal(self)))
+    {
+        return NULL;
+    }
+
+    self->backend.opendir = memory_opendir;
+    self->backend.readdir = memory_readdir;
+    self->backend.closedir = memory_closedir;
+    self->backend.stat = memory_stat;
+    self->backend.open = memory_open;
+    self->backend.context = self;
+    self->backend.is_host_fs = FALSE;
+
+    return &(self->backend);
+}
+
+void file_find_memory_tree_free(file_find_memory_tree_t * handle)
+{
+    memory_tree_type * const self = (memory_tree_type *)handle;
+
+    if (self->nodes)
+    {
+        g_array_free(self->nodes, TRUE);
+        self->nodes = NULL;
+    }
+
+    if (self->names)
+    {
+        g_string_free(self->names, TRUE);
+        self->names = NULL;
+    }
+
+    g_free(self->children);
+    self->children = NULL;
+
+    g_free(self);
+
+    return;
+}
@@ -0,0 +1,161 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findbackend.h
+ *
+ *    Description:  the file systems that a finder can walk: the one of the
+ *                  process, and trees that are kept in memory.
+ *
+ *        Created:  20/10/26 07:02:18
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_FINDBACKEND_H
+#define FILEFIND_FINDBACKEND_H
+
+#include <time.h>
+
+#include "filefind.h"
+
+/*
+ * The calls that a finder makes to list and stat() the tree that it walks.
+ * They are given full paths, as built from the targets, and context. With
+ * file_find_set_parallel_roots(), they are called from several threads at
+ * once.
+ * */
+typedef struct
+{
+    /*
+     * Returns a handle of the directory at path for readdir(), or NULL if
+     * it could not be opened.
+     * */
+    void * (*opendir)(void * context, const char * path);
+    /*
+     * Returns the name of the next entry of dir, other than "." and "..",
+     * or NULL after the last one. The name is valid until the next call.
+     * */
+    const char * (*readdir)(void * context, void * dir);
+    void (*closedir)(void * context, void * dir);
+    /*
+     * Like stat() if follow_links, and lstat() otherwise: returns 0, or -1
+     * if path could not be stat()ed.
+     * */
+    int (*stat)(
+        void * context,
+        const char * path,
+        int follow_links,
+        struct stat * stat_ret
+    );
+    /* Returns a file descriptor of path open for reading, or -1. */
+    int (*open)(void * context, const char * path);
+    void * context;
+    /*
+     * Whether the paths are those of the file system of the process, so
+     * that the file system types and mounts of file_find_set_no_cross_fs()
+     * and file_find_set_skip_fs_types() can be looked up.
+     * */
+    int is_host_fs;
+} file_find_backend_t;
+
+/*
+ * Like file_find_new(), but the tree is walked through backend, which must
+ * outlive the finder. NULL is file_find_backend_posix().
+ *
+ * file_find_set_should_stat_in_inode_order() and file_find_set_prefetch()
+ * only apply with file_find_backend_posix(), since they list and stat()
+ * the directories by themselves.
+ * */
+extern int file_find_new_with_backend(
+    file_find_handle_t * * output_handle,
+    const char * first_target,
+    const file_find_backend_t * backend
+);
+
+extern const file_find_backend_t * file_find_get_backend(
+    file_find_handle_t * handle
+);
+
+/*
+ * The default: the file system of the process, through GLib.
+ * */
+extern const file_find_backend_t * file_find_backend_posix(void);
+
+/*
+ * The file system of the process, listed with getdents64() into a large
+ * buffer instead of through readdir(), and stat()ed with fstatat(). Only
+ * on Linux; elsewhere it is file_find_backend_posix().
+ * */
+extern const file_find_backend_t * file_find_backend_getdents(void);
+
+/*
+ * A tree that is kept in memory, for benchmarking the finder without the
+ * kernel and for deterministic tests. The paths in it are relative to its
+ * root, "" (or "/" or ".") being the root itself, and ".." is not
+ * resolved. Its directories are listed in the order of their names, and
+ * its files have sizes but no contents, so they cannot be opened. Every
+ * node takes 36 bytes and its name.
+ * */
+typedef struct
+{
+    int stub;
+} file_find_memory_tree_t;
+
+extern int file_find_memory_tree_new(file_find_memory_tree_t * * output_handle);
+
+/*
+ * Adds the node at path, whose type is that of mode (S_IFDIR, S_IFREG,
+ * etc.), and the directories above it that are not there yet. Adding an
+ * existing node replaces its mode, size and mtime. Finding the parent
+ * directory goes over its entries, so directories of many entries are
+ * better built by file_find_memory_tree_add_synthetic().
+ *
+ * Returns FILE_FIND_NOT_SUPPORTED for symbolic links, for paths under a
+ * node that is not a directory, and after file_find_memory_tree_get_backend().
+ * */
+extern int file_find_memory_tree_add(
+    file_find_memory_tree_t * handle,
+    const char * path,
+    mode_t mode,
+    unsigned long long size,
+    time_t mtime
+);
+
+/*
+ * Adds a synthetic tree below the directory at path: every directory has
+ * num_files files ("f0", "f1", ...) and, above depth levels below path,
+ * num_subdirs subdirectories ("d0", "d1", ...). The sizes and mtimes of
+ * the files are pseudo-random, and the same for the same arguments. E.g:
+ * 10 subdirectories, 9 files and 6 levels make 11,111,109 nodes.
+ *
+ * Returns FILE_FIND_NOT_SUPPORTED if path already has entries, or the tree
+ * would have more than 2^32-2 nodes.
+ * */
+extern int file_find_memory_tree_add_synthetic(
+    file_find_memory_tree_t * handle,
+    const char * path,
+    int num_subdirs,
+    int num_files,
+    int depth
+);
+
+extern unsigned long long file_find_memory_tree_get_num_nodes(
+    file_find_memory_tree_t * handle
+);
+
+/*
+ * Returns the backend that walks the tree, which belongs to it, or NULL if
+ * out of memory. The tree cannot be added to afterwards, and is only read
+ * by the backend, so it may be walked by several finders at once.
+ * */
+extern const file_find_backend_t * file_find_memory_tree_get_backend(
+    file_find_memory_tree_t * handle
+);
+
+extern void file_find_memory_tree_free(file_find_memory_tree_t * handle);
+
+#endif /* #ifndef FILEFIND_FINDBACKEND_H */
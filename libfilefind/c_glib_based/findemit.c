@@ -0,0 +1,677 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findemit.c
+ *
+ *    Description:  writes the items of libfilefind to a file descriptor in
+ *                  machine-readable formats.
+ *
+ *        Created:  19/10/26 22:58:36
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef G_OS_UNIX
+#include <sys/uio.h>
+#include <unistd.h>
+#else
+#include <io.h>
+
+struct iovec
+{
+    void * iov_base;
+    size_t iov_len;
+};
+#endif
+
+#include "inline.h"
+
+#include "findemit.h"
+
+/* The text formats are written whenever this much is buffered. */
+#define EMIT_BUFFER_SIZE (1024 * 1024)
+
+/* A columnar batch is written whenever one of these is reached. */
+#define EMIT_BATCH_MAX_RECORDS (64 * 1024)
+#define EMIT_BATCH_MAX_PATHS_SIZE (4 * 1024 * 1024)
+
+#define EMIT_MAX_IOVS (6 + FILE_FIND_EMIT_NUM_FIELDS)
+
+const char * const file_find_emit_field_names[FILE_FIND_EMIT_NUM_FIELDS] =
+{
+    "size",
+    "mtime",
+    "mode",
+    "ino",
+    "dev",
+    "nlink",
+    "uid",
+    "gid",
+    "blocks",
+};
+
+typedef struct
+{
+    int fd;
+    int format;
+    unsigned int fields;
+    gboolean had_write_error;
+    /* The text of the text formats, or the paths of the columnar batch. */
+    GByteArray * buffer;
+    /* Of the columnar batch. */
+    guint num_records;
+    GArray * offsets;
+    GByteArray * types;
+    GArray * columns[FILE_FIND_EMIT_NUM_FIELDS];
+} emitter_t;
+
+static const guint8 emit_padding[8] = { 0 };
+
+/*
+ * Writes all of the chunks, resuming after partial writes.
+ * */
+static gboolean emit_writev(
+    const int fd,
+    struct iovec * iov,
+    int num_iov
+)
+{
+    while (num_iov > 0)
+    {
+#ifdef G_OS_UNIX
+        const ssize_t written = writev(fd, iov, num_iov);
+#else
+        const int written = write(fd, iov->iov_base, iov->iov_len);
+#endif
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return FALSE;
+        }
+
+        size_t remaining = written;
+
+        while ((num_iov > 0) && (remaining >= iov->iov_len))
+        {
+            remaining -= iov->iov_len;
+            iov++;
+            num_iov--;
+        }
+
+        if (num_iov > 0)
+        {
+            iov->iov_base = ((guint8 *)iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
+        }
+    }
+
+    return TRUE;
+}
+
+static GCC_INLINE char emit_type_char(const struct stat * const stat_ret)
+{
+    const mode_t mode = stat_ret->st_mode;
+
+    if (S_ISREG(mode))
+    {
+        return 'f';
+    }
+    else if (S_ISDIR(mode))
+    {
+        return 'd';
+    }
+#ifdef G_OS_UNIX
+    else if (S_ISLNK(mode))
+    {
+        return 'l';
+    }
+    else if (S_ISFIFO(mode))
+    {
+        return 'p';
+    }
+    else if (S_ISSOCK(mode))
+    {
+        return 's';
+    }
+    else if (S_ISCHR(mode))
+    {
+        return 'c';
+    }
+    else if (S_ISBLK(mode))
+    {
+        return 'b';
+    }
+#endif
+    else
+    {
+        return '?';
+    }
+}
+
+long long file_find_emit_get_field(
+    const struct stat * const stat_ret,
+    const unsigned int field
+)
+{
+    switch (field)
+    {
+        case FILE_FIND_EMIT_FIELD_SIZE:
+            return stat_ret->st_size;
+        case FILE_FIND_EMIT_FIELD_MTIME:
+            return stat_ret->st_mtime;
+        case FILE_FIND_EMIT_FIELD_MODE:
+            return stat_ret->st_mode;
+        case FILE_FIND_EMIT_FIELD_INO:
+            return stat_ret->st_ino;
+        case FILE_FIND_EMIT_FIELD_DEV:
+            return stat_ret->st_dev;
+        case FILE_FIND_EMIT_FIELD_NLINK:
+            return stat_ret->st_nlink;
+        case FILE_FIND_EMIT_FIELD_UID:
+            return stat_ret->st_uid;
+        case FILE_FIND_EMIT_FIELD_GID:
+            return stat_ret->st_gid;
+        case FILE_FIND_EMIT_FIELD_BLOCKS:
+#ifdef G_OS_WIN32
+            return ((stat_ret->st_size + 511) / 512);
+#else
+            return stat_ret->st_blocks;
+#endif
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Returns the length of the valid UTF-8 sequence at s, or 0 if there is
+ * none. Overlong forms, surrogates and code points above U+10FFFF are not
+ * valid.
+ * */
+static gsize utf8_sequence_length(const guint8 * const s, const gsize len)
+{
+    gunichar min_code_point;
+    gsize seq_len;
+    gunichar code_point;
+
+    if (s[0] < 0x80)
+    {
+        return 1;
+    }
+    else if ((s[0] & 0xE0) == 0xC0)
+    {
+        seq_len = 2;
+        min_code_point = 0x80;
+        code_point = (s[0] & 0x1F);
+    }
+    else if ((s[0] & 0xF0) == 0xE0)
+    {
+        seq_len = 3;
+        min_code_point = 0x800;
+        code_point = (s[0] & 0x0F);
+    }
+    else if ((s[0] & 0xF8) == 0xF0)
+    {
+        seq_len = 4;
+        min_code_point = 0x10000;
+        code_point = (s[0] & 0x07);
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (seq_len > len)
+    {
+        return 0;
+    }
+
+    for (gsize i = 1 ; i < seq_len ; i++)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+
+        code_point = ((code_point << 6) | (s[i] & 0x3F));
+    }
+
+    if ((code_point < min_code_point)
+        || (code_point > 0x10FFFF)
+        || ((code_point >= 0xD800) && (code_point <= 0xDFFF)))
+    {
+        return 0;
+    }
+
+    return seq_len;
+}
+
+static void emit_json_string(GByteArray * const buffer, const gchar * const string)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    const guint8 * s = (const guint8 *)string;
+    gsize len = strlen(string);
+
+    g_byte_array_append(buffer, (const guint8 *)"\"", 1);
+
+    while (len > 0)
+    {
+        const gsize seq_len = utf8_sequence_length(s, len);
+        char escape[7];
+
+        if ((seq_len == 1) && (*s >= 0x20) && (*s != '"') && (*s != '\\'))
+        {
+            g_byte_array_append(buffer, s, 1);
+        }
+        else if (seq_len == 1)
+        {
+            if ((*s == '"') || (*s == '\\'))
+            {
+                escape[0] = '\\';
+                escape[1] = *s;
+                g_byte_array_append(buffer, (const guint8 *)escape, 2);
+            }
+            else
+            {
+                memcpy(escape, "\\u00", 4);
+                escape[4] = hex_digits[*s >> 4];
+                escape[5] = hex_digits[*s & 0xF];
+                g_byte_array_append(buffer, (const guint8 *)escape, 6);
+            }
+        }
+        else if (seq_len > 1)
+        {
+            g_byte_array_append(buffer, s, seq_len);
+        }
+        else
+        {
+            /* An invalid byte, which is always >= 0x80. */
+            memcpy(escape, "\\udc", 4);
+            escape[4] = hex_digits[*s >> 4];
+            escape[5] = hex_digits[*s & 0xF];
+            g_byte_array_append(buffer, (const guint8 *)escape, 6);
+        }
+
+        s += (seq_len ? seq_len : 1);
+        len -= (seq_len ? seq_len : 1);
+    }
+
+    g_byte_array_append(buffer, (const guint8 *)"\"", 1);
+
+    return;
+}
+
+static void emit_json_record(
+    emitter_t * const self,
+    const file_find_item_t * const item
+)
+{
+    GByteArray * const buffer = self->buffer;
+    const struct stat * const stat_ret = file_find_item_get_stat(item);
+    char text[64];
+
+    g_byte_array_append(buffer, (const guint8 *)"{\"path\":", 8);
+    emit_json_string(buffer, file_find_item_get_path(item));
+
+    const int type_len = snprintf(
+        text, sizeof(text), ",\"type\":\"%c\"", emit_type_char(stat_ret)
+    );
+    g_byte_array_append(buffer, (const guint8 *)text, type_len);
+
+    for (int i = 0 ; i < FILE_FIND_EMIT_NUM_FIELDS ; i++)
+    {
+        if (self->fields & (1 << i))
+        {
+            const int len = snprintf(
+                text, sizeof(text), ",\"%s\":%lld",
+                file_find_emit_field_names[i],
+                file_find_emit_get_field(stat_ret, (1 << i))
+            );
+            g_byte_array_append(buffer, (const guint8 *)text, len);
+        }
+    }
+
+    if (file_find_item_is_dup_link(item))
+    {
+        g_byte_array_append(buffer, (const guint8 *)",\"dup_link\":true", 16);
+    }
+
+    g_byte_array_append(buffer, (const guint8 *)"}\n", 2);
+
+    return;
+}
+
+static gboolean emitter_write_buffer(emitter_t * const self)
+{
+    struct iovec iov;
+
+    if (! self->buffer->len)
+    {
+        return TRUE;
+    }
+
+    iov.iov_base = self->buffer->data;
+    iov.iov_len = self->buffer->len;
+
+    const gboolean ret = emit_writev(self->fd, &iov, 1);
+
+    g_byte_array_set_size(self->buffer, 0);
+
+    return ret;
+}
+
+static GCC_INLINE guint emit_padding_len(const guint len)
+{
+    return ((8 - (len & 0x7)) & 0x7);
+}
+
+/*
+ * Writes the current batch, which may be empty to end the stream.
+ * */
+static gboolean emitter_write_batch(emitter_t * const self)
+{
+    struct iovec iov[EMIT_MAX_IOVS];
+    int num_iov = 0;
+    guint32 header[2];
+
+#define ADD_IOV(base, len) \
+    { \
+        iov[num_iov].iov_base = (void *)(base); \
+        iov[num_iov].iov_len = (len); \
+        num_iov++; \
+    }
+
+    header[0] = GUINT32_TO_LE(self->num_records);
+    header[1] = GUINT32_TO_LE(self->buffer->len);
+
+    ADD_IOV(header, sizeof(header));
+
+    if (self->num_records)
+    {
+        ADD_IOV(self->offsets->data, self->offsets->len * sizeof(guint32));
+        ADD_IOV(self->buffer->data, self->buffer->len);
+        ADD_IOV(emit_padding, emit_padding_len(self->buffer->len));
+        ADD_IOV(self->types->data, self->types->len);
+        ADD_IOV(emit_padding, emit_padding_len(self->types->len));
+
+        for (int i = 0 ; i < FILE_FIND_EMIT_NUM_FIELDS ; i++)
+        {
+            if (self->columns[i])
+            {
+                ADD_IOV(self->columns[i]->data, self->num_records * sizeof(gint64));
+            }
+        }
+    }
+
+#undef ADD_IOV
+
+    const gboolean ret = emit_writev(self->fd, iov, num_iov);
+
+    self->num_records = 0;
+    g_byte_array_set_size(self->buffer, 0);
+    g_byte_array_set_size(self->types, 0);
+
+    for (int i = 0 ; i < FILE_FIND_EMIT_NUM_FIELDS ; i++)
+    {
+        if (self->columns[i])
+        {
+            g_array_set_size(self->columns[i], 0);
+        }
+    }
+
+    const guint32 first_offset = 0;
+
+    g_array_set_size(self->offsets, 0);
+    g_array_append_val(self->offsets, first_offset);
+
+    return ret;
+}
+
+static void emit_columnar_record(
+    emitter_t * const self,
+    const file_find_item_t * const item
+)
+{
+    const struct stat * const stat_ret = file_find_item_get_stat(item);
+    const gchar * const path = file_find_item_get_path(item);
+    const guint8 type = emit_type_char(stat_ret);
+
+    g_byte_array_append(self->buffer, (const guint8 *)path, strlen(path));
+
+    const guint32 offset = GUINT32_TO_LE(self->buffer->len);
+
+    g_array_append_val(self->offsets, offset);
+    g_byte_array_append(self->types, &type, 1);
+
+    for (int i = 0 ; i < FILE_FIND_EMIT_NUM_FIELDS ; i++)
+    {
+        if (self->columns[i])
+        {
+            const gint64 value = GINT64_TO_LE(
+                file_find_emit_get_field(stat_ret, (1 << i))
+            );
+
+            g_array_append_val(self->columns[i], value);
+        }
+    }
+
+    self->num_records++;
+
+    return;
+}
+
+static void emitter_free_buffers(emitter_t * const self)
+{
+    if (self->buffer)
+    {
+        g_byte_array_free(self->buffer, TRUE);
+        self->buffer = NULL;
+    }
+
+    if (self->offsets)
+    {
+        g_array_free(self->offsets, TRUE);
+        self->offsets = NULL;
+    }
+
+    if (self->types)
+    {
+        g_byte_array_free(self->types, TRUE);
+        self->types = NULL;
+    }
+
+    for (int i = 0 ; i < FILE_FIND_EMIT_NUM_FIELDS ; i++)
+    {
+        if (self->columns[i])
+        {
+            g_array_free(self->columns[i], TRUE);
+            self->columns[i] = NULL;
+        }
+    }
+
+    return;
+}
+
+int file_find_emitter_new(
+    file_find_emitter_t * * output_handle,
+    int fd,
+    int format,
+    unsigned int fields
+)
+{
+    emitter_t * self;
+
+    *output_handle = NULL;
+
+    if (! (self = g_new0(emitter_t, 1)))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    self->fd = fd;
+    self->format = format;
+    self->fields = (fields & ((1 << FILE_FIND_EMIT_NUM_FIELDS) - 1));
+
+    if (! (self->buffer = g_byte_array_sized_new(EMIT_BUFFER_SIZE)))
+    {
+        goto cleanup;
+    }
+
+    if (format == FILE_FIND_EMIT_COLUMNAR)
+    {
+        const guint32 first_offset = 0;
+
+        if (! (self->offsets = g_array_new(FALSE, FALSE, sizeof(guint32))))
+        {
+            goto cleanup;
+        }
+
+        g_array_append_val(self->offsets, first_offset);
+
+        if (! (self->types = g_byte_array_new()))
+        {
+            goto cleanup;
+        }
+
+        for (int i = 0 ; i < FILE_FIND_EMIT_NUM_FIELDS ; i++)
+        {
+            if ((self->fields & (1 << i))
+                && (! (self->columns[i] =
+                        g_array_new(FALSE, FALSE, sizeof(gint64)))))
+            {
+                goto cleanup;
+            }
+        }
+
+        guint32 header[4];
+
+        memcpy(header, "FFCOLS01", 8);
+        header[2] = GUINT32_TO_LE(self->fields);
+        header[3] = 0;
+
+        g_byte_array_append(self->buffer, (const guint8 *)header, sizeof(header));
+
+        if (! emitter_write_buffer(self))
+        {
+            self->had_write_error = TRUE;
+        }
+    }
+
+    *output_handle = (file_find_emitter_t *)self;
+
+    return FILE_FIND_OK;
+
+cleanup:
+
+    emitter_free_buffers(self);
+    g_free(self);
+
+    return FILE_FIND_OUT_OF_MEMORY;
+}
+
+int file_find_emitter_add(
+    file_find_emitter_t * handle,
+    const file_find_item_t * item
+)
+{
+    emitter_t * const self = (emitter_t *)handle;
+
+    if (self->had_write_error)
+    {
+        return FILE_FIND_COULD_NOT_WRITE;
+    }
+
+    switch (self->format)
+    {
+        case FILE_FIND_EMIT_COLUMNAR:
+            emit_columnar_record(self, item);
+
+            if ((self->num_records >= EMIT_BATCH_MAX_RECORDS)
+                || (self->buffer->len >= EMIT_BATCH_MAX_PATHS_SIZE))
+            {
+                self->had_write_error = (! emitter_write_batch(self));
+            }
+            break;
+
+        case FILE_FIND_EMIT_JSON_LINES:
+            emit_json_record(self, item);
+            break;
+
+        default:
+            {
+                const gchar * const path = file_find_item_get_path(item);
+                const guint8 separator =
+                    ((self->format == FILE_FIND_EMIT_NUL) ? '\0' : '\n');
+
+                g_byte_array_append(
+                    self->buffer, (const guint8 *)path, strlen(path)
+                );
+                g_byte_array_append(self->buffer, &separator, 1);
+            }
+            break;
+    }
+
+    if ((self->format != FILE_FIND_EMIT_COLUMNAR)
+        && (self->buffer->len >= EMIT_BUFFER_SIZE))
+    {
+        self->had_write_error = (! emitter_write_buffer(self));
+    }
+
+    return (self->had_write_error ? FILE_FIND_COULD_NOT_WRITE : FILE_FIND_OK);
+}
+
+int file_find_emitter_flush(file_find_emitter_t * handle)
+{
+    emitter_t * const self = (emitter_t *)handle;
+
+    if (! self->had_write_error)
+    {
+        if (self->format == FILE_FIND_EMIT_COLUMNAR)
+        {
+            if (self->num_records)
+            {
+                self->had_write_error = (! emitter_write_batch(self));
+            }
+        }
+        else
+        {
+            self->had_write_error = (! emitter_write_buffer(self));
+        }
+    }
+
+    return (self->had_write_error ? FILE_FIND_COULD_NOT_WRITE : FILE_FIND_OK);
+}
+
+int file_find_emitter_free(file_find_emitter_t * handle)
+{
+    emitter_t * const self = (emitter_t *)handle;
+
+    file_find_emitter_flush(handle);
+
+    /* The end of the stream. */
+    if ((self->format == FILE_FIND_EMIT_COLUMNAR) && (! self->had_write_error))
+    {
+        self->had_write_error = (! emitter_write_batch(self));
+    }
+
+    const int ret =
+        (self->had_write_error ? FILE_FIND_COULD_NOT_WRITE : FILE_FIND_OK);
+
+    emitter_free_buffers(self);
+    g_free(self);
+
+    return ret;
+}
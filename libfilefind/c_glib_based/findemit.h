@@ -0,0 +1,133 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findemit.h
+ *
+ *    Description:  writes the items of libfilefind to a file descriptor in
+ *                  machine-readable formats.
+ *
+ *        Created:  19/10/26 22:58:36
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_FINDEMIT_H
+#define FILEFIND_FINDEMIT_H
+
+#include "filefind.h"
+
+enum FILE_FIND_EMIT_FORMAT
+{
+    /* The paths, each followed by a newline. */
+    FILE_FIND_EMIT_LINES = 0,
+    /* The paths, each followed by a NUL, like find -print0. */
+    FILE_FIND_EMIT_NUL,
+    /*
+     * A JSON object per line, with the "path", the "type" (one of "f",
+     * "d", "l", "p", "s", "c", "b" or "?", like find -printf %y), the
+     * selected fields as numbers, and "dup_link": true for the items that
+     * file_find_item_is_dup_link(). The bytes of a path that are not valid
+     * UTF-8 are written as the lone surrogates \udc80-\udcff, like
+     * Python's "surrogateescape", so the path can be restored exactly.
+     * */
+    FILE_FIND_EMIT_JSON_LINES,
+    /* See below. */
+    FILE_FIND_EMIT_COLUMNAR,
+};
+
+/*
+ * The stat() fields to write with FILE_FIND_EMIT_JSON_LINES and
+ * FILE_FIND_EMIT_COLUMNAR. They are ORed together.
+ * */
+enum FILE_FIND_EMIT_FIELD
+{
+    FILE_FIND_EMIT_FIELD_SIZE = (1 << 0),
+    /* In seconds since the epoch. */
+    FILE_FIND_EMIT_FIELD_MTIME = (1 << 1),
+    FILE_FIND_EMIT_FIELD_MODE = (1 << 2),
+    FILE_FIND_EMIT_FIELD_INO = (1 << 3),
+    FILE_FIND_EMIT_FIELD_DEV = (1 << 4),
+    FILE_FIND_EMIT_FIELD_NLINK = (1 << 5),
+    FILE_FIND_EMIT_FIELD_UID = (1 << 6),
+    FILE_FIND_EMIT_FIELD_GID = (1 << 7),
+    /* In 512-byte units. */
+    FILE_FIND_EMIT_FIELD_BLOCKS = (1 << 8),
+};
+
+#define FILE_FIND_EMIT_NUM_FIELDS 9
+
+/*
+ * The names of the fields, in the order of their bits, as they appear in
+ * the JSON objects.
+ * */
+extern const char * const file_find_emit_field_names[FILE_FIND_EMIT_NUM_FIELDS];
+
+/*
+ * Returns the value of a single FILE_FIND_EMIT_FIELD of stat_ret.
+ * */
+extern long long file_find_emit_get_field(
+    const struct stat * stat_ret,
+    unsigned int field
+);
+
+/*
+ * FILE_FIND_EMIT_COLUMNAR is a stream of little-endian integers:
+ *
+ * 1. A header of the 8 bytes "FFCOLS01", then a uint32 of the selected
+ * fields and a uint32 of 0.
+ *
+ * 2. Batches of records, each of them:
+ *   - uint32 num_records, uint32 paths_size.
+ *   - uint32 offsets[num_records + 1] into the paths, starting with 0 and
+ *     ending with paths_size.
+ *   - The paths, without separators, padded with NULs to a multiple of 8
+ *     bytes.
+ *   - uint8 types[num_records] (the characters of the JSON "type"), padded
+ *     with NULs to a multiple of 8 bytes.
+ *   - For every selected field, in the order of their bits:
+ *     int64 values[num_records].
+ *
+ * 3. An empty batch (num_records of 0 and paths_size of 0) marks the end.
+ *
+ * The columns of a batch are written with a single writev().
+ * */
+
+typedef struct
+{
+    int stub;
+} file_find_emitter_t;
+
+/*
+ * Writes to fd, which is not closed by the emitter. fields is ignored by
+ * the formats without stat() fields.
+ * */
+extern int file_find_emitter_new(
+    file_find_emitter_t * * output_handle,
+    int fd,
+    int format,
+    unsigned int fields
+);
+
+/*
+ * The items are buffered and written in large chunks. Returns
+ * FILE_FIND_COULD_NOT_WRITE on a write error, after which nothing more is
+ * written.
+ * */
+extern int file_find_emitter_add(
+    file_find_emitter_t * handle,
+    const file_find_item_t * item
+);
+
+extern int file_find_emitter_flush(file_find_emitter_t * handle);
+
+/*
+ * Writes what is still buffered and the end of the stream, and frees the
+ * emitter. Returns FILE_FIND_COULD_NOT_WRITE if any of the writes failed.
+ * */
+extern int file_find_emitter_free(file_find_emitter_t * handle);
+
+#endif /* #ifndef FILEFIND_FINDEMIT_H */
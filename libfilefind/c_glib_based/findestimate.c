@@ -0,0 +1,450 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findestimate.c
+ *
+ *    Description:  estimates the size of a tree by sampling its
+ *                  directories.
+ *
+ *        Created:  20/10/26 04:52:33
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <math.h>
+#include <string.h>
+
+#include "findestimate.h"
+
+/* Of the 95% confidence intervals. */
+#define ESTIMATE_Z 1.96
+
+enum
+{
+    ESTIMATE_ITEMS = 0,
+    ESTIMATE_FILES,
+    ESTIMATE_BYTES,
+    ESTIMATE_NUM_COUNTS,
+};
+
+typedef struct
+{
+    gdouble counts[ESTIMATE_NUM_COUNTS];
+} estimate_counts_type;
+
+/*
+ * The probes that started at one of the directories where the full
+ * listing stopped.
+ * */
+typedef struct
+{
+    guint num_probes;
+    estimate_counts_type sum;
+    estimate_counts_type sum_of_squares;
+} estimate_stratum_type;
+
+typedef struct
+{
+    guint64 num_opendir;
+    GRand * rand;
+} estimator_type;
+
+/*
+ * Adds the entries of the directory path to counts, weighed by weight,
+ * and the paths of its subdirectories to subdirs. The subdirectories are
+ * pruned, so it is a single listing.
+ * */
+static int estimate_list_dir(
+    estimator_type * const self,
+    const gchar * const path,
+    const gdouble weight,
+    estimate_counts_type * const counts,
+    GPtrArray * const subdirs
+)
+{
+    file_find_handle_t * tree;
+    gboolean is_top = TRUE;
+    int ret;
+
+    self->num_opendir++;
+
+    if ((ret = file_find_new(&tree, path)) != FILE_FIND_OK)
+    {
+        return ret;
+    }
+
+    /* The order does not matter. */
+    file_find_set_should_sort(tree, 0);
+
+    while ((ret = file_find_next(tree)) == FILE_FIND_OK)
+    {
+        const file_find_item_t * const item = file_find_get_item(tree);
+        const struct stat * const stat_ret = file_find_item_get_stat(item);
+
+        if (is_top)
+        {
+            is_top = FALSE;
+            continue;
+        }
+
+        counts->counts[ESTIMATE_ITEMS] += weight;
+
+        if (S_ISREG(stat_ret->st_mode))
+        {
+            counts->counts[ESTIMATE_FILES] += weight;
+            counts->counts[ESTIMATE_BYTES] += weight * stat_ret->st_size;
+        }
+        else if (S_ISDIR(stat_ret->st_mode))
+        {
+            gchar * const subdir = g_strdup(file_find_item_get_path(item));
+
+            if (! subdir)
+            {
+                ret = FILE_FIND_OUT_OF_MEMORY;
+                break;
+            }
+
+            g_ptr_array_add(subdirs, subdir);
+            file_find_prune(tree);
+        }
+    }
+
+    file_find_free(tree);
+
+    return ((ret == FILE_FIND_END) ? FILE_FIND_OK : ret);
+}
+
+static void estimate_free_paths(GPtrArray * const paths)
+{
+    for (guint i = 0 ; i < paths->len ; i++)
+    {
+        g_free(g_ptr_array_index(paths, i));
+    }
+
+    g_ptr_array_free(paths, TRUE);
+
+    return;
+}
+
+/*
+ * Sends a probe down from dir, and sets *counts to its estimate of the
+ * subtree below it.
+ * */
+static int estimate_probe(
+    estimator_type * const self,
+    const gchar * const dir,
+    estimate_counts_type * const counts
+)
+{
+    gchar * path = g_strdup(dir);
+    gdouble weight = 1;
+    int ret = FILE_FIND_OK;
+
+    memset(counts, '\0', sizeof(*counts));
+
+    while (path)
+    {
+        GPtrArray * const subdirs = g_ptr_array_new();
+
+        if (! subdirs)
+        {
+            ret = FILE_FIND_OUT_OF_MEMORY;
+            break;
+        }
+
+        ret = estimate_list_dir(self, path, weight, counts, subdirs);
+
+        g_free(path);
+        path = NULL;
+
+        if ((ret == FILE_FIND_OK) && subdirs->len)
+        {
+            const guint idx = g_rand_int_range(self->rand, 0, subdirs->len);
+
+            path = g_ptr_array_index(subdirs, idx);
+            g_ptr_array_index(subdirs, idx) = NULL;
+            weight *= subdirs->len;
+        }
+
+        estimate_free_paths(subdirs);
+    }
+
+    if (path)
+    {
+        g_free(path);
+    }
+
+    return ret;
+}
+
+static void estimate_set_value(
+    file_find_estimate_value_t * const value,
+    const gdouble counted,
+    const gdouble estimate,
+    const gdouble variance
+)
+{
+    const gdouble margin = ESTIMATE_Z * sqrt(variance);
+
+    value->value = estimate;
+    value->low = MAX(counted, estimate - margin);
+    value->high = estimate + margin;
+
+    return;
+}
+
+/*
+ * The directories where the full listing stopped are sampled in a random
+ * order, and the probes of each of them estimate its subtree. If all of
+ * them were probed at least twice, the variances of the probes of each
+ * one are summed. Otherwise, the total is extrapolated from the ones that
+ * were probed, and its variance is that of their means.
+ * */
+static void estimate_combine(
+    file_find_estimate_t * const result,
+    const estimate_counts_type * const counted,
+    const estimate_stratum_type * const strata,
+    const guint num_strata
+)
+{
+    file_find_estimate_value_t * const values[ESTIMATE_NUM_COUNTS] =
+    {
+        &(result->num_items),
+        &(result->num_files),
+        &(result->num_bytes),
+    };
+    guint num_sampled = 0;
+    guint min_num_probes = G_MAXUINT;
+
+    for (guint i = 0 ; i < num_strata ; i++)
+    {
+        if (strata[i].num_probes)
+        {
+            num_sampled++;
+        }
+
+        min_num_probes = MIN(min_num_probes, strata[i].num_probes);
+    }
+
+    for (int c = 0 ; c < ESTIMATE_NUM_COUNTS ; c++)
+    {
+        gdouble sum_of_means = 0;
+        gdouble sum_of_squared_means = 0;
+        gdouble stratified_variance = 0;
+
+        for (guint i = 0 ; i < num_strata ; i++)
+        {
+            const guint n = strata[i].num_probes;
+
+            if (! n)
+            {
+                continue;
+            }
+
+            const gdouble mean = strata[i].sum.counts[c] / n;
+
+            sum_of_means += mean;
+            sum_of_squared_means += mean * mean;
+
+            if (n >= 2)
+            {
+                const gdouble variance =
+                    (strata[i].sum_of_squares.counts[c] - n * mean * mean)
+                    / (n - 1);
+
+                stratified_variance += MAX(variance, 0) / n;
+            }
+        }
+
+        const gdouble base = counted->counts[c];
+
+        if (! num_strata)
+        {
+            estimate_set_value(values[c], base, base, 0);
+        }
+        else if (! num_sampled)
+        {
+            estimate_set_value(values[c], base, base, INFINITY);
+        }
+        else if (min_num_probes >= 2)
+        {
+            estimate_set_value(
+                values[c], base, base + sum_of_means, stratified_variance
+            );
+        }
+        else
+        {
+            const gdouble scale = ((gdouble)num_strata) / num_sampled;
+            const gdouble mean_of_means = sum_of_means / num_sampled;
+            const gdouble variance_of_means = ((num_sampled >= 2)
+                ? (MAX(sum_of_squared_means
+                        - num_sampled * mean_of_means * mean_of_means, 0)
+                    / (num_sampled - 1))
+                : INFINITY
+            );
+
+            estimate_set_value(
+                values[c],
+                base,
+                base + scale * sum_of_means,
+                ((gdouble)num_strata) * num_strata * variance_of_means
+                    / num_sampled
+            );
+        }
+    }
+
+    return;
+}
+
+int file_find_estimate(
+    const char * target,
+    unsigned long long max_opendir,
+    unsigned int seed,
+    file_find_estimate_t * result
+)
+{
+    estimator_type self;
+    estimate_counts_type counted;
+    GPtrArray * level = g_ptr_array_new();
+    estimate_stratum_type * strata = NULL;
+    guint * order = NULL;
+    int ret = FILE_FIND_OUT_OF_MEMORY;
+
+    memset(result, '\0', sizeof(*result));
+    memset(&counted, '\0', sizeof(counted));
+
+    self.num_opendir = 0;
+
+    if (! (self.rand = g_rand_new_with_seed(seed)))
+    {
+        goto cleanup;
+    }
+
+    if (! level)
+    {
+        goto cleanup;
+    }
+
+    {
+        gchar * const target_copy = g_strdup(target);
+
+        if (! target_copy)
+        {
+            goto cleanup;
+        }
+
+        g_ptr_array_add(level, target_copy);
+    }
+
+    /* List the levels near the target in full. */
+    while (level->len
+        && ((! result->exact_depth)
+            || (self.num_opendir + level->len <= max_opendir / 4)))
+    {
+        GPtrArray * const next_level = g_ptr_array_new();
+
+        if (! next_level)
+        {
+            goto cleanup;
+        }
+
+        for (guint i = 0 ; i < level->len ; i++)
+        {
+            if ((ret = estimate_list_dir(
+                            &self,
+                            g_ptr_array_index(level, i),
+                            1,
+                            &counted,
+                            next_level
+                        )) != FILE_FIND_OK)
+            {
+                estimate_free_paths(next_level);
+                goto cleanup;
+            }
+        }
+
+        estimate_free_paths(level);
+        level = next_level;
+        result->exact_depth++;
+    }
+
+    const guint num_strata = level->len;
+
+    ret = FILE_FIND_OUT_OF_MEMORY;
+
+    if (num_strata
+        && (! ((strata = g_new0(estimate_stratum_type, num_strata))
+            && (order = g_new(guint, num_strata)))))
+    {
+        goto cleanup;
+    }
+
+    /* A random permutation, by Fisher-Yates. */
+    for (guint i = 0 ; i < num_strata ; i++)
+    {
+        const guint j = g_rand_int_range(self.rand, 0, i + 1);
+
+        order[i] = i;
+
+        const guint temp = order[i];
+
+        order[i] = order[j];
+        order[j] = temp;
+    }
+
+    for (guint64 probe_idx = 0 ;
+        num_strata && (self.num_opendir < max_opendir) ;
+        probe_idx++)
+    {
+        const guint stratum_idx = order[probe_idx % num_strata];
+        estimate_stratum_type * const stratum = &(strata[stratum_idx]);
+        estimate_counts_type counts;
+
+        if ((ret = estimate_probe(
+                        &self, g_ptr_array_index(level, stratum_idx), &counts
+                    )) != FILE_FIND_OK)
+        {
+            goto cleanup;
+        }
+
+        stratum->num_probes++;
+
+        for (int c = 0 ; c < ESTIMATE_NUM_COUNTS ; c++)
+        {
+            stratum->sum.counts[c] += counts.counts[c];
+            stratum->sum_of_squares.counts[c] +=
+                counts.counts[c] * counts.counts[c];
+        }
+
+        result->num_probes++;
+    }
+
+    result->is_exact = (! num_strata);
+    result->num_opendir = self.num_opendir;
+
+    estimate_combine(result, &counted, strata, num_strata);
+
+    ret = FILE_FIND_OK;
+
+cleanup:
+
+    if (level)
+    {
+        estimate_free_paths(level);
+    }
+
+    g_free(strata);
+    g_free(order);
+
+    if (self.rand)
+    {
+        g_rand_free(self.rand);
+    }
+
+    return ret;
+}
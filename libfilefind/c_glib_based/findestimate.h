@@ -0,0 +1,77 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findestimate.h
+ *
+ *    Description:  estimates the size of a tree by sampling its
+ *                  directories.
+ *
+ *        Created:  20/10/26 04:52:33
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_FINDESTIMATE_H
+#define FILEFIND_FINDESTIMATE_H
+
+#include "filefind.h"
+
+/*
+ * The estimator lists the directories near the target in full, for as
+ * long as the next level takes at most a quarter of the budget of
+ * directory listings. Below them it sends random probes, Knuth-style:
+ * a probe lists a directory, goes down into one of its subdirectories at
+ * random, and weighs what it finds there by the product of the numbers of
+ * subdirectories it chose from. The probes go round-robin over the
+ * directories where the full listing stopped, in a random order, until
+ * the budget is spent.
+ *
+ * The estimates of the probes are unbiased, but they vary a lot when
+ * large subtrees are rare, so the intervals are only as good as the
+ * normal approximation of their means.
+ * */
+
+typedef struct
+{
+    double value;
+    /*
+     * A 95% confidence interval. low is at least what was counted, and
+     * high is infinite if there were too few probes to tell.
+     * */
+    double low;
+    double high;
+} file_find_estimate_value_t;
+
+typedef struct
+{
+    /* All the entries below the target. */
+    file_find_estimate_value_t num_items;
+    file_find_estimate_value_t num_files;
+    /* Of the regular files. */
+    file_find_estimate_value_t num_bytes;
+    /* The number of levels that were listed in full. */
+    int exact_depth;
+    /* Whether the whole tree was listed, so the values are exact. */
+    int is_exact;
+    unsigned long long num_opendir;
+    unsigned long long num_probes;
+} file_find_estimate_t;
+
+/*
+ * Estimates the tree under target with about max_opendir directory
+ * listings: the last probe is completed even if it goes over the budget.
+ * Links are not followed. The same seed gives the same estimate of the
+ * same tree.
+ * */
+extern int file_find_estimate(
+    const char * target,
+    unsigned long long max_opendir,
+    unsigned int seed,
+    file_find_estimate_t * result
+);
+
+#endif /* #ifndef FILEFIND_FINDESTIMATE_H */
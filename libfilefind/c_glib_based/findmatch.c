@@ -0,0 +1,1012 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findmatch.c
+ *
+ *    Description:  matches names against many globs at once.
+ *
+ *        Created:  20/10/26 08:14:52
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "inline.h"
+
+#include "findmatch.h"
+
+#define MATCH_STATE_NONE G_MAXUINT32
+
+/*
+ * The NFA is that of Thompson: a SET state reads a byte that is in its set
+ * and goes to out, and a SPLIT state goes to out and to out2 without
+ * reading anything, either of which may be MATCH_STATE_NONE.
+ * */
+enum
+{
+    MATCH_NFA_SET,
+    MATCH_NFA_SPLIT,
+    MATCH_NFA_ACCEPT,
+};
+
+typedef struct
+{
+    guint32 type;
+    guint32 out;
+    guint32 out2;
+    /* Of a SET state, in byte_sets. */
+    guint32 set;
+} match_nfa_state_type;
+
+typedef struct
+{
+    guint32 bits[256 / 32];
+} match_byte_set_type;
+
+/*
+ * A piece of the NFA, whose end is a SPLIT state whose out2 is to be
+ * pointed at what follows it.
+ * */
+typedef struct
+{
+    guint32 start;
+    guint32 end;
+} match_fragment_type;
+
+/*
+ * A state of the DFA is the set of SET states of the NFA that it is in,
+ * sorted, and whether the NFA can accept there.
+ * */
+typedef struct
+{
+    guint32 accepts;
+    guint32 len;
+    guint32 items[];
+} match_dfa_key_type;
+
+/*
+ * The states of the NFA that can be reached from some of them without
+ * reading a byte.
+ * */
+typedef struct
+{
+    /* A state was reached if its mark is generation. */
+    guint32 * marks;
+    guint32 generation;
+    GArray * stack;
+    /* The SET states, sorted. */
+    GArray * items;
+    gboolean accepts;
+} match_closure_type;
+
+typedef struct
+{
+    GHashTable * literals;
+    GHashTable * suffixes;
+    /* The distinct lengths of the suffixes, in increasing order. */
+    GArray * suffix_lengths;
+    GArray * nfa;
+    GArray * byte_sets;
+    /* The sets of single bytes, by byte, and that of all but '/'. */
+    guint32 byte_set_of[256];
+    guint32 any_byte_set;
+    guint32 accept_state;
+    /*
+     * The SPLIT states that lead to the globs that do not start with a '.'
+     * [0], and to those that do [1], and the last SPLITs of their chains.
+     * */
+    guint32 nfa_starts[2];
+    guint32 nfa_chain_ends[2];
+    guint32 num_nfa_globs;
+    gboolean is_compiled;
+    /* The DFA, if there is one: 0 is its dead state. */
+    guint8 byte_classes[256];
+    guint32 num_classes;
+    guint32 num_dfa_states;
+    guint32 * dfa;
+    guint8 * dfa_accepts;
+    guint32 dfa_starts[2];
+} match_type;
+
+static GCC_INLINE gboolean match_byte_set_has(
+    const match_byte_set_type * const set,
+    const guint8 byte
+)
+{
+    return ((set->bits[byte >> 5] >> (byte & 31)) & 1);
+}
+
+static GCC_INLINE void match_byte_set_add(
+    match_byte_set_type * const set,
+    const guint8 byte
+)
+{
+    set->bits[byte >> 5] |= (1U << (byte & 31));
+}
+
+static GCC_INLINE match_nfa_state_type * match_get_state(
+    match_type * const self,
+    const guint32 idx
+)
+{
+    return &g_array_index(self->nfa, match_nfa_state_type, idx);
+}
+
+static guint32 match_add_state(
+    match_type * const self,
+    const guint32 type,
+    const guint32 out,
+    const guint32 set
+)
+{
+    match_nfa_state_type state;
+
+    state.type = type;
+    state.out = out;
+    state.out2 = MATCH_STATE_NONE;
+    state.set = set;
+
+    g_array_append_val(self->nfa, state);
+
+    return self->nfa->len - 1;
+}
+
+static guint32 match_add_byte_set(
+    match_type * const self,
+    const match_byte_set_type * const set
+)
+{
+    g_array_append_val(self->byte_sets, *set);
+
+    return self->byte_sets->len - 1;
+}
+
+/*
+ * A fragment that reads one byte of set.
+ * */
+static match_fragment_type match_add_set_fragment(
+    match_type * const self,
+    const guint32 set
+)
+{
+    match_fragment_type fragment;
+
+    fragment.end =
+        match_add_state(self, MATCH_NFA_SPLIT, MATCH_STATE_NONE, 0);
+    fragment.start = match_add_state(self, MATCH_NFA_SET, fragment.end, set);
+
+    return fragment;
+}
+
+static match_fragment_type match_add_byte_fragment(
+    match_type * const self,
+    const guint8 byte
+)
+{
+    if (self->byte_set_of[byte] == MATCH_STATE_NONE)
+    {
+        match_byte_set_type set;
+
+        memset(&set, '\0', sizeof(set));
+        match_byte_set_add(&set, byte);
+
+        self->byte_set_of[byte] = match_add_byte_set(self, &set);
+    }
+
+    return match_add_set_fragment(self, self->byte_set_of[byte]);
+}
+
+/*
+ * Makes *chain_end lead to target as well, through a new SPLIT state if
+ * it already leads somewhere.
+ * */
+static void match_add_branch(
+    match_type * const self,
+    guint32 * const chain_end,
+    const guint32 target
+)
+{
+    match_nfa_state_type * const end = match_get_state(self, *chain_end);
+
+    if (end->out == MATCH_STATE_NONE)
+    {
+        end->out = target;
+    }
+    else
+    {
+        const guint32 split =
+            match_add_state(self, MATCH_NFA_SPLIT, target, 0);
+
+        match_get_state(self, *chain_end)->out2 = split;
+        *chain_end = split;
+    }
+}
+
+/*
+ * Parses the "[...]" at *glob, which is past the "[", into set. Returns
+ * FALSE if it is not closed.
+ * */
+static gboolean match_parse_class(
+    const gchar * * const glob,
+    match_byte_set_type * const set
+)
+{
+    const gchar * s = *glob;
+    gboolean is_first = TRUE;
+
+    memset(set, '\0', sizeof(*set));
+
+    while (is_first || (*s != ']'))
+    {
+        if (! *s)
+        {
+            return FALSE;
+        }
+
+        if ((*s == '\\') && s[1])
+        {
+            s++;
+        }
+
+        const guint8 low = (guint8)*(s++);
+        guint8 high = low;
+
+        if ((*s == '-') && s[1] && (s[1] != ']'))
+        {
+            s++;
+            if ((*s == '\\') && s[1])
+            {
+                s++;
+            }
+            high = (guint8)*(s++);
+        }
+
+        for (guint c = low ; c <= high ; c++)
+        {
+            match_byte_set_add(set, (guint8)c);
+        }
+
+        is_first = FALSE;
+    }
+
+    *glob = s + 1;
+
+    return TRUE;
+}
+
+/*
+ * Parses the glob at *glob into *ret, up to its end, or, inside depth
+ * braces, up to the next "," or "}" at this depth. Returns FALSE if it is
+ * malformed.
+ * */
+static gboolean match_parse_sequence(
+    match_type * const self,
+    const gchar * * const glob,
+    const int depth,
+    match_fragment_type * const ret
+)
+{
+    ret->start = ret->end =
+        match_add_state(self, MATCH_NFA_SPLIT, MATCH_STATE_NONE, 0);
+
+    while (**glob)
+    {
+        const gchar c = **glob;
+        match_fragment_type piece;
+
+        if (depth && ((c == ',') || (c == '}')))
+        {
+            break;
+        }
+
+        (*glob)++;
+
+        if (c == '*')
+        {
+            const guint32 split =
+                match_add_state(self, MATCH_NFA_SPLIT, MATCH_STATE_NONE, 0);
+
+            const guint32 any =
+                match_add_state(self, MATCH_NFA_SET, split, self->any_byte_set);
+
+            match_get_state(self, split)->out = any;
+
+            piece.start = piece.end = split;
+        }
+        else if (c == '?')
+        {
+            piece = match_add_set_fragment(self, self->any_byte_set);
+        }
+        else if (c == '[')
+        {
+            match_byte_set_type set;
+
+            if (! match_parse_class(glob, &set))
+            {
+                return FALSE;
+            }
+
+            piece = match_add_set_fragment(self, match_add_byte_set(self, &set));
+        }
+        else if (c == '{')
+        {
+            guint32 chain_end;
+
+            piece.start = chain_end =
+                match_add_state(self, MATCH_NFA_SPLIT, MATCH_STATE_NONE, 0);
+            piece.end =
+                match_add_state(self, MATCH_NFA_SPLIT, MATCH_STATE_NONE, 0);
+
+            while (TRUE)
+            {
+                match_fragment_type alternative;
+
+                if (! match_parse_sequence(self, glob, depth + 1, &alternative))
+                {
+                    return FALSE;
+                }
+
+                match_add_branch(self, &chain_end, alternative.start);
+                match_get_state(self, alternative.end)->out2 = piece.end;
+
+                if (! **glob)
+                {
+                    return FALSE;
+                }
+
+                if (*((*glob)++) == '}')
+                {
+                    break;
+                }
+            }
+        }
+        else if ((c == '\\') && **glob)
+        {
+            piece = match_add_byte_fragment(self, (guint8)*((*glob)++));
+        }
+        else
+        {
+            piece = match_add_byte_fragment(self, (guint8)c);
+        }
+
+        match_get_state(self, ret->end)->out2 = piece.start;
+        ret->end = piece.end;
+    }
+
+    return TRUE;
+}
+
+int file_find_matcher_new(file_find_matcher_t * * output_handle)
+{
+    match_type * self;
+
+    *output_handle = NULL;
+
+    if (! (self = g_new0(match_type, 1)))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    if (! ((self->literals = g_hash_table_new_full(
+                g_str_hash, g_str_equal, g_free, NULL))
+        && (self->suffixes = g_hash_table_new_full(
+                g_str_hash, g_str_equal, g_free, NULL))
+        && (self->suffix_lengths = g_array_new(FALSE, FALSE, sizeof(guint32)))
+        && (self->nfa =
+            g_array_new(FALSE, FALSE, sizeof(match_nfa_state_type)))
+        && (self->byte_sets =
+            g_array_new(FALSE, FALSE, sizeof(match_byte_set_type)))))
+    {
+        file_find_matcher_free((file_find_matcher_t *)self);
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    for (int i = 0 ; i < 256 ; i++)
+    {
+        self->byte_set_of[i] = MATCH_STATE_NONE;
+    }
+
+    {
+        match_byte_set_type any;
+
+        memset(&any, 0xFF, sizeof(any));
+        any.bits['/' >> 5] &= ~(1U << ('/' & 31));
+
+        self->any_byte_set = match_add_byte_set(self, &any);
+    }
+
+    self->accept_state =
+        match_add_state(self, MATCH_NFA_ACCEPT, MATCH_STATE_NONE, 0);
+
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        self->nfa_starts[i] = self->nfa_chain_ends[i] =
+            match_add_state(self, MATCH_NFA_SPLIT, MATCH_STATE_NONE, 0);
+    }
+
+    *output_handle = (file_find_matcher_t *)self;
+
+    return FILE_FIND_OK;
+}
+
+static int match_uint32_cmp(gconstpointer a_void, gconstpointer b_void)
+{
+    const guint32 a = *(const guint32 *)a_void;
+    const guint32 b = *(const guint32 *)b_void;
+
+    return ((a < b) ? (-1) : (a > b) ? 1 : 0);
+}
+
+int file_find_matcher_add_glob(
+    file_find_matcher_t * handle,
+    const char * glob
+)
+{
+    match_type * const self = (match_type *)handle;
+
+    if (self->is_compiled)
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    if (! strpbrk(glob, "*?[{\\"))
+    {
+        g_hash_table_replace(self->literals, g_strdup(glob), NULL);
+
+        return FILE_FIND_OK;
+    }
+
+    if ((glob[0] == '*') && (! strpbrk(glob + 1, "*?[{\\")))
+    {
+        const guint32 len = strlen(glob + 1);
+
+        if (! g_hash_table_contains(self->suffixes, glob + 1))
+        {
+            g_hash_table_replace(self->suffixes, g_strdup(glob + 1), NULL);
+        }
+
+        guint32 i = 0;
+
+        while ((i < self->suffix_lengths->len)
+            && (g_array_index(self->suffix_lengths, guint32, i) < len))
+        {
+            i++;
+        }
+
+        if ((i == self->suffix_lengths->len)
+            || (g_array_index(self->suffix_lengths, guint32, i) != len))
+        {
+            g_array_append_val(self->suffix_lengths, len);
+            g_array_sort(self->suffix_lengths, match_uint32_cmp);
+        }
+
+        return FILE_FIND_OK;
+    }
+
+    /* A malformed glob leaves the NFA as it was. */
+    const guint32 num_states = self->nfa->len;
+    const guint32 num_byte_sets = self->byte_sets->len;
+    const gchar * s = glob;
+    match_fragment_type fragment;
+
+    if (! match_parse_sequence(self, &s, 0, &fragment))
+    {
+        g_array_set_size(self->nfa, num_states);
+        g_array_set_size(self->byte_sets, num_byte_sets);
+
+        for (int i = 0 ; i < 256 ; i++)
+        {
+            if ((self->byte_set_of[i] != MATCH_STATE_NONE)
+                && (self->byte_set_of[i] >= num_byte_sets))
+            {
+                self->byte_set_of[i] = MATCH_STATE_NONE;
+            }
+        }
+
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    match_get_state(self, fragment.end)->out2 = self->accept_state;
+    match_add_branch(
+        self, &(self->nfa_chain_ends[glob[0] == '.']), fragment.start
+    );
+    self->num_nfa_globs++;
+
+    return FILE_FIND_OK;
+}
+
+static gboolean match_closure_init(
+    match_closure_type * const closure,
+    const guint32 num_states
+)
+{
+    closure->generation = 0;
+    closure->marks = g_new0(guint32, num_states);
+    closure->stack = g_array_new(FALSE, FALSE, sizeof(guint32));
+    closure->items = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+    return (closure->marks && closure->stack && closure->items);
+}
+
+static void match_closure_free(match_closure_type * const closure)
+{
+    g_free(closure->marks);
+    closure->marks = NULL;
+
+    if (closure->stack)
+    {
+        g_array_free(closure->stack, TRUE);
+        closure->stack = NULL;
+    }
+
+    if (closure->items)
+    {
+        g_array_free(closure->items, TRUE);
+        closure->items = NULL;
+    }
+}
+
+/*
+ * Starts a closure, to which the states are added by
+ * match_closure_add().
+ * */
+static void match_closure_start(match_closure_type * const closure)
+{
+    closure->generation++;
+    g_array_set_size(closure->items, 0);
+    closure->accepts = FALSE;
+}
+
+static void match_closure_add(
+    match_type * const self,
+    match_closure_type * const closure,
+    const guint32 first
+)
+{
+    g_array_set_size(closure->stack, 0);
+    g_array_append_val(closure->stack, first);
+
+    while (closure->stack->len)
+    {
+        const guint32 idx =
+            g_array_index(closure->stack, guint32, closure->stack->len - 1);
+
+        g_array_set_size(closure->stack, closure->stack->len - 1);
+
+        if ((idx == MATCH_STATE_NONE)
+            || (closure->marks[idx] == closure->generation))
+        {
+            continue;
+        }
+
+        closure->marks[idx] = closure->generation;
+
+        const match_nfa_state_type * const state = match_get_state(self, idx);
+
+        if (state->type == MATCH_NFA_SET)
+        {
+            g_array_append_val(closure->items, idx);
+        }
+        else if (state->type == MATCH_NFA_ACCEPT)
+        {
+            closure->accepts = TRUE;
+        }
+        else
+        {
+            g_array_append_val(closure->stack, state->out2);
+            g_array_append_val(closure->stack, state->out);
+        }
+    }
+}
+
+/*
+ * Moves the closure past byte: from the states of from, which may not be
+ * its own items.
+ * */
+static void match_closure_step(
+    match_type * const self,
+    match_closure_type * const closure,
+    const guint32 * const from,
+    const guint32 num_from,
+    const guint8 byte
+)
+{
+    match_closure_start(closure);
+
+    for (guint32 i = 0 ; i < num_from ; i++)
+    {
+        const match_nfa_state_type * const state =
+            match_get_state(self, from[i]);
+
+        if (match_byte_set_has(
+                &g_array_index(self->byte_sets, match_byte_set_type, state->set),
+                byte))
+        {
+            match_closure_add(self, closure, state->out);
+        }
+    }
+}
+
+/*
+ * Runs the NFA over name, for when there is no DFA.
+ * */
+static gboolean match_run_nfa(match_type * const self, const gchar * name)
+{
+    match_closure_type closure;
+    GArray * from = g_array_new(FALSE, FALSE, sizeof(guint32));
+    gboolean ret = FALSE;
+
+    if (! (match_closure_init(&closure, self->nfa->len) && from))
+    {
+        goto cleanup;
+    }
+
+    match_closure_start(&closure);
+    match_closure_add(self, &closure, self->nfa_starts[name[0] == '.']);
+
+    for ( ; *name && closure.items->len ; name++)
+    {
+        g_array_set_size(from, 0);
+        g_array_append_vals(from, closure.items->data, closure.items->len);
+
+        match_closure_step(
+            self, &closure,
+            (const guint32 *)(void *)from->data, from->len, (guint8)*name
+        );
+    }
+
+    ret = ((! *name) && closure.accepts);
+
+cleanup:
+    match_closure_free(&closure);
+
+    if (from)
+    {
+        g_array_free(from, TRUE);
+    }
+
+    return ret;
+}
+
+static guint match_dfa_key_hash(gconstpointer key_void)
+{
+    const match_dfa_key_type * const key = key_void;
+    guint32 h = 2166136261U ^ key->accepts;
+
+    for (guint32 i = 0 ; i < key->len ; i++)
+    {
+        h = (h ^ key->items[i]) * 16777619U;
+    }
+
+    return h;
+}
+
+static gboolean match_dfa_key_equal(gconstpointer a_void, gconstpointer b_void)
+{
+    const match_dfa_key_type * const a = a_void;
+    const match_dfa_key_type * const b = b_void;
+
+    return ((a->accepts == b->accepts) && (a->len == b->len)
+        && (! memcmp(a->items, b->items, a->len * sizeof(a->items[0]))));
+}
+
+/*
+ * Returns the state of the DFA for the closure, which is added to keys
+ * and accepts if it is new.
+ * */
+static guint32 match_dfa_get_state(
+    GHashTable * const states,
+    GPtrArray * const keys,
+    GArray * const accepts,
+    match_closure_type * const closure
+)
+{
+    match_dfa_key_type * const key = g_malloc(
+        sizeof(*key) + closure->items->len * sizeof(key->items[0])
+    );
+    gpointer value;
+
+    g_array_sort(closure->items, match_uint32_cmp);
+
+    key->accepts = closure->accepts;
+    key->len = closure->items->len;
+    memcpy(key->items, closure->items->data, key->len * sizeof(key->items[0]));
+
+    if (g_hash_table_lookup_extended(states, key, NULL, &value))
+    {
+        g_free(key);
+        return GPOINTER_TO_UINT(value);
+    }
+
+    const guint32 idx = keys->len;
+    const guint8 accepts_byte = (guint8)key->accepts;
+
+    g_ptr_array_add(keys, key);
+    g_hash_table_insert(states, key, GUINT_TO_POINTER(idx));
+    g_array_append_val(accepts, accepts_byte);
+
+    return idx;
+}
+
+/*
+ * The bytes that every SET state treats alike share a class, so the DFA
+ * has a column per class rather than per byte.
+ * */
+static void match_calc_byte_classes(
+    match_type * const self,
+    guint8 * const representatives
+)
+{
+    guint32 remap[256 * 2];
+
+    memset(self->byte_classes, '\0', sizeof(self->byte_classes));
+    self->num_classes = 1;
+
+    for (guint32 s = 0 ; s < self->byte_sets->len ; s++)
+    {
+        const match_byte_set_type * const set =
+            &g_array_index(self->byte_sets, match_byte_set_type, s);
+        guint32 num_classes = 0;
+
+        for (guint32 i = 0 ; i < self->num_classes * 2 ; i++)
+        {
+            remap[i] = MATCH_STATE_NONE;
+        }
+
+        for (int b = 0 ; b < 256 ; b++)
+        {
+            const guint32 k =
+                self->byte_classes[b] * 2 + match_byte_set_has(set, (guint8)b);
+
+            if (remap[k] == MATCH_STATE_NONE)
+            {
+                remap[k] = num_classes++;
+            }
+
+            self->byte_classes[b] = (guint8)remap[k];
+        }
+
+        self->num_classes = num_classes;
+    }
+
+    for (int b = 255 ; b >= 0 ; b--)
+    {
+        representatives[self->byte_classes[b]] = (guint8)b;
+    }
+}
+
+/*
+ * The subset construction, over the states in the order that they are
+ * found. Returns FALSE if the DFA would be too large.
+ * */
+static gboolean match_build_dfa(match_type * const self)
+{
+    guint8 representatives[256];
+    match_closure_type closure;
+    GHashTable * const states = g_hash_table_new(
+        match_dfa_key_hash, match_dfa_key_equal
+    );
+    GPtrArray * const keys = g_ptr_array_new_with_free_func(g_free);
+    GArray * const accepts = g_array_new(FALSE, FALSE, sizeof(guint8));
+    GArray * const rows = g_array_new(FALSE, TRUE, sizeof(guint32));
+    gboolean ret = FALSE;
+
+    if (! (match_closure_init(&closure, self->nfa->len)
+        && states && keys && accepts && rows))
+    {
+        goto cleanup;
+    }
+
+    match_calc_byte_classes(self, representatives);
+
+    /* The dead state. */
+    match_closure_start(&closure);
+    match_dfa_get_state(states, keys, accepts, &closure);
+
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        match_closure_start(&closure);
+        match_closure_add(self, &closure, self->nfa_starts[i]);
+
+        self->dfa_starts[i] =
+            match_dfa_get_state(states, keys, accepts, &closure);
+    }
+
+    g_array_set_size(rows, self->num_classes);
+
+    for (guint32 idx = 1 ; idx < keys->len ; idx++)
+    {
+        const match_dfa_key_type * const key = g_ptr_array_index(keys, idx);
+
+        g_array_set_size(rows, (idx + 1) * self->num_classes);
+
+        for (guint32 c = 0 ; c < self->num_classes ; c++)
+        {
+            match_closure_step(
+                self, &closure, key->items, key->len, representatives[c]
+            );
+
+            const guint32 target =
+                match_dfa_get_state(states, keys, accepts, &closure);
+
+            if (keys->len > FILE_FIND_MATCHER_MAX_DFA_STATES + 1)
+            {
+                goto cleanup;
+            }
+
+            g_array_index(rows, guint32, idx * self->num_classes + c) = target;
+        }
+    }
+
+    self->num_dfa_states = keys->len;
+    self->dfa = (guint32 *)(void *)g_array_free(rows, FALSE);
+    self->dfa_accepts = (guint8 *)g_array_free(accepts, FALSE);
+    ret = TRUE;
+
+cleanup:
+    match_closure_free(&closure);
+
+    if (! ret)
+    {
+        if (rows)
+        {
+            g_array_free(rows, TRUE);
+        }
+
+        if (accepts)
+        {
+            g_array_free(accepts, TRUE);
+        }
+    }
+
+    if (states)
+    {
+        g_hash_table_destroy(states);
+    }
+
+    if (keys)
+    {
+        g_ptr_array_free(keys, TRUE);
+    }
+
+    return ret;
+}
+
+int file_find_matcher_compile(file_find_matcher_t * handle)
+{
+    match_type * const self = (match_type *)handle;
+
+    if (self->is_compiled)
+    {
+        return FILE_FIND_OK;
+    }
+
+    self->is_compiled = TRUE;
+
+    /* Without it, the NFA is run. */
+    if (self->num_nfa_globs)
+    {
+        match_build_dfa(self);
+    }
+
+    return FILE_FIND_OK;
+}
+
+int file_find_matcher_match(
+    file_find_matcher_t * handle,
+    const char * name
+)
+{
+    match_type * const self = (match_type *)handle;
+
+    if (g_hash_table_size(self->literals)
+        && g_hash_table_contains(self->literals, name))
+    {
+        return TRUE;
+    }
+
+    const gboolean is_dot_name = (name[0] == '.');
+
+    if (self->suffix_lengths->len && (! is_dot_name))
+    {
+        const gsize len = strlen(name);
+
+        for (guint32 i = 0 ; i < self->suffix_lengths->len ; i++)
+        {
+            const guint32 suffix_len =
+                g_array_index(self->suffix_lengths, guint32, i);
+
+            if (suffix_len > len)
+            {
+                break;
+            }
+
+            if (g_hash_table_contains(self->suffixes, name + len - suffix_len))
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    if (! self->num_nfa_globs)
+    {
+        return FALSE;
+    }
+
+    if (! self->dfa)
+    {
+        return match_run_nfa(self, name);
+    }
+
+    const guint32 * const dfa = self->dfa;
+    const guint8 * const byte_classes = self->byte_classes;
+    const guint32 num_classes = self->num_classes;
+    guint32 state = self->dfa_starts[is_dot_name];
+
+    for (const guint8 * s = (const guint8 *)name ; *s && state ; s++)
+    {
+        state = dfa[state * num_classes + byte_classes[*s]];
+    }
+
+    return self->dfa_accepts[state];
+}
+
+unsigned int file_find_matcher_get_num_dfa_states(
+    file_find_matcher_t * handle
+)
+{
+    match_type * const self = (match_type *)handle;
+
+    return (self->dfa ? (self->num_dfa_states - 1) : 0);
+}
+
+void file_find_matcher_free(file_find_matcher_t * handle)
+{
+    match_type * const self = (match_type *)handle;
+
+    if (self->literals)
+    {
+        g_hash_table_destroy(self->literals);
+        self->literals = NULL;
+    }
+
+    if (self->suffixes)
+    {
+        g_hash_table_destroy(self->suffixes);
+        self->suffixes = NULL;
+    }
+
+    if (self->suffix_lengths)
+    {
+        g_array_free(self->suffix_lengths, TRUE);
+        self->suffix_lengths = NULL;
+    }
+
+    if (self->nfa)
+    {
+        g_array_free(self->nfa, TRUE);
+        self->nfa = NULL;
+    }
+
+    if (self->byte_sets)
+    {
+        g_array_free(self->byte_sets, TRUE);
+        self->byte_sets = NULL;
+    }
+
+    g_free(self->dfa);
+    self->dfa = NULL;
+
+    g_free(self->dfa_accepts);
+    self->dfa_accepts = NULL;
+
+    g_free(self);
+
+    return;
+}
@@ -0,0 +1,94 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findmatch.h
+ *
+ *    Description:  matches names against many globs at once.
+ *
+ *        Created:  20/10/26 08:14:52
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_FINDMATCH_H
+#define FILEFIND_FINDMATCH_H
+
+#include "filefind.h"
+
+/*
+ * A set of globs, which a name matches if it matches any of them. The
+ * globs are split by their shape when the matcher is compiled:
+ *
+ * 1. Globs without wildcards go into a hash table of the names themselves.
+ *
+ * 2. Globs of a "*" followed by a string without wildcards, such as "*.c",
+ * go into a hash table of their suffixes, which is looked up once for every
+ * distinct length of suffix.
+ *
+ * 3. The other globs are compiled together into one DFA, which reads each
+ * byte of the name once, however many globs there are. If it would have
+ * more than FILE_FIND_MATCHER_MAX_DFA_STATES states, the NFA that it was
+ * built from is run instead.
+ *
+ * The syntax is that of Text::Glob, as used by File::Find::Object::Rule:
+ *
+ * - "*" matches any string, and "?" any single character, except for "/".
+ * - "[...]" matches one of the characters in it, which may have ranges
+ *   such as "a-z". A "]" right after the "[" is one of them. There is no
+ *   negation: "!" and "^" are characters like the others.
+ * - "{a,b,...}" matches any of the comma-separated globs in it, which may
+ *   have braces of their own. Outside braces, "," and "}" are themselves.
+ * - "\" makes the next character match itself.
+ *
+ * Like in Text::Glob, a name that starts with "." only matches the globs
+ * that start with a ".". The names are matched as bytes.
+ * */
+
+#define FILE_FIND_MATCHER_MAX_DFA_STATES 10000
+
+typedef struct
+{
+    int stub;
+} file_find_matcher_t;
+
+extern int file_find_matcher_new(file_find_matcher_t * * output_handle);
+
+/*
+ * Returns FILE_FIND_NOT_SUPPORTED if glob has a "[" or "{" that is not
+ * closed, or after file_find_matcher_compile().
+ * */
+extern int file_find_matcher_add_glob(
+    file_find_matcher_t * handle,
+    const char * glob
+);
+
+/*
+ * Builds the DFA of the globs that were added. Until then, they are matched
+ * by running their NFA. Afterwards the matcher is only read, so it may be
+ * used by several threads at once.
+ * */
+extern int file_find_matcher_compile(file_find_matcher_t * handle);
+
+/*
+ * Whether name matches any of the globs.
+ * */
+extern int file_find_matcher_match(
+    file_find_matcher_t * handle,
+    const char * name
+);
+
+/*
+ * The number of states of the DFA, without its dead state, or 0 if there
+ * is none because of the globs or its size.
+ * */
+extern unsigned int file_find_matcher_get_num_dfa_states(
+    file_find_matcher_t * handle
+);
+
+extern void file_find_matcher_free(file_find_matcher_t * handle);
+
+#endif /* #ifndef FILEFIND_FINDMATCH_H */
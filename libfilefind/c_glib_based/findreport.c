@@ -0,0 +1,898 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findreport.c
+ *
+ *    Description:  streaming top-K and quantile reports of the items of a
+ *                  walk.
+ *
+ *        Created:  20/10/26 03:26:18
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inline.h"
+
+#include "findreport.h"
+
+typedef struct
+{
+    gint64 value;
+    gchar * path;
+} top_entry_type;
+
+typedef struct
+{
+    guint k;
+    unsigned int field;
+    gboolean should_keep_smallest;
+    /*
+     * A binary heap of the kept entries, whose root is the one that is
+     * dropped first.
+     * */
+    GArray * heap;
+    /* The sorted results, which point into the heap. */
+    GArray * results;
+} top_type;
+
+int file_find_top_new(
+    file_find_top_t * * output_handle,
+    int k,
+    unsigned int field,
+    int should_keep_smallest
+)
+{
+    top_type * self;
+
+    *output_handle = NULL;
+
+    if (k <= 0)
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    if (! (self = g_new0(top_type, 1)))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    self->k = k;
+    self->field = field;
+    self->should_keep_smallest = should_keep_smallest;
+
+    if (! ((self->heap = g_array_new(FALSE, FALSE, sizeof(top_entry_type)))
+        && (self->results =
+            g_array_new(FALSE, FALSE, sizeof(file_find_top_entry_t)))))
+    {
+        file_find_top_free((file_find_top_t *)self);
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    *output_handle = (file_find_top_t *)self;
+
+    return FILE_FIND_OK;
+}
+
+/*
+ * Whether an entry of value and path would be kept rather than other.
+ * */
+static GCC_INLINE gboolean top_is_better(
+    const top_type * const self,
+    const gint64 value,
+    const gchar * const path,
+    const top_entry_type * const other
+)
+{
+    if (value != other->value)
+    {
+        return (self->should_keep_smallest
+            ? (value < other->value)
+            : (value > other->value)
+        );
+    }
+
+    return (strcmp(path, other->path) < 0);
+}
+
+static void top_sift_down(top_type * const self, guint idx)
+{
+    GArray * const heap = self->heap;
+    const top_entry_type entry = g_array_index(heap, top_entry_type, idx);
+
+    while (TRUE)
+    {
+        guint child = (idx << 1) + 1;
+
+        if (child >= heap->len)
+        {
+            break;
+        }
+
+        /* The worse of the children goes up. */
+        if ((child + 1 < heap->len)
+            && top_is_better(
+                self,
+                g_array_index(heap, top_entry_type, child).value,
+                g_array_index(heap, top_entry_type, child).path,
+                &g_array_index(heap, top_entry_type, child + 1)
+            ))
+        {
+            child++;
+        }
+
+        if (! top_is_better(
+                self,
+                entry.value,
+                entry.path,
+                &g_array_index(heap, top_entry_type, child)
+            ))
+        {
+            break;
+        }
+
+        g_array_index(heap, top_entry_type, idx) =
+            g_array_index(heap, top_entry_type, child);
+        idx = child;
+    }
+
+    g_array_index(heap, top_entry_type, idx) = entry;
+
+    return;
+}
+
+static int top_offer(
+    top_type * const self,
+    const gint64 value,
+    const gchar * const path
+)
+{
+    GArray * const heap = self->heap;
+
+    if (heap->len == self->k)
+    {
+        top_entry_type * const worst = &g_array_index(heap, top_entry_type, 0);
+
+        if (! top_is_better(self, value, path, worst))
+        {
+            return FILE_FIND_OK;
+        }
+
+        gchar * const path_copy = g_strdup(path);
+
+        if (! path_copy)
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        g_free(worst->path);
+        worst->value = value;
+        worst->path = path_copy;
+
+        top_sift_down(self, 0);
+
+        return FILE_FIND_OK;
+    }
+
+    top_entry_type entry = { value, g_strdup(path) };
+
+    if (! entry.path)
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    g_array_append_val(heap, entry);
+
+    /* Sift up. */
+    guint i = heap->len - 1;
+
+    while (i > 0)
+    {
+        const guint parent_idx = ((i - 1) >> 1);
+        top_entry_type * const up =
+            &g_array_index(heap, top_entry_type, parent_idx);
+
+        if (! top_is_better(self, up->value, up->path, &entry))
+        {
+            break;
+        }
+
+        g_array_index(heap, top_entry_type, i) = *up;
+        i = parent_idx;
+    }
+
+    g_array_index(heap, top_entry_type, i) = entry;
+
+    return FILE_FIND_OK;
+}
+
+int file_find_top_add(
+    file_find_top_t * handle,
+    const file_find_item_t * item
+)
+{
+    top_type * const self = (top_type *)handle;
+
+    return top_offer(
+        self,
+        file_find_emit_get_field(file_find_item_get_stat(item), self->field),
+        file_find_item_get_path(item)
+    );
+}
+
+int file_find_top_merge(
+    file_find_top_t * dest,
+    const file_find_top_t * src
+)
+{
+    top_type * const self = (top_type *)dest;
+    const top_type * const other = (const top_type *)src;
+
+    if ((self->field != other->field)
+        || ((! self->should_keep_smallest) != (! other->should_keep_smallest)))
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    for (guint i = 0 ; i < other->heap->len ; i++)
+    {
+        const top_entry_type * const entry =
+            &g_array_index(other->heap, top_entry_type, i);
+        const int ret = top_offer(self, entry->value, entry->path);
+
+        if (ret != FILE_FIND_OK)
+        {
+            return ret;
+        }
+    }
+
+    return FILE_FIND_OK;
+}
+
+static gint top_results_cmp(gconstpointer a, gconstpointer b, gpointer context)
+{
+    const top_type * const self = (const top_type *)context;
+    const file_find_top_entry_t * const entry_a = (const file_find_top_entry_t *)a;
+    const file_find_top_entry_t * const entry_b = (const file_find_top_entry_t *)b;
+
+    if (entry_a->value != entry_b->value)
+    {
+        return (((entry_a->value < entry_b->value) == (! self->should_keep_smallest))
+            ? 1 : -1
+        );
+    }
+
+    return strcmp(entry_a->path, entry_b->path);
+}
+
+int file_find_top_get_results(
+    file_find_top_t * handle,
+    int * num_entries,
+    const file_find_top_entry_t * * entries
+)
+{
+    top_type * const self = (top_type *)handle;
+
+    g_array_set_size(self->results, self->heap->len);
+
+    for (guint i = 0 ; i < self->heap->len ; i++)
+    {
+        const top_entry_type * const entry =
+            &g_array_index(self->heap, top_entry_type, i);
+        file_find_top_entry_t * const result =
+            &g_array_index(self->results, file_find_top_entry_t, i);
+
+        result->path = entry->path;
+        result->value = entry->value;
+    }
+
+    g_array_sort_with_data(self->results, top_results_cmp, self);
+
+    *num_entries = self->results->len;
+    *entries = (const file_find_top_entry_t *)self->results->data;
+
+    return FILE_FIND_OK;
+}
+
+void file_find_top_free(file_find_top_t * handle)
+{
+    top_type * const self = (top_type *)handle;
+
+    if (self->heap)
+    {
+        for (guint i = 0 ; i < self->heap->len ; i++)
+        {
+            g_free(g_array_index(self->heap, top_entry_type, i).path);
+        }
+
+        g_array_free(self->heap, TRUE);
+    }
+
+    if (self->results)
+    {
+        g_array_free(self->results, TRUE);
+    }
+
+    g_free(self);
+
+    return;
+}
+
+/*
+ * A KLL sketch. levels[h] holds values of weight 2^h. Once a level is at
+ * its capacity, it is sorted and every other value (starting from a coin
+ * flip) moves to the level above, which keeps the total weight and adds a
+ * rank error of at most 2^h. The capacities shrink by a factor of 2/3
+ * below the top level, so that most of the values are kept where their
+ * weights are large.
+ * */
+typedef struct
+{
+    GPtrArray * levels;
+    guint num_values;
+    guint max_num_values;
+    guint64 count;
+    gint64 min;
+    gint64 max;
+    guint32 coin;
+} kll_sketch_type;
+
+#define KLL_MIN_CAPACITY 2
+
+static guint kll_capacity(
+    const kll_sketch_type * const sketch,
+    const guint accuracy,
+    const guint level
+)
+{
+    gdouble capacity = accuracy;
+
+    for (guint i = level + 1 ; i < sketch->levels->len ; i++)
+    {
+        capacity *= (2.0 / 3.0);
+    }
+
+    return MAX(KLL_MIN_CAPACITY, ((guint)capacity) + 1);
+}
+
+static gboolean kll_grow(kll_sketch_type * const sketch, const guint accuracy)
+{
+    GArray * const level = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+    if (! level)
+    {
+        return FALSE;
+    }
+
+    g_ptr_array_add(sketch->levels, level);
+
+    sketch->max_num_values = 0;
+
+    for (guint h = 0 ; h < sketch->levels->len ; h++)
+    {
+        sketch->max_num_values += kll_capacity(sketch, accuracy, h);
+    }
+
+    return TRUE;
+}
+
+static kll_sketch_type * kll_new(const guint accuracy)
+{
+    kll_sketch_type * const sketch = g_new0(kll_sketch_type, 1);
+
+    if (! sketch)
+    {
+        return NULL;
+    }
+
+    /* Any odd seed will do: it only has to be reproducible. */
+    sketch->coin = 0x9e3779b9;
+
+    if (! ((sketch->levels = g_ptr_array_new()) && kll_grow(sketch, accuracy)))
+    {
+        if (sketch->levels)
+        {
+            g_ptr_array_free(sketch->levels, TRUE);
+        }
+
+        g_free(sketch);
+        return NULL;
+    }
+
+    return sketch;
+}
+
+static void kll_free(gpointer data)
+{
+    kll_sketch_type * const sketch = (kll_sketch_type *)data;
+
+    for (guint h = 0 ; h < sketch->levels->len ; h++)
+    {
+        g_array_free(g_ptr_array_index(sketch->levels, h), TRUE);
+    }
+
+    g_ptr_array_free(sketch->levels, TRUE);
+    g_free(sketch);
+
+    return;
+}
+
+static gint kll_value_cmp(gconstpointer a, gconstpointer b)
+{
+    const gint64 value_a = *(const gint64 *)a;
+    const gint64 value_b = *(const gint64 *)b;
+
+    return ((value_a < value_b) ? -1 : (value_a > value_b) ? 1 : 0);
+}
+
+static GCC_INLINE gboolean kll_flip_coin(kll_sketch_type * const sketch)
+{
+    /* xorshift32 */
+    guint32 x = sketch->coin;
+
+    x ^= (x << 13);
+    x ^= (x >> 17);
+    x ^= (x << 5);
+
+    sketch->coin = x;
+
+    return (x & 1);
+}
+
+/*
+ * Compacts the lowest levels that are at their capacity until the sketch
+ * fits in max_num_values again.
+ * */
+static gboolean kll_compress(kll_sketch_type * const sketch, const guint accuracy)
+{
+    for (guint h = 0 ; h < sketch->levels->len ; h++)
+    {
+        GArray * const level = g_ptr_array_index(sketch->levels, h);
+
+        if (level->len < kll_capacity(sketch, accuracy, h))
+        {
+            continue;
+        }
+
+        if ((h + 1 == sketch->levels->len) && (! kll_grow(sketch, accuracy)))
+        {
+            return FALSE;
+        }
+
+        GArray * const above = g_ptr_array_index(sketch->levels, h + 1);
+
+        g_array_sort(level, kll_value_cmp);
+
+        /* An odd one out stays, and it had better be the smallest. */
+        const guint start = (level->len & 1);
+        const guint offset = kll_flip_coin(sketch);
+
+        for (guint i = start ; i + 1 < level->len ; i += 2)
+        {
+            g_array_append_val(above, g_array_index(level, gint64, i + offset));
+        }
+
+        sketch->num_values -= (level->len - start) - ((level->len - start) >> 1);
+        g_array_set_size(level, start);
+
+        if (sketch->num_values < sketch->max_num_values)
+        {
+            break;
+        }
+    }
+
+    return TRUE;
+}
+
+static gboolean kll_add(
+    kll_sketch_type * const sketch,
+    const guint accuracy,
+    const gint64 value
+)
+{
+    if ((! sketch->count) || (value < sketch->min))
+    {
+        sketch->min = value;
+    }
+
+    if ((! sketch->count) || (value > sketch->max))
+    {
+        sketch->max = value;
+    }
+
+    sketch->count++;
+
+    g_array_append_val((GArray *)g_ptr_array_index(sketch->levels, 0), value);
+
+    return ((++sketch->num_values < sketch->max_num_values)
+        || kll_compress(sketch, accuracy)
+    );
+}
+
+static gboolean kll_merge(
+    kll_sketch_type * const sketch,
+    const guint accuracy,
+    const kll_sketch_type * const other
+)
+{
+    if (! other->count)
+    {
+        return TRUE;
+    }
+
+    if ((! sketch->count) || (other->min < sketch->min))
+    {
+        sketch->min = other->min;
+    }
+
+    if ((! sketch->count) || (other->max > sketch->max))
+    {
+        sketch->max = other->max;
+    }
+
+    sketch->count += other->count;
+
+    while (sketch->levels->len < other->levels->len)
+    {
+        if (! kll_grow(sketch, accuracy))
+        {
+            return FALSE;
+        }
+    }
+
+    for (guint h = 0 ; h < other->levels->len ; h++)
+    {
+        const GArray * const level = g_ptr_array_index(other->levels, h);
+
+        g_array_append_vals(
+            g_ptr_array_index(sketch->levels, h), level->data, level->len
+        );
+        sketch->num_values += level->len;
+    }
+
+    while (sketch->num_values >= sketch->max_num_values)
+    {
+        const guint old_num_values = sketch->num_values;
+
+        if (! kll_compress(sketch, accuracy))
+        {
+            return FALSE;
+        }
+
+        /* Only the levels that are at their capacity are compacted. */
+        if (sketch->num_values == old_num_values)
+        {
+            break;
+        }
+    }
+
+    return TRUE;
+}
+
+typedef struct
+{
+    gint64 value;
+    guint64 weight;
+} kll_weighted_value_type;
+
+static gint kll_weighted_value_cmp(gconstpointer a, gconstpointer b)
+{
+    return kll_value_cmp(
+        &(((const kll_weighted_value_type *)a)->value),
+        &(((const kll_weighted_value_type *)b)->value)
+    );
+}
+
+static gboolean kll_get_quantile(
+    const kll_sketch_type * const sketch,
+    const gdouble phi,
+    gint64 * const value
+)
+{
+    if (phi <= 0)
+    {
+        *value = sketch->min;
+        return TRUE;
+    }
+
+    if (phi >= 1)
+    {
+        *value = sketch->max;
+        return TRUE;
+    }
+
+    kll_weighted_value_type * const values =
+        g_new(kll_weighted_value_type, sketch->num_values);
+    guint num_values = 0;
+
+    if (! values)
+    {
+        return FALSE;
+    }
+
+    for (guint h = 0 ; h < sketch->levels->len ; h++)
+    {
+        const GArray * const level = g_ptr_array_index(sketch->levels, h);
+
+        for (guint i = 0 ; i < level->len ; i++)
+        {
+            values[num_values].value = g_array_index(level, gint64, i);
+            values[num_values].weight = (((guint64)1) << h);
+            num_values++;
+        }
+    }
+
+    qsort(values, num_values, sizeof(values[0]), kll_weighted_value_cmp);
+
+    const gdouble target = phi * sketch->count;
+    guint64 weight = 0;
+
+    *value = sketch->max;
+
+    for (guint i = 0 ; i < num_values ; i++)
+    {
+        weight += values[i].weight;
+
+        if (weight >= target)
+        {
+            *value = values[i].value;
+            break;
+        }
+    }
+
+    g_free(values);
+
+    return TRUE;
+}
+
+typedef struct
+{
+    guint accuracy;
+    unsigned int field;
+    int group_by;
+    /* The name of a group -> its kll_sketch_type. */
+    GHashTable * groups;
+    GPtrArray * group_names;
+} quantiles_type;
+
+int file_find_quantiles_new(
+    file_find_quantiles_t * * output_handle,
+    int accuracy,
+    unsigned int field,
+    int group_by
+)
+{
+    quantiles_type * self;
+
+    *output_handle = NULL;
+
+    if (! (self = g_new0(quantiles_type, 1)))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    self->accuracy = ((accuracy > 0)
+        ? accuracy : FILE_FIND_QUANTILES_DEFAULT_ACCURACY
+    );
+    self->field = field;
+    self->group_by = group_by;
+
+    if (! ((self->groups =
+            g_hash_table_new_full(g_str_hash, g_str_equal, g_free, kll_free))
+        && (self->group_names = g_ptr_array_new())))
+    {
+        file_find_quantiles_free((file_find_quantiles_t *)self);
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    *output_handle = (file_find_quantiles_t *)self;
+
+    return FILE_FIND_OK;
+}
+
+static const gchar * quantiles_get_group(
+    const quantiles_type * const self,
+    const file_find_item_t * const item
+)
+{
+    switch (self->group_by)
+    {
+        case FILE_FIND_REPORT_GROUP_EXTENSION:
+        {
+            const gchar * const basename = file_find_item_get_basename(item);
+            const gchar * const dot = (basename ? strrchr(basename, '.') : NULL);
+
+            return ((dot && (dot != basename)) ? (dot + 1) : "");
+        }
+
+        case FILE_FIND_REPORT_GROUP_TOP_DIR:
+        {
+            int num_components;
+            const char * const * const components =
+                file_find_item_get_dir_components(item, &num_components);
+
+            return ((num_components > 0) ? components[0] : "");
+        }
+
+        default:
+            return "";
+    }
+}
+
+/*
+ * Returns the sketch of group, which is created if needed, or NULL if out
+ * of memory.
+ * */
+static kll_sketch_type * quantiles_lookup_sketch(
+    quantiles_type * const self,
+    const gchar * const group
+)
+{
+    kll_sketch_type * sketch = g_hash_table_lookup(self->groups, group);
+
+    if (sketch)
+    {
+        return sketch;
+    }
+
+    gchar * const name = g_strdup(group);
+
+    if (! name)
+    {
+        return NULL;
+    }
+
+    if (! (sketch = kll_new(self->accuracy)))
+    {
+        g_free(name);
+        return NULL;
+    }
+
+    g_hash_table_insert(self->groups, name, sketch);
+
+    return sketch;
+}
+
+int file_find_quantiles_add(
+    file_find_quantiles_t * handle,
+    const file_find_item_t * item
+)
+{
+    quantiles_type * const self = (quantiles_type *)handle;
+    kll_sketch_type * const sketch =
+        quantiles_lookup_sketch(self, quantiles_get_group(self, item));
+
+    if (! (sketch
+        && kll_add(
+            sketch,
+            self->accuracy,
+            file_find_emit_get_field(file_find_item_get_stat(item), self->field)
+        )))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    return FILE_FIND_OK;
+}
+
+int file_find_quantiles_merge(
+    file_find_quantiles_t * dest,
+    const file_find_quantiles_t * src
+)
+{
+    quantiles_type * const self = (quantiles_type *)dest;
+    const quantiles_type * const other = (const quantiles_type *)src;
+    GHashTableIter iter;
+    gpointer name, other_sketch;
+
+    if ((self->field != other->field) || (self->group_by != other->group_by))
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    g_hash_table_iter_init(&iter, other->groups);
+
+    while (g_hash_table_iter_next(&iter, &name, &other_sketch))
+    {
+        kll_sketch_type * const sketch =
+            quantiles_lookup_sketch(self, (const gchar *)name);
+
+        if (! (sketch
+            && kll_merge(
+                sketch,
+                self->accuracy,
+                (const kll_sketch_type *)other_sketch
+            )))
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+    }
+
+    return FILE_FIND_OK;
+}
+
+static gint quantiles_group_names_cmp(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const gchar * const *)a, *(const gchar * const *)b);
+}
+
+int file_find_quantiles_get_groups(
+    file_find_quantiles_t * handle,
+    int * num_groups,
+    const char * const * * names
+)
+{
+    quantiles_type * const self = (quantiles_type *)handle;
+    GHashTableIter iter;
+    gpointer name;
+
+    g_ptr_array_set_size(self->group_names, 0);
+    g_hash_table_iter_init(&iter, self->groups);
+
+    while (g_hash_table_iter_next(&iter, &name, NULL))
+    {
+        g_ptr_array_add(self->group_names, name);
+    }
+
+    g_ptr_array_sort(self->group_names, quantiles_group_names_cmp);
+
+    *num_groups = self->group_names->len;
+    *names = (const char * const *)self->group_names->pdata;
+
+    return FILE_FIND_OK;
+}
+
+int file_find_quantiles_get(
+    file_find_quantiles_t * handle,
+    const char * group,
+    double phi,
+    long long * value,
+    unsigned long long * count
+)
+{
+    quantiles_type * const self = (quantiles_type *)handle;
+    const kll_sketch_type * const sketch =
+        g_hash_table_lookup(self->groups, group);
+    gint64 quantile;
+
+    if (! sketch)
+    {
+        return FILE_FIND_END;
+    }
+
+    if (! kll_get_quantile(sketch, phi, &quantile))
+    {
+        return FILE_FIND_OUT_OF_MEMORY;
+    }
+
+    *value = quantile;
+    *count = sketch->count;
+
+    return FILE_FIND_OK;
+}
+
+void file_find_quantiles_free(file_find_quantiles_t * handle)
+{
+    quantiles_type * const self = (quantiles_type *)handle;
+
+    if (self->groups)
+    {
+        g_hash_table_destroy(self->groups);
+    }
+
+    if (self->group_names)
+    {
+        g_ptr_array_free(self->group_names, TRUE);
+    }
+
+    g_free(self);
+
+    return;
+}
@@ -0,0 +1,169 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  findreport.h
+ *
+ *    Description:  streaming top-K and quantile reports of the items of a
+ *                  walk.
+ *
+ *        Created:  20/10/26 03:26:18
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_FINDREPORT_H
+#define FILEFIND_FINDREPORT_H
+
+#include "filefind.h"
+#include "findemit.h"
+
+/*
+ * The reports are fed the items that the caller chooses (e.g: only the
+ * regular files) as they are walked, and keep a bounded summary of them,
+ * so that e.g: the largest 1000 files of a tree of 100M files are known at
+ * the end of the walk without keeping or sorting all of their paths. The
+ * value of an item is one of the FILE_FIND_EMIT_FIELD_* of its stat().
+ *
+ * A report is not thread-safe, but the reports of the same kind that were
+ * fed by different threads (e.g: one per shard) can be merged at the end.
+ * */
+
+typedef struct
+{
+    int stub;
+} file_find_top_t;
+
+typedef struct
+{
+    const char * path;
+    long long value;
+} file_find_top_entry_t;
+
+/*
+ * Keeps the k items with the largest values of field, or with the
+ * smallest ones if should_keep_smallest. Equal values are ordered by
+ * their paths, so the result does not depend on the order the items were
+ * added or merged in. Only the paths of the items that are kept are
+ * copied.
+ *
+ * Returns FILE_FIND_NOT_SUPPORTED if k is not positive.
+ * */
+extern int file_find_top_new(
+    file_find_top_t * * output_handle,
+    int k,
+    unsigned int field,
+    int should_keep_smallest
+);
+
+extern int file_find_top_add(
+    file_find_top_t * handle,
+    const file_find_item_t * item
+);
+
+/*
+ * Adds the items that src kept to dest. Returns FILE_FIND_NOT_SUPPORTED if
+ * they do not have the same field and order.
+ * */
+extern int file_find_top_merge(
+    file_find_top_t * dest,
+    const file_find_top_t * src
+);
+
+/*
+ * Sets *entries to the items that were kept, from the largest value (or
+ * the smallest one) on. They are valid until the report is changed or
+ * freed.
+ * */
+extern int file_find_top_get_results(
+    file_find_top_t * handle,
+    int * num_entries,
+    const file_find_top_entry_t * * entries
+);
+
+extern void file_find_top_free(file_find_top_t * handle);
+
+/*
+ * How the items of file_find_quantiles_new() are grouped.
+ * */
+enum FILE_FIND_REPORT_GROUP
+{
+    /* A single group named "". */
+    FILE_FIND_REPORT_GROUP_NONE = 0,
+    /*
+     * By what follows the last dot of their names, or "" for none (and
+     * for directories). Dot files such as ".bashrc" have no extension.
+     * */
+    FILE_FIND_REPORT_GROUP_EXTENSION,
+    /*
+     * By the first directory below their target, or "" for the items that
+     * are directly inside it and the targets themselves.
+     * */
+    FILE_FIND_REPORT_GROUP_TOP_DIR,
+};
+
+#define FILE_FIND_QUANTILES_DEFAULT_ACCURACY 200
+
+typedef struct
+{
+    int stub;
+} file_find_quantiles_t;
+
+/*
+ * Keeps a KLL sketch of the values of field for every group. The rank of
+ * a quantile is usually off by less than about 3.3 / accuracy (under 2%
+ * for the default), and a group takes O(accuracy) memory regardless of
+ * its number of items. accuracy <= 0 means
+ * FILE_FIND_QUANTILES_DEFAULT_ACCURACY. The counts and the smallest and
+ * largest values are exact.
+ * */
+extern int file_find_quantiles_new(
+    file_find_quantiles_t * * output_handle,
+    int accuracy,
+    unsigned int field,
+    int group_by
+);
+
+extern int file_find_quantiles_add(
+    file_find_quantiles_t * handle,
+    const file_find_item_t * item
+);
+
+/*
+ * Adds the groups of src to those of dest. Returns FILE_FIND_NOT_SUPPORTED
+ * if they do not have the same field and grouping.
+ * */
+extern int file_find_quantiles_merge(
+    file_find_quantiles_t * dest,
+    const file_find_quantiles_t * src
+);
+
+/*
+ * Sets *names to the sorted names of the groups, which are valid until
+ * the report is changed or freed.
+ * */
+extern int file_find_quantiles_get_groups(
+    file_find_quantiles_t * handle,
+    int * num_groups,
+    const char * const * * names
+);
+
+/*
+ * Sets *value to the value below which the fraction phi (from 0 to 1) of
+ * the items of group lie, and *count to their number. Returns
+ * FILE_FIND_END if there is no such group.
+ * */
+extern int file_find_quantiles_get(
+    file_find_quantiles_t * handle,
+    const char * group,
+    double phi,
+    long long * value,
+    unsigned long long * count
+);
+
+extern void file_find_quantiles_free(file_find_quantiles_t * handle);
+
+#endif /* #ifndef FILEFIND_FINDREPORT_H */
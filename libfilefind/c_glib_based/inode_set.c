@@ -0,0 +1,177 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  inode_set.c
+ *
+ *    Description:  a compact set of (st_dev, st_ino) pairs.
+ *
+ *        Created:  19/10/26 22:03:18
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+
+#include "inline.h"
+
+#include "inode_set.h"
+
+#define INODE_SET_MIN_CAPACITY 256
+
+typedef struct
+{
+    guint64 dev;
+    /* 0 in an empty slot. */
+    guint64 ino;
+} inode_set_slot_type;
+
+struct inode_set_struct
+{
+    /* A power of 2, or 0 before the first pair. */
+    guint64 capacity;
+    guint64 size;
+    inode_set_slot_type * slots;
+};
+
+/*
+ * Inodes are mostly sequential, so their bits are mixed (with the
+ * finalizer of MurmurHash3) before they pick a slot.
+ * */
+static GCC_INLINE guint64 inode_set_hash(const guint64 dev, const guint64 ino)
+{
+    guint64 h = ino ^ (dev * 0x9E3779B97F4A7C15ULL);
+
+    h ^= (h >> 33);
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= (h >> 33);
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= (h >> 33);
+
+    return h;
+}
+
+/*
+ * Returns the slot of the pair, or the empty slot where it belongs.
+ * */
+static GCC_INLINE inode_set_slot_type * inode_set_find_slot(
+    inode_set_slot_type * const slots,
+    const guint64 capacity,
+    const guint64 dev,
+    const guint64 ino
+)
+{
+    const guint64 mask = capacity - 1;
+    guint64 idx = (inode_set_hash(dev, ino) & mask);
+
+    while (slots[idx].ino
+        && ((slots[idx].ino != ino) || (slots[idx].dev != dev)))
+    {
+        idx = ((idx + 1) & mask);
+    }
+
+    return &(slots[idx]);
+}
+
+static gboolean inode_set_grow(inode_set_t * const self)
+{
+    const guint64 new_capacity =
+        (self->capacity ? (self->capacity * 2) : INODE_SET_MIN_CAPACITY);
+
+    inode_set_slot_type * const new_slots =
+        g_try_new0(inode_set_slot_type, new_capacity);
+
+    if (! new_slots)
+    {
+        return FALSE;
+    }
+
+    for (guint64 i = 0 ; i < self->capacity ; i++)
+    {
+        const inode_set_slot_type * const slot = &(self->slots[i]);
+
+        if (slot->ino)
+        {
+            *inode_set_find_slot(new_slots, new_capacity, slot->dev, slot->ino)
+                = *slot;
+        }
+    }
+
+    g_free(self->slots);
+    self->slots = new_slots;
+    self->capacity = new_capacity;
+
+    return TRUE;
+}
+
+inode_set_t * inode_set_new(void)
+{
+    return g_new0(inode_set_t, 1);
+}
+
+gboolean inode_set_add(
+    inode_set_t * const self,
+    const guint64 dev,
+    const guint64 ino,
+    gboolean * const was_present
+)
+{
+    *was_present = FALSE;
+
+    if (! ino)
+    {
+        return TRUE;
+    }
+
+    if ((! self->capacity) && (! inode_set_grow(self)))
+    {
+        return FALSE;
+    }
+
+    inode_set_slot_type * slot =
+        inode_set_find_slot(self->slots, self->capacity, dev, ino);
+
+    if (slot->ino)
+    {
+        *was_present = TRUE;
+        return TRUE;
+    }
+
+    /* Keep it at most 3/4 full, so the probe sequences stay short. */
+    if ((self->size + 1) * 4 > self->capacity * 3)
+    {
+        if (! inode_set_grow(self))
+        {
+            return FALSE;
+        }
+
+        slot = inode_set_find_slot(self->slots, self->capacity, dev, ino);
+    }
+
+    slot->dev = dev;
+    slot->ino = ino;
+    self->size++;
+
+    return TRUE;
+}
+
+guint64 inode_set_get_size(inode_set_t * const self)
+{
+    return self->size;
+}
+
+guint64 inode_set_get_memory_bytes(inode_set_t * const self)
+{
+    return (sizeof(*self) + self->capacity * sizeof(inode_set_slot_type));
+}
+
+void inode_set_free(inode_set_t * const self)
+{
+    g_free(self->slots);
+    g_free(self);
+
+    return;
+}
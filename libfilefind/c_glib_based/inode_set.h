@@ -0,0 +1,58 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  inode_set.h
+ *
+ *    Description:  a compact set of (st_dev, st_ino) pairs. Internal to
+ *                  libfilefind.
+ *
+ *        Created:  19/10/26 22:03:18
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_INODE_SET_H
+#define FILEFIND_INODE_SET_H
+
+#include <glib.h>
+
+/*
+ * An open-addressing hash table with linear probing, whose slots are the
+ * pairs themselves, so it takes 16 bytes per slot and no allocation per
+ * pair. It is kept between 3/8 and 3/4 full, so a pair costs at most about
+ * 43 bytes.
+ * */
+typedef struct inode_set_struct inode_set_t;
+
+/*
+ * Nothing is allocated until the first pair is added. Returns NULL if out
+ * of memory.
+ * */
+extern inode_set_t * inode_set_new(void);
+
+/*
+ * Adds the pair and sets *was_present to whether it was already in the
+ * set. An inode of 0 is never added, and is reported as not present.
+ * Returns FALSE if out of memory.
+ * */
+extern gboolean inode_set_add(
+    inode_set_t * self,
+    guint64 dev,
+    guint64 ino,
+    gboolean * was_present
+);
+
+extern guint64 inode_set_get_size(inode_set_t * self);
+
+/*
+ * The memory held by the set.
+ * */
+extern guint64 inode_set_get_memory_bytes(inode_set_t * self);
+
+extern void inode_set_free(inode_set_t * self);
+
+#endif /* #ifndef FILEFIND_INODE_SET_H */
@@ -0,0 +1,414 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  listing_spill.c
+ *
+ *    Description:  spills the sorted runs of a huge directory listing to a
+ *                  temporary file and merges them back.
+ *
+ *        Created:  19/10/26 16:40:05
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "inline.h"
+
+#include "listing_spill.h"
+
+/*
+ * The names are stored NUL-terminated, one after the other, which is safe
+ * because file names cannot contain NULs. A buffer is always large enough
+ * for a complete name.
+ * */
+#define SPILL_BUFFER_SIZE (64 * 1024)
+
+typedef struct
+{
+    /* Set for the last run, which is kept in memory. */
+    GPtrArray * names;
+    guint next_idx;
+    /* The part of the file that was not read yet. */
+    off_t offset;
+    off_t end;
+    gchar * buffer;
+    gsize start;
+    gsize len;
+    /* The smallest name that was not returned yet, or NULL. */
+    const gchar * head;
+} spill_run_type;
+
+struct listing_spill_struct
+{
+    int fd;
+    off_t size;
+    GArray * runs;
+    /* A min-heap of the indexes of the runs that were not exhausted. */
+    guint * heap;
+    guint heap_len;
+    GString * current;
+};
+
+listing_spill_t * listing_spill_new(void)
+{
+    listing_spill_t * self;
+    gchar * filename = NULL;
+
+    if (! (self = g_new0(listing_spill_t, 1)))
+    {
+        return NULL;
+    }
+
+    if (! (self->runs = g_array_new(FALSE, TRUE, sizeof(spill_run_type))))
+    {
+        g_free(self);
+        return NULL;
+    }
+
+    if ((self->fd = g_file_open_tmp("filefind-spill-XXXXXX", &filename, NULL)) < 0)
+    {
+        g_array_free(self->runs, TRUE);
+        g_free(self);
+        return NULL;
+    }
+
+    /* Nobody else needs it, and it is gone even if we crash. */
+    g_unlink(filename);
+    g_free(filename);
+
+    return self;
+}
+
+static gboolean spill_write_all(
+    const int fd,
+    const gchar * buffer,
+    gsize len
+)
+{
+    while (len > 0)
+    {
+        const ssize_t written = write(fd, buffer, len);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return FALSE;
+        }
+
+        buffer += written;
+        len -= written;
+    }
+
+    return TRUE;
+}
+
+gboolean listing_spill_add_run(
+    listing_spill_t * const self,
+    GPtrArray * const names
+)
+{
+    spill_run_type run;
+    gchar * const buffer = g_malloc(SPILL_BUFFER_SIZE);
+    gsize len = 0;
+
+    if (! buffer)
+    {
+        return FALSE;
+    }
+
+    memset(&run, '\0', sizeof(run));
+    run.offset = self->size;
+
+    for (guint i = 0 ; i < names->len ; i++)
+    {
+        const gchar * const name = g_ptr_array_index(names, i);
+        const gsize name_len = strlen(name) + 1;
+
+        if (len + name_len > SPILL_BUFFER_SIZE)
+        {
+            if (! spill_write_all(self->fd, buffer, len))
+            {
+                g_free(buffer);
+                return FALSE;
+            }
+
+            self->size += len;
+            len = 0;
+        }
+
+        memcpy(buffer + len, name, name_len);
+        len += name_len;
+    }
+
+    const gboolean ret = spill_write_all(self->fd, buffer, len);
+
+    g_free(buffer);
+
+    if (ret)
+    {
+        self->size += len;
+        run.end = self->size;
+        g_array_append_val(self->runs, run);
+    }
+
+    return ret;
+}
+
+/*
+ * Makes run->head point to the next complete name, reading more of the
+ * run as needed.
+ * */
+static void spill_run_read_head(
+    listing_spill_t * const self,
+    spill_run_type * const run
+)
+{
+    if (run->names)
+    {
+        run->head =
+            ((run->next_idx < run->names->len)
+             ? g_ptr_array_index(run->names, run->next_idx)
+             : NULL
+            );
+
+        return;
+    }
+
+    while (TRUE)
+    {
+        const gchar * const nul =
+            memchr(run->buffer + run->start, '\0', run->len - run->start);
+
+        if (nul)
+        {
+            run->head = run->buffer + run->start;
+            return;
+        }
+
+        memmove(run->buffer, run->buffer + run->start, run->len - run->start);
+        run->len -= run->start;
+        run->start = 0;
+
+        const gsize to_read =
+            MIN((gsize)(run->end - run->offset), SPILL_BUFFER_SIZE - run->len);
+
+        const ssize_t num_read =
+            ((to_read > 0)
+             ? pread(self->fd, run->buffer + run->len, to_read, run->offset)
+             : 0
+            );
+
+        if ((num_read < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+
+        if (num_read <= 0)
+        {
+            /* The run is exhausted (or unreadable). */
+            run->head = NULL;
+            return;
+        }
+
+        run->offset += num_read;
+        run->len += num_read;
+    }
+}
+
+static GCC_INLINE gint spill_heap_cmp(
+    listing_spill_t * const self,
+    const guint a,
+    const guint b
+)
+{
+    return strcmp(
+        g_array_index(self->runs, spill_run_type, self->heap[a]).head,
+        g_array_index(self->runs, spill_run_type, self->heap[b]).head
+    );
+}
+
+static void spill_heap_sift_down(listing_spill_t * const self, guint idx)
+{
+    while (TRUE)
+    {
+        guint smallest = idx;
+        const guint left = 2 * idx + 1;
+        const guint right = left + 1;
+
+        if ((left < self->heap_len) && (spill_heap_cmp(self, left, smallest) < 0))
+        {
+            smallest = left;
+        }
+
+        if ((right < self->heap_len) && (spill_heap_cmp(self, right, smallest) < 0))
+        {
+            smallest = right;
+        }
+
+        if (smallest == idx)
+        {
+            return;
+        }
+
+        const guint temp = self->heap[idx];
+        self->heap[idx] = self->heap[smallest];
+        self->heap[smallest] = temp;
+
+        idx = smallest;
+    }
+}
+
+gboolean listing_spill_start_merge(
+    listing_spill_t * const self,
+    GPtrArray * const last_run
+)
+{
+    spill_run_type memory_run;
+
+    memset(&memory_run, '\0', sizeof(memory_run));
+    memory_run.names = last_run;
+    g_array_append_val(self->runs, memory_run);
+
+    if (! (self->current = g_string_new(NULL)))
+    {
+        return FALSE;
+    }
+
+    if (! (self->heap = g_new(guint, self->runs->len + 1)))
+    {
+        return FALSE;
+    }
+
+    for (guint i = 0 ; i < self->runs->len ; i++)
+    {
+        spill_run_type * const run = &g_array_index(self->runs, spill_run_type, i);
+
+        if ((! run->names) && (! (run->buffer = g_malloc(SPILL_BUFFER_SIZE))))
+        {
+            return FALSE;
+        }
+
+        spill_run_read_head(self, run);
+
+        if (run->head)
+        {
+            self->heap[self->heap_len++] = i;
+        }
+    }
+
+    for (guint i = self->heap_len / 2 ; i > 0 ; i--)
+    {
+        spill_heap_sift_down(self, i - 1);
+    }
+
+    return TRUE;
+}
+
+const gchar * listing_spill_next(listing_spill_t * const self)
+{
+    if (self->heap_len == 0)
+    {
+        return NULL;
+    }
+
+    spill_run_type * const run =
+        &g_array_index(self->runs, spill_run_type, self->heap[0]);
+
+    g_string_assign(self->current, run->head);
+
+    if (run->names)
+    {
+        run->next_idx++;
+    }
+    else
+    {
+        run->start += strlen(run->head) + 1;
+    }
+    spill_run_read_head(self, run);
+
+    if (! run->head)
+    {
+        g_free(run->buffer);
+        run->buffer = NULL;
+        self->heap[0] = self->heap[--self->heap_len];
+    }
+
+    spill_heap_sift_down(self, 0);
+
+    return self->current->str;
+}
+
+guint64 listing_spill_get_memory_bytes(listing_spill_t * const self)
+{
+    guint64 ret = 0;
+
+    for (guint i = 0 ; i < self->runs->len ; i++)
+    {
+        const spill_run_type * const run =
+            &g_array_index(self->runs, spill_run_type, i);
+
+        if (run->buffer)
+        {
+            ret += SPILL_BUFFER_SIZE;
+        }
+
+        if (run->names)
+        {
+            for (guint j = run->next_idx ; j < run->names->len ; j++)
+            {
+                ret += sizeof(gpointer)
+                    + strlen(g_ptr_array_index(run->names, j)) + 1;
+            }
+        }
+    }
+
+    return ret;
+}
+
+void listing_spill_free(listing_spill_t * const self)
+{
+    for (guint i = 0 ; i < self->runs->len ; i++)
+    {
+        spill_run_type * const run =
+            &g_array_index(self->runs, spill_run_type, i);
+
+        g_free(run->buffer);
+
+        if (run->names)
+        {
+            for (guint j = 0 ; j < run->names->len ; j++)
+            {
+                g_free(g_ptr_array_index(run->names, j));
+            }
+            g_ptr_array_free(run->names, TRUE);
+        }
+    }
+
+    g_array_free(self->runs, TRUE);
+
+    g_free(self->heap);
+
+    if (self->current)
+    {
+        g_string_free(self->current, TRUE);
+    }
+
+    close(self->fd);
+
+    g_free(self);
+
+    return;
+}
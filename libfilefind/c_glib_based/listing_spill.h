@@ -0,0 +1,63 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  listing_spill.h
+ *
+ *    Description:  spills the sorted runs of a huge directory listing to a
+ *                  temporary file and merges them back. Internal to
+ *                  libfilefind.
+ *
+ *        Created:  19/10/26 16:40:05
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_LISTING_SPILL_H
+#define FILEFIND_LISTING_SPILL_H
+
+#include <glib.h>
+
+typedef struct listing_spill_struct listing_spill_t;
+
+/*
+ * Returns NULL if the temporary file could not be created.
+ * */
+extern listing_spill_t * listing_spill_new(void);
+
+/*
+ * Writes the names, which must be sorted, as a new run. Returns FALSE on
+ * a write error.
+ * */
+extern gboolean listing_spill_add_run(
+    listing_spill_t * self,
+    GPtrArray * names
+);
+
+/*
+ * Must be called after the last run was written. last_run holds the sorted
+ * names that were not spilled, is merged from memory, and is owned by the
+ * spill afterwards (even on failure). Returns FALSE if out of memory.
+ * */
+extern gboolean listing_spill_start_merge(
+    listing_spill_t * self,
+    GPtrArray * last_run
+);
+
+/*
+ * Returns the next name in the merged order or NULL at the end. The name
+ * is valid until the next call.
+ * */
+extern const gchar * listing_spill_next(listing_spill_t * self);
+
+/*
+ * The memory held by the read buffers and the names of the last run.
+ * */
+extern guint64 listing_spill_get_memory_bytes(listing_spill_t * self);
+
+extern void listing_spill_free(listing_spill_t * self);
+
+#endif /* #ifndef FILEFIND_LISTING_SPILL_H */
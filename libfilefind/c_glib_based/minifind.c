@@ -1,35 +1,1662 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "filefind.h"
+#include "dupfind.h"
+#include "findemit.h"
+#include "findestimate.h"
+#include "findarchive.h"
+#include "findbackend.h"
+#include "findmatch.h"
+#include "findreport.h"
+#include "findasync.h"
 
-int main(int argc, char * argv[])
+static void print_dups_group(
+    int num_paths,
+    const char * const * paths,
+    unsigned long long size,
+    void * context
+)
+{
+    for (int i = 0 ; i < num_paths ; i++)
+    {
+        puts(paths[i]);
+    }
+    puts("");
+}
+
+static int write_checkpoint(file_find_handle_t * tree, const char * path)
 {
-    file_find_handle_t * tree;
+    char * buffer;
+    size_t len;
+    int ret = file_find_checkpoint(tree, &buffer, &len);
 
-    if (argc < 2)
+    if (ret != FILE_FIND_OK)
     {
-        fprintf(stderr, "%s\n", "Usage: minifind [path]");
-        return -1;
+        return ret;
     }
 
-    if (file_find_new(&tree, argv[1]) != FILE_FIND_OK)
+    /* Replaced at once, so an interrupted write leaves the old one. */
+    char * const temp_path = malloc(strlen(path) + 5);
+    FILE * fh = NULL;
+
+    ret = FILE_FIND_COULD_NOT_WRITE;
+
+    if (temp_path)
+    {
+        sprintf(temp_path, "%s.new", path);
+
+        if ((fh = fopen(temp_path, "wb")))
+        {
+            if ((fwrite(buffer, 1, len, fh) == len)
+                && (fclose(fh) == 0)
+                && (rename(temp_path, path) == 0))
+            {
+                ret = FILE_FIND_OK;
+            }
+        }
+
+        free(temp_path);
+    }
+
+    free(buffer);
+
+    return ret;
+}
+
+static int resume_from_checkpoint(file_find_handle_t * tree, const char * path)
+{
+    FILE * const fh = fopen(path, "rb");
+    char * buffer = NULL;
+    size_t len = 0;
+    size_t num_read;
+    int ret;
+
+    if (! fh)
+    {
+        return FILE_FIND_INVALID_CHECKPOINT;
+    }
+
+    do
+    {
+        char * const new_buffer = realloc(buffer, len + 65536);
+
+        if (! new_buffer)
+        {
+            free(buffer);
+            fclose(fh);
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        buffer = new_buffer;
+        num_read = fread(buffer + len, 1, 65536, fh);
+        len += num_read;
+    } while (num_read == 65536);
+
+    fclose(fh);
+
+    ret = file_find_resume(tree, buffer, len);
+
+    free(buffer);
+
+    return ret;
+}
+
+/*
+ * Returns path relative to the target that contains it, or path itself.
+ * */
+static const char * relative_to_targets(
+    const char * path,
+    int num_targets,
+    char * * targets
+)
+{
+    for (int i = 0 ; i < num_targets ; i++)
+    {
+        size_t len = strlen(targets[i]);
+
+        while ((len > 1) && (targets[i][len - 1] == '/'))
+        {
+            len--;
+        }
+
+        if ((! strncmp(path, targets[i], len))
+            && ((path[len] == '/') || (targets[i][len - 1] == '/')))
+        {
+            return path + len + (path[len] == '/');
+        }
+    }
+
+    return path;
+}
+
+/*
+ * Reads lines of a cost, a tab and a path, like the output of --du.
+ * */
+static int read_shard_costs(
+    file_find_handle_t * tree,
+    const char * path,
+    int shard_depth,
+    int num_targets,
+    char * * targets
+)
+{
+    FILE * const fh = fopen(path, "r");
+    char * * paths = NULL;
+    unsigned long long * costs = NULL;
+    int num_subtrees = 0;
+    int max_num_subtrees = 0;
+    char * line = NULL;
+    size_t line_size = 0;
+    ssize_t line_len;
+    int ret = FILE_FIND_OUT_OF_MEMORY;
+
+    if (! fh)
+    {
+        return FILE_FIND_NOT_SUPPORTED;
+    }
+
+    while ((line_len = getline(&line, &line_size, fh)) >= 0)
+    {
+        char * const tab = strchr(line, '\t');
+
+        if (! tab)
+        {
+            continue;
+        }
+
+        if ((line_len > 0) && (line[line_len - 1] == '\n'))
+        {
+            line[line_len - 1] = '\0';
+        }
+
+        if (num_subtrees == max_num_subtrees)
+        {
+            max_num_subtrees = (max_num_subtrees ? max_num_subtrees * 2 : 64);
+
+            char * * const new_paths =
+                realloc(paths, sizeof(paths[0]) * max_num_subtrees);
+            unsigned long long * const new_costs =
+                (new_paths
+                 ? realloc(costs, sizeof(costs[0]) * max_num_subtrees)
+                 : NULL
+                );
+
+            if (new_paths)
+            {
+                paths = new_paths;
+            }
+
+            if (! new_costs)
+            {
+                goto cleanup;
+            }
+
+            costs = new_costs;
+        }
+
+        if (! (paths[num_subtrees] = strdup(
+                    shard_depth
+                    ? relative_to_targets(tab + 1, num_targets, targets)
+                    : (tab + 1)
+                )))
+        {
+            goto cleanup;
+        }
+
+        costs[num_subtrees++] = strtoull(line, NULL, 10);
+    }
+
+    ret = file_find_set_shard_costs(
+        tree, num_subtrees, (const char * const *)paths, costs
+    );
+
+cleanup:
+
+    fclose(fh);
+    free(line);
+
+    for (int i = 0 ; i < num_subtrees ; i++)
+    {
+        free(paths[i]);
+    }
+
+    free(paths);
+    free(costs);
+
+    return ret;
+}
+
+static void print_du_record(const file_find_du_record_t * record, void * context)
+{
+    /* Like du, in units of 1024 bytes. */
+    printf("%llu\t%s\n", ((record->blocks + 1) / 2), record->path);
+}
+
+/* The scores of --best-first. */
+static double score_by_mtime(const file_find_item_t * item, void * context)
+{
+    return (double)file_find_item_get_stat(item)->st_mtime;
+}
+
+static double score_by_size(const file_find_item_t * item, void * context)
+{
+    return (double)file_find_item_get_stat(item)->st_size;
+}
+
+/*
+ * Like -type of find(1): 'f', 'd' or 'l', or '\0' to match everything.
+ * */
+static int item_matches_type(const file_find_item_t * item, char type)
+{
+    switch (type)
+    {
+        case 'f':
+            return (file_find_item_is_file(item) && ! file_find_item_is_link(item));
+
+        case 'd':
+            return (file_find_item_is_dir(item) && ! file_find_item_is_link(item));
+
+        case 'l':
+            return file_find_item_is_link(item);
+
+        default:
+            return 1;
+    }
+}
+
+/*
+ * Whether the base name of item, the part of its path after the last '/',
+ * matches any of the globs of matcher.
+ * */
+static int item_matches_name(
+    const file_find_item_t * item,
+    file_find_matcher_t * matcher
+)
+{
+    const char * const path = file_find_item_get_path(item);
+    const char * const slash = strrchr(path, '/');
+
+    return file_find_matcher_match(matcher, (slash ? (slash + 1) : path));
+}
+
+#define GREP_BUFFER_SIZE (64 * 1024)
+
+static int buffer_contains(
+    const char * buf,
+    size_t len,
+    const char * needle,
+    size_t needle_len
+)
+{
+    for (size_t i = 0 ; i + needle_len <= len ; i++)
+    {
+        if ((buf[i] == needle[0]) && (! memcmp(buf + i, needle, needle_len)))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Whether the contents of the regular file item contain needle. The files
+ * are opened through backend, and the members of archives are read from
+ * the archive of tree, which is NULL when it is walked in the background.
+ * The contents are read in blocks that overlap by the length of needle
+ * minus one.
+ * */
+static int item_contains(
+    file_find_handle_t * tree,
+    const file_find_backend_t * backend,
+    const file_find_item_t * item,
+    const char * needle
+)
+{
+    static char buf[GREP_BUFFER_SIZE];
+    const size_t needle_len = strlen(needle);
+    file_find_archive_t * archive = NULL;
+    int fd = -1;
+    size_t kept = 0;
+    int found = 0;
+
+    if (! file_find_item_is_file(item))
+    {
+        return 0;
+    }
+
+    if (file_find_item_is_archive_member(item))
+    {
+        if (! (tree && (archive = file_find_get_archive(tree))))
+        {
+            return 0;
+        }
+    }
+    else if ((fd = backend->open(
+                    backend->context, file_find_item_get_path(item))) < 0)
+    {
+        return 0;
+    }
+
+    while (! found)
+    {
+        size_t num_read;
+
+        if (archive)
+        {
+            if (file_find_archive_read(
+                    archive, buf + kept, sizeof(buf) - kept, &num_read
+                ) != FILE_FIND_OK)
+            {
+                break;
+            }
+        }
+        else
+        {
+            const ssize_t ret = read(fd, buf + kept, sizeof(buf) - kept);
+
+            if (ret < 0)
+            {
+                break;
+            }
+            num_read = ret;
+        }
+
+        if (! num_read)
+        {
+            break;
+        }
+
+        const size_t len = kept + num_read;
+
+        found = buffer_contains(buf, len, needle, needle_len);
+
+        kept = ((len < needle_len - 1) ? len : (needle_len - 1));
+        memmove(buf, buf + len - kept, kept);
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return found;
+}
+
+/*
+ * Parses a comma-separated list of file_find_emit_field_names. Returns -1
+ * on an unknown field.
+ * */
+static int parse_emit_fields(const char * list, unsigned int * fields)
+{
+    *fields = 0;
+
+    while (*list)
+    {
+        const size_t len = strcspn(list, ",");
+        int i;
+
+        for (i = 0 ; i < FILE_FIND_EMIT_NUM_FIELDS ; i++)
+        {
+            if ((strlen(file_find_emit_field_names[i]) == len)
+                && (! strncmp(list, file_find_emit_field_names[i], len)))
+            {
+                *fields |= (1 << i);
+                break;
+            }
+        }
+
+        if (i == FILE_FIND_EMIT_NUM_FIELDS)
+        {
+            return -1;
+        }
+
+        list += len;
+
+        if (*list == ',')
+        {
+            list++;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Parses the name of a single emit field. Returns -1 if it is not one.
+ * */
+static int parse_emit_field(const char * name, unsigned int * field)
+{
+    if ((parse_emit_fields(name, field) != 0)
+        || (! *field) || (*field & (*field - 1)))
     {
-        fprintf(stderr, "%s\n", "Could not allocate file finder.");
         return -1;
     }
 
-    while (file_find_next(tree) == FILE_FIND_OK)
+    return 0;
+}
+
+static void print_top_report(file_find_top_t * top)
+{
+    const file_find_top_entry_t * entries;
+    int num_entries;
+
+    file_find_top_get_results(top, &num_entries, &entries);
+
+    for (int i = 0 ; i < num_entries ; i++)
+    {
+        printf("%lld\t%s\n", entries[i].value, entries[i].path);
+    }
+}
+
+static void print_quantiles_report(file_find_quantiles_t * quantiles)
+{
+    static const double phis[] = { 0, 0.5, 0.9, 0.99, 1 };
+    const char * const * names;
+    int num_groups;
+
+    file_find_quantiles_get_groups(quantiles, &num_groups, &names);
+
+    printf("%s\n", "group\tcount\tmin\tp50\tp90\tp99\tmax");
+
+    for (int i = 0 ; i < num_groups ; i++)
     {
-        puts(file_find_get_path(tree));
+        /* The items without an extension or a directory of their own. */
+        printf("%s", (names[i][0] ? names[i] : "-"));
+
+        for (size_t j = 0 ; j < sizeof(phis) / sizeof(phis[0]) ; j++)
+        {
+            long long value;
+            unsigned long long count;
+
+            file_find_quantiles_get(quantiles, names[i], phis[j], &value, &count);
+
+            if (! j)
+            {
+                printf("\t%llu", count);
+            }
+
+            printf("\t%lld", value);
+        }
+
+        printf("\n");
     }
+}
+
+static int print_estimate(
+    const char * target,
+    unsigned long long max_opendir,
+    unsigned int seed
+)
+{
+    file_find_estimate_t estimate;
 
-    if (file_find_free(tree) != FILE_FIND_OK)
+    if (file_find_estimate(target, max_opendir, seed, &estimate) != FILE_FIND_OK)
     {
-        fprintf(stderr, "%s\n", "Not succesful in freeing the finder.");
         return -1;
     }
 
-    tree = NULL;
+    const struct
+    {
+        const char * name;
+        const file_find_estimate_value_t * value;
+    } values[] =
+    {
+        { "items", &estimate.num_items },
+        { "files", &estimate.num_files },
+        { "bytes", &estimate.num_bytes },
+    };
+
+    for (size_t i = 0 ; i < sizeof(values) / sizeof(values[0]) ; i++)
+    {
+        printf("%s\t%s\t%.0f\t%.0f\t%.0f\n",
+            target, values[i].name,
+            values[i].value->value, values[i].value->low, values[i].value->high
+        );
+    }
+
+    fprintf(stderr, "%s: %llu opendir, %llu probes, %d levels listed%s\n",
+        target, estimate.num_opendir, estimate.num_probes,
+        estimate.exact_depth, (estimate.is_exact ? " (exact)" : "")
+    );
 
     return 0;
 }
+
+static void print_stats(file_find_handle_t * tree)
+{
+    file_find_stats_t stats;
+
+    file_find_get_stats(tree, &stats);
+
+#define PRINT_COUNT_AND_TIME(name, count, ns) \
+    fprintf(stderr, "%-16s %12llu %16llu ns\n", name, stats.count, stats.ns)
+
+    PRINT_COUNT_AND_TIME("opendir", num_opendir, opendir_ns);
+    PRINT_COUNT_AND_TIME("readdir", num_readdir, readdir_ns);
+    PRINT_COUNT_AND_TIME("stat", num_stat, stat_ns);
+    PRINT_COUNT_AND_TIME("sort", num_sort, sort_ns);
+    PRINT_COUNT_AND_TIME("inode_lookup", num_inode_lookups, inode_lookup_ns);
+    PRINT_COUNT_AND_TIME("callback", num_callbacks, callback_ns);
+    PRINT_COUNT_AND_TIME("consumer", num_items, consumer_ns);
+
+#undef PRINT_COUNT_AND_TIME
+
+    fprintf(stderr, "%-16s %12llu\n", "spilled_runs", stats.num_spilled_runs);
+    fprintf(stderr, "%-16s %12llu\n", "spilled_dirs", stats.num_spilled_dirs);
+    fprintf(stderr, "%-16s %12llu\n", "prefetch_hits", stats.num_prefetch_hits);
+    fprintf(stderr, "%-16s %12llu\n", "prefetch_misses", stats.num_prefetch_misses);
+    fprintf(stderr, "%-16s %12llu\n", "archives", stats.num_archives);
+    fprintf(stderr, "%-16s %12llu\n", "archive_members", stats.num_archive_members);
+    fprintf(stderr, "%-16s %12llu\n", "archive_errors", stats.num_archive_errors);
+    fprintf(stderr, "%-16s %12llu\n", "link_cache_hits", stats.num_link_cache_hits);
+    fprintf(stderr, "%-16s %12llu\n", "hard_links", stats.num_hard_links_tracked);
+    fprintf(stderr, "%-16s %12llu\n", "hard_links_bytes", stats.hard_links_bytes);
+    fprintf(stderr, "%-16s %12llu\n", "dup_links", stats.num_dup_links);
+    fprintf(stderr, "%-16s %12llu\n", "max_depth", stats.max_depth);
+    fprintf(stderr, "%-16s %12llu\n", "peak_dir_stack", stats.peak_dir_stack_len);
+    fprintf(stderr, "%-16s %12llu\n", "peak_bytes", stats.peak_listing_bytes);
+    fprintf(stderr, "%-16s %12llu\n", "peak_roots_queue", stats.peak_roots_queue_len);
+}
+
+/*
+ * Either waits for the next item of the background walk of async, or
+ * walks the finder in slices of up to budget_entries entries, the way an
+ * event loop would, or just walks it.
+ * */
+static int next_item(
+    file_find_handle_t * tree,
+    file_find_async_t * async,
+    unsigned long long budget_entries,
+    file_find_item_t * * async_item
+)
+{
+    int ret;
+
+    if (async)
+    {
+        if (*async_item)
+        {
+            file_find_item_free(*async_item);
+        }
+
+        while ((ret = file_find_async_next(async, async_item))
+                == FILE_FIND_AGAIN)
+        {
+            struct pollfd pfd = { file_find_async_get_fd(async), POLLIN, 0 };
+
+            poll(&pfd, 1, -1);
+        }
+
+        return ret;
+    }
+
+    if (budget_entries)
+    {
+        while ((ret = file_find_next_with_budget(tree, budget_entries, 0))
+                == FILE_FIND_AGAIN)
+        {
+            /* The other work of the event loop would go here. */
+        }
+
+        return ret;
+    }
+
+    return file_find_next(tree);
+}
+
+typedef struct
+{
+    int should_find_dups;
+    int should_calc_du;
+    int should_print_stats;
+    int should_only_count;
+    int should_traverse_depth_first;
+    int should_sort;
+    int should_stat_in_inode_order;
+    unsigned long long max_listing_bytes;
+    int prefetch_num_dirs;
+    int prefetch_num_threads;
+    int should_follow_link;
+    int should_enter_dirs_once;
+    int should_not_cross_fs;
+    int hard_links_mode;
+    /* Point into argv. NULL until the first --skip-fs-type. */
+    const char * * skip_fs_types;
+    int num_skip_fs_types;
+    int num_threads;
+    int roots_order;
+    char type;
+    /* -1 for the plain output, with " (hard link)" markers. */
+    int emit_format;
+    unsigned int emit_fields;
+    unsigned long long estimate_max_opendir;
+    unsigned int estimate_seed;
+    int top_k;
+    unsigned int top_field;
+    int should_keep_smallest;
+    unsigned int quantiles_field;
+    int quantiles_group_by;
+    const char * checkpoint_path;
+    const char * resume_path;
+    unsigned long long stop_after;
+    int shard_index;
+    int num_shards;
+    int should_walk_async;
+    int should_enter_archives;
+    const char * grep_needle;
+    file_find_matcher_t * name_matcher;
+    double (*dir_score)(const file_find_item_t * item, void * context);
+    int should_traverse_breadth_first;
+    unsigned long long max_frontier_bytes;
+    unsigned long long budget_entries;
+    int shard_depth;
+    const char * shard_costs_path;
+    const file_find_backend_t * backend;
+    int memory_num_subdirs;
+    int memory_num_files;
+    int memory_depth;
+} minifind_options_t;
+
+static void minifind_options_free(minifind_options_t * const options)
+{
+    free(options->skip_fs_types);
+    options->skip_fs_types = NULL;
+
+    if (options->name_matcher)
+    {
+        file_find_matcher_free(options->name_matcher);
+        options->name_matcher = NULL;
+    }
+
+    return;
+}
+
+/*
+ * Returns the option for which file_find_checkpoint() and file_find_resume()
+ * return FILE_FIND_NOT_SUPPORTED.
+ * */
+static const char * checkpoint_conflict(
+    const minifind_options_t * const options,
+    const int num_targets
+)
+{
+    if (! options->should_sort)
+    {
+        return "--unsorted";
+    }
+    else if ((options->num_threads != 1) && (num_targets > 1))
+    {
+        return "--threads";
+    }
+    else if (options->should_calc_du)
+    {
+        return "--du";
+    }
+    else if (options->hard_links_mode != FILE_FIND_HARD_LINKS_ALL)
+    {
+        return "--hard-links";
+    }
+    else if (options->should_enter_dirs_once)
+    {
+        return "--unique";
+    }
+    else if (options->dir_score)
+    {
+        return "--best-first";
+    }
+    else if (options->should_traverse_breadth_first)
+    {
+        return "--breadth-first";
+    }
+    else if (options->should_enter_archives)
+    {
+        return "--archives";
+    }
+
+    return "these options";
+}
+
+/*
+ * Fills *options from the command line, and returns the index of the first
+ * target, or -1 after printing the error. Either way, *options is to be
+ * freed by minifind_options_free().
+ * */
+static int parse_options(
+    int argc,
+    char * argv[],
+    minifind_options_t * const options
+)
+{
+    int arg_idx = 1;
+
+    memset(options, '\0', sizeof(*options));
+    options->should_sort = 1;
+    options->prefetch_num_threads = 1;
+    options->hard_links_mode = FILE_FIND_HARD_LINKS_ALL;
+    options->num_threads = 1;
+    options->roots_order = FILE_FIND_ROOTS_IN_TARGET_ORDER;
+    options->emit_format = -1;
+    options->emit_fields =
+        (FILE_FIND_EMIT_FIELD_SIZE | FILE_FIND_EMIT_FIELD_MTIME
+         | FILE_FIND_EMIT_FIELD_MODE);
+    options->quantiles_group_by = FILE_FIND_REPORT_GROUP_NONE;
+    options->num_shards = 1;
+    options->shard_depth = 1;
+    options->backend = file_find_backend_posix();
+    options->memory_depth = -1;
+
+    while ((arg_idx < argc) && (argv[arg_idx][0] == '-'))
+    {
+        const char * const arg = argv[arg_idx++];
+
+        if (! strcmp(arg, "--"))
+        {
+            break;
+        }
+        else if (! strcmp(arg, "--dups"))
+        {
+            options->should_find_dups = 1;
+        }
+        else if (! strcmp(arg, "--du"))
+        {
+            options->should_calc_du = 1;
+        }
+        else if (! strcmp(arg, "--stats"))
+        {
+            options->should_print_stats = 1;
+        }
+        else if (! strcmp(arg, "--count"))
+        {
+            options->should_only_count = 1;
+        }
+        else if (! strcmp(arg, "--depth-first"))
+        {
+            options->should_traverse_depth_first = 1;
+        }
+        else if (! strcmp(arg, "--best-first"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--best-first requires an argument.");
+                return -1;
+            }
+
+            const char * const score = argv[arg_idx++];
+
+            if (! strcmp(score, "mtime"))
+            {
+                options->dir_score = score_by_mtime;
+            }
+            else if (! strcmp(score, "size"))
+            {
+                options->dir_score = score_by_size;
+            }
+            else
+            {
+                fprintf(stderr, "%s\n", "--best-first requires mtime or size.");
+                return -1;
+            }
+        }
+        else if (! strcmp(arg, "--breadth-first"))
+        {
+            options->should_traverse_breadth_first = 1;
+        }
+        else if (! strcmp(arg, "--max-frontier-bytes"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--max-frontier-bytes requires an argument.");
+                return -1;
+            }
+            options->max_frontier_bytes = strtoull(argv[arg_idx++], NULL, 10);
+        }
+        else if (! strcmp(arg, "--unsorted"))
+        {
+            options->should_sort = 0;
+        }
+        else if (! strcmp(arg, "--inode-order"))
+        {
+            options->should_stat_in_inode_order = 1;
+        }
+        else if (! strcmp(arg, "--max-listing-bytes"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--max-listing-bytes requires an argument.");
+                return -1;
+            }
+            options->max_listing_bytes = strtoull(argv[arg_idx++], NULL, 10);
+        }
+        else if (! strcmp(arg, "--prefetch"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--prefetch requires an argument.");
+                return -1;
+            }
+            options->prefetch_num_dirs = atoi(argv[arg_idx++]);
+        }
+        else if (! strcmp(arg, "--prefetch-threads"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--prefetch-threads requires an argument.");
+                return -1;
+            }
+            options->prefetch_num_threads = atoi(argv[arg_idx++]);
+        }
+        else if (! strcmp(arg, "--threads"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--threads requires an argument.");
+                return -1;
+            }
+            options->num_threads = atoi(argv[arg_idx++]);
+        }
+        else if (! strcmp(arg, "--type"))
+        {
+            if ((arg_idx >= argc) || (! argv[arg_idx][0])
+                || argv[arg_idx][1] || (! strchr("fdl", argv[arg_idx][0])))
+            {
+                fprintf(stderr, "%s\n", "--type requires f, d or l.");
+                return -1;
+            }
+            options->type = argv[arg_idx++][0];
+        }
+        else if (! strcmp(arg, "--follow"))
+        {
+            options->should_follow_link = 1;
+        }
+        else if (! strcmp(arg, "--unique"))
+        {
+            options->should_enter_dirs_once = 1;
+        }
+        else if (! strcmp(arg, "--hard-links"))
+        {
+            if ((arg_idx < argc) && (! strcmp(argv[arg_idx], "flag")))
+            {
+                options->hard_links_mode = FILE_FIND_HARD_LINKS_FLAG;
+            }
+            else if ((arg_idx < argc) && (! strcmp(argv[arg_idx], "once")))
+            {
+                options->hard_links_mode = FILE_FIND_HARD_LINKS_SUPPRESS;
+            }
+            else
+            {
+                fprintf(stderr, "%s\n", "--hard-links requires flag or once.");
+                return -1;
+            }
+            arg_idx++;
+        }
+        else if (! strcmp(arg, "--xdev"))
+        {
+            options->should_not_cross_fs = 1;
+        }
+        else if (! strcmp(arg, "--skip-fs-type"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--skip-fs-type requires an argument.");
+                return -1;
+            }
+            /* There are fewer of them than arguments. */
+            if ((! options->skip_fs_types)
+                && (! (options->skip_fs_types =
+                        malloc(sizeof(options->skip_fs_types[0]) * argc))))
+            {
+                fprintf(stderr, "%s\n", "Could not allocate the file system types.");
+                return -1;
+            }
+
+            options->skip_fs_types[options->num_skip_fs_types++] = argv[arg_idx++];
+        }
+        else if (! strcmp(arg, "-0"))
+        {
+            options->emit_format = FILE_FIND_EMIT_NUL;
+        }
+        else if (! strcmp(arg, "--format"))
+        {
+            const char * const format = ((arg_idx < argc) ? argv[arg_idx++] : "");
+
+            if (! strcmp(format, "lines"))
+            {
+                options->emit_format = FILE_FIND_EMIT_LINES;
+            }
+            else if (! strcmp(format, "nul"))
+            {
+                options->emit_format = FILE_FIND_EMIT_NUL;
+            }
+            else if (! strcmp(format, "jsonl"))
+            {
+                options->emit_format = FILE_FIND_EMIT_JSON_LINES;
+            }
+            else if (! strcmp(format, "columnar"))
+            {
+                options->emit_format = FILE_FIND_EMIT_COLUMNAR;
+            }
+            else
+            {
+                fprintf(stderr, "%s\n",
+                    "--format requires lines, nul, jsonl or columnar.");
+                return -1;
+            }
+        }
+        else if (! strcmp(arg, "--fields"))
+        {
+            if ((arg_idx >= argc)
+                || (parse_emit_fields(argv[arg_idx++], &options->emit_fields) != 0))
+            {
+                fprintf(stderr, "%s\n",
+                    "--fields requires a comma-separated list of size, mtime,"
+                    " mode, ino, dev, nlink, uid, gid or blocks.");
+                return -1;
+            }
+        }
+        else if (! strcmp(arg, "--estimate"))
+        {
+            if ((arg_idx >= argc)
+                || (! (options->estimate_max_opendir =
+                        strtoull(argv[arg_idx++], NULL, 10))))
+            {
+                fprintf(stderr, "%s\n", "--estimate requires a number of directories.");
+                return -1;
+            }
+        }
+        else if (! strcmp(arg, "--seed"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--seed requires an argument.");
+                return -1;
+            }
+            options->estimate_seed = strtoul(argv[arg_idx++], NULL, 10);
+        }
+        else if ((! strcmp(arg, "--top")) || (! strcmp(arg, "--bottom")))
+        {
+            options->should_keep_smallest = (! strcmp(arg, "--bottom"));
+
+            if ((arg_idx + 1 >= argc)
+                || ((options->top_k = atoi(argv[arg_idx++])) <= 0)
+                || (parse_emit_field(argv[arg_idx++], &options->top_field) != 0))
+            {
+                fprintf(stderr, "%s requires a count and a field.\n", arg);
+                return -1;
+            }
+        }
+        else if (! strcmp(arg, "--quantiles"))
+        {
+            const char * group_by;
+
+            if ((arg_idx + 1 >= argc)
+                || (parse_emit_field(argv[arg_idx++], &options->quantiles_field) != 0))
+            {
+                fprintf(stderr, "%s\n", "--quantiles requires a field and all, ext or top.");
+                return -1;
+            }
+
+            group_by = argv[arg_idx++];
+
+            if (! strcmp(group_by, "all"))
+            {
+                options->quantiles_group_by = FILE_FIND_REPORT_GROUP_NONE;
+            }
+            else if (! strcmp(group_by, "ext"))
+            {
+                options->quantiles_group_by = FILE_FIND_REPORT_GROUP_EXTENSION;
+            }
+            else if (! strcmp(group_by, "top"))
+            {
+                options->quantiles_group_by = FILE_FIND_REPORT_GROUP_TOP_DIR;
+            }
+            else
+            {
+                fprintf(stderr, "%s\n", "--quantiles requires a field and all, ext or top.");
+                return -1;
+            }
+        }
+        else if (! strcmp(arg, "--as-ready"))
+        {
+            options->roots_order = FILE_FIND_ROOTS_AS_READY;
+        }
+        else if (! strcmp(arg, "--checkpoint"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--checkpoint requires an argument.");
+                return -1;
+            }
+            options->checkpoint_path = argv[arg_idx++];
+        }
+        else if (! strcmp(arg, "--resume"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--resume requires an argument.");
+                return -1;
+            }
+            options->resume_path = argv[arg_idx++];
+        }
+        else if (! strcmp(arg, "--shard"))
+        {
+            if ((arg_idx >= argc)
+                || (sscanf(argv[arg_idx++], "%d/%d",
+                        &options->shard_index, &options->num_shards
+                    ) != 2))
+            {
+                fprintf(stderr, "%s\n", "--shard requires K/N.");
+                return -1;
+            }
+        }
+        else if (! strcmp(arg, "--shard-depth"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--shard-depth requires an argument.");
+                return -1;
+            }
+            options->shard_depth = atoi(argv[arg_idx++]);
+        }
+        else if (! strcmp(arg, "--shard-costs"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--shard-costs requires an argument.");
+                return -1;
+            }
+            options->shard_costs_path = argv[arg_idx++];
+        }
+        else if (! strcmp(arg, "--stop-after"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--stop-after requires an argument.");
+                return -1;
+            }
+            options->stop_after = strtoull(argv[arg_idx++], NULL, 10);
+        }
+        else if (! strcmp(arg, "--archives"))
+        {
+            options->should_enter_archives = 1;
+        }
+        else if (! strcmp(arg, "--grep"))
+        {
+            if ((arg_idx >= argc) || (! argv[arg_idx][0])
+                || (strlen(argv[arg_idx]) >= GREP_BUFFER_SIZE / 2))
+            {
+                fprintf(stderr, "%s\n", "--grep requires a string.");
+                return -1;
+            }
+            options->grep_needle = argv[arg_idx++];
+        }
+        else if (! strcmp(arg, "--name"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--name requires a glob.");
+                return -1;
+            }
+
+            if ((! options->name_matcher)
+                && (file_find_matcher_new(&options->name_matcher) != FILE_FIND_OK))
+            {
+                fprintf(stderr, "%s\n", "Could not allocate the name matcher.");
+                return -1;
+            }
+
+            if (file_find_matcher_add_glob(options->name_matcher, argv[arg_idx++])
+                    != FILE_FIND_OK)
+            {
+                fprintf(stderr, "Invalid glob \"%s\".\n", argv[arg_idx - 1]);
+                return -1;
+            }
+        }
+        else if (! strcmp(arg, "--backend"))
+        {
+            const char * const name = ((arg_idx < argc) ? argv[arg_idx++] : "");
+
+            if (! strcmp(name, "posix"))
+            {
+                options->backend = file_find_backend_posix();
+            }
+            else if (! strcmp(name, "getdents"))
+            {
+                options->backend = file_find_backend_getdents();
+            }
+            else
+            {
+                fprintf(stderr, "%s\n", "--backend requires posix or getdents.");
+                return -1;
+            }
+        }
+        else if (! strcmp(arg, "--memory-tree"))
+        {
+            if ((arg_idx >= argc)
+                || (sscanf(argv[arg_idx++], "%d,%d,%d",
+                        &options->memory_num_subdirs, &options->memory_num_files, &options->memory_depth
+                    ) != 3)
+                || (options->memory_num_subdirs < 0) || (options->memory_num_files < 0)
+                || (options->memory_depth < 0))
+            {
+                fprintf(stderr, "%s\n", "--memory-tree requires SUBDIRS,FILES,DEPTH.");
+                return -1;
+            }
+        }
+        else if (! strcmp(arg, "--async"))
+        {
+            options->should_walk_async = 1;
+        }
+        else if (! strcmp(arg, "--budget"))
+        {
+            if (arg_idx >= argc)
+            {
+                fprintf(stderr, "%s\n", "--budget requires an argument.");
+                return -1;
+            }
+            options->budget_entries = strtoull(argv[arg_idx++], NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option \"%s\".\n", arg);
+            return -1;
+        }
+    }
+
+    if (arg_idx >= argc)
+    {
+        fprintf(stderr, "%s\n",
+            "Usage: minifind [--dups|--du|--count] [--depth-first|--best-first mtime|size"
+            "|--breadth-first [--max-frontier-bytes N]] [--unsorted] [--inode-order] [--max-listing-bytes N]"
+            " [--prefetch N [--prefetch-threads N]] [--threads N [--as-ready]]"
+            " [--follow] [--unique] [--hard-links flag|once]"
+            " [--xdev] [--skip-fs-type TYPE]... [--archives]"
+            " [--type f|d|l] [--name GLOB]... [--grep STRING] [-0|--format lines|nul|jsonl|columnar]"
+            " [--fields FIELD,...] [--top|--bottom K FIELD]"
+            " [--quantiles FIELD all|ext|top] [--checkpoint FILE [--stop-after N]]"
+            " [--resume FILE] [--shard K/N [--shard-depth D]"
+            " [--shard-costs FILE]] [--async|--budget N] [--stats]"
+            " [--backend posix|getdents|--memory-tree SUBDIRS,FILES,DEPTH]"
+            " [--estimate N [--seed S]]"
+            " path [path...]"
+        );
+        return -1;
+    }
+
+    return arg_idx;
+}
+
+int main(int argc, char * argv[])
+{
+    minifind_options_t options;
+    file_find_handle_t * tree = NULL;
+    file_find_dups_handle_t * dups = NULL;
+    file_find_emitter_t * emitter = NULL;
+    file_find_top_t * top = NULL;
+    file_find_quantiles_t * quantiles = NULL;
+    unsigned long long num_items = 0;
+    unsigned long long num_walked = 0;
+    time_t last_checkpoint_time = time(NULL);
+    file_find_async_t * async = NULL;
+    file_find_item_t * async_item = NULL;
+    file_find_memory_tree_t * memory_tree = NULL;
+    int ret = -1;
+    int arg_idx = parse_options(argc, argv, &options);
+
+    if (arg_idx < 0)
+    {
+        goto cleanup;
+    }
+
+    /* Only estimates the sizes of the targets, without walking them. */
+    if (options.estimate_max_opendir)
+    {
+        for ( ; arg_idx < argc ; arg_idx++)
+        {
+            if (print_estimate(
+                    argv[arg_idx], options.estimate_max_opendir,
+                    options.estimate_seed
+                ) != 0)
+            {
+                fprintf(stderr, "%s\n", "Could not estimate the size.");
+                goto cleanup;
+            }
+        }
+
+        ret = 0;
+        goto cleanup;
+    }
+
+    const int first_target_idx = arg_idx;
+
+    /* The targets are paths in a synthetic tree, e.g: "/" for its root. */
+    if (options.memory_depth >= 0)
+    {
+        if (options.should_find_dups)
+        {
+            fprintf(stderr, "%s\n", "--memory-tree cannot be used with --dups.");
+            goto cleanup;
+        }
+
+        if ((file_find_memory_tree_new(&memory_tree) != FILE_FIND_OK)
+            || (file_find_memory_tree_add_synthetic(
+                    memory_tree, "", options.memory_num_subdirs,
+                    options.memory_num_files,
+                    options.memory_depth
+                ) != FILE_FIND_OK)
+            || (! (options.backend = file_find_memory_tree_get_backend(memory_tree))))
+        {
+            fprintf(stderr, "%s\n", "Could not build the memory tree.");
+            goto cleanup;
+        }
+    }
+
+    if (options.name_matcher
+        && (file_find_matcher_compile(options.name_matcher) != FILE_FIND_OK))
+    {
+        fprintf(stderr, "%s\n", "Could not compile the name matcher.");
+        goto cleanup;
+    }
+
+    if (file_find_new_with_backend(&tree, argv[arg_idx], options.backend)
+            != FILE_FIND_OK)
+    {
+        fprintf(stderr, "%s\n", "Could not allocate file finder.");
+        goto cleanup;
+    }
+
+    while (++arg_idx < argc)
+    {
+        if (file_find_add_target(tree, argv[arg_idx]) != FILE_FIND_OK)
+        {
+            fprintf(stderr, "%s\n", "Could not add a target.");
+            goto cleanup;
+        }
+    }
+
+    if (options.num_threads != 1)
+    {
+        file_find_set_parallel_roots(tree, options.num_threads, options.roots_order);
+    }
+
+    file_find_set_should_traverse_depth_first(tree, options.should_traverse_depth_first);
+
+    if (options.dir_score
+        && (file_find_set_best_first(tree, options.dir_score, NULL)
+            != FILE_FIND_OK))
+    {
+        fprintf(stderr, "%s\n", "Could not set the best-first order.");
+        goto cleanup;
+    }
+
+    if (options.should_traverse_breadth_first
+        && (file_find_set_breadth_first(tree, 1, options.max_frontier_bytes)
+            != FILE_FIND_OK))
+    {
+        fprintf(stderr, "%s\n", "Could not set the breadth-first order.");
+        goto cleanup;
+    }
+
+    file_find_set_should_sort(tree, options.should_sort);
+    file_find_set_should_stat_in_inode_order(tree, options.should_stat_in_inode_order);
+    file_find_set_max_listing_bytes(tree, options.max_listing_bytes);
+    file_find_set_prefetch(
+        tree, options.prefetch_num_dirs, options.prefetch_num_threads
+    );
+    file_find_set_should_follow_link(tree, options.should_follow_link);
+    file_find_set_should_enter_dirs_once(tree, options.should_enter_dirs_once);
+    file_find_set_hard_links(tree, options.hard_links_mode);
+    file_find_set_no_cross_fs(tree, options.should_not_cross_fs);
+
+    if (file_find_set_archives(tree, options.should_enter_archives) != FILE_FIND_OK)
+    {
+        fprintf(stderr, "%s\n", "Could not enter the archives.");
+        goto cleanup;
+    }
+
+    if (file_find_set_skip_fs_types(
+            tree, options.num_skip_fs_types, options.skip_fs_types)
+            != FILE_FIND_OK)
+    {
+        fprintf(stderr, "%s\n", "Could not set the file system types to skip.");
+        goto cleanup;
+    }
+
+    if (file_find_set_shard(
+            tree, options.shard_index, options.num_shards, options.shard_depth)
+            != FILE_FIND_OK)
+    {
+        fprintf(stderr, "%s\n", "Invalid shard.");
+        goto cleanup;
+    }
+
+    if (options.shard_costs_path && (options.num_shards > 1)
+        && (read_shard_costs(
+                tree, options.shard_costs_path, options.shard_depth,
+                argc - first_target_idx, argv + first_target_idx
+            ) != FILE_FIND_OK))
+    {
+        fprintf(stderr, "%s\n", "Could not read the shard costs.");
+        goto cleanup;
+    }
+
+    if (options.should_calc_du)
+    {
+        file_find_set_du_callback(tree, print_du_record, NULL);
+    }
+
+    if (options.should_find_dups)
+    {
+        if (file_find_dups_new(&dups, 0) != FILE_FIND_OK)
+        {
+            fprintf(stderr, "%s\n", "Could not allocate duplicates finder.");
+            goto cleanup;
+        }
+    }
+
+    if (options.top_k
+        && (file_find_top_new(
+                &top, options.top_k, options.top_field, options.should_keep_smallest
+            ) != FILE_FIND_OK))
+    {
+        fprintf(stderr, "%s\n", "Could not allocate the top report.");
+        goto cleanup;
+    }
+
+    if (options.quantiles_field
+        && (file_find_quantiles_new(
+                &quantiles, 0, options.quantiles_field, options.quantiles_group_by
+            ) != FILE_FIND_OK))
+    {
+        fprintf(stderr, "%s\n", "Could not allocate the quantiles report.");
+        goto cleanup;
+    }
+
+    if ((options.emit_format >= 0)
+        && (file_find_emitter_new(
+                &emitter, fileno(stdout), options.emit_format, options.emit_fields
+            ) != FILE_FIND_OK))
+    {
+        fprintf(stderr, "%s\n", "Could not allocate the emitter.");
+        goto cleanup;
+    }
+
+    if (options.resume_path)
+    {
+        const int status = resume_from_checkpoint(tree, options.resume_path);
+
+        if (status == FILE_FIND_NOT_SUPPORTED)
+        {
+            fprintf(stderr, "--resume cannot be used with %s.\n",
+                checkpoint_conflict(&options, argc - first_target_idx));
+            goto cleanup;
+        }
+        else if (status != FILE_FIND_OK)
+        {
+            fprintf(stderr, "%s\n", "Could not resume from the checkpoint.");
+            goto cleanup;
+        }
+    }
+
+    /* Fails before the walk rather than at its first checkpoint. */
+    if (options.checkpoint_path)
+    {
+        char * buffer = NULL;
+        size_t len;
+        const int status = file_find_checkpoint(tree, &buffer, &len);
+
+        if (status == FILE_FIND_NOT_SUPPORTED)
+        {
+            fprintf(stderr, "--checkpoint cannot be used with %s.\n",
+                checkpoint_conflict(&options, argc - first_target_idx));
+            goto cleanup;
+        }
+        else if (status != FILE_FIND_OK)
+        {
+            fprintf(stderr, "%s\n", "Could not take a checkpoint.");
+            goto cleanup;
+        }
+
+        free(buffer);
+    }
+
+    if (options.budget_entries && (options.num_threads != 1))
+    {
+        fprintf(stderr, "%s\n", "--budget cannot be used with --threads.");
+        goto cleanup;
+    }
+
+    /* The finder belongs to the walking thread until it is freed. */
+    if (options.should_walk_async)
+    {
+        if (dups || options.checkpoint_path)
+        {
+            fprintf(stderr, "%s\n",
+                "--async cannot be used with --dups or --checkpoint.");
+            goto cleanup;
+        }
+
+        if (file_find_async_new(&async, tree, 0) != FILE_FIND_OK)
+        {
+            fprintf(stderr, "%s\n", "Could not start the background walk.");
+            goto cleanup;
+        }
+    }
+
+    while (next_item(tree, async, options.budget_entries, &async_item)
+            == FILE_FIND_OK)
+    {
+        const file_find_item_t * const item =
+            (async ? async_item : file_find_get_item(tree));
+
+        num_walked++;
+
+        /* Every second, and when interrupted by --stop-after. */
+        if (options.checkpoint_path
+            && ((options.stop_after && (num_walked == options.stop_after))
+                || (time(NULL) != last_checkpoint_time)))
+        {
+            if (write_checkpoint(tree, options.checkpoint_path) != FILE_FIND_OK)
+            {
+                fprintf(stderr, "%s\n", "Could not write the checkpoint.");
+                goto cleanup;
+            }
+
+            last_checkpoint_time = time(NULL);
+        }
+
+        if (! item_matches_type(item, options.type))
+        {
+            continue;
+        }
+
+        if (options.name_matcher && (! item_matches_name(item, options.name_matcher)))
+        {
+            continue;
+        }
+
+        if (options.grep_needle
+            && (! item_contains(
+                    (async ? NULL : tree), options.backend, item,
+                    options.grep_needle)))
+        {
+            continue;
+        }
+
+        if (dups)
+        {
+            if (file_find_dups_add_current(dups, tree) != FILE_FIND_OK)
+            {
+                fprintf(stderr, "%s\n", "Out of memory in the duplicates finder.");
+                goto cleanup;
+            }
+        }
+        else if (top || quantiles)
+        {
+            if ((top && (file_find_top_add(top, item) != FILE_FIND_OK))
+                || (quantiles
+                    && (file_find_quantiles_add(quantiles, item) != FILE_FIND_OK)))
+            {
+                fprintf(stderr, "%s\n", "Out of memory in the reports.");
+                goto cleanup;
+            }
+        }
+        else if (options.should_only_count)
+        {
+            num_items++;
+        }
+        else if (emitter)
+        {
+            if (file_find_emitter_add(emitter, item) != FILE_FIND_OK)
+            {
+                break;
+            }
+        }
+        else
+        {
+            printf("%s%s\n",
+                file_find_item_get_path(item),
+                (file_find_item_is_dup_link(item) ? " (hard link)" : "")
+            );
+        }
+
+        if (options.stop_after && (num_walked == options.stop_after))
+        {
+            break;
+        }
+    }
+
+    if (async)
+    {
+        if (async_item)
+        {
+            file_find_item_free(async_item);
+            async_item = NULL;
+        }
+
+        file_find_async_free(async);
+        async = NULL;
+    }
+
+    /* The walk is over, so resuming it returns nothing. */
+    if (options.checkpoint_path && (num_walked != options.stop_after)
+        && (write_checkpoint(tree, options.checkpoint_path) != FILE_FIND_OK))
+    {
+        fprintf(stderr, "%s\n", "Could not write the checkpoint.");
+        goto cleanup;
+    }
+
+    if (options.should_only_count)
+    {
+        printf("%llu\n", num_items);
+    }
+
+    if (emitter)
+    {
+        file_find_emitter_t * const to_free = emitter;
+
+        emitter = NULL;
+
+        if (file_find_emitter_free(to_free) != FILE_FIND_OK)
+        {
+            fprintf(stderr, "%s\n", "Could not write the output.");
+            goto cleanup;
+        }
+    }
+
+    if (top)
+    {
+        print_top_report(top);
+        file_find_top_free(top);
+        top = NULL;
+    }
+
+    if (quantiles)
+    {
+        print_quantiles_report(quantiles);
+        file_find_quantiles_free(quantiles);
+        quantiles = NULL;
+    }
+
+    if (dups)
+    {
+        if (file_find_dups_finish(dups, print_dups_group, NULL) != FILE_FIND_OK)
+        {
+            fprintf(stderr, "%s\n", "Could not finish finding the duplicates.");
+            goto cleanup;
+        }
+        file_find_dups_free(dups);
+        dups = NULL;
+    }
+
+    if (options.should_print_stats)
+    {
+        print_stats(tree);
+    }
+
+    {
+        file_find_handle_t * const to_free = tree;
+
+        tree = NULL;
+
+        if (file_find_free(to_free) != FILE_FIND_OK)
+        {
+            fprintf(stderr, "%s\n", "Not succesful in freeing the finder.");
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+cleanup:
+    /* The background walk owns the finder until it is freed. */
+    if (async)
+    {
+        if (async_item)
+        {
+            file_find_item_free(async_item);
+        }
+
+        file_find_async_free(async);
+    }
+
+    if (emitter)
+    {
+        file_find_emitter_free(emitter);
+    }
+
+    if (top)
+    {
+        file_find_top_free(top);
+    }
+
+    if (quantiles)
+    {
+        file_find_quantiles_free(quantiles);
+    }
+
+    if (dups)
+    {
+        file_find_dups_free(dups);
+    }
+
+    if (tree)
+    {
+        file_find_free(tree);
+    }
+
+    if (memory_tree)
+    {
+        file_find_memory_tree_free(memory_tree);
+    }
+
+    minifind_options_free(&options);
+
+    return ret;
+}
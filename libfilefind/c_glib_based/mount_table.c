@@ -0,0 +1,252 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  mount_table.c
+ *
+ *    Description:  a table of the mounted file systems, by their device.
+ *
+ *        Created:  19/10/26 20:47:12
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+#include "mount_table.h"
+
+typedef struct
+{
+    /* The key of devs. */
+    guint64 dev;
+    gchar * fs_type;
+    guint num_mounts;
+} mount_dev_type;
+
+struct mount_table_struct
+{
+    /* Of mount_dev_type, by dev. */
+    GHashTable * devs;
+    /* The unescaped mount points. */
+    GHashTable * mount_points;
+};
+
+static void mount_dev_free(gpointer data)
+{
+    mount_dev_type * const mount_dev = (mount_dev_type *)data;
+
+    g_free(mount_dev->fs_type);
+    g_free(mount_dev);
+
+    return;
+}
+
+#ifdef G_OS_UNIX
+
+/*
+ * A line looks like:
+ *
+ * 36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1 - ext3 /dev/root rw
+ *
+ * Where the fields after the mount point and before the " - " separator
+ * are optional, and the file system type comes right after it.
+ * */
+static gboolean mount_table_add_line(
+    mount_table_t * const self,
+    const gchar * const line
+)
+{
+    guint major, minor;
+    gboolean ret = TRUE;
+
+    gchar * * const fields = g_strsplit(line, " ", -1);
+
+    if (! fields)
+    {
+        return FALSE;
+    }
+
+    const guint num_fields = g_strv_length(fields);
+    guint sep_idx;
+
+    for (sep_idx = 6 ; sep_idx < num_fields ; sep_idx++)
+    {
+        if (! strcmp(fields[sep_idx], "-"))
+        {
+            break;
+        }
+    }
+
+    /* Skip malformed lines. */
+    if ((sep_idx + 1 >= num_fields)
+        || (sscanf(fields[2], "%u:%u", &major, &minor) != 2))
+    {
+        g_strfreev(fields);
+        return TRUE;
+    }
+
+    const guint64 dev = makedev(major, minor);
+    mount_dev_type * mount_dev = g_hash_table_lookup(self->devs, &dev);
+
+    if (mount_dev)
+    {
+        mount_dev->num_mounts++;
+    }
+    else if ((mount_dev = g_new0(mount_dev_type, 1)))
+    {
+        mount_dev->dev = dev;
+        mount_dev->num_mounts = 1;
+
+        if ((mount_dev->fs_type = g_strdup(fields[sep_idx + 1])))
+        {
+            g_hash_table_insert(self->devs, &(mount_dev->dev), mount_dev);
+        }
+        else
+        {
+            g_free(mount_dev);
+            ret = FALSE;
+        }
+    }
+    else
+    {
+        ret = FALSE;
+    }
+
+    /* Spaces and the like are escaped as octal, e.g: "\040". */
+    gchar * const mount_point = (ret ? g_strcompress(fields[4]) : NULL);
+
+    if (mount_point)
+    {
+        g_hash_table_add(self->mount_points, mount_point);
+    }
+    else
+    {
+        ret = FALSE;
+    }
+
+    g_strfreev(fields);
+
+    return ret;
+}
+
+#endif
+
+mount_table_t * mount_table_new(const gchar * const mountinfo_path)
+{
+    mount_table_t * self;
+
+    if (! (self = g_new0(mount_table_t, 1)))
+    {
+        return NULL;
+    }
+
+    if (! (self->devs = g_hash_table_new_full(
+                    g_int64_hash, g_int64_equal, NULL, mount_dev_free)))
+    {
+        goto cleanup;
+    }
+
+    if (! (self->mount_points = g_hash_table_new_full(
+                    g_str_hash, g_str_equal, g_free, NULL)))
+    {
+        goto cleanup;
+    }
+
+#ifdef G_OS_UNIX
+    {
+        gchar * contents = NULL;
+
+        if (g_file_get_contents(mountinfo_path, &contents, NULL, NULL))
+        {
+            gchar * line = contents;
+
+            while (line && *line)
+            {
+                gchar * const eol = strchr(line, '\n');
+
+                if (eol)
+                {
+                    *eol = '\0';
+                }
+
+                if (! mount_table_add_line(self, line))
+                {
+                    g_free(contents);
+                    goto cleanup;
+                }
+
+                line = (eol ? (eol + 1) : NULL);
+            }
+
+            g_free(contents);
+        }
+    }
+#endif
+
+    return self;
+
+cleanup:
+
+    mount_table_free(self);
+
+    return NULL;
+}
+
+const gchar * mount_table_get_fs_type(
+    mount_table_t * const self,
+    const dev_t dev
+)
+{
+    const guint64 key = dev;
+    const mount_dev_type * const mount_dev = g_hash_table_lookup(self->devs, &key);
+
+    return (mount_dev ? mount_dev->fs_type : NULL);
+}
+
+gboolean mount_table_is_dev_mounted_more_than_once(
+    mount_table_t * const self,
+    const dev_t dev
+)
+{
+    const guint64 key = dev;
+    const mount_dev_type * const mount_dev = g_hash_table_lookup(self->devs, &key);
+
+    return (mount_dev && (mount_dev->num_mounts > 1));
+}
+
+gboolean mount_table_is_mount_point(
+    mount_table_t * const self,
+    const gchar * const abs_path
+)
+{
+    return g_hash_table_contains(self->mount_points, abs_path);
+}
+
+void mount_table_free(mount_table_t * const self)
+{
+    if (self->devs)
+    {
+        g_hash_table_destroy(self->devs);
+        self->devs = NULL;
+    }
+
+    if (self->mount_points)
+    {
+        g_hash_table_destroy(self->mount_points);
+        self->mount_points = NULL;
+    }
+
+    g_free(self);
+
+    return;
+}
@@ -0,0 +1,59 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  mount_table.h
+ *
+ *    Description:  a table of the mounted file systems, by their device.
+ *                  Internal to libfilefind.
+ *
+ *        Created:  19/10/26 20:47:12
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_MOUNT_TABLE_H
+#define FILEFIND_MOUNT_TABLE_H
+
+#include <glib.h>
+#include <sys/types.h>
+
+typedef struct mount_table_struct mount_table_t;
+
+/*
+ * Parses a mountinfo file (see proc(5)), normally /proc/self/mountinfo.
+ * If it cannot be read (e.g: on non-Linux systems), the table is empty.
+ * Returns NULL if out of memory. The table is read-only afterwards, so it
+ * can be shared between threads.
+ * */
+extern mount_table_t * mount_table_new(const gchar * mountinfo_path);
+
+/*
+ * Returns the type of the file system of dev (e.g: "ext4", "proc" or
+ * "fuse.sshfs"), or NULL if it is not mounted.
+ * */
+extern const gchar * mount_table_get_fs_type(
+    mount_table_t * self,
+    dev_t dev
+);
+
+/*
+ * Whether dev is mounted in more than one place, as with bind mounts, so
+ * that its mount points cannot be told apart by st_dev alone.
+ * */
+extern gboolean mount_table_is_dev_mounted_more_than_once(
+    mount_table_t * self,
+    dev_t dev
+);
+
+extern gboolean mount_table_is_mount_point(
+    mount_table_t * self,
+    const gchar * abs_path
+);
+
+extern void mount_table_free(mount_table_t * self);
+
+#endif /* #ifndef FILEFIND_MOUNT_TABLE_H */
@@ -0,0 +1,651 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  roots_scanner.c
+ *
+ *    Description:  scans several root targets of a finder concurrently.
+ *
+ *        Created:  19/10/26 14:02:17
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "inline.h"
+
+#include "roots_scanner.h"
+
+typedef struct
+{
+    /* NULL marks the end of a root. */
+    gchar * path;
+    struct stat stat_ret;
+    /* For the end marker: FILE_FIND_END or the error of the root. */
+    int status;
+} roots_scanner_item_t;
+
+/*
+ * The most items that a queue holds for the consumer before the workers
+ * that fill it wait for it to catch up. The end markers are not counted.
+ * */
+#define ROOTS_SCANNER_MAX_QUEUED_ITEMS 1024
+
+typedef struct
+{
+    GAsyncQueue * queue;
+    GMutex lock;
+    /* Signalled when len drops below ROOTS_SCANNER_MAX_QUEUED_ITEMS. */
+    GCond not_full;
+    guint len;
+    guint peak_len;
+} roots_scanner_queue_t;
+
+/*
+ * A device that a worker is scanning roots of. It scans the roots that are
+ * found on the device in the meantime after the current one.
+ * */
+typedef struct
+{
+    dev_t dev;
+    guint current_root;
+    /* The indexes of the roots, in target order. */
+    GArray * pending_roots;
+} roots_scanner_device_t;
+
+struct roots_scanner_struct
+{
+    GPtrArray * targets;
+    roots_scanner_new_finder_t new_finder;
+    void * new_finder_context;
+    gboolean in_target_order;
+    /*
+     * One queue per root when returning the items in target order, or a
+     * single shared one otherwise.
+     * */
+    GPtrArray * queues;
+    /* The devices that are being scanned, guarded by devices_lock. */
+    GPtrArray * devices;
+    GMutex devices_lock;
+    GThreadPool * pool;
+    /* The root being returned, or the number of finished roots. */
+    guint next_root;
+    roots_scanner_item_t * item;
+    /* One per root. */
+    roots_scanner_item_t * end_markers;
+    gint cancelled;
+    GMutex stats_lock;
+    file_find_stats_t stats;
+};
+
+static void roots_scanner_item_free(roots_scanner_item_t * const item)
+{
+    g_free(item->path);
+    g_free(item);
+
+    return;
+}
+
+static GCC_INLINE roots_scanner_queue_t * roots_scanner_root_queue(
+    roots_scanner_t * const self,
+    const guint root_idx
+)
+{
+    return g_ptr_array_index(
+        self->queues, (self->in_target_order ? root_idx : 0)
+    );
+}
+
+/*
+ * Waits for room in queue, unless the scan was cancelled. The end markers
+ * are always pushed at once, so every root is terminated.
+ * */
+static void roots_scanner_queue_push(
+    roots_scanner_t * const self,
+    roots_scanner_queue_t * const queue,
+    roots_scanner_item_t * const item
+)
+{
+    g_mutex_lock(&(queue->lock));
+
+    if (item->path)
+    {
+        while ((queue->len >= ROOTS_SCANNER_MAX_QUEUED_ITEMS)
+            && (! g_atomic_int_get(&(self->cancelled))))
+        {
+            g_cond_wait(&(queue->not_full), &(queue->lock));
+        }
+
+        if (++queue->len > queue->peak_len)
+        {
+            queue->peak_len = queue->len;
+        }
+    }
+
+    g_async_queue_push(queue->queue, item);
+
+    g_mutex_unlock(&(queue->lock));
+
+    return;
+}
+
+static roots_scanner_item_t * roots_scanner_queue_pop(
+    roots_scanner_queue_t * const queue
+)
+{
+    roots_scanner_item_t * const item = g_async_queue_pop(queue->queue);
+
+    if (item->path)
+    {
+        g_mutex_lock(&(queue->lock));
+        queue->len--;
+        g_cond_signal(&(queue->not_full));
+        g_mutex_unlock(&(queue->lock));
+    }
+
+    return item;
+}
+
+#define MAX_STAT(field) \
+    if (src->field > dest->field) \
+    { \
+        dest->field = src->field; \
+    }
+
+static void stats_merge(
+    file_find_stats_t * const dest,
+    const file_find_stats_t * const src
+)
+{
+    dest->num_items += src->num_items;
+    dest->num_opendir += src->num_opendir;
+    dest->opendir_ns += src->opendir_ns;
+    dest->num_readdir += src->num_readdir;
+    dest->readdir_ns += src->readdir_ns;
+    dest->num_stat += src->num_stat;
+    dest->stat_ns += src->stat_ns;
+    dest->num_sort += src->num_sort;
+    dest->sort_ns += src->sort_ns;
+    dest->num_spilled_runs += src->num_spilled_runs;
+    dest->num_spilled_dirs += src->num_spilled_dirs;
+    dest->num_prefetch_hits += src->num_prefetch_hits;
+    dest->num_prefetch_misses += src->num_prefetch_misses;
+    dest->num_archives += src->num_archives;
+    dest->num_archive_members += src->num_archive_members;
+    dest->num_archive_errors += src->num_archive_errors;
+    dest->num_link_cache_hits += src->num_link_cache_hits;
+    dest->num_hard_links_tracked += src->num_hard_links_tracked;
+    dest->hard_links_bytes += src->hard_links_bytes;
+    dest->num_dup_links += src->num_dup_links;
+    dest->num_inode_lookups += src->num_inode_lookups;
+    dest->inode_lookup_ns += src->inode_lookup_ns;
+    dest->num_callbacks += src->num_callbacks;
+    dest->callback_ns += src->callback_ns;
+    dest->listing_bytes += src->listing_bytes;
+    MAX_STAT(max_depth);
+    MAX_STAT(peak_dir_stack_len);
+    MAX_STAT(peak_listing_bytes);
+    MAX_STAT(peak_roots_queue_len);
+
+    return;
+}
+
+#undef MAX_STAT
+
+static int roots_scanner_scan_finder(
+    roots_scanner_t * const self,
+    file_find_handle_t * const finder,
+    roots_scanner_queue_t * const queue
+)
+{
+    int status = FILE_FIND_END;
+
+    while ((! g_atomic_int_get(&(self->cancelled)))
+        && ((status = file_find_next(finder)) == FILE_FIND_OK))
+    {
+        roots_scanner_item_t * const item = g_new0(roots_scanner_item_t, 1);
+
+        if (! item)
+        {
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        if (! (item->path = g_strdup(file_find_get_path(finder))))
+        {
+            g_free(item);
+            return FILE_FIND_OUT_OF_MEMORY;
+        }
+
+        const struct stat * const stat_ret = file_find_get_stat(finder);
+
+        if (stat_ret)
+        {
+            item->stat_ret = *stat_ret;
+        }
+
+        roots_scanner_queue_push(self, queue, item);
+    }
+
+    return (g_atomic_int_get(&(self->cancelled)) ? FILE_FIND_END : status);
+}
+
+static void roots_scanner_scan_root(
+    roots_scanner_t * const self,
+    const guint root_idx
+)
+{
+    roots_scanner_queue_t * const queue =
+        roots_scanner_root_queue(self, root_idx);
+    file_find_handle_t * finder = NULL;
+    int status = FILE_FIND_END;
+
+    if (! g_atomic_int_get(&(self->cancelled)))
+    {
+        status = (self->new_finder)(
+            &finder,
+            g_ptr_array_index(self->targets, root_idx),
+            self->new_finder_context
+        );
+    }
+
+    if (finder)
+    {
+        file_find_stats_t stats;
+
+        status = roots_scanner_scan_finder(self, finder, queue);
+
+        file_find_get_stats(finder, &stats);
+
+        g_mutex_lock(&(self->stats_lock));
+        stats_merge(&(self->stats), &stats);
+        g_mutex_unlock(&(self->stats_lock));
+
+        file_find_free(finder);
+    }
+
+    /*
+     * The end markers are allocated in advance by roots_scanner_new(), so
+     * a root is always terminated, even when running out of memory.
+     * */
+    self->end_markers[root_idx].status = status;
+    roots_scanner_queue_push(self, queue, &(self->end_markers[root_idx]));
+
+    return;
+}
+
+static void roots_scanner_device_free(roots_scanner_device_t * const device)
+{
+    g_array_free(device->pending_roots, TRUE);
+    g_free(device);
+
+    return;
+}
+
+/*
+ * Returns the device that is being scanned and that the root should wait
+ * for, or NULL after making the worker the one that scans dev if nobody
+ * does, in which case *device_ret is set to it, or NULL if out of memory.
+ * */
+static roots_scanner_device_t * roots_scanner_find_device(
+    roots_scanner_t * const self,
+    const dev_t dev,
+    const guint root_idx,
+    roots_scanner_device_t * * const device_ret
+)
+{
+    *device_ret = NULL;
+
+    for (guint i = 0 ; i < self->devices->len ; i++)
+    {
+        roots_scanner_device_t * const device =
+            g_ptr_array_index(self->devices, i);
+
+        if (device->dev == dev)
+        {
+            /*
+             * A root that comes before the one being scanned is scanned at
+             * once, beside it, since the consumer may be waiting for it
+             * while the queue of the current root is full.
+             * */
+            return ((device->current_root < root_idx) ? device : NULL);
+        }
+    }
+
+    roots_scanner_device_t * const device = g_new0(roots_scanner_device_t, 1);
+
+    if (device)
+    {
+        if (! (device->pending_roots = g_array_new(FALSE, FALSE, sizeof(guint))))
+        {
+            g_free(device);
+            return NULL;
+        }
+
+        device->dev = dev;
+        device->current_root = root_idx;
+        g_ptr_array_add(self->devices, device);
+
+        *device_ret = device;
+    }
+
+    return NULL;
+}
+
+/*
+ * Scans the root of the task: the device that it is on is told by
+ * stat()ing it here, so a root that hangs (e.g: on a dead NFS mount) only
+ * holds up its own worker. Roots on the same device are scanned one after
+ * the other by the first worker that reached it, so a single disk is not
+ * thrashed. Roots that cannot be stat()ed are taken to be on device 0,
+ * and end immediately.
+ * */
+static void roots_scanner_scan_task(gpointer data, gpointer user_data)
+{
+    roots_scanner_t * const self = (roots_scanner_t *)user_data;
+    guint root_idx = GPOINTER_TO_UINT(data) - 1;
+    struct stat stat_ret;
+    dev_t dev = 0;
+    roots_scanner_device_t * device;
+
+    if ((! g_atomic_int_get(&(self->cancelled)))
+        && (! g_stat(g_ptr_array_index(self->targets, root_idx), &stat_ret)))
+    {
+        dev = stat_ret.st_dev;
+    }
+
+    g_mutex_lock(&(self->devices_lock));
+
+    roots_scanner_device_t * const busy_device =
+        roots_scanner_find_device(self, dev, root_idx, &device);
+
+    if (busy_device)
+    {
+        guint i = busy_device->pending_roots->len;
+
+        while ((i > 0)
+            && (g_array_index(busy_device->pending_roots, guint, i - 1) > root_idx))
+        {
+            i--;
+        }
+
+        g_array_insert_val(busy_device->pending_roots, i, root_idx);
+    }
+
+    g_mutex_unlock(&(self->devices_lock));
+
+    if (busy_device)
+    {
+        return;
+    }
+
+    roots_scanner_scan_root(self, root_idx);
+
+    if (! device)
+    {
+        return;
+    }
+
+    while (TRUE)
+    {
+        g_mutex_lock(&(self->devices_lock));
+
+        if (! device->pending_roots->len)
+        {
+            g_ptr_array_remove(self->devices, device);
+            g_mutex_unlock(&(self->devices_lock));
+
+            roots_scanner_device_free(device);
+
+            return;
+        }
+
+        root_idx = g_array_index(device->pending_roots, guint, 0);
+        g_array_remove_index(device->pending_roots, 0);
+        device->current_root = root_idx;
+
+        g_mutex_unlock(&(self->devices_lock));
+
+        roots_scanner_scan_root(self, root_idx);
+    }
+}
+
+static void roots_scanner_queue_free(gpointer data)
+{
+    roots_scanner_queue_t * const queue = (roots_scanner_queue_t *)data;
+    roots_scanner_item_t * item;
+
+    while ((item = g_async_queue_try_pop(queue->queue)))
+    {
+        if (item->path)
+        {
+            roots_scanner_item_free(item);
+        }
+    }
+
+    g_async_queue_unref(queue->queue);
+    g_mutex_clear(&(queue->lock));
+    g_cond_clear(&(queue->not_full));
+    g_free(queue);
+
+    return;
+}
+
+roots_scanner_t * roots_scanner_new(
+    GPtrArray * targets,
+    int num_threads,
+    gboolean in_target_order,
+    roots_scanner_new_finder_t new_finder,
+    void * new_finder_context
+)
+{
+    roots_scanner_t * self;
+
+    if (! (self = g_new0(roots_scanner_t, 1)))
+    {
+        return NULL;
+    }
+
+    g_mutex_init(&(self->stats_lock));
+    g_mutex_init(&(self->devices_lock));
+
+    self->targets = targets;
+    self->new_finder = new_finder;
+    self->new_finder_context = new_finder_context;
+    self->in_target_order = in_target_order;
+
+    if (! (self->end_markers = g_new0(roots_scanner_item_t, targets->len)))
+    {
+        goto cleanup;
+    }
+
+    if (! (self->queues = g_ptr_array_new_with_free_func(
+                    roots_scanner_queue_free)))
+    {
+        goto cleanup;
+    }
+
+    for (guint i = 0 ; i < (in_target_order ? targets->len : 1) ; i++)
+    {
+        roots_scanner_queue_t * const queue = g_new0(roots_scanner_queue_t, 1);
+
+        if (! queue)
+        {
+            goto cleanup;
+        }
+
+        if (! (queue->queue = g_async_queue_new()))
+        {
+            g_free(queue);
+            goto cleanup;
+        }
+
+        g_mutex_init(&(queue->lock));
+        g_cond_init(&(queue->not_full));
+
+        g_ptr_array_add(self->queues, queue);
+    }
+
+    if (! (self->devices = g_ptr_array_new()))
+    {
+        goto cleanup;
+    }
+
+    if (num_threads <= 0)
+    {
+        num_threads = g_get_num_processors();
+    }
+
+    if (num_threads > targets->len)
+    {
+        num_threads = targets->len;
+    }
+
+    if (! (self->pool = g_thread_pool_new(
+                    roots_scanner_scan_task, self, num_threads, FALSE, NULL)))
+    {
+        goto cleanup;
+    }
+
+    /*
+     * The tasks are taken in target order, so a worker only waits for the
+     * consumer to drain roots that come after those that it is waiting for.
+     * */
+    for (guint i = 0 ; i < targets->len ; i++)
+    {
+        g_thread_pool_push(self->pool, GUINT_TO_POINTER(i + 1), NULL);
+    }
+
+    return self;
+
+cleanup:
+
+    roots_scanner_free(self);
+
+    return NULL;
+}
+
+int roots_scanner_next(
+    roots_scanner_t * const self,
+    const gchar * * path,
+    const struct stat * * stat_ret
+)
+{
+    *path = NULL;
+    *stat_ret = NULL;
+
+    if (self->item)
+    {
+        roots_scanner_item_free(self->item);
+        self->item = NULL;
+    }
+
+    while (self->next_root < self->targets->len)
+    {
+        roots_scanner_item_t * const item = roots_scanner_queue_pop(
+            roots_scanner_root_queue(self, self->next_root)
+        );
+
+        if (item->path)
+        {
+            self->item = item;
+            *path = item->path;
+            *stat_ret = &(item->stat_ret);
+
+            return FILE_FIND_OK;
+        }
+
+        self->next_root++;
+
+        if (item->status != FILE_FIND_END)
+        {
+            return item->status;
+        }
+    }
+
+    return FILE_FIND_END;
+}
+
+void roots_scanner_add_stats(
+    roots_scanner_t * const self,
+    file_find_stats_t * const stats
+)
+{
+    g_mutex_lock(&(self->stats_lock));
+    stats_merge(stats, &(self->stats));
+    g_mutex_unlock(&(self->stats_lock));
+
+    for (guint i = 0 ; i < self->queues->len ; i++)
+    {
+        roots_scanner_queue_t * const queue =
+            g_ptr_array_index(self->queues, i);
+
+        g_mutex_lock(&(queue->lock));
+
+        if (queue->peak_len > stats->peak_roots_queue_len)
+        {
+            stats->peak_roots_queue_len = queue->peak_len;
+        }
+
+        g_mutex_unlock(&(queue->lock));
+    }
+
+    return;
+}
+
+void roots_scanner_free(roots_scanner_t * const self)
+{
+    g_atomic_int_set(&(self->cancelled), 1);
+
+    /* Wakes up the workers that wait for room in the queues. */
+    for (guint i = 0 ; self->queues && (i < self->queues->len) ; i++)
+    {
+        roots_scanner_queue_t * const queue =
+            g_ptr_array_index(self->queues, i);
+
+        g_mutex_lock(&(queue->lock));
+        g_cond_broadcast(&(queue->not_full));
+        g_mutex_unlock(&(queue->lock));
+    }
+
+    if (self->pool)
+    {
+        /* The workers notice the cancellation after their current item. */
+        g_thread_pool_free(self->pool, FALSE, TRUE);
+        self->pool = NULL;
+    }
+
+    if (self->item)
+    {
+        roots_scanner_item_free(self->item);
+        self->item = NULL;
+    }
+
+    if (self->queues)
+    {
+        g_ptr_array_free(self->queues, TRUE);
+        self->queues = NULL;
+    }
+
+    /* The workers remove their devices when they are done. */
+    if (self->devices)
+    {
+        g_ptr_array_free(self->devices, TRUE);
+        self->devices = NULL;
+    }
+
+    g_free(self->end_markers);
+    self->end_markers = NULL;
+
+    g_mutex_clear(&(self->stats_lock));
+    g_mutex_clear(&(self->devices_lock));
+
+    g_free(self);
+
+    return;
+}
@@ -0,0 +1,74 @@
+/*
+ * =========================================================================
+ *
+ *       Filename:  roots_scanner.h
+ *
+ *    Description:  scans several root targets of a finder concurrently.
+ *                  Internal to libfilefind.
+ *
+ *        Created:  19/10/26 14:02:17
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Shlomi Fish
+ *
+ * =========================================================================
+ */
+
+#ifndef FILEFIND_ROOTS_SCANNER_H
+#define FILEFIND_ROOTS_SCANNER_H
+
+#include <glib.h>
+
+#include "filefind.h"
+
+/*
+ * Every root is scanned by a finder of its own, created by new_finder on
+ * the worker thread that scans it, which also stat()s the root to find its
+ * st_dev. Roots that share an st_dev are scanned one after the other by the
+ * same worker, so a single disk is not thrashed, while roots on different
+ * devices proceed in parallel and a slow (e.g: NFS) mount only holds up its
+ * own worker. The workers wait while the consumer has too many of their
+ * items pending.
+ * */
+typedef int (*roots_scanner_new_finder_t)(
+    file_find_handle_t * * output_handle,
+    const char * target,
+    void * context
+);
+
+typedef struct roots_scanner_struct roots_scanner_t;
+
+extern roots_scanner_t * roots_scanner_new(
+    GPtrArray * targets,
+    int num_threads,
+    gboolean in_target_order,
+    roots_scanner_new_finder_t new_finder,
+    void * new_finder_context
+);
+
+/*
+ * Returns FILE_FIND_OK and sets *path and *stat_ret to the next item, which
+ * remain valid until the next call, or FILE_FIND_END when all the roots
+ * were exhausted.
+ * */
+extern int roots_scanner_next(
+    roots_scanner_t * self,
+    const gchar * * path,
+    const struct stat * * stat_ret
+);
+
+/*
+ * Adds the stats of the roots that were finished so far to *stats.
+ * */
+extern void roots_scanner_add_stats(
+    roots_scanner_t * self,
+    file_find_stats_t * stats
+);
+
+/*
+ * Stops the workers early if the scan was not completed.
+ * */
+extern void roots_scanner_free(roots_scanner_t * self);
+
+#endif /* #ifndef FILEFIND_ROOTS_SCANNER_H */
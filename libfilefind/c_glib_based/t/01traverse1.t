@@ -3,7 +3,7 @@
 use strict;
 use warnings;
 
-use Test::More tests => 1;
+use Test::More tests => 11;
 
 use File::TreeCreate ();
 
@@ -62,5 +62,258 @@ use File::Path qw( mkpath rmtree );
         "Checking for regular, lexicographically sorted order",
     );
 
+    open $lff_fh,
+        "./minifind --depth-first "
+        . $t->get_path("./t/sample-data/traverse-1") . "|"
+        or die "Cannot execute minifind";
+
+    @results = <$lff_fh>;
+    chomp(@results);
+
+    close($lff_fh);
+
+    # TEST
+    is_deeply(
+        \@results,
+        [
+            (
+                map { $t->get_path("t/sample-data/traverse-1/$_") } (
+                    qw(
+                        a
+                        b.doc
+                        foo/yet
+                        foo
+                    ),
+                    "",
+                )
+            ),
+        ],
+        "Directories are returned after their contents in depth-first mode",
+    );
+
+    open $lff_fh,
+        "./minifind --inode-order "
+        . $t->get_path("./t/sample-data/traverse-1") . "|"
+        or die "Cannot execute minifind";
+
+    @results = <$lff_fh>;
+    chomp(@results);
+
+    close($lff_fh);
+
+    # TEST
+    is_deeply(
+        \@results,
+        [
+            (
+                map { $t->get_path("t/sample-data/traverse-1/$_") } (
+                    "", qw(
+                        a
+                        b.doc
+                        foo
+                        foo/yet
+                    )
+                )
+            ),
+        ],
+        "Stat'ing in inode order does not change the order",
+    );
+
+    open $lff_fh,
+        "./minifind --max-listing-bytes 1 "
+        . $t->get_path("./t/sample-data/traverse-1") . "|"
+        or die "Cannot execute minifind";
+
+    @results = <$lff_fh>;
+    chomp(@results);
+
+    close($lff_fh);
+
+    # TEST
+    is_deeply(
+        \@results,
+        [
+            (
+                map { $t->get_path("t/sample-data/traverse-1/$_") } (
+                    "", qw(
+                        a
+                        b.doc
+                        foo
+                        foo/yet
+                    )
+                )
+            ),
+        ],
+        "Spilled listings are merged back in order",
+    );
+
+    open $lff_fh,
+        "./minifind --prefetch 4 --prefetch-threads 2 "
+        . $t->get_path("./t/sample-data/traverse-1") . "|"
+        or die "Cannot execute minifind";
+
+    @results = <$lff_fh>;
+    chomp(@results);
+
+    close($lff_fh);
+
+    # TEST
+    is_deeply(
+        \@results,
+        [
+            (
+                map { $t->get_path("t/sample-data/traverse-1/$_") } (
+                    "", qw(
+                        a
+                        b.doc
+                        foo
+                        foo/yet
+                    )
+                )
+            ),
+        ],
+        "Prefetching the directories does not change the order",
+    );
+
+    open $lff_fh,
+        "./minifind --xdev --prefetch 4 "
+        . $t->get_path("./t/sample-data/traverse-1") . "|"
+        or die "Cannot execute minifind";
+
+    @results = <$lff_fh>;
+    chomp(@results);
+
+    close($lff_fh);
+
+    # TEST
+    is_deeply(
+        \@results,
+        [
+            (
+                map { $t->get_path("t/sample-data/traverse-1/$_") } (
+                    "", qw(
+                        a
+                        b.doc
+                        foo
+                        foo/yet
+                    )
+                )
+            ),
+        ],
+        "Not crossing file systems within a single one",
+    );
+
+    open $lff_fh,
+        "./minifind --type f "
+        . $t->get_path("./t/sample-data/traverse-1") . "|"
+        or die "Cannot execute minifind";
+
+    @results = <$lff_fh>;
+    chomp(@results);
+
+    close($lff_fh);
+
+    # TEST
+    is_deeply(
+        \@results,
+        [ $t->get_path("t/sample-data/traverse-1/b.doc") ],
+        "Filtering by the type of the items - files",
+    );
+
+    open $lff_fh,
+        "./minifind --type d "
+        . $t->get_path("./t/sample-data/traverse-1") . "|"
+        or die "Cannot execute minifind";
+
+    @results = <$lff_fh>;
+    chomp(@results);
+
+    close($lff_fh);
+
+    # TEST
+    is_deeply(
+        \@results,
+        [
+            (
+                map { $t->get_path("t/sample-data/traverse-1/$_") } (
+                    "", qw(
+                        a
+                        foo
+                        foo/yet
+                    )
+                )
+            ),
+        ],
+        "Filtering by the type of the items - directories",
+    );
+
     rmtree( $t->get_path("./t/sample-data/traverse-1") );
 }
+
+{
+    # The last entries of both directories are files, whose stats must not
+    # be taken for the directories when they are returned after them.
+    my $tree = {
+        'name' => "traverse-2/",
+        'subs' => [
+            {
+                'name' => "d/",
+                'subs' => [
+                    {
+                        'name'     => "e.txt",
+                        'contents' => "e",
+                    },
+                ],
+            },
+            {
+                'name'     => "f.txt",
+                'contents' => "f",
+            },
+        ],
+    };
+
+    my $t = File::TreeCreate->new();
+    $t->create_tree( "./t/sample-data/", $tree );
+
+    my $path = sub { return $t->get_path("t/sample-data/traverse-2/$_[0]"); };
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    # TEST
+    is_deeply(
+        $run->( "--depth-first --type d " . $path->("") ),
+        [ map { $path->($_) } ( "d", "" ) ],
+        "Directories have their own stat in depth-first mode",
+    );
+
+    # TEST
+    is_deeply(
+        $run->( "--depth-first --type f " . $path->("") ),
+        [ map { $path->($_) } qw( d/e.txt f.txt ) ],
+        "Directories are not taken for their last files in depth-first mode",
+    );
+
+    # TEST
+    is_deeply(
+        [
+            $run->( $path->("f.txt") ),
+            $run->( "--depth-first --type f " . $path->("f.txt") ),
+        ],
+        [ [ $path->("f.txt") ], [ $path->("f.txt") ] ],
+        "A target that is not a directory is returned in both orders",
+    );
+
+    rmtree( $t->get_path("./t/sample-data/traverse-2") );
+}
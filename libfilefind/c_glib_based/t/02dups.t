@@ -0,0 +1,83 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 1;
+
+use File::TreeCreate ();
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $big_prefix = ( "x" x 5000 );
+    my $tree       = {
+        'name' => "dups-1/",
+        'subs' => [
+            {
+                'name'     => "a.txt",
+                'contents' => "hello world",
+            },
+            {
+                'name'     => "big1.dat",
+                'contents' => "${big_prefix}A",
+            },
+            {
+                'name'     => "big2.dat",
+                'contents' => "${big_prefix}A",
+            },
+            {
+                'name'     => "big3.dat",
+                'contents' => "${big_prefix}B",
+            },
+            {
+                'name'     => "c.txt",
+                'contents' => "hello WORLD",
+            },
+            {
+                'name'     => "empty1",
+                'contents' => "",
+            },
+            {
+                'name'     => "empty2",
+                'contents' => "",
+            },
+            {
+                'name' => "sub/",
+                'subs' => [
+                    {
+                        'name'     => "b.txt",
+                        'contents' => "hello world",
+                    },
+                ],
+            },
+        ],
+    };
+
+    my $t = File::TreeCreate->new();
+    mkpath("./t/sample-data");
+    $t->create_tree( "./t/sample-data/", $tree );
+
+    open my $lff_fh,
+        "./minifind --dups " . $t->get_path("./t/sample-data/dups-1") . "|"
+        or die "Cannot execute minifind";
+
+    my @results = <$lff_fh>;
+    chomp(@results);
+
+    close($lff_fh);
+
+    my $path = sub { return $t->get_path("t/sample-data/dups-1/$_[0]"); };
+
+    # TEST
+    is_deeply(
+        \@results,
+        [
+            $path->("a.txt"),    $path->("sub/b.txt"), "",
+            $path->("big1.dat"), $path->("big2.dat"),  "",
+        ],
+        "Duplicate groups are reported sorted, without false positives",
+    );
+
+    rmtree( $t->get_path("./t/sample-data/dups-1") );
+}
@@ -0,0 +1,66 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 1;
+
+use File::TreeCreate ();
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $tree = {
+        'name' => "du-1/",
+        'subs' => [
+            {
+                'name'     => "b.doc",
+                'contents' => ( "This file was spotted in the wild.\n" x 300 ),
+            },
+            {
+                'name' => "a/",
+            },
+            {
+                'name' => "foo/",
+                'subs' => [
+                    {
+                        'name'     => "big.txt",
+                        'contents' => ( "0123456789" x 5000 ),
+                    },
+                    {
+                        'name' => "yet/",
+                    },
+                ],
+            },
+        ],
+    };
+
+    my $t = File::TreeCreate->new();
+    mkpath("./t/sample-data");
+    $t->create_tree( "./t/sample-data/", $tree );
+
+    my $dir = $t->get_path("./t/sample-data/du-1");
+
+    # A hard link should only be counted once.
+    link( "$dir/foo/big.txt", "$dir/foo/big-link.txt" )
+        or die "Cannot link - $!";
+
+    my $get_lines = sub {
+        my ($cmd) = @_;
+        open my $fh, "$cmd $dir |"
+            or die "Cannot execute $cmd";
+        my @lines = <$fh>;
+        close($fh);
+        chomp(@lines);
+        return [ sort @lines ];
+    };
+
+    # TEST
+    is_deeply(
+        $get_lines->("./minifind --du"),
+        $get_lines->("du"),
+        "minifind --du agrees with du",
+    );
+
+    rmtree($dir);
+}
@@ -0,0 +1,153 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 5;
+
+use File::TreeCreate ();
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $tree = {
+        'name' => "roots-1/",
+        'subs' => [
+            {
+                'name' => "a/",
+                'subs' => [
+                    {
+                        'name'     => "a1.txt",
+                        'contents' => "a1",
+                    },
+                    {
+                        'name' => "sub/",
+                        'subs' => [
+                            {
+                                'name'     => "a2.txt",
+                                'contents' => "a2",
+                            },
+                        ],
+                    },
+                ],
+            },
+            {
+                'name' => "b/",
+                'subs' => [
+                    {
+                        'name'     => "b1.txt",
+                        'contents' => "b1",
+                    },
+                ],
+            },
+            {
+                'name'     => "c.txt",
+                'contents' => "c",
+            },
+        ],
+    };
+
+    my $t = File::TreeCreate->new();
+    mkpath("./t/sample-data");
+    $t->create_tree( "./t/sample-data/", $tree );
+
+    my $path = sub { return $t->get_path("t/sample-data/roots-1/$_[0]"); };
+
+    my $run = sub {
+        my $opts = shift;
+
+        my @targets =
+            ( map { $path->($_) } qw(b c.txt does-not-exist a) );
+
+        open my $lff_fh, "./minifind $opts @targets |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    my @expected = (
+        map { $path->($_) } (
+            qw(
+                b
+                b/b1.txt
+                c.txt
+                a
+                a/a1.txt
+                a/sub
+                a/sub/a2.txt
+            )
+        )
+    );
+
+    # TEST
+    is_deeply( $run->(""), \@expected,
+        "Several targets are traversed one after the other" );
+
+    # TEST
+    is_deeply( $run->("--threads 3"),
+        \@expected, "Parallel scanning preserves the target order" );
+
+    # TEST
+    is_deeply(
+        [ sort @{ $run->("--threads 3 --as-ready") } ],
+        [ sort @expected ],
+        "Parallel scanning as ready returns the same items",
+    );
+
+    rmtree( $t->get_path("./t/sample-data/roots-1") );
+}
+
+{
+    # A consumer that is slower than the workers: they must wait for it
+    # instead of buffering the later roots whole.
+    my $t    = File::TreeCreate->new();
+    my $base = $t->get_path("./t/sample-data/roots-slow");
+
+    my @targets = ( map { "$base/r$_" } ( 1 .. 3 ) );
+    my @expected;
+
+    foreach my $target (@targets)
+    {
+        mkpath($target);
+        push @expected, $target;
+
+        foreach my $idx ( 1 .. 3000 )
+        {
+            my $fn = sprintf( "%s/f%04d.txt", $target, $idx );
+            open my $out, ">", $fn or die "Cannot create $fn";
+            close($out);
+            push @expected, $fn;
+        }
+    }
+
+    my $stats_fn = "$base/stats.txt";
+
+    open my $lff_fh, "./minifind --threads 3 --stats @targets 2> $stats_fn |"
+        or die "Cannot execute minifind";
+
+    my @results = scalar(<$lff_fh>);
+    sleep(1);
+    push @results, <$lff_fh>;
+    chomp(@results);
+
+    close($lff_fh);
+
+    # TEST
+    is_deeply( \@results, \@expected, "A slow consumer gets all the items" );
+
+    open my $stats_fh, "<", $stats_fn or die "Cannot open $stats_fn";
+    my ($peak) =
+        ( join( "", <$stats_fh> ) =~ /^peak_roots_queue\s+(\d+)$/m );
+    close($stats_fh);
+
+    # TEST
+    ok( ( ( $peak > 0 ) && ( $peak <= 1024 ) ),
+        "The workers wait for a slow consumer" );
+
+    rmtree($base);
+}
@@ -0,0 +1,98 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 5;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    # level-0 .. level-$depth, where every level except the last has two
+    # links to the next one ("left" and "right", so there are 2**$i paths to
+    # level $i), and every level has a link back to level 0.
+    my $depth = 10;
+    my $base  = "./t/sample-data/links-1";
+
+    rmtree($base);
+
+    foreach my $i ( 0 .. $depth )
+    {
+        my $dir = "$base/level-$i";
+        mkpath($dir);
+
+        open my $fh, ">", "$dir/file.txt"
+            or die "Cannot create $dir/file.txt";
+        print {$fh} "$i\n";
+        close($fh);
+
+        symlink( "../level-0", "$dir/back" )
+            or die "Cannot create a link in $dir";
+
+        if ( $i < $depth )
+        {
+            foreach my $name (qw(left right))
+            {
+                symlink( "../level-" . ( $i + 1 ), "$dir/$name" )
+                    or die "Cannot create a link in $dir";
+            }
+        }
+    }
+
+    my $count = sub {
+        my $opts = shift;
+
+        open my $lff_fh, "./minifind --count $opts $base/level-0 |"
+            or die "Cannot execute minifind";
+
+        my $ret = <$lff_fh>;
+        chomp($ret);
+
+        close($lff_fh);
+
+        return $ret;
+    };
+
+    # TEST
+    is( $count->(""), 5, "Links are not followed by default", );
+
+    # The target, then file.txt, back, left and right for every visit of
+    # the levels before the last one, and file.txt and back for the last.
+    # TEST
+    is(
+        $count->("--follow"),
+        1 + 4 * ( 2**$depth - 1 ) + 2 * 2**$depth,
+        "Following a diamond of links visits every path, and stops at cycles",
+    );
+
+    # TEST
+    is(
+        $count->("--follow --unique"),
+        1 + 4 * $depth + 2,
+        "Following links enters every real directory once",
+    );
+
+    # TEST
+    is(
+        $count->("--follow --unique --inode-order --prefetch 4"),
+        1 + 4 * $depth + 2,
+        "Following links uniquely with entries stat()ed in advance",
+    );
+
+    open my $lff_fh, "./minifind --count --follow --unique $base/level-$depth |"
+        or die "Cannot execute minifind";
+
+    my $last_count = <$lff_fh>;
+    chomp($last_count);
+
+    close($lff_fh);
+
+    # The cycle through "back" leads from the last level to all the others,
+    # and from them to the target again, which is not entered twice.
+    # TEST
+    is(
+        $last_count,
+        3 + 4 * $depth,
+        "Following a cycle of links back to the target",
+    );
+}
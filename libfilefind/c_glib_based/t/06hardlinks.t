@@ -0,0 +1,75 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 3;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base = "./t/sample-data/hard-links-1";
+
+    rmtree($base);
+    mkpath( [ "$base/a", "$base/b" ] );
+
+    foreach my $name (qw(a/first a/solo))
+    {
+        open my $fh, ">", "$base/$name"
+            or die "Cannot create $base/$name";
+        print {$fh} "$name\n";
+        close($fh);
+    }
+
+    foreach my $name (qw(b/second b/third))
+    {
+        link( "$base/a/first", "$base/$name" )
+            or die "Cannot link $base/$name";
+    }
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    # TEST
+    is_deeply(
+        $run->("--hard-links flag $base"),
+        [
+            map { "$base$_" } (
+                "", qw(
+                    /a
+                    /a/first
+                    /a/solo
+                    /b
+                    ),
+                "/b/second (hard link)",
+                "/b/third (hard link)",
+            )
+        ],
+        "The later names of a file are flagged",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--hard-links once $base"),
+        [ map { "$base$_" } ( "", qw( /a /a/first /a/solo /b ) ) ],
+        "Only the first name of a file is returned",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--hard-links once --threads 2 $base/b $base/a"),
+        [ map { "$base$_" } (qw( /b /b/second /a /a/solo )) ],
+        "The links are tracked across the roots of a parallel scan",
+    );
+}
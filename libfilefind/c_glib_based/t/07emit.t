@@ -0,0 +1,73 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 3;
+
+use JSON::PP ();
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base = "./t/sample-data/emit-1";
+
+    rmtree($base);
+    mkpath("$base/sub");
+
+    foreach my $name ( "sub/plain", "sub/new\nline", "sub/q\"uote" )
+    {
+        open my $fh, ">", "$base/$name"
+            or die "Cannot create $base/$name";
+        print {$fh} "12345";
+        close($fh);
+    }
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args $base |"
+            or die "Cannot execute minifind";
+        binmode($lff_fh);
+
+        my $ret = do { local $/; <$lff_fh> };
+
+        close($lff_fh);
+
+        return $ret;
+    };
+
+    my @expected = (
+        map { "$base$_" } ( "", "/sub", "/sub/new\nline", "/sub/plain",
+            "/sub/q\"uote", )
+    );
+
+    # TEST
+    is_deeply(
+        [ split /\0/, $run->("-0") ],
+        \@expected, "NUL-delimited output keeps newlines in the names",
+    );
+
+    my @records =
+        map { JSON::PP::decode_json($_) } split /\n/, $run->("--format jsonl");
+
+    # TEST
+    is_deeply(
+        [
+            map { [ $_->{path}, $_->{type}, $_->{size} ] }
+            grep { $_->{type} eq 'f' } @records
+        ],
+        [ map { [ $_, 'f', 5 ] } @expected[ 2 .. 4 ] ],
+        "JSON Lines output with the stat fields",
+    );
+
+    my $columnar = $run->("--format columnar --fields size");
+
+    my ( $magic, $fields, $num_records ) = unpack( "a8 V x4 V", $columnar );
+
+    # TEST
+    is_deeply(
+        [ $magic, $fields, $num_records ],
+        [ "FFCOLS01", 1, scalar(@expected) ],
+        "The header and the first batch of the columnar output",
+    );
+}
@@ -0,0 +1,152 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 6;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base       = "./t/sample-data/checkpoint-1";
+    my $checkpoint = "./t/sample-data/checkpoint-1.ckpt";
+
+    rmtree($base);
+    unlink($checkpoint);
+
+    foreach my $dir (qw(a/deep/er b c/d))
+    {
+        mkpath("$base/$dir");
+    }
+
+    foreach my $name (qw(a/f1 a/f2 a/deep/er/f3 a/f4 b/f5 c/d/f6 c/f7 g))
+    {
+        open my $fh, ">", "$base/$name"
+            or die "Cannot create $base/$name";
+        print {$fh} "$name\n";
+        close($fh);
+    }
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    # Walks in chunks of $num_items, each of them resuming the previous one.
+    my $run_in_chunks = sub {
+        my ( $opts, $num_items ) = @_;
+
+        unlink($checkpoint);
+
+        my @results = @{
+            $run->(
+                "$opts --checkpoint $checkpoint --stop-after $num_items $base")
+        };
+
+        while (1)
+        {
+            my $chunk = $run->( "$opts --checkpoint $checkpoint "
+                    . "--stop-after $num_items --resume $checkpoint $base" );
+
+            push @results, @$chunk;
+
+            last if ( @$chunk < $num_items );
+        }
+
+        return \@results;
+    };
+
+    # TEST
+    is_deeply(
+        $run_in_chunks->( "", 3 ),
+        $run->($base),
+        "Resuming from checkpoints continues the walk where it stopped",
+    );
+
+    # TEST
+    is_deeply(
+        $run_in_chunks->( "--depth-first", 2 ),
+        $run->("--depth-first $base"),
+        "Resuming a depth-first walk",
+    );
+
+    # TEST
+    is_deeply(
+        $run_in_chunks->( "--max-listing-bytes 10", 1 ),
+        $run->($base),
+        "Resuming a walk of spilled listings",
+    );
+
+    $run->("--checkpoint $checkpoint --stop-after 4 $base");
+
+    # The stored path is gone, so the walk continues with what follows it.
+    rmtree("$base/a/deep");
+    unlink("$base/a/f4");
+
+    # TEST
+    is_deeply(
+        $run->("--resume $checkpoint $base"),
+        [ map { "$base/$_" } qw(a/f1 a/f2 b b/f5 c c/d c/d/f6 c/f7 g) ],
+        "Resuming after the current item was removed",
+    );
+
+    # Returns what minifind printed to stderr, followed by the count of the
+    # lines of its stdout.
+    my $run_stderr = sub {
+        my $args = shift;
+
+        my $stderr = `./minifind $args 2>&1 >/dev/null`;
+        my $num_lines = () = `./minifind $args 2>/dev/null`;
+
+        return "$stderr$num_lines";
+    };
+
+    my %conflicts = (
+        "--unsorted"         => "--unsorted",
+        "--du"               => "--du",
+        "--hard-links flag"  => "--hard-links",
+        "--hard-links once"  => "--hard-links",
+        "--unique"           => "--unique",
+        "--best-first mtime" => "--best-first",
+        "--breadth-first"    => "--breadth-first",
+        "--archives"         => "--archives",
+        "--threads 2"        => "--threads",
+    );
+
+    unlink($checkpoint);
+
+    # TEST
+    is_deeply(
+        {
+            map {
+                $_ => $run_stderr->(
+                    "$_ --checkpoint $checkpoint $base $base/b")
+            } keys(%conflicts)
+        },
+        {
+            map { $_ => "--checkpoint cannot be used with $conflicts{$_}.\n0" }
+                keys(%conflicts)
+        },
+        "The options that cannot be checkpointed are named before the walk",
+    );
+
+    $run->("--checkpoint $checkpoint --stop-after 2 $base");
+
+    # TEST
+    is(
+        $run_stderr->("--unsorted --resume $checkpoint $base"),
+        "--resume cannot be used with --unsorted.\n0",
+        "The options that cannot be resumed are named",
+    );
+
+    unlink($checkpoint);
+}
@@ -0,0 +1,117 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 4;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base  = "./t/sample-data/shards-1";
+    my $costs = "./t/sample-data/shards-1.costs";
+
+    rmtree($base);
+
+    foreach my $top ( 1 .. 6 )
+    {
+        foreach my $sub ( 1 .. 3 )
+        {
+            my $dir = "$base/top$top/sub$sub";
+            mkpath($dir);
+
+            foreach my $file ( 1 .. $top )
+            {
+                open my $fh, ">", "$dir/f$file"
+                    or die "Cannot create $dir/f$file";
+                close($fh);
+            }
+        }
+    }
+
+    open my $top_fh, ">", "$base/top-file"
+        or die "Cannot create $base/top-file";
+    close($top_fh);
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    # Whether the shards split the walk, each of them in its order.
+    my $check_shards = sub {
+        my ( $opts, $num_shards ) = @_;
+
+        my @all = @{ $run->("$opts $base") };
+        my %pos;
+        @pos{@all} = ( 0 .. $#all );
+
+        my @merged;
+
+        foreach my $shard ( 0 .. $num_shards - 1 )
+        {
+            my @results = @{ $run->("$opts --shard $shard/$num_shards $base") };
+
+            foreach my $i ( 1 .. $#results )
+            {
+                return 0
+                    if ( ( $pos{ $results[$i] } // -1 )
+                    <= ( $pos{ $results[ $i - 1 ] } // -1 ) );
+            }
+
+            push @merged, @results;
+        }
+
+        @merged = sort { $pos{$a} <=> $pos{$b} } @merged;
+
+        return ( join( "\n", @merged ) eq join( "\n", @all ) );
+    };
+
+    # TEST
+    ok( $check_shards->( "", 3 ),
+        "Merging the shards gives the whole walk" );
+
+    # TEST
+    ok( $check_shards->( "--depth-first --shard-depth 2", 4 ),
+        "Merging the shards of a depth-first walk carved at depth 2" );
+
+    # The costs of a previous run: top6 alone weighs as much as the rest.
+    open my $costs_fh, ">", $costs
+        or die "Cannot create $costs";
+    foreach my $top ( 1 .. 5 )
+    {
+        print {$costs_fh} "$top\t$base/top$top\n";
+    }
+    print {$costs_fh} "15\t$base/top6\n";
+    print {$costs_fh} "35\t$base\n";
+    close($costs_fh);
+
+    my @firsts = map {
+        [
+            grep { m{\A\Q$base\E/top\d+\z} }
+                @{ $run->("--shard $_/2 --shard-costs $costs $base") }
+        ]
+    } ( 0 .. 1 );
+
+    # TEST
+    is_deeply(
+        \@firsts,
+        [ ["$base/top6"], [ map { "$base/top$_" } ( 1 .. 5 ) ] ],
+        "The shards are balanced by the costs",
+    );
+
+    # TEST
+    ok( $check_shards->( "--shard-costs $costs", 2 ),
+        "Merging the shards balanced by the costs" );
+
+    unlink($costs);
+}
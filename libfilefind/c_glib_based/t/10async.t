@@ -0,0 +1,61 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 3;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base = "./t/sample-data/async-1";
+
+    rmtree($base);
+
+    foreach my $dir (qw(a/deep/er b c/d))
+    {
+        mkpath("$base/$dir");
+    }
+
+    foreach my $name (qw(a/f1 a/f2 a/deep/er/f3 a/f4 b/f5 c/d/f6 c/f7 g))
+    {
+        open my $fh, ">", "$base/$name"
+            or die "Cannot create $base/$name";
+        close($fh);
+    }
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    # TEST
+    is_deeply(
+        $run->("--async $base"),
+        $run->($base),
+        "Walking in the background gives the same results",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--budget 1 --depth-first $base"),
+        $run->("--depth-first $base"),
+        "Walking in slices of a single entry gives the same results",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--async --stop-after 3 $base"),
+        [ map { "$base$_" } ( "", "/a", "/a/deep" ) ],
+        "Stopping a background walk in its middle",
+    );
+}
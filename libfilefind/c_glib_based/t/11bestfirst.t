@@ -0,0 +1,79 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 3;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base = "./t/sample-data/best-first-1";
+
+    rmtree($base);
+
+    foreach my $dir (qw(a/x/y b/z c))
+    {
+        mkpath("$base/$dir");
+    }
+
+    foreach my $name (qw(a/x/y/f1 b/z/f2 c/f3 top))
+    {
+        open my $fh, ">", "$base/$name"
+            or die "Cannot create $base/$name";
+        close($fh);
+    }
+
+    # Only the directories are ordered, so give them distinct times.
+    my %mtimes =
+    (
+        "a" => 1000, "a/x" => 500, "a/x/y" => 100,
+        "b" => 4000, "b/z" => 3000, "c" => 2000,
+    );
+
+    # Deepest first, so that the times of the parents are kept.
+    foreach my $dir (sort { length($b) <=> length($a) } keys(%mtimes))
+    {
+        utime($mtimes{$dir}, $mtimes{$dir}, "$base/$dir");
+    }
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    # TEST
+    is_deeply(
+        $run->("--best-first mtime --type d $base"),
+        [ map { "$base$_" } ( "", "/a", "/b", "/c", "/b/z", "/a/x",
+            "/a/x/y" )
+        ],
+        "The most recently modified directories are listed first",
+    );
+
+    # TEST
+    is_deeply(
+        [ sort @{$run->("--best-first size $base")} ],
+        [ sort @{$run->($base)} ],
+        "A best-first walk finds the same files",
+    );
+
+    symlink("../..", "$base/b/z/loop")
+        or die "Cannot symlink";
+
+    # TEST
+    is_deeply(
+        [ sort @{$run->("--best-first mtime --follow $base")} ],
+        [ sort @{$run->("--follow $base")} ],
+        "A best-first walk that follows links stops at loops",
+    );
+}
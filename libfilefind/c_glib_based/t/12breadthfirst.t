@@ -0,0 +1,83 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 4;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base = "./t/sample-data/breadth-first-1";
+
+    rmtree($base);
+
+    foreach my $dir (qw(a/x/y b/z c))
+    {
+        mkpath("$base/$dir");
+    }
+
+    foreach my $name (qw(a/x/y/f1 b/z/f2 c/f3 top))
+    {
+        open my $fh, ">", "$base/$name"
+            or die "Cannot create $base/$name";
+        close($fh);
+    }
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    my @expected =
+    (
+        map { "$base$_" }
+        ( "", "/a", "/b", "/c", "/top",
+            "/a/x", "/b/z", "/c/f3",
+            "/a/x/y", "/b/z/f2",
+            "/a/x/y/f1",
+        )
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--breadth-first $base"),
+        \@expected,
+        "The items are returned level by level",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--breadth-first --max-frontier-bytes 1 $base"),
+        \@expected,
+        "Spilling the queued directories keeps the order",
+    );
+
+    symlink("../..", "$base/b/z/loop")
+        or die "Cannot symlink";
+
+    # TEST
+    is_deeply(
+        [ sort @{$run->("--breadth-first --follow $base")} ],
+        [ sort @{$run->("--follow $base")} ],
+        "A breadth-first walk that follows links stops at loops",
+    );
+
+    # TEST
+    is_deeply(
+        [ sort @{$run->(
+            "--breadth-first --max-frontier-bytes 1 --follow $base"
+        )} ],
+        [ sort @{$run->("--follow $base")} ],
+        "Spilled directories still stop at loops",
+    );
+}
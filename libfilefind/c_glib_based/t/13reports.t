@@ -0,0 +1,85 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 4;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base = "./t/sample-data/reports-1";
+
+    rmtree($base);
+
+    foreach my $dir (qw(a b))
+    {
+        mkpath("$base/$dir");
+    }
+
+    my %sizes =
+    (
+        "a/x.txt" => 10, "a/y.txt" => 30, "b/z.log" => 20, "b/w.log" => 40,
+        "top.txt" => 5, ".hidden" => 1,
+    );
+
+    while (my ($name, $size) = each(%sizes))
+    {
+        open my $fh, ">", "$base/$name"
+            or die "Cannot create $base/$name";
+        print {$fh} ("x" x $size);
+        close($fh);
+    }
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    # TEST
+    is_deeply(
+        $run->("--type f --top 2 size $base"),
+        [ "40\t$base/b/w.log", "30\t$base/a/y.txt" ],
+        "The largest files",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--type f --bottom 2 size $base"),
+        [ "1\t$base/.hidden", "5\t$base/top.txt" ],
+        "The smallest files",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--type f --quantiles size ext $base"),
+        [
+            "group\tcount\tmin\tp50\tp90\tp99\tmax",
+            "-\t1\t1\t1\t1\t1\t1",
+            "log\t2\t20\t20\t40\t40\t40",
+            "txt\t3\t5\t10\t30\t30\t30",
+        ],
+        "The quantiles of the sizes by extension",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--type f --quantiles size top $base"),
+        [
+            "group\tcount\tmin\tp50\tp90\tp99\tmax",
+            "-\t2\t1\t1\t5\t5\t5",
+            "a\t2\t10\t10\t30\t30\t30",
+            "b\t2\t20\t20\t40\t40\t40",
+        ],
+        "The quantiles of the sizes by top directory",
+    );
+}
@@ -0,0 +1,75 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 3;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base = "./t/sample-data/estimate-1";
+
+    rmtree($base);
+
+    # Every directory looks the same, so every probe finds the same.
+    foreach my $top (qw(a b c d))
+    {
+        foreach my $sub (qw(x y z))
+        {
+            mkpath("$base/$top/$sub");
+
+            foreach my $name (qw(f1 f2))
+            {
+                open my $fh, ">", "$base/$top/$sub/$name"
+                    or die "Cannot create $base/$top/$sub/$name";
+                print {$fh} "1234";
+                close($fh);
+            }
+        }
+    }
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args 2>/dev/null |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    my $expected =
+    [
+        "$base\titems\t40\t40\t40",
+        "$base\tfiles\t24\t24\t24",
+        "$base\tbytes\t96\t96\t96",
+    ];
+
+    # TEST
+    is_deeply(
+        $run->("--estimate 1000 $base"),
+        $expected,
+        "A budget that covers the whole tree counts it exactly",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--estimate 4 $base"),
+        $expected,
+        "Probing a part of a uniform tree",
+    );
+
+    mkpath("$base/b/y/deeper/still");
+
+    # TEST
+    is_deeply(
+        $run->("--estimate 10 --seed 5 $base"),
+        $run->("--estimate 10 --seed 5 $base"),
+        "The same seed gives the same estimate",
+    );
+}
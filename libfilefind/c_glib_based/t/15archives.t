@@ -0,0 +1,190 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 6;
+
+use File::Path qw( mkpath rmtree );
+use Archive::Tar ();
+use IO::Compress::Zip qw( $ZipError );
+
+{
+    my $base = "./t/sample-data/archives-1";
+
+    rmtree($base);
+    mkpath("$base/dir");
+
+    # Without entries for the directories, which are returned anyway.
+    {
+        my $tar = Archive::Tar->new;
+
+        $tar->add_data("a.txt", "the needle\n");
+        $tar->add_data("sub/deep/b.txt", ("x" x 5000) . "needle");
+        $tar->add_data("sub/c.txt", "nothing\n");
+
+        $tar->write("$base/dir/files.tar") or die "Cannot write the tar";
+        $tar->write("$base/dir/files.tgz", Archive::Tar::COMPRESS_GZIP())
+            or die "Cannot write the tar.gz";
+    }
+
+    {
+        my $zip = IO::Compress::Zip->new("$base/files.zip", Name => "z/one.txt")
+            or die "Cannot write the zip: $ZipError";
+
+        $zip->print("zipped needle\n");
+        $zip->newStream(Name => "z/two.txt");
+        $zip->print("nothing\n");
+        $zip->close;
+    }
+
+    # A tar of a pax header with the given records, and then of a file.
+    my $pax_tar = sub {
+        my ( $fn, $records ) = @_;
+
+        my $header = sub {
+            my ( $name, $typeflag, $size ) = @_;
+
+            my $block = pack( "a100 a8 a8 a8 a12 a12 A8 a1 a100 a6 a2",
+                $name, "0000644", "0000000", "0000000",
+                sprintf( "%011o", $size ), "00000000000", "",
+                $typeflag, "", "ustar", "00" );
+            $block .= "\0" x ( 512 - length($block) );
+
+            my $sum = unpack( "%32C*", $block );
+            substr( $block, 148, 8, sprintf( "%06o\0 ", $sum ) );
+
+            return $block;
+        };
+        my $pad = sub {
+            my $data = shift;
+
+            return $data . ( "\0" x ( ( 512 - length($data) % 512 ) % 512 ) );
+        };
+
+        open my $tar_fh, ">", $fn or die "Cannot create $fn";
+        binmode($tar_fh);
+        print {$tar_fh} $header->( "PaxHeader", "x", length($records) ),
+            $pad->($records), $header->( "file.txt", "0", 6 ),
+            $pad->("hello\n"), ( "\0" x 1024 );
+        close($tar_fh);
+    };
+
+    mkpath("$base/pax");
+    $pax_tar->( "$base/pax/good.tar", "20 path=renamed.txt\n" );
+    $pax_tar->( "$base/pax/empty-record.tar", "6 a=b\n0 " );
+    $pax_tar->( "$base/pax/empty-first-record.tar", "0 " );
+    $pax_tar->( "$base/pax/short-record.tar", "3 \n" );
+
+    open my $fh, ">", "$base/broken.zip"
+        or die "Cannot create $base/broken.zip";
+    print {$fh} "Not a zip.\n";
+    close($fh);
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    my @members = ("a.txt", "sub", "sub/deep", "sub/deep/b.txt", "sub/c.txt");
+
+    # TEST
+    is_deeply(
+        $run->("--archives $base"),
+        [
+            $base,
+            "$base/broken.zip",
+            "$base/dir",
+            "$base/dir/files.tar",
+            (map { "$base/dir/files.tar/$_" } @members),
+            "$base/dir/files.tgz",
+            (map { "$base/dir/files.tgz/$_" } @members),
+            "$base/files.zip",
+            "$base/files.zip/z",
+            "$base/files.zip/z/one.txt",
+            "$base/files.zip/z/two.txt",
+            "$base/pax",
+            "$base/pax/empty-first-record.tar",
+            "$base/pax/empty-record.tar",
+            "$base/pax/good.tar",
+            "$base/pax/good.tar/renamed.txt",
+            "$base/pax/short-record.tar",
+        ],
+        "The members of the archives follow them",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("$base"),
+        [
+            $base,
+            "$base/broken.zip",
+            "$base/dir",
+            "$base/dir/files.tar",
+            "$base/dir/files.tgz",
+            "$base/files.zip",
+            "$base/pax",
+            "$base/pax/empty-first-record.tar",
+            "$base/pax/empty-record.tar",
+            "$base/pax/good.tar",
+            "$base/pax/short-record.tar",
+        ],
+        "The archives are not entered by default",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--archives $base/pax/good.tar"),
+        [ "$base/pax/good.tar", "$base/pax/good.tar/renamed.txt", ],
+        "The path of a pax header replaces the name of the next member",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--archives $base/pax"),
+        [
+            "$base/pax",
+            "$base/pax/empty-first-record.tar",
+            "$base/pax/empty-record.tar",
+            "$base/pax/good.tar",
+            "$base/pax/good.tar/renamed.txt",
+            "$base/pax/short-record.tar",
+        ],
+        "Pax records that are shorter than their own length are rejected",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--archives --type f --grep needle $base/dir/files.tgz $base/files.zip"),
+        [
+            "$base/dir/files.tgz/a.txt",
+            "$base/dir/files.tgz/sub/deep/b.txt",
+            "$base/files.zip/z/one.txt",
+        ],
+        "The contents of the members are read",
+    );
+
+    my $emitted = $run->("--archives --format jsonl --fields size $base/dir/files.tar");
+
+    # TEST
+    is_deeply(
+        [ @{$emitted}[1 .. $#$emitted] ],
+        [
+            qq#{"path":"$base/dir/files.tar/a.txt","type":"f","size":11}#,
+            qq#{"path":"$base/dir/files.tar/sub","type":"d","size":0}#,
+            qq#{"path":"$base/dir/files.tar/sub/deep","type":"d","size":0}#,
+            qq#{"path":"$base/dir/files.tar/sub/deep/b.txt","type":"f","size":5006}#,
+            qq#{"path":"$base/dir/files.tar/sub/c.txt","type":"f","size":8}#,
+        ],
+        "The sizes of the members are those in their headers",
+    );
+}
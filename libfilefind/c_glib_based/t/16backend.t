@@ -0,0 +1,84 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 4;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    # TEST
+    is_deeply(
+        $run->("--memory-tree 2,1,2 /"),
+        [
+            "/",
+            "/d0",
+            "/d0/d0",
+            "/d0/d0/f0",
+            "/d0/d1",
+            "/d0/d1/f0",
+            "/d0/f0",
+            "/d1",
+            "/d1/d0",
+            "/d1/d0/f0",
+            "/d1/d1",
+            "/d1/d1/f0",
+            "/d1/f0",
+            "/f0",
+        ],
+        "The synthetic tree is walked in memory",
+    );
+
+    # 1 + 3 + 9 + 27 directories, with 2 files each.
+    # TEST
+    is_deeply(
+        $run->("--memory-tree 3,2,3 --count --unsorted --depth-first /"),
+        [ 120 ],
+        "All the nodes of the synthetic tree are found",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--memory-tree 3,2,3 --format jsonl --fields size,mtime d2/d1/d0"),
+        $run->("--memory-tree 3,2,3 --format jsonl --fields size,mtime --threads 2 d2/d1/d0"),
+        "The synthetic tree is the same every time",
+    );
+
+    my $base = "./t/sample-data/backend-1";
+
+    rmtree($base);
+    mkpath("$base/a/b");
+    mkpath("$base/c");
+
+    foreach my $name ("a/one.txt", "a/b/two.txt", "c/three.txt", "four.txt")
+    {
+        open my $fh, ">", "$base/$name"
+            or die "Cannot create $base/$name";
+        print {$fh} "$name\n";
+        close($fh);
+    }
+
+    symlink("a", "$base/link-to-a");
+
+    # TEST
+    is_deeply(
+        $run->("--backend getdents --follow --format jsonl --fields size $base"),
+        $run->("--follow --format jsonl --fields size $base"),
+        "getdents64() lists the same as readdir()",
+    );
+}
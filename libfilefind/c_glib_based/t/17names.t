@@ -0,0 +1,89 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 4;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base = "./t/sample-data/names-1";
+
+    rmtree($base);
+    mkpath("$base/src/.git");
+    mkpath("$base/doc");
+
+    foreach my $name (
+        "src/main.c", "src/main.h", "src/main.o", "src/.hidden.c",
+        "src/.git/config", "src/Makefile", "src/a.out", "src/x~",
+        "doc/guide.txt", "doc/guide.html", "doc/README", "doc/notes3",
+        "doc/notes12",
+        )
+    {
+        open my $fh, ">", "$base/$name"
+            or die "Cannot create $base/$name";
+        print {$fh} "$name\n";
+        close($fh);
+    }
+
+    my $run = sub {
+        my $args = shift;
+
+        open my $lff_fh, "./minifind $args |"
+            or die "Cannot execute minifind";
+
+        my @results = <$lff_fh>;
+        chomp(@results);
+
+        close($lff_fh);
+
+        return \@results;
+    };
+
+    my $many = join(" ", map { sprintf("--name '*.e%03d'", $_) } 1 .. 200);
+
+    # TEST
+    is_deeply(
+        $run->("$many --name '*.c' --name '*.h' --name '*~' $base"),
+        [
+            "$base/src/main.c",
+            "$base/src/main.h",
+            "$base/src/x~",
+        ],
+        "Many suffixes are matched, but not by names that start with a dot",
+    );
+
+    # TEST
+    is_deeply(
+        $run->(
+            "--name Makefile --name README --name '.*' --name '*.{htm,html}'"
+            . " --name 'notes[0-9]' --name 'a.???' $base"
+        ),
+        [
+            "$base/doc/README",
+            "$base/doc/guide.html",
+            "$base/doc/notes3",
+            "$base/src/.git",
+            "$base/src/.hidden.c",
+            "$base/src/Makefile",
+            "$base/src/a.out",
+        ],
+        "Names, braces, classes and wildcards are matched together",
+    );
+
+    # TEST
+    is_deeply(
+        $run->("--name '*.{c,h' $base 2>/dev/null"),
+        [],
+        "A malformed glob is rejected",
+    );
+
+    # 3 + 9 directories named "d0" to "d2".
+    # TEST
+    is_deeply(
+        $run->("--memory-tree 3,2,2 --name 'd?' --count /"),
+        [ 12 ],
+        "The names in a memory tree are matched",
+    );
+}
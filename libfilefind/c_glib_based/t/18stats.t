@@ -0,0 +1,59 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Test::More tests => 4;
+
+use File::Path qw( mkpath rmtree );
+
+{
+    my $base = "./t/sample-data/stats-1";
+
+    rmtree($base);
+    mkpath("$base/a/b/c");
+    mkpath("$base/d");
+
+    foreach my $name ( "f", "a/g", "a/b/c/h", "d/i" )
+    {
+        open my $fh, ">", "$base/$name"
+            or die "Cannot create $base/$name";
+        print {$fh} "$name\n";
+        close($fh);
+    }
+
+    my $stats_fn = "./t/sample-data/stats-1.txt";
+
+    # Returns the counters that minifind --stats printed, by their names.
+    my $stats = sub {
+        my $args = shift;
+
+        system("./minifind --stats $args $base > /dev/null 2> $stats_fn")
+            and die "Cannot execute minifind";
+
+        open my $fh, "<", $stats_fn or die "Cannot open $stats_fn";
+        my %ret = ( map { /^(\w+)\s+(\d+)/ ? ( $1 => $2 ) : () } <$fh> );
+        close($fh);
+
+        return \%ret;
+    };
+
+    foreach my $mode ( "", "--depth-first", "--breadth-first" )
+    {
+        my $got = $stats->($mode);
+
+        # TEST*3
+        is_deeply(
+            [ @{$got}{qw(opendir max_depth)} ],
+            [ 5, 4 ],
+            "Every directory is opened once, and a/b/c/h is 4 deep ($mode)",
+        );
+    }
+
+    # TEST
+    cmp_ok( $stats->("")->{peak_dir_stack},
+        ">=", 1, "The stack of directories is counted" );
+
+    unlink($stats_fn);
+    rmtree($base);
+}